@@ -0,0 +1,13 @@
+#include <zlib.h>
+
+int main(int,char**)
+{
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return 1;
+    deflateEnd(&stream);
+    return 0;
+}
@@ -0,0 +1,8 @@
+CONFIG -= app_bundle
+TEMPLATE = app
+TARGET = zlib
+DEPENDPATH += .
+INCLUDEPATH += .
+SOURCES += main.cpp
+LIBS += -lz
+QT = core
@@ -8,6 +8,7 @@ HEADERS  += qxtabstractsignalserializer.h
 HEADERS  += qxtalgorithms.h
 HEADERS  += qxtbasicfileloggerengine.h
 HEADERS  += qxtbasicstdloggerengine.h
+HEADERS  += qxtbinarysignalserializer.h
 HEADERS  += qxtboundcfunction.h
 HEADERS  += qxtboundfunction.h
 HEADERS  += qxtboundfunctionbase.h
@@ -22,8 +23,10 @@ HEADERS  += qxtdeplex_p.h
 HEADERS  += qxterror.h
 HEADERS  += qxtfifo.h
 HEADERS  += qxtglobal.h
+HEADERS  += qxtgzip_p.h
 HEADERS  += qxthmac.h
 HEADERS  += qxtjson.h
+HEADERS  += qxtjsonreader.h
 HEADERS  += qxtjob.h
 HEADERS  += qxtjob_p.h
 HEADERS  += qxtlinesocket.h
@@ -70,6 +73,7 @@ SOURCES  += qxtabstractfileloggerengine.cpp
 SOURCES  += qxtabstractiologgerengine.cpp
 SOURCES  += qxtbasicfileloggerengine.cpp
 SOURCES  += qxtbasicstdloggerengine.cpp
+SOURCES  += qxtbinarysignalserializer.cpp
 SOURCES  += qxtcommandoptions.cpp
 SOURCES  += qxtcsvmodel.cpp
 SOURCES  += qxtcurrency.cpp
@@ -79,9 +83,11 @@ SOURCES  += qxtdeplex.cpp
 SOURCES  += qxterror.cpp
 SOURCES  += qxtfifo.cpp
 SOURCES  += qxtglobal.cpp
+SOURCES  += qxtgzip.cpp
 SOURCES  += qxthmac.cpp
 SOURCES  += qxtlocale.cpp
 SOURCES  += qxtjson.cpp
+SOURCES  += qxtjsonreader.cpp
 SOURCES  += qxtjob.cpp
 SOURCES  += qxtlinesocket.cpp
 SOURCES  += qxtlinkedtree.cpp
@@ -4,5 +4,9 @@ QT               = core
 QXT              =
 CONVENIENCE     += $$CLEAN_TARGET
 
+contains(DEFINES,QXT_HAVE_ZLIB) {
+  LIBS += -lz
+}
+
 include(core.pri)
 include(../qxtbase.pri)
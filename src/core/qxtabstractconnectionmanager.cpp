@@ -31,6 +31,7 @@
 
 #include "qxtabstractconnectionmanager.h"
 #include <QHash>
+#include <QReadWriteLock>
 #include <QtDebug>
 
 /*!
@@ -51,12 +52,18 @@
  * of an established connection before disconnecting. Finally, a subclass must invoke
  * addConnection() after a new incoming connection has been established and prepared.
  *
+ * The client table is protected by a lock, so clientCount(), clients(), client(),
+ * disconnect() and addConnection() may be called from any thread. This allows
+ * implementations to serve their connections from several I/O threads.
+ *
  * \sa QxtTcpConnectionManager
  */
 
 class QxtAbstractConnectionManagerPrivate : public QxtPrivate<QxtAbstractConnectionManager>
 {
 public:
+    // Connections may be added and removed from the threads that serve them.
+    mutable QReadWriteLock lock;
     QHash<quint64, QIODevice*> clients;
 
     QXT_DECLARE_PUBLIC(QxtAbstractConnectionManager)
@@ -83,6 +90,7 @@ QxtAbstractConnectionManager::~QxtAbstractConnectionManager()
  */
 int QxtAbstractConnectionManager::clientCount() const
 {
+    QReadLocker locker(&qxt_d().lock);
     return qxt_d().clients.count();
 }
 
@@ -91,6 +99,7 @@ int QxtAbstractConnectionManager::clientCount() const
  */
 QList<quint64> QxtAbstractConnectionManager::clients() const
 {
+    QReadLocker locker(&qxt_d().lock);
     return qxt_d().clients.keys();
 }
 
@@ -99,6 +108,7 @@ QList<quint64> QxtAbstractConnectionManager::clients() const
  */
 QIODevice* QxtAbstractConnectionManager::client(quint64 clientID) const
 {
+    QReadLocker locker(&qxt_d().lock);
     return qxt_d().clients.value(clientID, NULL);
 }
 
@@ -112,13 +122,15 @@ QIODevice* QxtAbstractConnectionManager::client(quint64 clientID) const
  */
 void QxtAbstractConnectionManager::disconnect(quint64 clientID)
 {
-    QIODevice* device = qxt_d().clients.value(clientID, 0);
+    // Take the device under the lock so that only one caller gets to disconnect it.
+    qxt_d().lock.lockForWrite();
+    QIODevice* device = qxt_d().clients.take(clientID);
+    qxt_d().lock.unlock();
     if (!device)
     {
         qWarning() << "QxtAbstractConnectionManager::disconnect: client ID not in use";
         return;
     }
-    qxt_d().clients.remove(clientID);
     emit disconnected(device, clientID);
     removeConnection(device, clientID);
 }
@@ -134,6 +146,8 @@ void QxtAbstractConnectionManager::disconnect(quint64 clientID)
  */
 void QxtAbstractConnectionManager::addConnection(QIODevice* device, quint64 clientID)
 {
+    qxt_d().lock.lockForWrite();
     qxt_d().clients[clientID] = device;
+    qxt_d().lock.unlock();
     emit newConnection(device, clientID);
 }
@@ -88,6 +88,50 @@ public:
      */
     virtual bool canDeserialize(const QByteArray& buffer) const = 0;
 
+    /*!
+     * Deserializes one signal from \a data starting at the byte position pointed to by \a offset and advances
+     * \a offset past the processed portion. The buffer itself is left untouched, so a caller draining many queued
+     * messages does not have to shift the remaining data after each of them.
+     *
+     * The default implementation wraps the unread portion of the buffer without copying it and calls
+     * deserialize(QByteArray&). Reimplement it to read the message directly from the buffer.
+     */
+    virtual DeserializedData deserialize(const QByteArray& data, int* offset)
+    {
+        QByteArray view = QByteArray::fromRawData(data.constData() + *offset, data.size() - *offset);
+        int available = view.size();
+        DeserializedData rv = deserialize(view);
+        *offset += available - view.size();
+        return rv;
+    }
+
+    /*!
+     * Indicates whether the data in \a buffer starting at \a offset can be deserialized.
+     *
+     * The default implementation wraps the unread portion of the buffer without copying it and calls
+     * canDeserialize(const QByteArray&).
+     */
+    virtual bool canDeserialize(const QByteArray& buffer, int offset) const
+    {
+        if(offset == 0)
+            return canDeserialize(buffer);
+        return canDeserialize(QByteArray::fromRawData(buffer.constData() + offset, buffer.size() - offset));
+    }
+
+    /*!
+     * Returns a new serializer configured like this one, or 0 if the serializer keeps no state between messages.
+     *
+     * Serializers that remember what has already been sent, such as QxtBinarySignalSerializer, must see every
+     * message of exactly one connection. QxtRPCService calls clone() for each connection and uses the returned
+     * instance for that connection only; when clone() returns 0, one instance is shared by all connections.
+     *
+     * The default implementation returns 0.
+     */
+    virtual QxtAbstractSignalSerializer* clone() const
+    {
+        return 0;
+    }
+
     /*!
      * Returns an object that indicates that the deserialized data does not invoke a signal.
      */
@@ -28,9 +28,12 @@
 **
 ** <http://libqxt.org>  <foundation@libqxt.org>
 *****************************************************************************/
-
 #include "qxtbasicfileloggerengine.h"
+#include "qxtgzip_p.h"
 #include <QDateTime>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QRunnable>
 
 /*!
     \class QxtBasicFileLoggerEngine
@@ -44,16 +47,102 @@
                            Hi there!
     \endcode
 
+    Every entry is formatted into one buffer and written with a single call.
+    By default each entry is written as soon as it is logged. Setting a
+    bufferSize() groups entries into larger writes: the buffer is written when
+    it is full, when its oldest entry is older than flushInterval(), and
+    whenever QxtLogger has no more messages queued.
+
+    The engine can rotate its file once it reaches maximumFileSize() or has
+    been open for rotationInterval() seconds. The current file is renamed by
+    appending the time of the rotation to its name, for example
+    \c{app.log.20110425-134501}, and a new file is started. Rotated files can
+    be gzip compressed in the background when Qxt was built with zlib.
+
     \sa QxtLogger
  */
 
+/*
+ * Compresses a rotated log file to <name>.gz on a pool thread and removes the
+ * original. The file is streamed through zlib, so a large segment is never
+ * held in memory.
+ */
+class QxtLogCompressor : public QRunnable
+{
+public:
+    QxtLogCompressor(const QString& fileName) : fileName(fileName) {}
+
+    void run()
+    {
+        QFile in(fileName);
+        if (!in.open(QIODevice::ReadOnly)) return;
+        QFile out(fileName + ".gz");
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) return;
+        if (!qxtGzip(&in, &out) || !out.flush())
+        {
+            out.remove();
+            return;
+        }
+        out.close();
+        in.remove();
+    }
+
+private:
+    QString fileName;
+};
+
 class QxtBasicFileLoggerEnginePrivate : public QxtPrivate<QxtBasicFileLoggerEngine>
 {
 public:
     QXT_DECLARE_PUBLIC(QxtBasicFileLoggerEngine)
+    QxtBasicFileLoggerEnginePrivate();
+
     QString dateFormat;
+
+    // the formatted time is reused for every entry logged within the same millisecond
+    qint64 stampTime;
+    QByteArray stamp;
+    int stampLength;
+    QByteArray padding;
+
+    QByteArray buffer;              // entries not written yet
+    qint64 bufferedSince;
+    int bufferSize;
+    int flushInterval;
+
+    qint64 fileSize;
+    qint64 openedAt;
+    qint64 maximumFileSize;
+    int rotationInterval;
+    bool compress;
+
+    void opened();
+    void flush();
 };
 
+QxtBasicFileLoggerEnginePrivate::QxtBasicFileLoggerEnginePrivate()
+        : stampTime(-1), stampLength(0), bufferedSince(0), bufferSize(0), flushInterval(1000),
+          fileSize(0), openedAt(0), maximumFileSize(0), rotationInterval(0), compress(false)
+{
+    // a reserved buffer keeps its capacity when it is emptied
+    buffer.reserve(4096);
+}
+
+void QxtBasicFileLoggerEnginePrivate::opened()
+{
+    QIODevice* file = qxt_p().device();
+    fileSize = file ? file->size() : 0;
+    openedAt = QDateTime::currentMSecsSinceEpoch();
+}
+
+void QxtBasicFileLoggerEnginePrivate::flush()
+{
+    if (buffer.isEmpty()) return;
+    QIODevice* file = qxt_p().device();
+    if (file) file->write(buffer);
+    buffer.resize(0);
+}
+
 /*!
     Constructs a basic file logger engine with \a fileName.
 */
@@ -62,10 +151,20 @@ QxtBasicFileLoggerEngine::QxtBasicFileLoggerEngine(const QString &fileName)
 {
     QXT_INIT_PRIVATE(QxtBasicFileLoggerEngine);
     qxt_d().dateFormat = "hh:mm:ss.zzz";
+    qxt_d().opened();
+}
+
+/*!
+    Destructs the basic file logger engine, writing any buffered entries.
+ */
+QxtBasicFileLoggerEngine::~QxtBasicFileLoggerEngine()
+{
+    qxt_d().flush();
 }
 
 /*!
     Returns the date format in use by this logger engine.
+
     \sa QDateTime::toString()
  */
 QString QxtBasicFileLoggerEngine::dateFormat() const
@@ -75,11 +174,163 @@ QString QxtBasicFileLoggerEngine::dateFormat() const
 
 /*!
     Sets the date \a format used by this logger engine.
+
     \sa QDateTime::toString()
  */
 void QxtBasicFileLoggerEngine::setDateFormat(const QString& format)
 {
     qxt_d().dateFormat = format;
+    qxt_d().stampTime = -1;
+}
+
+/*!
+    Returns the number of bytes of entries collected before they are written.
+    The default is 0, which writes every entry as soon as it is logged.
+
+    \sa setBufferSize(), flushInterval()
+ */
+int QxtBasicFileLoggerEngine::bufferSize() const
+{
+    return qxt_d().bufferSize;
+}
+
+/*!
+    Sets the number of bytes of entries collected before they are written to
+    \a bytes. Buffered entries are also written after flushInterval(), when
+    QxtLogger goes idle and when the engine is killed.
+ */
+void QxtBasicFileLoggerEngine::setBufferSize(int bytes)
+{
+    qxt_d().flush();
+    qxt_d().bufferSize = qMax(0, bytes);
+    if (bytes > qxt_d().buffer.capacity())
+        qxt_d().buffer.reserve(bytes + 4096);
+}
+
+/*!
+    Returns the longest time in milliseconds an entry is kept in the buffer
+    while further entries are logged. The default is 1000 milliseconds.
+
+    \sa setFlushInterval(), bufferSize()
+ */
+int QxtBasicFileLoggerEngine::flushInterval() const
+{
+    return qxt_d().flushInterval;
+}
+
+/*!
+    Sets the longest time an entry is kept in the buffer to \a msecs.
+ */
+void QxtBasicFileLoggerEngine::setFlushInterval(int msecs)
+{
+    qxt_d().flushInterval = qMax(0, msecs);
+}
+
+/*!
+    Returns the size in bytes at which the log file is rotated, or 0 if it
+    is never rotated because of its size. The default is 0.
+
+    \sa setMaximumFileSize(), rotationInterval()
+ */
+qint64 QxtBasicFileLoggerEngine::maximumFileSize() const
+{
+    return qxt_d().maximumFileSize;
+}
+
+/*!
+    Sets the size at which the log file is rotated to \a bytes.
+ */
+void QxtBasicFileLoggerEngine::setMaximumFileSize(qint64 bytes)
+{
+    qxt_d().maximumFileSize = qMax(Q_INT64_C(0), bytes);
+}
+
+/*!
+    Returns the number of seconds after which the log file is rotated, or 0
+    if it is never rotated because of its age. The default is 0.
+
+    \sa setRotationInterval(), maximumFileSize()
+ */
+int QxtBasicFileLoggerEngine::rotationInterval() const
+{
+    return qxt_d().rotationInterval;
+}
+
+/*!
+    Sets the number of seconds after which the log file is rotated to \a seconds.
+ */
+void QxtBasicFileLoggerEngine::setRotationInterval(int seconds)
+{
+    qxt_d().rotationInterval = qMax(0, seconds);
+}
+
+/*!
+    Returns \c true if rotated files are gzip compressed. The default is \c false.
+
+    \sa setCompressRotatedFiles()
+ */
+bool QxtBasicFileLoggerEngine::compressRotatedFiles() const
+{
+    return qxt_d().compress;
+}
+
+/*!
+    Sets whether rotated files are compressed to \a enable. Compression runs
+    on QThreadPool::globalInstance() and replaces the rotated file by a file
+    of the same name with a \c .gz suffix. Without zlib, rotated files are
+    kept uncompressed.
+ */
+void QxtBasicFileLoggerEngine::setCompressRotatedFiles(bool enable)
+{
+    qxt_d().compress = enable;
+}
+
+/*!
+    \reimp
+ */
+void QxtBasicFileLoggerEngine::initLoggerEngine()
+{
+    QxtAbstractFileLoggerEngine::initLoggerEngine();
+    qxt_d().opened();
+}
+
+/*!
+    \reimp
+ */
+void QxtBasicFileLoggerEngine::killLoggerEngine()
+{
+    qxt_d().flush();
+    QxtAbstractFileLoggerEngine::killLoggerEngine();
+}
+
+/*!
+    \reimp
+ */
+void QxtBasicFileLoggerEngine::flushLoggerEngine()
+{
+    qxt_d().flush();
+}
+
+/*!
+    Closes the log file, renames it by appending the current time to its name
+    and starts a new file. This function is called when the file reaches
+    maximumFileSize() or rotationInterval().
+ */
+void QxtBasicFileLoggerEngine::rotate()
+{
+    QString name = logFileName();
+    if (name.isEmpty()) return;
+    killLoggerEngine();
+
+    QString base = name + '.' + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss");
+    QString target = base;
+    for (int i = 1; QFile::exists(target) || QFile::exists(target + ".gz"); i++)
+        target = base + '-' + QString::number(i);
+    bool renamed = QFile::rename(name, target);
+
+    initLoggerEngine();
+    if (renamed && qxt_d().compress && qxtGzipAvailable())
+        QThreadPool::globalInstance()->start(new QxtLogCompressor(target));
 }
 
 /*!
@@ -88,21 +339,49 @@ void QxtBasicFileLoggerEngine::setDateFormat(const QString& format)
 void QxtBasicFileLoggerEngine::writeToFile(const QString &level, const QVariantList &messages)
 {
     if (messages.isEmpty()) return;
-    QString header = '[' + QDateTime::currentDateTime().toString(qxt_d().dateFormat) + "] [" + level + "] ";
-    QString padding;
-    QIODevice* file = device();
-    Q_ASSERT(file);
-    file->write(header.toUtf8());
-    for (int i = 0; i < header.size(); i++) padding.append(" ");
+    QxtBasicFileLoggerEnginePrivate& d = qxt_d();
+    Q_ASSERT(device());
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if ((d.maximumFileSize > 0 && d.fileSize >= d.maximumFileSize)
+            || (d.rotationInterval > 0 && now - d.openedAt >= qint64(d.rotationInterval) * 1000))
+    {
+        rotate();
+        if (!device()) return;
+    }
+
+    if (now != d.stampTime)
+    {
+        QString stamp = QDateTime::fromMSecsSinceEpoch(now).toString(d.dateFormat);
+        d.stamp = stamp.toUtf8();
+        d.stampLength = stamp.size();
+        d.stampTime = now;
+    }
+
+    int start = d.buffer.size();
+    if (start == 0) d.bufferedSince = now;
+    d.buffer.append('[');
+    d.buffer.append(d.stamp);
+    d.buffer.append("] [");
+    d.buffer.append(level.toUtf8());
+    d.buffer.append("] ");
+
+    // continuation lines are indented by the width of the header
+    int width = d.stampLength + level.size() + 6;
+    if (d.padding.size() < width) d.padding.fill(' ', width);
     int count = 0;
     Q_FOREACH(const QVariant& out, messages)
     {
         if (!out.isNull())
         {
-            if (count != 0) file->write(padding.toUtf8());
-            file->write(out.toString().toUtf8());
-            file->write("\n");
+            if (count != 0) d.buffer.append(d.padding.constData(), width);
+            d.buffer.append(out.toString().toUtf8());
+            d.buffer.append('\n');
         }
         count++;
     }
+    d.fileSize += d.buffer.size() - start;
+
+    if (d.bufferSize == 0 || d.buffer.size() >= d.bufferSize || now - d.bufferedSince >= d.flushInterval)
+        d.flush();
 }
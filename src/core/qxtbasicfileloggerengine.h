@@ -47,13 +47,31 @@ class QXT_CORE_EXPORT QxtBasicFileLoggerEngine : public QxtAbstractFileLoggerEng
 {
 public:
     QxtBasicFileLoggerEngine(const QString &fileName = QString());
+    ~QxtBasicFileLoggerEngine();
 
 public:
     QString dateFormat() const;
     void setDateFormat(const QString& format);
 
+    int bufferSize() const;
+    void setBufferSize(int bytes);
+    int flushInterval() const;
+    void setFlushInterval(int msecs);
+
+    qint64 maximumFileSize() const;
+    void setMaximumFileSize(qint64 bytes);
+    int rotationInterval() const;
+    void setRotationInterval(int seconds);
+    bool compressRotatedFiles() const;
+    void setCompressRotatedFiles(bool enable);
+
+    virtual void initLoggerEngine();
+    virtual void killLoggerEngine();
+    virtual void flushLoggerEngine();
+
 protected:
     virtual void writeToFile(const QString &level, const QVariantList &messages);
+    void rotate();
 
 private:
     QXT_DECLARE_PRIVATE(QxtBasicFileLoggerEngine)
@@ -0,0 +1,382 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#include <qxtbinarysignalserializer.h>
+#include <QIODevice>
+#include <QDataStream>
+#include <QHash>
+#include <QVector>
+#include <QtGlobal>
+#include <qendian.h>
+#include <string.h>
+
+/*!
+ * \class QxtBinarySignalSerializer
+ * \inmodule QxtCore
+ * \brief The QxtBinarySignalSerializer class encodes signals in a compact binary form.
+ *
+ * QxtBinarySignalSerializer is an alternative to QxtDataStreamSignalSerializer for connections that carry many small
+ * messages. Each function name is transmitted only the first time it is used on a connection; later messages refer
+ * to it by a small integer ID. Parameters of type bool, int, uint, qlonglong, qulonglong, double, QString and
+ * QByteArray are written directly using variable-length integers. Parameters of any other type fall back to the
+ * QDataStream encoding of QVariant.
+ *
+ * Because the name table is built up as messages are sent, an instance must only be used for a single connection.
+ * QxtRPCService takes care of this by calling clone() for every connection. Both ends of a connection have to use
+ * QxtBinarySignalSerializer.
+ *
+ * Each message is a variable-length frame size followed by a function reference, the parameter count and the
+ * parameters. The low bit of the function reference marks a definition: when it is set, the UTF-8 encoded name
+ * follows and is stored under the ID held in the remaining bits. At most MaximumFunctionNames - 1 names are
+ * remembered; names beyond that are sent in full every time.
+ */
+
+static inline void qxtWriteVarint(QByteArray& out, quint64 value)
+{
+    while(value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+// Returns 1 if a value was read, 0 if the buffer ends in the middle of it and -1 if it is longer than 64 bits.
+static inline int qxtReadVarint(const char*& pos, const char* end, quint64& value)
+{
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        if(pos == end) return 0;
+        uchar byte = uchar(*pos++);
+        value |= quint64(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) return 1;
+    }
+    return -1;
+}
+
+static inline bool qxtReadLength(const char*& pos, const char* end, int& length)
+{
+    quint64 value;
+    if(qxtReadVarint(pos, end, value) != 1 || value > quint64(end - pos)) return false;
+    length = int(value);
+    return true;
+}
+
+static inline quint64 qxtZigzag(qint64 value)
+{
+    return (quint64(value) << 1) ^ quint64(value >> 63);
+}
+
+static inline qint64 qxtUnzigzag(quint64 value)
+{
+    return qint64(value >> 1) ^ -qint64(value & 1);
+}
+
+class QxtBinarySignalSerializerPrivate : public QxtPrivate<QxtBinarySignalSerializer>
+{
+public:
+    QXT_DECLARE_PUBLIC(QxtBinarySignalSerializer)
+
+    enum ValueTag
+    {
+        InvalidTag,
+        FalseTag,
+        TrueTag,
+        IntTag,
+        UIntTag,
+        LongLongTag,
+        ULongLongTag,
+        DoubleTag,
+        StringTag,
+        ByteArrayTag,
+        VariantTag
+    };
+
+    enum { MaximumFrameSize = 0x7fffffff };
+
+    // serialize() is const, but every name it sends for the first time is added to the table.
+    mutable QHash<QString, quint32> sentNames;
+    QVector<QString> receivedNames;
+
+    void writeValue(QByteArray& out, const QVariant& value) const;
+    bool readValue(const char*& pos, const char* end, QVariant& value) const;
+};
+
+void QxtBinarySignalSerializerPrivate::writeValue(QByteArray& out, const QVariant& value) const
+{
+    switch(value.userType()) {
+    case QMetaType::UnknownType:
+        out.append(char(InvalidTag));
+        break;
+    case QMetaType::Bool:
+        out.append(char(value.toBool() ? TrueTag : FalseTag));
+        break;
+    case QMetaType::Int:
+        out.append(char(IntTag));
+        qxtWriteVarint(out, qxtZigzag(value.toInt()));
+        break;
+    case QMetaType::UInt:
+        out.append(char(UIntTag));
+        qxtWriteVarint(out, value.toUInt());
+        break;
+    case QMetaType::LongLong:
+        out.append(char(LongLongTag));
+        qxtWriteVarint(out, qxtZigzag(value.toLongLong()));
+        break;
+    case QMetaType::ULongLong:
+        out.append(char(ULongLongTag));
+        qxtWriteVarint(out, value.toULongLong());
+        break;
+    case QMetaType::Double:
+        {
+            double number = value.toDouble();
+            quint64 bits;
+            memcpy(&bits, &number, sizeof(bits));
+            char raw[8];
+            qToLittleEndian(bits, reinterpret_cast<uchar*>(raw));
+            out.append(char(DoubleTag));
+            out.append(raw, 8);
+        }
+        break;
+    case QMetaType::QString:
+        {
+            QByteArray utf8 = static_cast<const QString*>(value.constData())->toUtf8();
+            out.append(char(StringTag));
+            qxtWriteVarint(out, utf8.size());
+            out.append(utf8);
+        }
+        break;
+    case QMetaType::QByteArray:
+        {
+            const QByteArray* bytes = static_cast<const QByteArray*>(value.constData());
+            out.append(char(ByteArrayTag));
+            qxtWriteVarint(out, bytes->size());
+            out.append(*bytes);
+        }
+        break;
+    default:
+        {
+            QByteArray encoded;
+            QDataStream str(&encoded, QIODevice::WriteOnly);
+            str << value;
+            out.append(char(VariantTag));
+            qxtWriteVarint(out, encoded.size());
+            out.append(encoded);
+        }
+        break;
+    }
+}
+
+bool QxtBinarySignalSerializerPrivate::readValue(const char*& pos, const char* end, QVariant& value) const
+{
+    if(pos == end) return false;
+    quint64 number;
+    int length;
+    switch(uchar(*pos++)) {
+    case InvalidTag:
+        value = QVariant();
+        return true;
+    case FalseTag:
+        value = false;
+        return true;
+    case TrueTag:
+        value = true;
+        return true;
+    case IntTag:
+        if(qxtReadVarint(pos, end, number) != 1) return false;
+        value = int(qxtUnzigzag(number));
+        return true;
+    case UIntTag:
+        if(qxtReadVarint(pos, end, number) != 1) return false;
+        value = uint(number);
+        return true;
+    case LongLongTag:
+        if(qxtReadVarint(pos, end, number) != 1) return false;
+        value = qlonglong(qxtUnzigzag(number));
+        return true;
+    case ULongLongTag:
+        if(qxtReadVarint(pos, end, number) != 1) return false;
+        value = qulonglong(number);
+        return true;
+    case DoubleTag:
+        {
+            if(end - pos < 8) return false;
+            quint64 bits = qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(pos));
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            pos += 8;
+            value = d;
+        }
+        return true;
+    case StringTag:
+        if(!qxtReadLength(pos, end, length)) return false;
+        value = QString::fromUtf8(pos, length);
+        pos += length;
+        return true;
+    case ByteArrayTag:
+        if(!qxtReadLength(pos, end, length)) return false;
+        value = QByteArray(pos, length);
+        pos += length;
+        return true;
+    case VariantTag:
+        {
+            if(!qxtReadLength(pos, end, length)) return false;
+            QByteArray encoded = QByteArray::fromRawData(pos, length);
+            QDataStream str(encoded);
+            str >> value;
+            pos += length;
+            return str.status() == QDataStream::Ok;
+        }
+    default:
+        return false;
+    }
+}
+
+QxtBinarySignalSerializer::QxtBinarySignalSerializer()
+{
+    QXT_INIT_PRIVATE(QxtBinarySignalSerializer);
+}
+
+QByteArray QxtBinarySignalSerializer::serialize(const QString& fn, const QVariant& p1, const QVariant& p2, const QVariant& p3,
+        const QVariant& p4, const QVariant& p5, const QVariant& p6, const QVariant& p7, const QVariant& p8) const
+{
+    const QVariant* params[8] = { &p1, &p2, &p3, &p4, &p5, &p6, &p7, &p8 };
+    int ct = 0;
+    while(ct < 8 && params[ct]->isValid())
+        ct++;
+
+    QByteArray body;
+    body.reserve(16 + ct * 8);
+    QHash<QString, quint32>::const_iterator name = qxt_d().sentNames.constFind(fn);
+    if(name != qxt_d().sentNames.constEnd()) {
+        qxtWriteVarint(body, quint64(*name) << 1);
+    } else {
+        // The last ID is never stored: once the table is full it is redefined by every message that needs it.
+        quint32 id = quint32(qxt_d().sentNames.count());
+        if(id < MaximumFunctionNames - 1)
+            qxt_d().sentNames.insert(fn, id);
+        QByteArray utf8 = fn.toUtf8();
+        qxtWriteVarint(body, (quint64(id) << 1) | 1);
+        qxtWriteVarint(body, utf8.size());
+        body.append(utf8);
+    }
+    body.append(char(ct));
+    for(int i = 0; i < ct; i++)
+        qxt_d().writeValue(body, *params[i]);
+
+    QByteArray rv;
+    rv.reserve(body.size() + 5);
+    qxtWriteVarint(rv, body.size());
+    rv.append(body);
+    return rv;
+}
+
+QxtAbstractSignalSerializer::DeserializedData QxtBinarySignalSerializer::deserialize(QByteArray& data)
+{
+    int offset = 0;
+    DeserializedData rv = deserialize(data, &offset);
+    data.remove(0, offset);
+    return rv;
+}
+
+QxtAbstractSignalSerializer::DeserializedData QxtBinarySignalSerializer::deserialize(const QByteArray& data, int* offset)
+{
+    const char* pos = data.constData() + *offset;
+    const char* end = data.constData() + data.size();
+    quint64 len;
+    if(qxtReadVarint(pos, end, len) != 1 || len > quint64(end - pos)) {
+        *offset = data.size();
+        return ProtocolError();
+    }
+    const char* frameEnd = pos + len;
+    *offset = int(frameEnd - data.constData());
+    if(len == 0) return NoOp();
+
+    QxtBinarySignalSerializerPrivate& d = qxt_d();
+    quint64 ref;
+    if(qxtReadVarint(pos, frameEnd, ref) != 1) return ProtocolError();
+    quint64 id = ref >> 1;
+    QString signal;
+    if(ref & 1) {
+        // A definition may add the next ID or replace an existing one.
+        int nameLength;
+        if(id >= quint64(MaximumFunctionNames) || id > quint64(d.receivedNames.count())) return ProtocolError();
+        if(!qxtReadLength(pos, frameEnd, nameLength)) return ProtocolError();
+        signal = QString::fromUtf8(pos, nameLength);
+        pos += nameLength;
+        if(id == quint64(d.receivedNames.count()))
+            d.receivedNames.append(signal);
+        else
+            d.receivedNames[int(id)] = signal;
+    } else {
+        if(id >= quint64(d.receivedNames.count())) return ProtocolError();
+        signal = d.receivedNames.at(int(id));
+    }
+
+    if(pos == frameEnd) return ProtocolError();
+    int argCount = uchar(*pos++);
+    QList<QVariant> v;
+    v.reserve(argCount);
+    QVariant t;
+    for(int i = 0; i < argCount; i++) {
+        if(!d.readValue(pos, frameEnd, t)) return ProtocolError();
+        v << t;
+    }
+    if(pos != frameEnd) return ProtocolError();
+    if(signal.isEmpty()) return NoOp();
+    return qMakePair(signal, v);
+}
+
+bool QxtBinarySignalSerializer::canDeserialize(const QByteArray& buffer) const
+{
+    return canDeserialize(buffer, 0);
+}
+
+bool QxtBinarySignalSerializer::canDeserialize(const QByteArray& buffer, int offset) const
+{
+    const char* pos = buffer.constData() + offset;
+    const char* end = buffer.constData() + buffer.size();
+    quint64 len;
+    int status = qxtReadVarint(pos, end, len);
+    // A malformed size is reported as deserializable so that deserialize() can flag the protocol error.
+    if(status < 0 || (status > 0 && len > quint64(QxtBinarySignalSerializerPrivate::MaximumFrameSize))) return true;
+    return status > 0 && len <= quint64(end - pos);
+}
+
+QxtAbstractSignalSerializer* QxtBinarySignalSerializer::clone() const
+{
+    return new QxtBinarySignalSerializer;
+}
+
+void QxtBinarySignalSerializer::reset()
+{
+    qxt_d().sentNames.clear();
+    qxt_d().receivedNames.clear();
+}
@@ -38,6 +38,7 @@
 #include "qxtalgorithms.h"
 #include "qxtbasicfileloggerengine.h"
 #include "qxtbasicstdloggerengine.h"
+#include "qxtbinarysignalserializer.h"
 #include "qxtboundcfunction.h"
 #include "qxtboundfunction.h"
 #include "qxtboundfunctionbase.h"
@@ -52,6 +53,7 @@
 #include "qxtglobal.h"
 #include "qxthmac.h"
 #include "qxtjson.h"
+#include "qxtjsonreader.h"
 #include "qxtjob.h"
 #include "qxtlinesocket.h"
 #include "qxtlinkedtree.h"
@@ -88,24 +88,39 @@ QByteArray QxtDataStreamSignalSerializer::serialize(const QString& fn, const QVa
 
 QxtAbstractSignalSerializer::DeserializedData QxtDataStreamSignalSerializer::deserialize(QByteArray& data)
 {
-    QByteArray cmd;
-    quint32 len = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(data.constData()));
+    int offset = 0;
+    DeserializedData rv = deserialize(data, &offset);
+    data.remove(0, offset);
+    return rv;
+}
 
-    cmd = data.mid(4, len);
-    data = data.mid(len + 4);
-    if (cmd.length() == 0) return NoOp();
+QxtAbstractSignalSerializer::DeserializedData QxtDataStreamSignalSerializer::deserialize(const QByteArray& data, int* offset)
+{
+    if (data.size() - *offset < 4) {
+        *offset = data.size();
+        return NoOp();
+    }
+    const char* frame = data.constData() + *offset;
+    quint32 len = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(frame));
+    quint32 available = quint32(data.size() - *offset - 4);
+    if (len > available) len = available;
+    *offset += int(len) + 4;
+    if (len == 0) return NoOp();
 
+    // The stream reads the frame in place; nothing is copied until the values are extracted.
+    QByteArray cmd = QByteArray::fromRawData(frame + 4, int(len));
     QDataStream str(cmd);
     qxt_d().applyVersion(str);
 
     QString signal;
     unsigned char argCount;
-    QList<QVariant> v;
-    QVariant t;
     str >> signal >> argCount;
 
     if (str.status() == QDataStream::ReadCorruptData) return ProtocolError();
 
+    QList<QVariant> v;
+    v.reserve(argCount);
+    QVariant t;
     for (int i = 0; i < argCount; i++)
     {
         str >> t;
@@ -116,9 +131,14 @@ QxtAbstractSignalSerializer::DeserializedData QxtDataStreamSignalSerializer::des
 
 bool QxtDataStreamSignalSerializer::canDeserialize(const QByteArray& buffer) const
 {
-    if(buffer.length() < int(sizeof(quint32))) return false;
-    quint32 headerLen = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(buffer.constData()));
-    quint32 bodyLen = quint32(buffer.length() - 4);
+    return canDeserialize(buffer, 0);
+}
+
+bool QxtDataStreamSignalSerializer::canDeserialize(const QByteArray& buffer, int offset) const
+{
+    if(buffer.length() - offset < int(sizeof(quint32))) return false;
+    quint32 headerLen = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(buffer.constData() + offset));
+    quint32 bodyLen = quint32(buffer.length() - offset - 4);
     return headerLen <= bodyLen;
 }
 
@@ -62,6 +62,16 @@ public:
      */
     virtual bool canDeserialize(const QByteArray& buffer) const;
 
+    /*!
+     * Deserializes one signal from \a data starting at \a offset and advances \a offset past it.
+     */
+    virtual DeserializedData deserialize(const QByteArray& data, int* offset);
+
+    /*!
+     * Indicates whether the data in \a buffer starting at \a offset can be deserialized.
+     */
+    virtual bool canDeserialize(const QByteArray& buffer, int offset) const;
+
     enum  {
         DefaultDataStreamVersion = 0
     };
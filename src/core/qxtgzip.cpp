@@ -0,0 +1,105 @@
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#include "qxtgzip_p.h"
+#include <QIODevice>
+#ifdef QXT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+enum { QxtGzipBlockSize = 65536 };
+
+bool qxtGzipAvailable()
+{
+#ifdef QXT_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Reads in to its end and writes it to out as a gzip stream. Returns
+ * false if deflating or writing failed; what was written by then is left
+ * to the caller to discard.
+ */
+bool qxtGzip(QIODevice* in, QIODevice* out, int level)
+{
+#ifdef QXT_HAVE_ZLIB
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    // A window of 15 bits with 16 added selects the gzip container
+    if (deflateInit2(&stream, qBound(1, level, 9), Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    QByteArray input(QxtGzipBlockSize, Qt::Uninitialized);
+    QByteArray output(QxtGzipBlockSize, Qt::Uninitialized);
+    int result = Z_OK;
+    bool ok = true;
+    while (ok && result != Z_STREAM_END)
+    {
+        qint64 size = in->read(input.data(), input.size());
+        if (size < 0)
+        {
+            ok = false;
+            break;
+        }
+        int flush = (in->atEnd() || size == 0) ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef*>(input.data());
+        stream.avail_in = uInt(size);
+        do
+        {
+            stream.next_out = reinterpret_cast<Bytef*>(output.data());
+            stream.avail_out = uInt(output.size());
+            result = deflate(&stream, flush);
+            if (result == Z_STREAM_ERROR)
+            {
+                ok = false;
+                break;
+            }
+            qint64 produced = output.size() - stream.avail_out;
+            if (produced > 0 && out->write(output.constData(), produced) != produced)
+            {
+                ok = false;
+                break;
+            }
+        } while (stream.avail_out == 0);
+    }
+    deflateEnd(&stream);
+    return ok;
+#else
+    Q_UNUSED(in);
+    Q_UNUSED(out);
+    Q_UNUSED(level);
+    return false;
+#endif
+}
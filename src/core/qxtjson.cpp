@@ -30,6 +30,7 @@
 *****************************************************************************/
 
 
+
 /*!
     \class QxtJSON
     \inmodule QxtCore
@@ -44,325 +45,396 @@
     \row  \o object \o QVariantMap/QVariantHash
     \row  \o array \o QVariantList/QStringList
     \row  \o string \o QString
-    \row  \o number \o int,double
+    \row  \o number \o int,qlonglong,double
     \row  \o true \o bool
     \row  \o false \o bool
     \row  \o null \o QVariant()
 
     \endtable
 
+    parseUtf8() and the UTF-8 overloads of stringify() work on the encoded
+    bytes directly and are the fastest way to handle JSON that travels over
+    the network. Large documents can be written straight to a QIODevice.
+    QxtJSONReader reads a document token by token without building a
+    QVariant tree.
+
+    \sa QxtJSONReader
 */
 
 #include "qxtjson.h"
+#include "qxtjsonreader.h"
 #include <QVariant>
-#include <QDebug>
-#include <QTextStream>
 #include <QStringList>
+#include <QIODevice>
+#include <QLocale>
+#include <qnumeric.h>
 
-QString QxtJSON::stringify(QVariant v){
-    if (v.isNull()){
-        return "null";
+#ifndef QXT_DOXYGEN_RUN
+/*
+ * Appends the UTF-8 encoding of a QVariant to a byte array. When a device
+ * is given, the array is a reusable buffer that is written to the device
+ * whenever it fills up.
+ */
+class QxtJSONWriter
+{
+public:
+    enum { FlushSize = 65536 };
+
+    QxtJSONWriter(QByteArray* out, QIODevice* device = 0) : out(out), device(device), ok(true)
+    {
+        if (device)
+            out->reserve(FlushSize + FlushSize / 4);
     }
-    switch (v.type()) {
-        case QVariant::Bool:
-            return v.toBool()?"true":"false";
-            break;
-        case QVariant::ULongLong:
-        case QVariant::UInt:
-            return QString::number(v.toULongLong());
-            break;
-        case QVariant::LongLong:
-        case QVariant::Int:
-            return QString::number(v.toLongLong());
-            break;
-        case QVariant::Double:
-            return QString::number(v.toDouble());
-            break;
-        case QVariant::Map:
-            {
-                QString r="{";
-                QMap<QString, QVariant> map = v.toMap();
-                QMapIterator<QString, QVariant> i(map);
-                while (i.hasNext()){
-                    i.next();
-                    r+="\""+i.key()+"\":"+stringify(i.value())+",";
-                }
-                if(r.length()>1)
-                    r.chop(1);
-                r+="}";
-                return r;
-            }
-            break;
-#if QT_VERSION >= 0x040500
-        case QVariant::Hash:
+
+    void write(const QVariant& v);
+    bool flush();
+
+private:
+    void writeString(const QChar* data, int size);
+    inline void writeString(const QString& s)
+    {
+        writeString(s.constData(), s.size());
+    }
+    void writeInteger(qint64 value);
+    void writeUnsigned(quint64 value, bool negative = false);
+    void writeDouble(double value);
+    inline void writeRaw(const char* data, int size)
+    {
+        out->append(data, size);
+    }
+    inline void checkFlush()
+    {
+        if (device && out->size() >= FlushSize)
+            flush();
+    }
+
+    QByteArray* out;
+    QIODevice* device;
+    bool ok;
+};
+
+bool QxtJSONWriter::flush()
+{
+    if (device && !out->isEmpty())
+    {
+        if (device->write(*out) != out->size())
+            ok = false;
+        out->resize(0);
+    }
+    return ok;
+}
+
+void QxtJSONWriter::write(const QVariant& v)
+{
+    if (v.isNull())
+    {
+        writeRaw("null", 4);
+        return;
+    }
+    // Containers are read in place instead of through toMap() and friends
+    switch (v.userType())
+    {
+    case QMetaType::Bool:
+        if (v.toBool())
+            writeRaw("true", 4);
+        else
+            writeRaw("false", 5);
+        break;
+    case QMetaType::Int:
+    case QMetaType::LongLong:
+    case QMetaType::Short:
+    case QMetaType::Long:
+        writeInteger(v.toLongLong());
+        break;
+    case QMetaType::UInt:
+    case QMetaType::ULongLong:
+    case QMetaType::UShort:
+    case QMetaType::ULong:
+        writeUnsigned(v.toULongLong());
+        break;
+    case QMetaType::Double:
+    case QMetaType::Float:
+        writeDouble(v.toDouble());
+        break;
+    case QMetaType::QVariantMap:
+        {
+            const QVariantMap& map = *static_cast<const QVariantMap*>(v.constData());
+            out->append('{');
+            for (QVariantMap::const_iterator i = map.constBegin(); i != map.constEnd(); ++i)
             {
-                QString r="{";
-                QHash<QString, QVariant> map = v.toHash();
-                QHashIterator<QString, QVariant> i(map);
-                while (i.hasNext()){
-                    i.next();
-                    r+="\""+i.key()+"\":"+stringify(i.value())+",";
-                }
-                if(r.length()>1)
-                    r.chop(1);
-                r+="}";
-                return r;
+                if (i != map.constBegin())
+                    out->append(',');
+                writeString(i.key());
+                out->append(':');
+                write(i.value());
+                checkFlush();
             }
-            break;
-#endif
-        case QVariant::StringList:
+            out->append('}');
+        }
+        break;
+    case QMetaType::QVariantHash:
+        {
+            const QVariantHash& hash = *static_cast<const QVariantHash*>(v.constData());
+            out->append('{');
+            for (QVariantHash::const_iterator i = hash.constBegin(); i != hash.constEnd(); ++i)
             {
-                QString r="[";
-                QStringList l = v.toStringList();
-                foreach(QString i, l){
-                    r += stringify(i) + ",";
-                }
-                if(r.length()>1)
-                    r.chop(1);
-                r+="]";
-                return r;
+                if (i != hash.constBegin())
+                    out->append(',');
+                writeString(i.key());
+                out->append(':');
+                write(i.value());
+                checkFlush();
             }
-        case QVariant::List:
+            out->append('}');
+        }
+        break;
+    case QMetaType::QVariantList:
+        {
+            const QVariantList& list = *static_cast<const QVariantList*>(v.constData());
+            out->append('[');
+            for (int i = 0; i < list.size(); i++)
             {
-                QString r="[";
-                QVariantList l = v.toList();
-                foreach(QVariant i, l){
-                    r+=stringify(i)+",";
-                }
-                if(r.length()>1)
-                    r.chop(1);
-                r+="]";
-                return r;
+                if (i)
+                    out->append(',');
+                write(list.at(i));
+                checkFlush();
             }
-            break;
-        case QVariant::String:
-        default:
+            out->append(']');
+        }
+        break;
+    case QMetaType::QStringList:
+        {
+            const QStringList& list = *static_cast<const QStringList*>(v.constData());
+            out->append('[');
+            for (int i = 0; i < list.size(); i++)
             {
-                QString in = v.toString();
-                QString out;
-                for(QString::ConstIterator i = in.constBegin(); i != in.constEnd(); i++){
-                    if( (*i) == QChar('\b'))
-                        out.append("\\b");
-                    else if( (*i) == QChar('\f'))
-                        out.append("\\f");
-                    else if( (*i) == QChar('\n'))
-                        out.append("\\n");
-                    else if( (*i) == QChar('\r'))
-                        out.append("\\r");
-                    else if( (*i) == QChar('\t'))
-                        out.append("\\t");
-                    else if( (*i) == QChar('\f'))
-                        out.append("\\f");
-                    else if( (*i) == QChar('\\'))
-                        out.append("\\\\");
-                    else if( (*i) == QChar('/'))
-                        out.append("\\/");
-                    else if( (*i) == QChar('"'))
-                        out.append("\\\"");
-                    else
-                        out.append(*i);
-                }
-                return "\""+out+"\"";
+                if (i)
+                    out->append(',');
+                writeString(list.at(i));
+                checkFlush();
             }
-            break;
+            out->append(']');
+        }
+        break;
+    case QMetaType::QString:
+        writeString(*static_cast<const QString*>(v.constData()));
+        break;
+    default:
+        writeString(v.toString());
+        break;
     }
-    return QString();
-}
-
-static QVariant parseValue(QTextStream &s,bool & error);
-static QVariantMap parseObject (QTextStream & s,bool & error);
-static QVariantList parseArray (QTextStream & s,bool & error);
-static QString parseString (QTextStream & s,bool & error);
-static QVariant parseLiteral (QTextStream & s,bool & error);
-
-QVariant QxtJSON::parse(QString string){
-    QTextStream s(&string);
-    bool error=false;
-    QVariant v=parseValue(s,error);
-    if(error)
-        return QVariant();
-    return v;
 }
 
+void QxtJSONWriter::writeString(const QChar* data, int size)
+{
+    static const char hex[] = "0123456789abcdef";
+    const ushort* begin = reinterpret_cast<const ushort*>(data);
+    const ushort* end = begin + size;
 
-
-static QVariant parseValue(QTextStream &s,bool & error){
-    s.skipWhiteSpace();
-    QChar c;
-    while(!s.atEnd() && !error){
-        s>>c;
-        if (c=='{'){
-            return parseObject(s,error);
-        } else if (c=='"'){
-            return parseString(s,error);
-        } else if (c=='['){
-            return parseArray(s,error);
-        } else {
-            return parseLiteral(s,error);
+    // Measure first so that the output is grown once
+    int length = 2;
+    for (const ushort* p = begin; p < end; p++)
+    {
+        ushort c = *p;
+        if (c < 0x80)
+        {
+            if (c >= 0x20 && c != '"' && c != '\\')
+                length += 1;
+            else if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t')
+                length += 2;
+            else
+                length += 6;
+        }
+        else if (c < 0x800)
+        {
+            length += 2;
+        }
+        else if (QChar::isHighSurrogate(c) && p + 1 < end && QChar::isLowSurrogate(p[1]))
+        {
+            length += 4;
+            p++;
+        }
+        else if (QChar::isSurrogate(c))
+        {
+            length += 6;    // a lone surrogate can't be encoded; escape it
+        }
+        else
+        {
+            length += 3;
         }
-        s.skipWhiteSpace();
     }
-    return QVariant();
-}
-
-static QVariantMap parseObject (QTextStream & s,bool & error){
-    s.skipWhiteSpace();
-    QVariantMap o;
-    QString key;
-    bool atVal=false;
 
-    QChar c;
-    while(!s.atEnd() && !error){
-        s>>c;
-        if (c=='}'){
-            return o;
-        } else if (c==',' || c==':'){
-            /*
-              They're syntactic sugar, since key:value come in bundles anyway
-              Could check for error handling. too lazy.
-            */
-        } else if (c=='"'){
-            if(atVal){
-                o[key]=parseString(s,error);
-                atVal=false;
-            }else{
-                key=parseString(s,error);
-                atVal=true;
-            }
-        } else if (c=='['){
-            if(atVal){
-                o[key]=parseArray(s,error);
-                atVal=false;
-            }else{
-                error=true;
-                return QVariantMap();
-            }
-        } else if (c=='{'){
-            if(atVal){
-                o[key]=parseObject(s,error);
-                atVal=false;
-            }else{
-                error=true;
-                return QVariantMap();
+    int offset = out->size();
+    out->resize(offset + length);
+    char* o = out->data() + offset;
+    *o++ = '"';
+    for (const ushort* p = begin; p < end; p++)
+    {
+        ushort c = *p;
+        if (c < 0x80)
+        {
+            if (c >= 0x20 && c != '"' && c != '\\')
+            {
+                *o++ = char(c);
+                continue;
             }
-        } else {
-            if(atVal){
-                o[key]=parseLiteral(s,error);
-                atVal=false;
-            }else{
-                error=true;
-                return QVariantMap();
+            *o++ = '\\';
+            switch (c)
+            {
+            case '"':  *o++ = '"'; break;
+            case '\\': *o++ = '\\'; break;
+            case '\b': *o++ = 'b'; break;
+            case '\f': *o++ = 'f'; break;
+            case '\n': *o++ = 'n'; break;
+            case '\r': *o++ = 'r'; break;
+            case '\t': *o++ = 't'; break;
+            default:
+                *o++ = 'u';
+                *o++ = '0';
+                *o++ = '0';
+                *o++ = hex[c >> 4];
+                *o++ = hex[c & 15];
+                break;
             }
         }
-        s.skipWhiteSpace();
-    }
-    error=true;
-    return QVariantMap();
-}
-static QVariantList parseArray (QTextStream & s,bool & error){
-    s.skipWhiteSpace();
-    QVariantList l;
-    QChar c;
-    while(!s.atEnd() && !error){
-        s>>c;
-        if (c==']'){
-            return l;
-        } else if (c==','){
-        } else if (c=='"'){
-            l.append(QVariant(parseString(s,error)));
-        } else if (c=='['){
-            l.append(QVariant(parseArray(s,error)));
-        } else if (c=='{'){
-            l.append(QVariant(parseObject(s,error)));
-        } else {
-            l.append(QVariant(parseLiteral(s,error)));
+        else if (c < 0x800)
+        {
+            *o++ = char(0xc0 | (c >> 6));
+            *o++ = char(0x80 | (c & 0x3f));
         }
-        s.skipWhiteSpace();
-    }
-    error=true;
-    return QVariantList();
-}
-static QString parseString (QTextStream & s,bool & error){
-    QString str;
-    QChar c;
-    while(!s.atEnd() && !error){
-        s>>c;
-        if(c=='"'){
-            return str;
-        }else if(c=='\\'){
-            s>>c;
-            if(c=='b'){
-                str.append('\b');
-            }else if(c=='f'){
-                str.append('\f');
-            }else if(c=='n'){
-                str.append('\n');
-            }else if(c=='r'){
-                str.append('\r');
-            }else if(c=='t'){
-                str.append('\t');
-            }else if(c=='f'){
-                str.append('\f');
-            }else if(c=='u'){
-                QString k;
-                for (int i = 0; i < 4; i++ ) {
-                    s >> c;
-                    k.append(c);
-                }
-                bool ok;
-                int i = k.toInt(&ok, 16);
-                if (ok)
-                    str.append(QChar(i));
-            }else{
-                str.append(c);
-            }
-        }else{
-            str.append(c);
+        else if (QChar::isHighSurrogate(c) && p + 1 < end && QChar::isLowSurrogate(p[1]))
+        {
+            uint ucs4 = QChar::surrogateToUcs4(c, p[1]);
+            *o++ = char(0xf0 | (ucs4 >> 18));
+            *o++ = char(0x80 | ((ucs4 >> 12) & 0x3f));
+            *o++ = char(0x80 | ((ucs4 >> 6) & 0x3f));
+            *o++ = char(0x80 | (ucs4 & 0x3f));
+            p++;
+        }
+        else if (QChar::isSurrogate(c))
+        {
+            *o++ = '\\';
+            *o++ = 'u';
+            *o++ = hex[c >> 12];
+            *o++ = hex[(c >> 8) & 15];
+            *o++ = hex[(c >> 4) & 15];
+            *o++ = hex[c & 15];
+        }
+        else
+        {
+            *o++ = char(0xe0 | (c >> 12));
+            *o++ = char(0x80 | ((c >> 6) & 0x3f));
+            *o++ = char(0x80 | (c & 0x3f));
         }
     }
-    error=true;
-    return QString();
+    *o = '"';
 }
-static QVariant parseLiteral (QTextStream & s,bool & error){
-    s.seek(s.pos()-1);
-    QChar c;
-    while(!s.atEnd() && !error){
-        s>>c;
-        if (c=='t'){
-            s>>c;//r
-            s>>c;//u
-            s>>c;//e
-            return true;
-        } else if (c=='f'){
-            s>>c;//a
-            s>>c;//l
-            s>>c;//s
-            s>>c;//e
-            return false;
-        }else if (c=='n'){
-            s>>c;//u
-            s>>c;//l
-            s>>c;//l
-            return QVariant();
-        }else if (c=='-' || c.isDigit()){
-            QString n;
-            while(( c.isDigit()  || (c=='.') || (c=='E') || (c=='e') || (c=='-') || (c=='+') )){
-                n.append(c);
-                if(s.atEnd() ||  error)
-                    break;
-                s>>c;
-            }
-            s.seek(s.pos()-1);
-            if(n.contains('.')) {
-                return n.toDouble();
-            } else {
-                bool ok = false;
-                int result = n.toInt(&ok);
-                if(ok) return result;
-                return n.toLongLong();
-            }
-        }
+
+void QxtJSONWriter::writeInteger(qint64 value)
+{
+    if (value < 0)
+        writeUnsigned(0 - quint64(value), true);
+    else
+        writeUnsigned(quint64(value));
+}
+
+void QxtJSONWriter::writeUnsigned(quint64 value, bool negative)
+{
+    char buffer[24];
+    char* p = buffer + sizeof(buffer);
+    do
+    {
+        *--p = char('0' + value % 10);
+        value /= 10;
+    } while (value);
+    if (negative)
+        *--p = '-';
+    writeRaw(p, int(buffer + sizeof(buffer) - p));
+}
+
+void QxtJSONWriter::writeDouble(double value)
+{
+    // JSON has no representation for these
+    if (qIsNaN(value) || qIsInf(value))
+    {
+        writeRaw("null", 4);
+        return;
     }
-    error=true;
-    return QVariant();
+    out->append(QByteArray::number(value, 'g', QLocale::FloatingPointShortest));
+}
+#endif
+
+/*!
+ * Returns the JSON representation of \a v.
+ *
+ * \sa stringifyUtf8()
+ */
+QString QxtJSON::stringify(QVariant v){
+    QByteArray out;
+    QxtJSONWriter(&out).write(v);
+    return QString::fromUtf8(out);
+}
+
+/*!
+ * Returns the UTF-8 encoded JSON representation of \a v.
+ *
+ * \sa parseUtf8()
+ */
+QByteArray QxtJSON::stringifyUtf8(const QVariant& v)
+{
+    QByteArray out;
+    QxtJSONWriter(&out).write(v);
+    return out;
+}
+
+/*!
+ * Appends the UTF-8 encoded JSON representation of \a v to \a out. Reserve
+ * space in \a out beforehand to serialize without reallocating.
+ */
+void QxtJSON::stringify(const QVariant& v, QByteArray* out)
+{
+    QxtJSONWriter(out).write(v);
+}
+
+/*!
+ * Writes the UTF-8 encoded JSON representation of \a v to \a device, in
+ * pieces of about 64 KB. Returns false if the device did not accept all of
+ * the data.
+ */
+bool QxtJSON::stringify(const QVariant& v, QIODevice* device)
+{
+    QByteArray buffer;
+    QxtJSONWriter writer(&buffer, device);
+    writer.write(v);
+    return writer.flush();
+}
+
+/*!
+ * Parses the JSON document in \a string and returns its value, or a null
+ * QVariant if the document is malformed.
+ *
+ * \sa parseUtf8()
+ */
+QVariant QxtJSON::parse(QString string){
+    return parseUtf8(string.toUtf8());
+}
+
+/*!
+ * Parses the UTF-8 encoded JSON document in \a json and returns its value.
+ * If the document is malformed, a null QVariant is returned and \a ok, if
+ * given, is set to false.
+ *
+ * \sa QxtJSONReader
+ */
+QVariant QxtJSON::parseUtf8(const QByteArray& json, bool* ok)
+{
+    QxtJSONReader reader(json);
+    QVariant v = reader.readValue();
+    if (!reader.hasError())
+        reader.readNext();  // only whitespace may follow
+    if (ok)
+        *ok = !reader.hasError();
+    if (reader.hasError())
+        return QVariant();
+    return v;
 }
@@ -35,10 +35,18 @@
 #include "qxtglobal.h"
 #include <QVariant>
 #include <QString>
+#include <QByteArray>
+
+QT_FORWARD_DECLARE_CLASS(QIODevice)
 
 class QXT_CORE_EXPORT QxtJSON {
 public:
     static QVariant parse     (QString string);
     static QString  stringify (QVariant v);
+
+    static QVariant   parseUtf8     (const QByteArray& json, bool* ok = 0);
+    static QByteArray stringifyUtf8 (const QVariant& v);
+    static void       stringify     (const QVariant& v, QByteArray* out);
+    static bool       stringify     (const QVariant& v, QIODevice* device);
 };
 #endif
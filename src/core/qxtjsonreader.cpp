@@ -0,0 +1,685 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+/*!
+    \class QxtJSONReader
+    \inmodule QxtCore
+    \brief The QxtJSONReader class is a fast pull parser for UTF-8 encoded JSON
+
+    QxtJSONReader reads a JSON document as a stream of tokens, in the manner
+    of QXmlStreamReader. It works directly on the UTF-8 bytes it is given:
+    nothing is copied or decoded until a token's value is requested, so
+    skipping over parts of a document is cheap and only the strings that
+    are actually used are converted to QString.
+
+    \code
+    QxtJSONReader reader(reply->readAll());
+    if (reader.readNext() == QxtJSONReader::StartObject)
+    {
+        while (reader.readNext() == QxtJSONReader::Name)
+        {
+            if (reader.text() == "id")
+                id = reader.readValue();
+            else
+                reader.skipValue();
+        }
+    }
+    if (reader.hasError())
+        qWarning() << reader.errorString();
+    \endcode
+
+    readValue() builds a QVariant from the next value, using the same type
+    mapping as QxtJSON::parse(), and may be mixed freely with readNext().
+
+    The reader is strict: it accepts exactly one value, optionally
+    surrounded by whitespace, as described by RFC 8259. Containers may be
+    nested up to MaximumDepth levels.
+
+    \sa QxtJSON
+*/
+
+/*!
+    \enum QxtJSONReader::TokenType
+
+    \value NoToken      Nothing has been read yet.
+    \value Invalid      An error occurred; see errorString().
+    \value StartObject  The start of an object.
+    \value EndObject    The end of an object.
+    \value StartArray   The start of an array.
+    \value EndArray     The end of an array.
+    \value Name         The name of an object member; the member's value follows.
+    \value String       A string value.
+    \value Number       A number.
+    \value Bool         \c true or \c false.
+    \value Null         \c null.
+    \value EndDocument  The end of the document has been reached.
+*/
+
+#include "qxtjsonreader.h"
+#include <string.h>
+#include <limits.h>
+
+/*!
+ * Constructs a reader without data.
+ */
+QxtJSONReader::QxtJSONReader()
+{
+    setData(QByteArray());
+}
+
+/*!
+ * Constructs a reader for the UTF-8 encoded document in \a data.
+ */
+QxtJSONReader::QxtJSONReader(const QByteArray& data)
+{
+    setData(data);
+}
+
+/*!
+ * Starts reading the UTF-8 encoded document in \a data from the beginning.
+ * The data is shared, not copied.
+ */
+void QxtJSONReader::setData(const QByteArray& data)
+{
+    m_data = data;
+    m_begin = m_pos = m_tokenStart = m_tokenEnd = m_data.constData();
+    m_end = m_begin + m_data.size();
+    m_escaped = m_integer = false;
+    m_integerValue = 0;
+    m_token = NoToken;
+    m_expect = ExpectValue;
+    m_stack.clear();
+    m_error = 0;
+    m_errorOffset = -1;
+}
+
+/*!
+ * Returns the document being read.
+ */
+QByteArray QxtJSONReader::data() const
+{
+    return m_data;
+}
+
+/*!
+ * Returns the type of the current token.
+ */
+QxtJSONReader::TokenType QxtJSONReader::tokenType() const
+{
+    return m_token;
+}
+
+/*!
+ * Returns true if the end of the document has been reached or an error
+ * occurred.
+ */
+bool QxtJSONReader::atEnd() const
+{
+    return m_token == EndDocument || m_token == Invalid;
+}
+
+/*!
+ * Returns the number of containers enclosing the reader's position.
+ */
+int QxtJSONReader::depth() const
+{
+    return m_stack.size();
+}
+
+/*!
+ * Returns true if the document is malformed.
+ */
+bool QxtJSONReader::hasError() const
+{
+    return m_token == Invalid;
+}
+
+/*!
+ * Returns a description of the error, or an empty string.
+ */
+QString QxtJSONReader::errorString() const
+{
+    return m_error ? QString::fromLatin1(m_error) : QString();
+}
+
+/*!
+ * Returns the byte offset at which the error was found, or -1.
+ */
+int QxtJSONReader::errorOffset() const
+{
+    return m_errorOffset;
+}
+
+void QxtJSONReader::raiseError(const char* message)
+{
+    m_token = Invalid;
+    m_error = message;
+    m_errorOffset = int(m_pos - m_begin);
+}
+
+void QxtJSONReader::skipWhitespace()
+{
+    while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' || *m_pos == '\t'))
+        m_pos++;
+}
+
+static inline bool qxtIsHexDigit(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static inline int qxtHexValue(char c)
+{
+    if (c <= '9') return c - '0';
+    return (c | 0x20) - 'a' + 10;
+}
+
+/*
+ * Finds the end of the string starting at m_pos and validates its escape
+ * sequences. The contents are decoded later, and only on request.
+ */
+bool QxtJSONReader::scanString()
+{
+    const char* p = m_pos + 1;
+    m_escaped = false;
+    while (p < m_end)
+    {
+        uchar c = *p;
+        if (c == '"')
+        {
+            m_tokenStart = m_pos + 1;
+            m_tokenEnd = p;
+            m_pos = p + 1;
+            return true;
+        }
+        if (c == '\\')
+        {
+            m_escaped = true;
+            if (++p == m_end) break;
+            if (*p == 'u')
+            {
+                if (m_end - p < 5 || !qxtIsHexDigit(p[1]) || !qxtIsHexDigit(p[2]) || !qxtIsHexDigit(p[3]) || !qxtIsHexDigit(p[4]))
+                {
+                    m_pos = p;
+                    raiseError("invalid unicode escape");
+                    return false;
+                }
+                p += 5;
+                continue;
+            }
+            if (!strchr("\"\\/bfnrt", *p) || !*p)
+            {
+                m_pos = p;
+                raiseError("invalid escape sequence");
+                return false;
+            }
+        }
+        else if (c < 0x20)
+        {
+            m_pos = p;
+            raiseError("control character in string");
+            return false;
+        }
+        p++;
+    }
+    m_pos = m_end;
+    raiseError("unterminated string");
+    return false;
+}
+
+bool QxtJSONReader::scanNumber()
+{
+    const char* p = m_pos;
+    bool negative = false;
+    if (*p == '-')
+    {
+        negative = true;
+        p++;
+    }
+    if (p == m_end || *p < '0' || *p > '9')
+    {
+        m_pos = p;
+        raiseError("invalid number");
+        return false;
+    }
+    // Integers are converted while they are scanned
+    quint64 magnitude = 0;
+    bool overflow = false;
+    if (*p == '0')
+    {
+        p++;
+    }
+    else
+    {
+        while (p < m_end && *p >= '0' && *p <= '9')
+        {
+            uint digit = *p - '0';
+            if (magnitude > (Q_UINT64_C(0xFFFFFFFFFFFFFFFF) - digit) / 10)
+                overflow = true;
+            magnitude = magnitude * 10 + digit;
+            p++;
+        }
+    }
+    m_integer = true;
+    if (p < m_end && *p == '.')
+    {
+        m_integer = false;
+        if (++p == m_end || *p < '0' || *p > '9')
+        {
+            m_pos = p;
+            raiseError("invalid number");
+            return false;
+        }
+        while (p < m_end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    if (p < m_end && (*p == 'e' || *p == 'E'))
+    {
+        m_integer = false;
+        if (++p < m_end && (*p == '+' || *p == '-'))
+            p++;
+        if (p == m_end || *p < '0' || *p > '9')
+        {
+            m_pos = p;
+            raiseError("invalid number");
+            return false;
+        }
+        while (p < m_end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    if (m_integer)
+    {
+        // Integers outside the range of qint64 are read as doubles
+        if (overflow || magnitude > quint64(Q_INT64_C(0x7FFFFFFFFFFFFFFF)) + (negative ? 1 : 0))
+            m_integer = false;
+        else
+            m_integerValue = negative ? qint64(0 - magnitude) : qint64(magnitude);
+    }
+    m_tokenStart = m_pos;
+    m_tokenEnd = m_pos = p;
+    return true;
+}
+
+bool QxtJSONReader::scanLiteral(const char* literal, int length)
+{
+    if (m_end - m_pos < length || memcmp(m_pos, literal, length))
+    {
+        raiseError("invalid literal");
+        return false;
+    }
+    m_tokenStart = m_pos;
+    m_pos += length;
+    m_tokenEnd = m_pos;
+    return true;
+}
+
+/*!
+ * Reads the next token and returns its type. Once the end of the document
+ * or an error is reached, the same type is returned by every further call.
+ */
+QxtJSONReader::TokenType QxtJSONReader::readNext()
+{
+    if (m_token == EndDocument || m_token == Invalid)
+        return m_token;
+    skipWhitespace();
+    if (m_expect == ExpectNothing)
+    {
+        if (m_pos != m_end)
+        {
+            raiseError("garbage after the end of the document");
+            return m_token;
+        }
+        return m_token = EndDocument;
+    }
+    if (m_pos == m_end)
+    {
+        raiseError("unexpected end of data");
+        return m_token;
+    }
+    char c = *m_pos;
+    Context context = m_stack.isEmpty() ? TopLevel : Context(m_stack.at(m_stack.size() - 1));
+    if (m_expect == ExpectComma)
+    {
+        if (c == ',')
+        {
+            m_pos++;
+            skipWhitespace();
+            if (m_pos == m_end)
+            {
+                raiseError("unexpected end of data");
+                return m_token;
+            }
+            c = *m_pos;
+            m_expect = context == InObject ? ExpectName : ExpectValue;
+        }
+        else if ((c == '}' && context == InObject) || (c == ']' && context == InArray))
+        {
+            m_pos++;
+            m_stack.chop(1);
+            m_expect = m_stack.isEmpty() ? ExpectNothing : ExpectComma;
+            return m_token = (c == '}' ? EndObject : EndArray);
+        }
+        else
+        {
+            raiseError(context == InObject ? "expected ',' or '}'" : "expected ',' or ']'");
+            return m_token;
+        }
+    }
+    if (m_expect == ExpectName)
+    {
+        if (c == '}' && m_token == StartObject)
+        {
+            m_pos++;
+            m_stack.chop(1);
+            m_expect = m_stack.isEmpty() ? ExpectNothing : ExpectComma;
+            return m_token = EndObject;
+        }
+        if (c != '"')
+        {
+            raiseError("expected a member name");
+            return m_token;
+        }
+        if (!scanString()) return m_token;
+        skipWhitespace();
+        if (m_pos == m_end || *m_pos != ':')
+        {
+            raiseError("expected ':'");
+            return m_token;
+        }
+        m_pos++;
+        m_expect = ExpectValue;
+        return m_token = Name;
+    }
+
+    TokenType token;
+    switch (c)
+    {
+    case '{':
+    case '[':
+        if (m_stack.size() >= MaximumDepth)
+        {
+            raiseError("document is nested too deeply");
+            return m_token;
+        }
+        m_pos++;
+        m_stack.append(char(c == '{' ? InObject : InArray));
+        m_expect = c == '{' ? ExpectName : ExpectValue;
+        return m_token = (c == '{' ? StartObject : StartArray);
+    case ']':
+        if (m_token != StartArray)
+        {
+            raiseError("expected a value");
+            return m_token;
+        }
+        m_pos++;
+        m_stack.chop(1);
+        m_expect = m_stack.isEmpty() ? ExpectNothing : ExpectComma;
+        return m_token = EndArray;
+    case '"':
+        if (!scanString()) return m_token;
+        token = String;
+        break;
+    case 't':
+        if (!scanLiteral("true", 4)) return m_token;
+        token = Bool;
+        break;
+    case 'f':
+        if (!scanLiteral("false", 5)) return m_token;
+        token = Bool;
+        break;
+    case 'n':
+        if (!scanLiteral("null", 4)) return m_token;
+        token = Null;
+        break;
+    default:
+        if (c != '-' && (c < '0' || c > '9'))
+        {
+            raiseError("expected a value");
+            return m_token;
+        }
+        if (!scanNumber()) return m_token;
+        token = Number;
+        break;
+    }
+    m_expect = context == TopLevel ? ExpectNothing : ExpectComma;
+    return m_token = token;
+}
+
+QString QxtJSONReader::decodeString() const
+{
+    if (!m_escaped)
+        return QString::fromUtf8(m_tokenStart, int(m_tokenEnd - m_tokenStart));
+    QString result;
+    result.reserve(int(m_tokenEnd - m_tokenStart));
+    const char* run = m_tokenStart;
+    const char* p = m_tokenStart;
+    while (p < m_tokenEnd)
+    {
+        if (*p != '\\')
+        {
+            p++;
+            continue;
+        }
+        if (p > run)
+            result.append(QString::fromUtf8(run, int(p - run)));
+        p++;
+        switch (*p)
+        {
+        case 'b': result.append(QLatin1Char('\b')); break;
+        case 'f': result.append(QLatin1Char('\f')); break;
+        case 'n': result.append(QLatin1Char('\n')); break;
+        case 'r': result.append(QLatin1Char('\r')); break;
+        case 't': result.append(QLatin1Char('\t')); break;
+        case 'u':
+            // Surrogate pairs arrive as two escapes and combine in the QString
+            result.append(QChar(ushort((qxtHexValue(p[1]) << 12) | (qxtHexValue(p[2]) << 8) | (qxtHexValue(p[3]) << 4) | qxtHexValue(p[4]))));
+            p += 4;
+            break;
+        default:
+            result.append(QLatin1Char(*p));
+            break;
+        }
+        run = ++p;
+    }
+    if (p > run)
+        result.append(QString::fromUtf8(run, int(p - run)));
+    return result;
+}
+
+/*!
+ * Returns the decoded text of the current Name or String token, and an
+ * empty string for other tokens.
+ */
+QString QxtJSONReader::text() const
+{
+    if (m_token != Name && m_token != String) return QString();
+    return decodeString();
+}
+
+/*!
+ * Returns the value of the current Bool token.
+ */
+bool QxtJSONReader::boolValue() const
+{
+    return m_token == Bool && *m_tokenStart == 't';
+}
+
+/*!
+ * Returns true if the current token is a Number without a fraction or
+ * exponent that fits into a qint64.
+ */
+bool QxtJSONReader::isInteger() const
+{
+    return m_token == Number && m_integer;
+}
+
+/*!
+ * Returns the value of the current Number token if isInteger() is true,
+ * otherwise the value truncated towards zero.
+ */
+qint64 QxtJSONReader::integerValue() const
+{
+    if (m_token != Number) return 0;
+    if (m_integer) return m_integerValue;
+    return qint64(doubleValue());
+}
+
+/*!
+ * Returns the value of the current Number token as a double.
+ */
+double QxtJSONReader::doubleValue() const
+{
+    if (m_token != Number) return 0;
+    if (m_integer) return double(m_integerValue);
+    return QByteArray::fromRawData(m_tokenStart, int(m_tokenEnd - m_tokenStart)).toDouble();
+}
+
+/*!
+ * Returns the value of the current token. Strings and names are returned as
+ * QString, integers as int when they fit and qlonglong otherwise, other
+ * numbers as double and \c true and \c false as bool. A null QVariant is
+ * returned for every other token.
+ */
+QVariant QxtJSONReader::value() const
+{
+    switch (m_token)
+    {
+    case Name:
+    case String:
+        return decodeString();
+    case Number:
+        if (!m_integer) return doubleValue();
+        if (m_integerValue >= INT_MIN && m_integerValue <= INT_MAX) return int(m_integerValue);
+        return qlonglong(m_integerValue);
+    case Bool:
+        return boolValue();
+    default:
+        return QVariant();
+    }
+}
+
+/*!
+ * Reads the next value, including everything nested in it, and returns it
+ * as a QVariant: objects become QVariantMap and arrays QVariantList. A null
+ * QVariant is returned on error and for a JSON \c null.
+ *
+ * \sa skipValue()
+ */
+QVariant QxtJSONReader::readValue()
+{
+    switch (readNext())
+    {
+    case StartObject:
+    case StartArray:
+        return readContainer();
+    case String:
+    case Number:
+    case Bool:
+    case Null:
+        return value();
+    case Invalid:
+        return QVariant();
+    default:
+        raiseError("expected a value");
+        return QVariant();
+    }
+}
+
+QVariant QxtJSONReader::readContainer()
+{
+    if (m_token == StartArray)
+    {
+        QVariantList list;
+        for (;;)
+        {
+            switch (readNext())
+            {
+            case EndArray:
+                return list;
+            case StartObject:
+            case StartArray:
+                list.append(readContainer());
+                break;
+            case String:
+            case Number:
+            case Bool:
+            case Null:
+                list.append(value());
+                break;
+            default:
+                return QVariant();
+            }
+        }
+    }
+    QVariantMap map;
+    for (;;)
+    {
+        TokenType token = readNext();
+        if (token == EndObject) return map;
+        if (token != Name) return QVariant();
+        QString key = decodeString();
+        QVariant member;
+        switch (readNext())
+        {
+        case StartObject:
+        case StartArray:
+            member = readContainer();
+            break;
+        case String:
+        case Number:
+        case Bool:
+        case Null:
+            member = value();
+            break;
+        default:
+            return QVariant();
+        }
+        // Members written by QxtJSON are sorted, which makes the hint exact
+        map.insert(map.constEnd(), key, member);
+    }
+}
+
+/*!
+ * Skips the next value, including everything nested in it, without
+ * decoding it.
+ *
+ * \sa readValue()
+ */
+void QxtJSONReader::skipValue()
+{
+    TokenType token = readNext();
+    if (token != StartObject && token != StartArray) return;
+    int level = m_stack.size();
+    while (m_stack.size() >= level)
+    {
+        if (readNext() == Invalid) return;
+    }
+}
@@ -0,0 +1,114 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTJSONREADER_H
+#define QXTJSONREADER_H
+
+#include "qxtglobal.h"
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+
+class QXT_CORE_EXPORT QxtJSONReader
+{
+public:
+    enum TokenType
+    {
+        NoToken,
+        Invalid,
+        StartObject,
+        EndObject,
+        StartArray,
+        EndArray,
+        Name,
+        String,
+        Number,
+        Bool,
+        Null,
+        EndDocument
+    };
+
+    enum { MaximumDepth = 512 };
+
+    QxtJSONReader();
+    explicit QxtJSONReader(const QByteArray& data);
+
+    void setData(const QByteArray& data);
+    QByteArray data() const;
+
+    TokenType readNext();
+    TokenType tokenType() const;
+    bool atEnd() const;
+    int depth() const;
+
+    bool hasError() const;
+    QString errorString() const;
+    int errorOffset() const;
+
+    QString text() const;
+    bool boolValue() const;
+    bool isInteger() const;
+    qint64 integerValue() const;
+    double doubleValue() const;
+    QVariant value() const;
+
+    QVariant readValue();
+    void skipValue();
+
+private:
+    enum Context { TopLevel, InObject, InArray };
+    enum Expect { ExpectValue, ExpectName, ExpectColon, ExpectComma, ExpectNothing };
+
+    void raiseError(const char* message);
+    void skipWhitespace();
+    bool scanString();
+    bool scanNumber();
+    bool scanLiteral(const char* literal, int length);
+    QString decodeString() const;
+    QVariant readContainer();
+
+    QByteArray m_data;
+    const char* m_begin;
+    const char* m_end;
+    const char* m_pos;
+    const char* m_tokenStart;
+    const char* m_tokenEnd;
+    bool m_escaped;
+    bool m_integer;
+    qint64 m_integerValue;
+    TokenType m_token;
+    Expect m_expect;
+    QByteArray m_stack;             // one Context per open container
+    const char* m_error;
+    int m_errorOffset;
+};
+
+#endif // QXTJSONREADER_H
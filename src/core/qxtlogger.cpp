@@ -136,12 +136,97 @@
 #include <QMutex>
 #include <QMutexLocker>
 
+QAtomicPointer<QxtLoggerPrivate> QxtLoggerPrivate::instance;
+
+/*******************************************************************************
+QxtLogQueue
+*******************************************************************************/
+QxtLogQueue::QxtLogQueue(int capacity)
+{
+    quintptr size = 2;
+    while (size < quintptr(capacity))
+        size <<= 1;
+    cells = new Cell[size];
+    for (quintptr i = 0; i < size; i++)
+        cells[i].sequence.store(i);
+    mask = size - 1;
+}
+
+QxtLogQueue::~QxtLogQueue()
+{
+    delete[] cells;
+}
+
+bool QxtLogQueue::push(QxtLogger::LogLevel level, const QList<QVariant>& args)
+{
+    Cell* cell;
+    quintptr pos = enqueuePos.load();
+    for (;;)
+    {
+        cell = &cells[pos & mask];
+        qintptr diff = qintptr(cell->sequence.loadAcquire()) - qintptr(pos);
+        if (diff == 0)
+        {
+            if (enqueuePos.testAndSetRelaxed(pos, pos + 1)) break;
+            pos = enqueuePos.load();
+        }
+        else if (diff < 0)
+        {
+            return false;   // the consumer has not freed this cell yet: full
+        }
+        else
+        {
+            pos = enqueuePos.load();
+        }
+    }
+    cell->level = level;
+    cell->args = args;
+    cell->sequence.storeRelease(pos + 1);
+    return true;
+}
+
+bool QxtLogQueue::pop(QxtLogger::LogLevel* level, QList<QVariant>* args)
+{
+    quintptr pos = dequeuePos.load();
+    Cell* cell = &cells[pos & mask];
+    if (qintptr(cell->sequence.loadAcquire()) - qintptr(pos + 1) < 0) return false;
+    *level = cell->level;
+    args->swap(cell->args);
+    cell->args.clear();
+    cell->sequence.storeRelease(pos + mask + 1);
+    dequeuePos.storeRelease(pos + 1);
+    return true;
+}
+
+int QxtLogQueue::capacity() const
+{
+    return int(mask + 1);
+}
+
+int QxtLogQueue::count() const
+{
+    return int(enqueuePos.load() - dequeuePos.loadAcquire());
+}
+
+quintptr QxtLogQueue::pushed() const
+{
+    return enqueuePos.load();
+}
+
+void QxtLogWriter::run()
+{
+    logger->drain();
+}
+
 /*******************************************************************************
 Constructor for QxtLogger's private data
 *******************************************************************************/
 QxtLoggerPrivate::QxtLoggerPrivate()
+    : queue(new QxtLogQueue(DefaultQueueCapacity)), writer(0),
+      overflowPolicy(QxtLogger::BlockOnOverflow), stopping(false)
 {
     mut_lock = new QMutex(QMutex::Recursive);
+    startWriter();
 }
 
 /*******************************************************************************
@@ -149,6 +234,9 @@ Destructor for QxtLogger's private data
 *******************************************************************************/
 QxtLoggerPrivate::~QxtLoggerPrivate()
 {
+    instance.store(0);
+    stopWriter();
+    delete queue;
     Q_FOREACH(QxtLoggerEngine *eng, map_logEngineMap)
     {
         if (eng)
@@ -172,6 +260,160 @@ void QxtLoggerPrivate::log(QxtLogger::LogLevel level, const QList<QVariant>& msg
     }
 }
 
+/*******************************************************************************
+Recomputes the levels any engine is interested in. Called with mut_lock held
+whenever engines or their levels change.
+*******************************************************************************/
+void QxtLoggerPrivate::updateLevels()
+{
+    static const QxtLogger::LogLevel levels[] =
+    {
+        QxtLogger::TraceLevel, QxtLogger::DebugLevel, QxtLogger::InfoLevel, QxtLogger::WarningLevel,
+        QxtLogger::ErrorLevel, QxtLogger::CriticalLevel, QxtLogger::FatalLevel, QxtLogger::WriteLevel
+    };
+    int mask = 0;
+    QMutexLocker lock(mut_lock);
+    Q_FOREACH(QxtLoggerEngine *eng, map_logEngineMap)
+    {
+        if (!eng || !eng->isLoggingEnabled()) continue;
+        for (int i = 0; i < 8; i++)
+        {
+            if (eng->isLogLevelEnabled(levels[i])) mask |= levels[i];
+        }
+    }
+    enabledLevels.storeRelease(mask);
+}
+
+/*******************************************************************************
+Called by QxtLoggerEngine when its levels or its enabled state change. The
+logger is not registered until it is fully constructed, so engines created
+by the constructor do not reenter getInstance().
+*******************************************************************************/
+void QxtLoggerPrivate::levelsChanged()
+{
+    QxtLoggerPrivate* d = instance.loadAcquire();
+    if (d) d->updateLevels();
+}
+
+/*******************************************************************************
+Queues a message for the writer thread. Messages logged by the writer thread
+itself, from inside an engine, are written right away.
+*******************************************************************************/
+void QxtLoggerPrivate::enqueue(QxtLogger::LogLevel level, const QList<QVariant>& args)
+{
+    if (QThread::currentThread() == writer)
+    {
+        QMutexLocker lock(mut_lock);
+        log(level, args);
+        return;
+    }
+    while (!queue->push(level, args))
+    {
+        if (overflowPolicy == QxtLogger::DropOnOverflow)
+        {
+            dropped.fetchAndAddRelaxed(1);
+            return;
+        }
+        wakeWriter();
+        QThread::yieldCurrentThread();
+    }
+    wakeWriter();
+}
+
+void QxtLoggerPrivate::wakeWriter()
+{
+    // Only the producer that finds the writer asleep pays for the mutex.
+    if (sleeping.testAndSetOrdered(1, 0))
+    {
+        QMutexLocker lock(&writerLock);
+        wakeup.wakeOne();
+    }
+}
+
+void QxtLoggerPrivate::startWriter()
+{
+    stopping = false;
+    writer = new QxtLogWriter(this);
+    writer->start(QThread::LowPriority);
+}
+
+void QxtLoggerPrivate::stopWriter()
+{
+    if (!writer) return;
+    writerLock.lock();
+    stopping = true;
+    wakeup.wakeOne();
+    writerLock.unlock();
+    writer->wait();
+    delete writer;
+    writer = 0;
+}
+
+/*******************************************************************************
+Blocks until everything queued before the call has been handed to the engines.
+*******************************************************************************/
+void QxtLoggerPrivate::flush()
+{
+    if (!writer || QThread::currentThread() == writer) return;
+    quintptr target = queue->pushed();
+    QMutexLocker lock(&writerLock);
+    while (qintptr(written.loadAcquire() - target) < 0)
+    {
+        sleeping.store(0);
+        wakeup.wakeOne();
+        flushed.wait(&writerLock, 100);
+    }
+}
+
+/*******************************************************************************
+The writer thread. Messages are written in batches so that mut_lock is taken
+once per batch rather than once per message.
+*******************************************************************************/
+void QxtLoggerPrivate::drain()
+{
+    QxtLogger::LogLevel level;
+    QList<QVariant> args;
+    forever
+    {
+        int count = 0;
+        if (queue->pop(&level, &args))
+        {
+            QMutexLocker lock(mut_lock);
+            do
+            {
+                log(level, args);
+                args.clear();
+                count++;
+            }
+            while (count < WriteBatchSize && queue->pop(&level, &args));
+            // the queue ran dry: let engines that batch their output write it
+            if (queue->count() == 0)
+            {
+                Q_FOREACH(QxtLoggerEngine *eng, map_logEngineMap)
+                {
+                    if (eng && eng->isInitialized()) eng->flushLoggerEngine();
+                }
+            }
+        }
+        QMutexLocker lock(&writerLock);
+        if (count)
+        {
+            written.fetchAndAddRelease(count);
+            flushed.wakeAll();
+            continue;
+        }
+        sleeping.fetchAndStoreOrdered(1);
+        if (queue->count() > 0)
+        {
+            sleeping.store(0);
+            continue;
+        }
+        if (stopping) break;
+        wakeup.wait(&writerLock, 1000);
+        sleeping.store(0);
+    }
+}
+
 void QxtLoggerPrivate::setQxtLoggerEngineMinimumLevel(QxtLoggerEngine *eng, QxtLogger::LogLevel level)
 {
     QMutexLocker lock(mut_lock);
@@ -290,7 +532,7 @@ QxtLogStream QxtLogger::write()
 */
 void QxtLogger::info(const QVariant &message, const QVariant &msg1, const QVariant &msg2, const QVariant &msg3, const QVariant &msg4, const QVariant &msg5, const QVariant &msg6, const QVariant &msg7, const QVariant &msg8 , const QVariant &msg9)
 {
-    QMutexLocker lock(qxt_d().mut_lock);
+    if (!(qxt_d().enabledLevels.loadAcquire() & QxtLogger::InfoLevel)) return;
     QList<QVariant> args;
     args.push_back(message);
     if (!msg1.isNull()) args.push_back(msg1);
@@ -314,7 +556,7 @@ void QxtLogger::info(const QVariant &message, const QVariant &msg1, const QVaria
 */
 void QxtLogger::trace(const QVariant &message, const QVariant &msg1 , const QVariant &msg2 , const QVariant &msg3 , const QVariant &msg4 , const QVariant &msg5 , const QVariant &msg6 , const QVariant &msg7 , const QVariant &msg8 , const QVariant &msg9)
 {
-    QMutexLocker lock(qxt_d().mut_lock);
+    if (!(qxt_d().enabledLevels.loadAcquire() & QxtLogger::TraceLevel)) return;
     QList<QVariant> args;
     args.push_back(message);
     if (!msg1.isNull()) args.push_back(msg1);
@@ -337,7 +579,7 @@ void QxtLogger::trace(const QVariant &message, const QVariant &msg1 , const QVar
 */
 void QxtLogger::warning(const QVariant &message, const QVariant &msg1 , const QVariant &msg2 , const QVariant &msg3 , const QVariant &msg4 , const QVariant &msg5 , const QVariant &msg6 , const QVariant &msg7 , const QVariant &msg8 , const QVariant &msg9)
 {
-    QMutexLocker lock(qxt_d().mut_lock);
+    if (!(qxt_d().enabledLevels.loadAcquire() & QxtLogger::WarningLevel)) return;
     QList<QVariant> args;
     args.push_back(message);
     if (!msg1.isNull()) args.push_back(msg1);
@@ -360,7 +602,7 @@ void QxtLogger::warning(const QVariant &message, const QVariant &msg1 , const QV
 */
 void QxtLogger::error(const QVariant &message, const QVariant &msg1 , const QVariant &msg2 , const QVariant &msg3 , const QVariant &msg4 , const QVariant &msg5 , const QVariant &msg6 , const QVariant &msg7 , const QVariant &msg8 , const QVariant &msg9)
 {
-    QMutexLocker lock(qxt_d().mut_lock);
+    if (!(qxt_d().enabledLevels.loadAcquire() & QxtLogger::ErrorLevel)) return;
     QList<QVariant> args;
     args.push_back(message);
     if (!msg1.isNull()) args.push_back(msg1);
@@ -383,7 +625,7 @@ void QxtLogger::error(const QVariant &message, const QVariant &msg1 , const QVar
 */
 void QxtLogger::debug(const QVariant &message, const QVariant &msg1 , const QVariant &msg2 , const QVariant &msg3 , const QVariant &msg4 , const QVariant &msg5 , const QVariant &msg6 , const QVariant &msg7 , const QVariant &msg8 , const QVariant &msg9)
 {
-    QMutexLocker lock(qxt_d().mut_lock);
+    if (!(qxt_d().enabledLevels.loadAcquire() & QxtLogger::DebugLevel)) return;
     QList<QVariant> args;
     args.push_back(message);
     if (!msg1.isNull()) args.push_back(msg1);
@@ -406,7 +648,7 @@ void QxtLogger::debug(const QVariant &message, const QVariant &msg1 , const QVar
 */
 void QxtLogger::write(const QVariant &message, const QVariant &msg1 , const QVariant &msg2, const QVariant &msg3 , const QVariant &msg4 , const QVariant &msg5 , const QVariant &msg6 , const QVariant &msg7 , const QVariant &msg8 , const QVariant &msg9)
 {
-    QMutexLocker lock(qxt_d().mut_lock);
+    if (!(qxt_d().enabledLevels.loadAcquire() & QxtLogger::WriteLevel)) return;
     QList<QVariant> args;
     args.push_back(message);
     if (!msg1.isNull()) args.push_back(msg1);
@@ -429,7 +671,7 @@ void QxtLogger::write(const QVariant &message, const QVariant &msg1 , const QVar
 */
 void QxtLogger::critical(const QVariant &message, const QVariant &msg1 , const QVariant &msg2 , const QVariant &msg3 , const QVariant &msg4 , const QVariant &msg5 , const QVariant &msg6 , const QVariant &msg7 , const QVariant &msg8 , const QVariant &msg9)
 {
-    QMutexLocker lock(qxt_d().mut_lock);
+    if (!(qxt_d().enabledLevels.loadAcquire() & QxtLogger::CriticalLevel)) return;
     QList<QVariant> args;
     args.push_back(message);
     if (!msg1.isNull()) args.push_back(msg1);
@@ -452,7 +694,7 @@ void QxtLogger::critical(const QVariant &message, const QVariant &msg1 , const Q
 */
 void QxtLogger::fatal(const QVariant &message, const QVariant &msg1 , const QVariant &msg2 , const QVariant &msg3 , const QVariant &msg4 , const QVariant &msg5 , const QVariant &msg6 , const QVariant &msg7 , const QVariant &msg8 , const QVariant &msg9)
 {
-    QMutexLocker lock(qxt_d().mut_lock);
+    if (!(qxt_d().enabledLevels.loadAcquire() & QxtLogger::FatalLevel)) return;
     QList<QVariant> args;
     args.push_back(message);
     if (!msg1.isNull()) args.push_back(msg1);
@@ -546,11 +788,8 @@ void QxtLogger::write(const QList<QVariant> &args)
 */
 void QxtLogger::log(LogLevel level, const QList<QVariant>& args)
 {
-    /*
-    QMutexLocker lock(qxt_d().mut_lock);
-    qxt_d().log(level, msgList);
-    */
-    QMetaObject::invokeMethod(&qxt_d(), "log", Qt::AutoConnection, Q_ARG(QxtLogger::LogLevel, level), Q_ARG(QList<QVariant>, args));
+    if (!(qxt_d().enabledLevels.loadAcquire() & level)) return;
+    qxt_d().enqueue(level, args);
 }
 
 /*******************************************************************************
@@ -583,6 +822,7 @@ void QxtLoggerMessageHandler(QtMsgType type, const char *msg)
         break;
     case QtFatalMsg:
         QxtLogger::getInstance()->fatal(msg, "qfatal");
+        QxtLogger::getInstance()->flush();
         abort();
     }
 }
@@ -622,6 +862,8 @@ QxtLogger::QxtLogger()
     qRegisterMetaType<QxtLogger::LogLevels>();
     addLoggerEngine("DEFAULT", new QxtBasicSTDLoggerEngine);
     setMinimumLevel("DEFAULT", QxtLogger::InfoLevel);
+    qxt_d().updateLevels();
+    QxtLoggerPrivate::instance.storeRelease(&qxt_d());
 }
 
 /***************************************************************************//*!
@@ -739,6 +981,8 @@ void QxtLogger::enableLogLevels(LogLevels levels)
 */
 QxtLogStream QxtLogger::stream(LogLevel level)
 {
+    // a stream for a level nobody logs collects nothing
+    if (!(qxt_d().enabledLevels.loadAcquire() & level)) return QxtLogStream(0, level, QList<QVariant>());
     return QxtLogStream(this, level, QList<QVariant>());
 }
 
@@ -971,6 +1215,7 @@ void QxtLogger::addLoggerEngine(const QString &engineName, QxtLoggerEngine *engi
     if (!qxt_d().map_logEngineMap.contains(engineName) && engine)
     {
         qxt_d().map_logEngineMap.insert(engineName, engine);
+        qxt_d().updateLevels();
         emit loggerEngineAdded(engineName);
     }
 }
@@ -1042,6 +1287,7 @@ QxtLoggerEngine *QxtLogger::takeLoggerEngine(const QString &engineName)
     QMutexLocker lock(qxt_d().mut_lock);
     QxtLoggerEngine *eng = qxt_d().map_logEngineMap.take(engineName);
     if (!eng) return NULL;
+    qxt_d().updateLevels();
     emit loggerEngineRemoved(engineName);
     return eng;
 }
@@ -1121,3 +1367,83 @@ bool QxtLogger::isLoggerEngineEnabled(const QString &engineName) const
     QMutexLocker lock(qxt_d().mut_lock);
     return (qxt_d().map_logEngineMap.contains(engineName) && qxt_d().map_logEngineMap.value(engineName)->isLoggingEnabled());
 }
+
+/*! \brief Checks if any enabled Engine has the given LogLevel enabled.
+    This check is cheap; use it to skip building expensive log messages.
+    \code
+    if (qxtLog->isLogLevelEnabled(QxtLogger::DebugLevel))
+        qxtLog->debug(dumpState());
+    \endcode
+    Returns true or false.
+*/
+bool QxtLogger::isLogLevelEnabled(LogLevel level) const
+{
+    return qxt_d().enabledLevels.loadAcquire() & level;
+}
+
+/*! \brief Returns the number of messages the queue can hold.
+    Messages are queued and written to the Engines by a dedicated writer thread,
+    so logging never waits for an Engine. The default capacity is 8192 messages.
+    \sa setQueueCapacity(), overflowPolicy()
+*/
+int QxtLogger::queueCapacity() const
+{
+    return qxt_d().queue->capacity();
+}
+
+/*! \brief Sets the number of messages the queue can hold to \a capacity.
+    The capacity is rounded up to a power of two. Messages already queued are
+    written first. Do not log from other threads while the capacity is changed.
+    \sa queueCapacity()
+*/
+void QxtLogger::setQueueCapacity(int capacity)
+{
+    if (capacity < 2 || capacity == queueCapacity()) return;
+    qxt_d().stopWriter();
+    delete qxt_d().queue;
+    qxt_d().queue = new QxtLogQueue(capacity);
+    qxt_d().written.store(0);
+    qxt_d().startWriter();
+}
+
+/*! \brief Returns what happens to messages logged while the queue is full.
+    The default is QxtLogger::BlockOnOverflow.
+    \sa setOverflowPolicy()
+*/
+QxtLogger::OverflowPolicy QxtLogger::overflowPolicy() const
+{
+    return qxt_d().overflowPolicy;
+}
+
+/*! \brief Sets what happens to messages logged while the queue is full to \a policy.
+    With QxtLogger::DropOnOverflow the message is discarded and counted by
+    droppedMessageCount(); with QxtLogger::BlockOnOverflow the logging thread
+    waits until the writer thread has made room.
+*/
+void QxtLogger::setOverflowPolicy(OverflowPolicy policy)
+{
+    qxt_d().overflowPolicy = policy;
+}
+
+/*! \brief Returns the number of messages discarded because the queue was full.
+    \sa setOverflowPolicy()
+*/
+qint64 QxtLogger::droppedMessageCount() const
+{
+    return qxt_d().dropped.load();
+}
+
+/*! \brief Returns the number of messages waiting to be written to the Engines.
+*/
+int QxtLogger::queuedMessageCount() const
+{
+    return qxt_d().queue->count();
+}
+
+/*! \brief Blocks until all messages logged so far have been written to the Engines.
+    QxtLogger calls this before aborting on qFatal().
+*/
+void QxtLogger::flush()
+{
+    qxt_d().flush();
+}
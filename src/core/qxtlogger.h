@@ -74,6 +74,12 @@ public:
     };
     Q_DECLARE_FLAGS(LogLevels, LogLevel)
 
+    enum OverflowPolicy
+    {
+        DropOnOverflow,         /**< Messages logged while the queue is full are discarded */
+        BlockOnOverflow         /**< Logging waits until the queue has room */
+    };
+
     /* Sone useful things */
     static QString logLevelToString(LogLevel level);
     static QxtLogger::LogLevel stringToLogLevel(const QString& level);
@@ -102,6 +108,18 @@ public:
     bool   isLogLevelEnabled(const QString& engineName, LogLevel level) const;
     bool   isLoggerEngine(const QString& engineName) const;
     bool   isLoggerEngineEnabled(const QString& engineName) const;
+    bool   isLogLevelEnabled(LogLevel level) const;
+
+    /*******************************************************************************
+    Messages are queued and written by a writer thread.
+    *******************************************************************************/
+    int queueCapacity() const;
+    void setQueueCapacity(int capacity);
+    OverflowPolicy overflowPolicy() const;
+    void setOverflowPolicy(OverflowPolicy policy);
+    qint64 droppedMessageCount() const;
+    int queuedMessageCount() const;
+    void flush();
 
     /*******************************************************************************
     Streaming!
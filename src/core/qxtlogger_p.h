@@ -34,24 +34,104 @@
 
 #include "qxtlogger.h"
 #include <QHash>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+
+/*******************************************************************************
+    QxtLogQueue
+    A bounded ring buffer that any number of threads push messages into
+    without taking a lock; only the writer thread pops. Every cell carries a
+    sequence number telling producers and the consumer whose turn it is.
+*******************************************************************************/
+class QxtLogQueue
+{
+public:
+    explicit QxtLogQueue(int capacity);
+    ~QxtLogQueue();
+
+    bool push(QxtLogger::LogLevel level, const QList<QVariant>& args);
+    bool pop(QxtLogger::LogLevel* level, QList<QVariant>* args);
+
+    int capacity() const;
+    int count() const;
+    quintptr pushed() const;
+
+private:
+    Q_DISABLE_COPY(QxtLogQueue)
+
+    struct Cell
+    {
+        QAtomicInteger<quintptr> sequence;
+        QxtLogger::LogLevel level;
+        QList<QVariant> args;
+    };
+    Cell* cells;
+    quintptr mask;
+    QAtomicInteger<quintptr> enqueuePos;
+    char padding[64];               // keeps producers and the consumer off one cache line
+    QAtomicInteger<quintptr> dequeuePos;
+};
+
+class QxtLogWriter : public QThread
+{
+public:
+    QxtLogWriter(QxtLoggerPrivate* logger) : logger(logger) {}
+
+protected:
+    void run();
+
+private:
+    QxtLoggerPrivate* logger;
+};
 
 /*******************************************************************************
     QxtLoggerPrivate
     This is the d_ptr private class containing the actual data this library
     works with.
 *******************************************************************************/
-QT_FORWARD_DECLARE_CLASS(QMutex)
 class QxtLoggerPrivate : public QObject, public QxtPrivate<QxtLogger>
 {
     Q_OBJECT
     QXT_DECLARE_PUBLIC(QxtLogger)
 public:
+    enum { DefaultQueueCapacity = 8192, WriteBatchSize = 256 };
+
     QxtLoggerPrivate();
     ~QxtLoggerPrivate();
     void setQxtLoggerEngineMinimumLevel(QxtLoggerEngine *engine, QxtLogger::LogLevel level);
     QHash<QString, QxtLoggerEngine*> map_logEngineMap;
     QMutex* mut_lock;
 
+    // Levels logged by at least one enabled engine. Messages of any other
+    // level are discarded before they are queued.
+    QAtomicInt enabledLevels;
+    void updateLevels();
+    static void levelsChanged();
+    static QAtomicPointer<QxtLoggerPrivate> instance;
+
+    QxtLogQueue* queue;
+    QxtLogWriter* writer;
+    QxtLogger::OverflowPolicy overflowPolicy;
+    QAtomicInteger<qint64> dropped;
+    QAtomicInteger<quintptr> written;   // messages handed to the engines
+
+    QMutex writerLock;
+    QWaitCondition wakeup;              // the writer waits here while the queue is empty
+    QWaitCondition flushed;             // flush() waits here
+    QAtomicInt sleeping;
+    bool stopping;
+
+    void enqueue(QxtLogger::LogLevel level, const QList<QVariant>& args);
+    void wakeWriter();
+    void startWriter();
+    void stopWriter();
+    void flush();
+    void drain();
+
 public Q_SLOTS:
     void log(QxtLogger::LogLevel, const QList<QVariant>&);
 };
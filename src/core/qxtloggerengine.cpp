@@ -30,6 +30,7 @@
 *****************************************************************************/
 
 #include "qxtloggerengine.h"
+#include "qxtlogger_p.h"
 
 /*! \class QxtLoggerEngine
     \brief The QxtLoggerEngine class is the parent class of all extended Engine Plugins.
@@ -105,6 +106,17 @@ QxtLoggerEngine::~QxtLoggerEngine()
     This function is called by QxtLogger. Reimplement this function when creating a subclass of QxtLoggerEngine.
  */
 
+/*!
+    Writes out anything the engine has buffered.
+
+    QxtLogger calls this function whenever it has no more messages queued, so
+    engines that batch their output can write it while the logger is idle.
+    The default implementation does nothing.
+ */
+void QxtLoggerEngine::flushLoggerEngine()
+{
+}
+
 /*!
     Returns \c true if logging is enabled and \c false otherwise.
  */
@@ -135,6 +147,7 @@ void QxtLoggerEngine::disableLogging()
 void QxtLoggerEngine::setLoggingEnabled(bool enable)
 {
     qxt_d().b_isLogging = enable;
+    QxtLoggerPrivate::levelsChanged();
 }
 
 /*!
@@ -150,6 +163,7 @@ void QxtLoggerEngine::setLogLevelsEnabled(QxtLogger::LogLevels levels, bool enab
     {
         qxt_d().bm_logLevel &= ~levels;
     }
+    QxtLoggerPrivate::levelsChanged();
 }
 
 /*!
@@ -53,6 +53,7 @@ public:
     virtual bool    isInitialized() const = 0;
 
     virtual void    writeFormatted(QxtLogger::LogLevel level, const QList<QVariant>& messages) = 0;
+    virtual void    flushLoggerEngine();
 
     virtual void    setLoggingEnabled(bool enable = true);
     bool            isLoggingEnabled() const;
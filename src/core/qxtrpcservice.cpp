@@ -35,6 +35,7 @@
 #include "qxtdatastreamsignalserializer.h"
 #include "qxtmetaobject.h"
 #include "qxtboundfunction.h"
+#include "qxtsignalwaiter.h"
 #include <QIODevice>
 #include <QtDebug>
 #include <QMetaObject>
@@ -45,9 +46,18 @@
 #include <QString>
 #include <QByteArray>
 #include <QPair>
+#include <QThread>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <limits.h>
 
 static bool qxt_rpcservice_debug = false;
 
+// Function names reserved for requests and their responses.
+static const char qxt_rpc_reserved_prefix[] = "QxtRPCService::";
+static const char qxt_rpc_request[] = "QxtRPCService::request";
+static const char qxt_rpc_response[] = "QxtRPCService::response";
+
 /*!
  * \class QxtRPCService
  * \inmodule QxtCore
@@ -68,6 +78,37 @@ static bool qxt_rpcservice_debug = false;
  * Due to a restriction of Qt's signals and slots mechanism, the number of parameters that can be passed to call() and
  * its related functions, as well as the number of parameters to any signal or slot attached to QxtRPCService, is
  * limited to 8.
+ *
+ * When acting as a server, a call sent to several clients is encoded once and the same frame is shared by all of
+ * them. Frames that do not fit into a client's write buffer wait in a per-client queue. A client that falls further
+ * behind than highWaterMark() either misses calls or is disconnected, depending on highWaterPolicy().
+ *
+ * Besides fire-and-forget calls, QxtRPCService can send requests that expect an answer. request() returns a
+ * QxtRPCReply that finishes when the peer has responded. The request is answered by the first slot attached to the
+ * function, and the slot's return value becomes the reply's result:
+ *
+ * \code
+ * int Calculator::add(int a, int b) { return a + b; }
+ *
+ * server.attachSlot("add", calculator, SLOT(add(quint64, int, int)));
+ *
+ * QxtRPCReply* reply = client.request("add", 2, 3);
+ * connect(reply, SIGNAL(finished()), this, SLOT(added()));
+ * \endcode
+ *
+ * Every request carries an ID and its response is matched to it on the same connection, so any number of requests
+ * can be in flight at once and the responses may arrive in any order. Each request can be given a timeout and can be
+ * canceled; see QxtRPCReply. The round-trip times of answered requests are collected per function in
+ * latencyHistogram().
+ */
+
+/*!
+ * \enum QxtRPCService::HighWaterPolicy
+ *
+ * This enum describes what happens to a client whose backlog of unsent data would exceed highWaterMark().
+ *
+ * \value DropOnHighWater       The call is not sent to that client. droppedCallCount() is incremented.
+ * \value DisconnectOnHighWater The client is disconnected after the call has been sent to the other clients.
  */
 
 /*
@@ -254,203 +295,784 @@ int QxtRPCServiceIntrospector::qt_metacall(QMetaObject::Call _c, int _id, void *
 }
 
 QxtRPCServicePrivate::QxtRPCServicePrivate()
-: QObject(NULL), manager(NULL), serializer(new QxtDataStreamSignalSerializer), device(NULL)
+: QObject(NULL), manager(NULL), serializer(new QxtDataStreamSignalSerializer), statefulSerializer(false),
+  serverSerializer(NULL), device(NULL), highWaterMark(0), highWaterPolicy(QxtRPCService::DropOnHighWater),
+  droppedCalls(0), nextRequestID(0), requestTimeout(0)
 {
     // The default serializer is a QxtDataStreamSerializer.
     fallbackSlot.recv = nullptr;
+    localWorker = new QxtRPCServiceWorker(this);
+    localWorker->setParent(this);
+
+    clock.start();
+    deadlineTimer.setSingleShot(true);
+    QObject::connect(&deadlineTimer, SIGNAL(timeout()), this, SLOT(expireRequests()));
 }
 
-void QxtRPCServicePrivate::clientConnected(QIODevice* dev, quint64 id)
+void QxtRPCServicePrivate::resetSerializers()
 {
-    // QxtMetaObject::bind() is a nice piece of magic that allows parameters to a slot to be defined in the connection.
-    QxtBoundFunction* clientDataArg = QxtMetaObject::bind(this, SLOT(clientData(quint64)), Q_ARG(quint64, id));
-    // save the arguments object for later release in clientDisconnected
-    clientsDataArgument.insert(id, clientDataArg);
+    QxtAbstractSignalSerializer* probe = serializer->clone();
+    statefulSerializer = (probe != NULL);
+    delete probe;
+
+    // Start every connection over with a fresh clone; the peers have to switch serializers at the same time anyway.
+    delete serverSerializer;
+    serverSerializer = device ? serializer->clone() : NULL;
+    localWorker->resetSerializers();
+    foreach(QxtRPCServiceWorker* worker, workers) {
+        if(worker)
+            QMetaObject::invokeMethod(worker, [worker]() { worker->resetSerializers(); }, Qt::QueuedConnection);
+    }
+}
+
+QString QxtRPCServicePrivate::normalizedName(const QString& fn)
+{
+    QHash<QString, QString>::const_iterator cached = normalizedNames.constFind(fn);
+    if(cached != normalizedNames.constEnd())
+        return *cached;
+
+    // Normalize the function name if it has the form of a signal or slot.
+    QString rv = fn;
+    QByteArray latin = fn.toLatin1();
+    if(QxtMetaObject::isSignalOrSlot(latin.constData()))
+        rv = QxtMetaObject::methodSignature(latin.constData());
+
+    // Callers normally use a small set of names; don't let arbitrary ones grow the cache without bound.
+    if(normalizedNames.count() < 1024)
+        normalizedNames.insert(fn, rv);
+    return rv;
+}
+
+QxtRPCServiceWorker* QxtRPCServicePrivate::workerFor(QThread* thread)
+{
+    if(thread == this->thread())
+        return localWorker;
+    for(int i = 0; i < workers.count(); i++) {
+        if(!workers.at(i)) {
+            // The worker went away with its thread.
+            workers.removeAt(i--);
+        } else if(workers.at(i)->thread() == thread) {
+            return workers.at(i);
+        }
+    }
+
+    // The first connection served by this thread; the worker lives as long as the thread does.
+    QxtRPCServiceWorker* worker = new QxtRPCServiceWorker(this);
+    worker->moveToThread(thread);
+    QObject::connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+    workers.append(worker);
+    return worker;
+}
 
-    QxtMetaObject::connect(dev, SIGNAL(readyRead()), clientDataArg);
+/*
+ * Connected directly to the manager's newConnection() signal, so this runs in the thread that added the connection,
+ * which is the thread serving the device. Only that thread may touch the device, so its identity is recorded here and
+ * the device is not dereferenced on the service's thread unless it lives there.
+ */
+void QxtRPCServicePrivate::connectionAdded(QIODevice* dev, quint64 id)
+{
+    QPointer<QThread> thread = QThread::currentThread();
+    if(thread == this->thread()) {
+        clientConnected(dev, id, thread);
+        return;
+    }
+    QMetaObject::invokeMethod(this, [this, dev, id, thread]() { clientConnected(dev, id, thread); }, Qt::QueuedConnection);
+}
+
+void QxtRPCServicePrivate::clientConnected(QIODevice* dev, quint64 id, const QPointer<QThread>& thread)
+{
+    // A connection announced from a worker thread may be gone by the time the announcement arrives. Only the
+    // pointers are compared; the device itself is left alone.
+    if(!thread || manager->client(id) != dev)
+        return;
+
+    // Hand the connection to the worker living in the device's thread.
+    QxtRPCServiceWorker* worker = workerFor(thread);
+    clientWorkers.insert(id, worker);
+    if(worker != localWorker) {
+        QMetaObject::invokeMethod(worker, [worker, dev, id]() {
+            worker->attach(dev, id);
+            worker->clientData(id);
+        }, Qt::QueuedConnection);
+        emit qxt_p().clientConnected(id);
+        return;
+    }
+
+    worker->attach(dev, id);
 
     // Inform other objects that a new client has connected.
     emit qxt_p().clientConnected(id);
 
-    // Initialize a new buffer for this connection.
-    buffers[id] = QByteArray();
-
     // If there's any unread data in the device, go ahead and process it up front.
     if(dev->bytesAvailable() > 0)
-        clientData(id);
+        worker->clientData(id);
 }
 
 void QxtRPCServicePrivate::clientDisconnected(QIODevice* dev, quint64 id)
 {
-    // When a device is disconnected, disconnect all signals connected to the object...
-    QObject::disconnect(dev, 0, this, 0);
-    QObject::disconnect(dev, 0, &qxt_p(), 0);
+    QxtRPCServiceWorker* worker = clientWorkers.take(id);
+    if(!worker)
+        return;
+    if(worker == localWorker) {
+        // When a device is disconnected, disconnect all signals connected to the object...
+        QObject::disconnect(dev, 0, this, 0);
+        QObject::disconnect(dev, 0, &qxt_p(), 0);
 
-    // ... remove its arguments object ...
-    QxtBoundFunction* clientDataArg = clientsDataArgument.take(id);
-    delete clientDataArg;
+        // ... remove its buffers and send queue...
+        worker->detach(id);
+    } else {
+        // The device belongs to another thread and may already be gone; the worker cleans up after it.
+        QMetaObject::invokeMethod(worker, [worker, id]() { worker->detach(id); }, Qt::QueuedConnection);
+    }
 
-    // ... remove its buffer object...
-    buffers.remove(id);
+    // ... fail the requests still waiting for it...
+    failReplies(id, QLatin1String("Client disconnected"));
 
     // ... and inform other objects that the disconnection has happened.
     emit qxt_p().clientDisconnected(id);
 }
 
-void QxtRPCServicePrivate::clientData(quint64 id)
+void QxtRPCServicePrivate::ReadBuffer::read(QIODevice* dev)
+{
+    if(offset == data.size()) {
+        // Everything has been consumed, so the new data can take the buffer's place without being copied.
+        data = dev->readAll();
+        offset = 0;
+        return;
+    }
+
+    // Only move the unread tail to the front once it is smaller than the consumed part; the bytes already consumed
+    // pay for the move.
+    if(offset > data.size() - offset) {
+        data.remove(0, offset);
+        offset = 0;
+    }
+    data.append(dev->readAll());
+}
+
+QByteArray QxtRPCServicePrivate::OutgoingCall::encode(QxtAbstractSignalSerializer* serializer) const
+{
+    return serializer->serialize(fn, params[0], params[1], params[2], params[3], params[4], params[5], params[6],
+            params[7]);
+}
+
+void QxtRPCServicePrivate::post(OutgoingCall& call)
 {
-    // Get the device from the connection manager.
-    QIODevice* dev = manager->client(id);
+    // Slots connected directly may call from a worker thread; the client tables belong to the service's thread.
+    if(QThread::currentThread() != thread()) {
+        OutgoingCall copy = call;
+        QMetaObject::invokeMethod(this, [this, copy]() mutable { post(copy); }, Qt::QueuedConnection);
+        return;
+    }
 
-    // Cache a reference to the buffer.
-    QByteArray& buf = buffers[id];
+    // Normalize the function name if it has the form of a signal or slot.
+    call.fn = normalizedName(call.fn);
+
+    if(call.target == OutgoingCall::Listed) {
+        // Split the receivers by the worker serving them.
+        QHash<QxtRPCServiceWorker*, QList<quint64> > receivers;
+        foreach(quint64 id, call.ids) {
+            QxtRPCServiceWorker* worker = clientWorkers.value(id);
+            if(!worker) {
+                qWarning() << "QxtRPCService::call: client ID not connected";
+                continue;
+            }
+            receivers[worker] << id;
+        }
+        if(receivers.isEmpty())
+            return;
+
+        // A stateless serializer encodes the call once for everyone.
+        if(!statefulSerializer)
+            call.frame = call.encode(serializer);
+        QHash<QxtRPCServiceWorker*, QList<quint64> >::const_iterator group = receivers.constBegin();
+        for(; group != receivers.constEnd(); ++group) {
+            call.ids = group.value();
+            postTo(group.key(), call);
+        }
+        return;
+    }
+
+    if(clientWorkers.isEmpty())
+        return;
+    if(!statefulSerializer)
+        call.frame = call.encode(serializer);
+    postTo(localWorker, call);
+    foreach(QxtRPCServiceWorker* worker, workers) {
+        if(worker)
+            postTo(worker, call);
+    }
+}
+
+void QxtRPCServicePrivate::postTo(QxtRPCServiceWorker* worker, const OutgoingCall& call)
+{
+    // Local clients are written to right away. Other workers get one event per call, carrying the shared frame.
+    if(worker == localWorker)
+        worker->deliver(call);
+    else
+        QMetaObject::invokeMethod(worker, [worker, call]() { worker->deliver(call); }, Qt::QueuedConnection);
+}
+
+void QxtRPCServicePrivate::serverData()
+{
+    // This function does the same thing as QxtRPCServiceWorker::clientData() except there's only one server
+    // connection instead of multiple client connections.
 
     // Read all available data on the device.
-    buf.append(dev->readAll());
+    serverBuffer.read(device);
 
-    while(serializer->canDeserialize(buf)) {
+    while(deviceSerializer()->canDeserialize(serverBuffer.data, serverBuffer.offset)) {
         // Extract one deserialized signal from the buffer.
-        QxtAbstractSignalSerializer::DeserializedData data = serializer->deserialize(buf);
+        QxtAbstractSignalSerializer::DeserializedData data = deviceSerializer()->deserialize(serverBuffer.data, &serverBuffer.offset);
 
         // Check to see if it's a blank command.
-        if(serializer->isNoOp(data))
+        if(QxtAbstractSignalSerializer::isNoOp(data))
             continue;
 
         // Check for protocol errors.
-        if(serializer->isProtocolError(data)) {
+        if(QxtAbstractSignalSerializer::isProtocolError(data)) {
             qWarning() << "QxtRPCService: Invalid data received; disconnecting";
-            qxt_p().disconnectClient(id);
+            qxt_p().disconnectServer();
             return;
         }
 
-        // Pad the arguments to 8, because that's what dispatchFromClient() expects.
-        while(data.second.count() < 8)
-            data.second << QVariant();
-
         // And finally, invoke the dispatcher.
-        dispatchFromClient(id, data.first, data.second[0], data.second[1], data.second[2], data.second[3],
-                data.second[4], data.second[5], data.second[6], data.second[7]);
+        if(!dispatchReserved(0, data))
+            dispatchFromServer(data.first, data.second);
     }
 }
 
-void QxtRPCServicePrivate::serverData()
+QxtRPCServiceWorker::QxtRPCServiceWorker(QxtRPCServicePrivate* service) : QObject(0), service(service)
 {
-    // This function does the same thing as clientData() except there's only one server connection instead of
-    // multiple client connections.
+    // initializers only
+}
+
+QxtRPCServiceWorker::~QxtRPCServiceWorker()
+{
+    foreach(quint64 id, clients.keys())
+        detach(id);
+}
+
+void QxtRPCServiceWorker::attach(QIODevice* dev, quint64 id)
+{
+    // A connection handed over from another thread may have been closed before it got here.
+    if(service->manager->client(id) != dev)
+        return;
+
+    // QxtMetaObject::bind() is a nice piece of magic that allows parameters to a slot to be defined in the connection.
+    Client& client = clients[id];
+    client.device = dev;
+    client.onReadyRead = QxtMetaObject::bind(this, SLOT(clientData(quint64)), Q_ARG(quint64, id));
+    QxtMetaObject::connect(dev, SIGNAL(readyRead()), client.onReadyRead);
+    client.onBytesWritten = QxtMetaObject::bind(this, SLOT(clientBytesWritten(quint64)), Q_ARG(quint64, id));
+    QxtMetaObject::connect(dev, SIGNAL(bytesWritten(qint64)), client.onBytesWritten);
+    client.serializer = service->serializer->clone();
+}
+
+void QxtRPCServiceWorker::detach(quint64 id)
+{
+    QHash<quint64, Client>::iterator it = clients.find(id);
+    if(it == clients.end())
+        return;
+    Client client = *it;
+    clients.erase(it);
+
+    // The bound functions may be on the stack if a slot disconnected its own client.
+    if(client.device)
+        QObject::disconnect(client.device, 0, this, 0);
+    client.onReadyRead->deleteLater();
+    client.onBytesWritten->deleteLater();
+    delete client.serializer;
+}
+
+void QxtRPCServiceWorker::resetSerializers()
+{
+    QHash<quint64, Client>::iterator client = clients.begin();
+    for(; client != clients.end(); ++client) {
+        delete client->serializer;
+        client->serializer = service->serializer->clone();
+    }
+}
+
+void QxtRPCServiceWorker::clientData(quint64 id)
+{
+    // Find the state for this connection.
+    QHash<quint64, Client>::iterator client = clients.find(id);
+    if(client == clients.end() || !client->device)
+        return;
 
     // Read all available data on the device.
-    serverBuffer.append(device->readAll());
+    client->buffer.read(client->device);
 
-    while(serializer->canDeserialize(serverBuffer)) {
+    QxtAbstractSignalSerializer* serializer = client->serializer ? client->serializer : service->serializer;
+    while(serializer->canDeserialize(client->buffer.data, client->buffer.offset)) {
         // Extract one deserialized signal from the buffer.
-        QxtAbstractSignalSerializer::DeserializedData data = serializer->deserialize(serverBuffer);
+        QxtAbstractSignalSerializer::DeserializedData data = serializer->deserialize(client->buffer.data, &client->buffer.offset);
 
         // Check to see if it's a blank command.
-        if(serializer->isNoOp(data))
+        if(QxtAbstractSignalSerializer::isNoOp(data))
             continue;
 
         // Check for protocol errors.
-        if(serializer->isProtocolError(data)) {
+        if(QxtAbstractSignalSerializer::isProtocolError(data)) {
             qWarning() << "QxtRPCService: Invalid data received; disconnecting";
-            qxt_p().disconnectServer();
+            service->manager->disconnect(id);
             return;
         }
 
-        // Pad the arguments to 8, because that's what dispatchFromServer() expects.
-        while(data.second.count() < 8)
-            data.second << QVariant();
-
         // And finally, invoke the dispatcher.
-        dispatchFromServer(data.first, data.second[0], data.second[1], data.second[2], data.second[3], data.second[4],
-                data.second[5], data.second[6], data.second[7]);
+        if(!service->dispatchReserved(id, data))
+            service->dispatchFromClient(id, data.first, data.second);
+
+        // A slot may have disconnected the client or connected another one, so look the state up again.
+        client = clients.find(id);
+        if(client == clients.end() || !client->device)
+            return;
+        serializer = client->serializer ? client->serializer : service->serializer;
     }
 }
 
-// Constructing a QGenericArgument object is generally done with a Q_ARG macro; this macro is a convenience that
-// does basically the same thing but dramatically shortens the call to invokeMethod().
-#define QXT_ARG(i) ((numParams>i)?QGenericArgument(p ## i .typeName(), p ## i.constData()):QGenericArgument())
+void QxtRPCServiceWorker::clientBytesWritten(quint64 id)
+{
+    QHash<quint64, Client>::iterator client = clients.find(id);
+    if(client == clients.end() || !client->device)
+        return;
+
+    // Top up the device's write buffer from the queued frames.
+    while(!client->frames.isEmpty() && client->device->bytesToWrite() < QxtRPCServicePrivate::DirectWriteLimit) {
+        QByteArray frame = client->frames.dequeue();
+        client->queued -= frame.size();
+        client->device->write(frame);
+    }
+}
+
+void QxtRPCServiceWorker::deliver(const QxtRPCServicePrivate::OutgoingCall& call)
+{
+    QList<quint64> slow;
+    if(call.target == QxtRPCServicePrivate::OutgoingCall::Listed) {
+        foreach(quint64 id, call.ids) {
+            // The client may have disconnected while the call was on its way.
+            QHash<quint64, Client>::iterator client = clients.find(id);
+            if(client != clients.end())
+                send(id, *client, call, slow);
+        }
+    } else {
+        QHash<quint64, Client>::iterator client = clients.begin();
+        for(; client != clients.end(); ++client) {
+            if(call.target != QxtRPCServicePrivate::OutgoingCall::AllExcept || !call.ids.contains(client.key()))
+                send(client.key(), *client, call, slow);
+        }
+    }
+
+    // Disconnecting changes the client tables, so it waits until the call has been sent to everyone.
+    foreach(quint64 id, slow) {
+        if(service->manager->client(id))
+            service->manager->disconnect(id);
+    }
+}
+
+void QxtRPCServiceWorker::send(quint64 id, Client& client, const QxtRPCServicePrivate::OutgoingCall& call,
+        QList<quint64>& slow)
+{
+    QIODevice* dev = client.device;
+    if(!dev)
+        return;
+
+    // Check the backlog before encoding, so that a dropped call never reaches a per-connection serializer.
+    qint64 mark = service->highWaterMark.load();
+    qint64 backlog = client.queued + dev->bytesToWrite();
+    if(mark > 0 && backlog > 0 && backlog + call.frame.size() > mark) {
+        // The client isn't keeping up. A single frame larger than the mark still goes out if nothing is pending.
+        if(service->highWaterPolicy.load() == QxtRPCService::DisconnectOnHighWater) {
+            qWarning() << "QxtRPCService: client" << id << "exceeded the high-water mark; disconnecting";
+            slow << id;
+        } else {
+            service->droppedCalls.fetchAndAddRelaxed(1);
+        }
+        return;
+    }
+
+    QByteArray frame = call.frame.isNull() ? call.encode(client.serializer ? client.serializer : service->serializer) : call.frame;
+    if(client.frames.isEmpty() && dev->bytesToWrite() < QxtRPCServicePrivate::DirectWriteLimit) {
+        dev->write(frame);
+    } else {
+        client.frames.enqueue(frame);
+        client.queued += frame.size();
+    }
+}
+
+// Fills argv with one QGenericArgument per parameter the slot expects. Parameters that were not received are left
+// empty, which is what invokeMethod() expects for unused arguments.
+static void qxt_rpc_arguments(QGenericArgument* argv, const QList<QVariant>& params, int numParams)
+{
+    int ct = qMin(qMin(numParams, params.count()), 8);
+    for(int i = 0; i < ct; i++)
+        argv[i] = QGenericArgument(params.at(i).typeName(), params.at(i).constData());
+}
 
-void QxtRPCServicePrivate::dispatchFromServer(const QString& fn, const QVariant& p0, const QVariant& p1,
-        const QVariant& p2, const QVariant& p3, const QVariant& p4, const QVariant& p5, const QVariant& p6,
-        const QVariant& p7) const
+bool QxtRPCServicePrivate::lookupSlots(const QString& fn, QList<SlotTarget>& targets, SlotTarget& fallback) const
 {
+    // Workers dispatch from their own threads. The slots are copied out so that none of them runs under the lock.
+    QReadLocker locker(&slotLock);
+
     // If the received message is not connected to any slots, ignore it.
-    if(!connectedSlots.contains(fn) && !fallbackSlot.recv) return;
+    if(!connectedSlots.contains(fn) && !fallbackSlot.recv) return false;
 
-    bool sent = false;
     foreach(const SlotDef& slot, connectedSlots.value(fn)) {
         // Look up the parameters for each slot based on its metamethod definition.
         MetaMethodDef method = qMakePair(slot.recv->metaObject(), slot.slot);
-        const QList<QByteArray>& params = slotParameters.value(method);
-        int numParams = params.count();
+        targets << qMakePair(slot, slotParameters.value(method).count());
+    }
+    fallback.first = fallbackSlot;
+    fallback.second = 0;
+    if(fallbackSlot.recv)
+        fallback.second = slotParameters.value(qMakePair(fallbackSlot.recv->metaObject(), fallbackSlot.slot)).count();
+    return true;
+}
+
+void QxtRPCServicePrivate::dispatchFromServer(const QString& fn, const QList<QVariant>& params) const
+{
+    QList<SlotTarget> targets;
+    SlotTarget fallback;
+    if(!lookupSlots(fn, targets, fallback)) return;
+
+    bool sent = false;
+    foreach(const SlotTarget& target, targets) {
+        const SlotDef& slot = target.first;
+        int numParams = target.second;
 
         // Invoke the specified slot on the receiver object using the arguments passed to the function. The
-        // QGenericArgument stuff is done here for safety, as it's not inconceivable (but it IS dangerous) for
+        // arguments are built per slot for safety, as it's not inconceivable (but it IS dangerous) for
         // different slots to have different parameter lists.
+        QGenericArgument argv[8];
+        qxt_rpc_arguments(argv, params, numParams);
         if(qxt_rpcservice_debug)
-            qDebug() << "QxtRPCService: received" << fn << "- invoking" << slot.recv << slot.slot.constData() << slot.type << p0 << p1 << p2 << p3 << p4 << p5 << p6 << p7;
-        if(QMetaObject::invokeMethod(slot.recv, slot.slot.constData(), slot.type, QXT_ARG(0), QXT_ARG(1), QXT_ARG(2),
-                    QXT_ARG(3), QXT_ARG(4), QXT_ARG(5), QXT_ARG(6), QXT_ARG(7))) {
+            qDebug() << "QxtRPCService: received" << fn << "- invoking" << slot.recv << slot.slot.constData() << slot.type << params;
+        if(QMetaObject::invokeMethod(slot.recv, slot.slot.constData(), slot.type, argv[0], argv[1], argv[2],
+                    argv[3], argv[4], argv[5], argv[6], argv[7])) {
             sent = true;
         } else {
             qWarning() << "QxtRPCService: invokeMethod for " << slot.recv << "::" << slot.slot << " failed";
         }
     }
-    if (!sent && fallbackSlot.recv) {
-        MetaMethodDef method = qMakePair(fallbackSlot.recv->metaObject(), fallbackSlot.slot);
-        const QList<QByteArray>& params = slotParameters.value(method);
-        int numParams = params.count() - 1;
-
-        if(!QMetaObject::invokeMethod(fallbackSlot.recv, fallbackSlot.slot.constData(), fallbackSlot.type, Q_ARG(QString,fn), QXT_ARG(0), QXT_ARG(1), QXT_ARG(2),
-                    QXT_ARG(3), QXT_ARG(4), QXT_ARG(5), QXT_ARG(6), QXT_ARG(7))) {
-            qWarning() << "QxtRPCService: invokeMethod for " << fallbackSlot.recv << "::" << fallbackSlot.slot << " failed";
+    if (!sent && fallback.first.recv) {
+        const SlotDef& slot = fallback.first;
+        int numParams = fallback.second - 1;
+
+        QGenericArgument argv[8];
+        qxt_rpc_arguments(argv, params, numParams);
+        if(!QMetaObject::invokeMethod(slot.recv, slot.slot.constData(), slot.type, Q_ARG(QString,fn), argv[0], argv[1], argv[2],
+                    argv[3], argv[4], argv[5], argv[6], argv[7])) {
+            qWarning() << "QxtRPCService: invokeMethod for " << slot.recv << "::" << slot.slot << " failed";
         }
     }
 }
 
-void QxtRPCServicePrivate::dispatchFromClient(quint64 id, const QString& fn, const QVariant& p0, const QVariant& p1,
-        const QVariant& p2, const QVariant& p3, const QVariant& p4, const QVariant& p5, const QVariant& p6,
-        const QVariant& p7) const
+void QxtRPCServicePrivate::dispatchFromClient(quint64 id, const QString& fn, const QList<QVariant>& params) const
 {
-    // If the received message is not connected to any slots, ignore it.
-    if(!connectedSlots.contains(fn) && !fallbackSlot.recv) return;
+    QList<SlotTarget> targets;
+    SlotTarget fallback;
+    if(!lookupSlots(fn, targets, fallback)) return;
 
     bool sent = false;
-    foreach(const SlotDef& slot, connectedSlots.value(fn))
+    foreach(const SlotTarget& target, targets)
     {
-        // Look up the parameters for each slot based on its metamethod definition.
-        MetaMethodDef method = qMakePair(slot.recv->metaObject(), slot.slot);
-        const QList<QByteArray>& params = slotParameters.value(method);
-        int numParams = params.count() - 1;
+        const SlotDef& slot = target.first;
+        int numParams = target.second - 1;
 
         // Invoke the specified slot on the receiver object using the arguments passed to the function.
-        // See dispatchFromServer() for a discussion of the safety of QXT_ARG here.
+        // See dispatchFromServer() for a discussion of the safety of building the arguments here.
+        QGenericArgument argv[8];
+        qxt_rpc_arguments(argv, params, numParams);
         if(qxt_rpcservice_debug)
-            qDebug() << "QxtRPCService: received" << fn << "- invoking" << slot.recv << slot.slot.constData() << slot.type << id << p0 << p1 << p2 << p3 << p4 << p5 << p6 << p7;
+            qDebug() << "QxtRPCService: received" << fn << "- invoking" << slot.recv << slot.slot.constData() << slot.type << id << params;
 
         // Use AutoConnection to invoke the method if Unique Connection was specified (since Unique Connection does not make sense to invokeMethod)
         Qt::ConnectionType actualSlotType = slot.type;
         if (actualSlotType == Qt::UniqueConnection)
             actualSlotType = Qt::AutoConnection;
-        if(QMetaObject::invokeMethod(slot.recv, slot.slot.constData(), actualSlotType, Q_ARG(quint64, id), QXT_ARG(0),
-                    QXT_ARG(1), QXT_ARG(2), QXT_ARG(3), QXT_ARG(4), QXT_ARG(5), QXT_ARG(6), QXT_ARG(7))) {
+        if(QMetaObject::invokeMethod(slot.recv, slot.slot.constData(), actualSlotType, Q_ARG(quint64, id), argv[0],
+                    argv[1], argv[2], argv[3], argv[4], argv[5], argv[6], argv[7])) {
             sent = true;
         } else {
             qWarning() << "QxtRPCService: invokeMethod for " << slot.recv << "::" << slot.slot << " failed";
         }
     }
-    if (!sent && fallbackSlot.recv) {
-        MetaMethodDef method = qMakePair(fallbackSlot.recv->metaObject(), fallbackSlot.slot);
-        const QList<QByteArray>& params = slotParameters.value(method);
-        int numParams = params.count() - 2;
+    if (!sent && fallback.first.recv) {
+        const SlotDef& slot = fallback.first;
+        int numParams = fallback.second - 2;
+
+        QGenericArgument argv[8];
+        qxt_rpc_arguments(argv, params, numParams);
+        if(!QMetaObject::invokeMethod(slot.recv, slot.slot.constData(), slot.type, Q_ARG(quint64, id), Q_ARG(QString, fn),
+                    argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6], argv[7])) {
+            qWarning() << "QxtRPCService: invokeMethod for " << slot.recv << "::" << slot.slot << " failed";
+        }
+    }
+}
+
+bool QxtRPCServicePrivate::dispatchReserved(quint64 id, const QxtAbstractSignalSerializer::DeserializedData& data)
+{
+    // Ordinary calls almost never share the reserved prefix, so most messages are turned away by one comparison.
+    if(!data.first.startsWith(QLatin1String(qxt_rpc_reserved_prefix)))
+        return false;
 
-        if(!QMetaObject::invokeMethod(fallbackSlot.recv, fallbackSlot.slot.constData(), fallbackSlot.type, Q_ARG(quint64, id), Q_ARG(QString, fn),
-                    QXT_ARG(0), QXT_ARG(1), QXT_ARG(2), QXT_ARG(3), QXT_ARG(4), QXT_ARG(5), QXT_ARG(6), QXT_ARG(7))) {
-            qWarning() << "QxtRPCService: invokeMethod for " << fallbackSlot.recv << "::" << fallbackSlot.slot << " failed";
+    if(data.first == QLatin1String(qxt_rpc_request)) {
+        dispatchRequest(id, data.second);
+        return true;
+    }
+    if(data.first == QLatin1String(qxt_rpc_response)) {
+        dispatchResponse(id, data.second);
+        return true;
+    }
+    return false;
+}
+
+void QxtRPCServicePrivate::dispatchRequest(quint64 id, const QList<QVariant>& frame)
+{
+    quint64 requestID = frame.value(0).toULongLong();
+    QString fn = frame.value(1).toString();
+    QList<QVariant> params = frame.value(2).toList();
+
+    // The first slot attached to the function answers the request.
+    QList<SlotTarget> targets;
+    SlotTarget fallback;
+    lookupSlots(fn, targets, fallback);
+    if(targets.isEmpty()) {
+        respond(id, requestID, ResponseNoSlot, QString("No slot is attached to %1").arg(fn));
+        return;
+    }
+    SlotDef slot = targets.first().first;
+    int numParams = targets.first().second - (id ? 1 : 0);
+    int returnType;
+    {
+        QReadLocker locker(&slotLock);
+        returnType = slotReturnTypes.value(qMakePair(slot.recv->metaObject(), slot.slot), int(QMetaType::Void));
+    }
+    if(qxt_rpcservice_debug)
+        qDebug() << "QxtRPCService: request" << requestID << fn << "- invoking" << slot.recv << slot.slot.constData() << id << params;
+
+    // The slot is invoked directly in the receiver's thread so that its return value can be captured. The response
+    // is sent from there; respond() takes care of getting it to the right connection.
+    QPointer<QxtRPCServicePrivate> self(this);
+    auto invoke = [self, slot, numParams, returnType, id, requestID, params]() {
+        QGenericArgument argv[8];
+        qxt_rpc_arguments(argv, params, numParams);
+
+        QVariant result;
+        QGenericReturnArgument ret;
+        if(returnType == QMetaType::QVariant) {
+            ret = Q_RETURN_ARG(QVariant, result);
+        } else if(returnType != QMetaType::Void && returnType != QMetaType::UnknownType) {
+            result = QVariant(returnType, static_cast<const void*>(0));
+            ret = QGenericReturnArgument(QMetaType::typeName(returnType), result.data());
+        }
+
+        bool ok;
+        if(id) {
+            ok = QMetaObject::invokeMethod(slot.recv, slot.slot.constData(), Qt::DirectConnection, ret,
+                    Q_ARG(quint64, id), argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6], argv[7]);
+        } else {
+            ok = QMetaObject::invokeMethod(slot.recv, slot.slot.constData(), Qt::DirectConnection, ret, argv[0],
+                    argv[1], argv[2], argv[3], argv[4], argv[5], argv[6], argv[7]);
         }
+        if(!ok)
+            qWarning() << "QxtRPCService: invokeMethod for " << slot.recv << "::" << slot.slot << " failed";
+        if(self) {
+            if(ok)
+                self->respond(id, requestID, ResponseOk, result);
+            else
+                self->respond(id, requestID, ResponseInvokeFailed, QString("Invoking %1 failed").arg(QString(slot.slot)));
+        }
+    };
+
+    Qt::ConnectionType type = slot.type;
+    if(type == Qt::DirectConnection || (type != Qt::QueuedConnection && type != Qt::BlockingQueuedConnection
+                && slot.recv->thread() == QThread::currentThread())) {
+        invoke();
+    } else {
+        // Dropped without an answer if the receiver is destroyed first; the requester's timeout covers that case.
+        QMetaObject::invokeMethod(slot.recv, invoke,
+                type == Qt::BlockingQueuedConnection ? Qt::BlockingQueuedConnection : Qt::QueuedConnection);
+    }
+}
+
+void QxtRPCServicePrivate::respond(quint64 id, quint64 requestID, int status, const QVariant& value)
+{
+    if(id) {
+        // The client may be served by any worker; post() finds it from the service's thread.
+        OutgoingCall out;
+        out.fn = QLatin1String(qxt_rpc_response);
+        out.params[0] = requestID;
+        out.params[1] = status;
+        out.params[2] = value;
+        out.ids << id;
+        post(out);
+        return;
+    }
+
+    // The server connection belongs to the service's thread.
+    if(QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, requestID, status, value]() { respond(0, requestID, status, value); },
+                Qt::QueuedConnection);
+        return;
+    }
+    if(!device)
+        return;
+    device->write(deviceSerializer()->serialize(QLatin1String(qxt_rpc_response), requestID, status, value));
+}
+
+void QxtRPCServicePrivate::dispatchResponse(quint64 id, const QList<QVariant>& frame)
+{
+    // Replies belong to the service's thread; responses read by a worker are handed over.
+    if(QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, id, frame]() { dispatchResponse(id, frame); }, Qt::QueuedConnection);
+        return;
+    }
+
+    // A response to a request that was canceled or timed out, or that came from another connection, is ignored.
+    QxtRPCReply* reply = pendingReplies.value(frame.value(0).toULongLong());
+    if(!reply || reply->qxt_d().clientID != id)
+        return;
+
+    if(frame.value(1).toInt() == ResponseOk)
+        finishReply(reply, QxtRPCReply::NoError, frame.value(2), QString());
+    else
+        finishReply(reply, QxtRPCReply::RemoteError, QVariant(), frame.value(2).toString());
+}
+
+QxtRPCReply* QxtRPCServicePrivate::sendRequest(quint64 id, const QString& fn, const QVariant* params)
+{
+    QxtRPCReply* reply = new QxtRPCReply(&qxt_p());
+    QxtRPCReplyPrivate& d = reply->qxt_d();
+    d.service = this;
+    d.requestID = ++nextRequestID;
+    d.clientID = id;
+    d.method = normalizedName(fn);
+    d.started = clock.nsecsElapsed();
+    pendingReplies.insert(d.requestID, reply);
+    d.timeout = requestTimeout;
+    if(requestTimeout > 0)
+        setDeadline(reply, requestTimeout);
+
+    // Only the parameters that were given are sent.
+    QList<QVariant> args;
+    int ct = 8;
+    while(ct > 0 && !params[ct - 1].isValid())
+        ct--;
+    for(int i = 0; i < ct; i++)
+        args << params[i];
+
+    bool connected = id ? (manager && manager->client(id)) : !device.isNull();
+    if(!connected) {
+        // Fail from the event loop so that the caller gets a chance to connect to finished().
+        quint64 requestID = d.requestID;
+        QMetaObject::invokeMethod(this, [this, requestID]() {
+            QxtRPCReply* reply = pendingReplies.value(requestID);
+            if(reply)
+                finishReply(reply, QxtRPCReply::ConnectionError, QVariant(), QLatin1String("Not connected"));
+        }, Qt::QueuedConnection);
+        return reply;
+    }
+
+    if(id) {
+        OutgoingCall out;
+        out.fn = QLatin1String(qxt_rpc_request);
+        out.params[0] = d.requestID;
+        out.params[1] = d.method;
+        out.params[2] = args;
+        out.ids << id;
+        post(out);
+    } else {
+        device->write(deviceSerializer()->serialize(QLatin1String(qxt_rpc_request), d.requestID, d.method, args));
+    }
+    return reply;
+}
+
+void QxtRPCServicePrivate::finishReply(QxtRPCReply* reply, int error, const QVariant& result, const QString& errorString)
+{
+    QxtRPCReplyPrivate& d = reply->qxt_d();
+    forgetReply(reply);
+    d.finished = true;
+    d.error = QxtRPCReply::Error(error);
+    d.result = result;
+    d.errorString = errorString;
+    d.latency = (clock.nsecsElapsed() - d.started) / 1000;
+
+    // Only round trips count towards the latency histograms.
+    if(error == QxtRPCReply::NoError || error == QxtRPCReply::RemoteError) {
+        QVector<quint64>& histogram = latencies[d.method];
+        if(histogram.isEmpty())
+            histogram.fill(0, LatencyBuckets);
+        int bucket = 0;
+        for(qint64 us = d.latency; us > 1 && bucket < LatencyBuckets - 1; us >>= 1)
+            bucket++;
+        histogram[bucket]++;
+    }
+
+    emit reply->finished();
+}
+
+void QxtRPCServicePrivate::failReplies(quint64 id, const QString& errorString)
+{
+    QList<QxtRPCReply*> failed;
+    foreach(QxtRPCReply* reply, pendingReplies) {
+        if(reply->qxt_d().clientID == id)
+            failed << reply;
+    }
+    foreach(QxtRPCReply* reply, failed) {
+        // A slot connected to an earlier reply may have canceled this one already.
+        if(pendingReplies.contains(reply->qxt_d().requestID))
+            finishReply(reply, QxtRPCReply::ConnectionError, QVariant(), errorString);
+    }
+}
+
+void QxtRPCServicePrivate::forgetReply(QxtRPCReply* reply)
+{
+    QxtRPCReplyPrivate& d = reply->qxt_d();
+    pendingReplies.remove(d.requestID);
+    if(d.deadline) {
+        deadlines.remove(d.deadline, d.requestID);
+        d.deadline = 0;
     }
 }
 
+void QxtRPCServicePrivate::setDeadline(QxtRPCReply* reply, int msec)
+{
+    QxtRPCReplyPrivate& d = reply->qxt_d();
+    if(d.deadline)
+        deadlines.remove(d.deadline, d.requestID);
+    d.deadline = msec > 0 ? d.started + qint64(msec) * 1000000 : 0;
+    if(d.deadline)
+        deadlines.insert(d.deadline, d.requestID);
+    scheduleDeadlines();
+}
+
+void QxtRPCServicePrivate::scheduleDeadlines()
+{
+    if(deadlines.isEmpty()) {
+        deadlineTimer.stop();
+        return;
+    }
+
+    // Round up so that the timer never fires just before the earliest deadline.
+    qint64 wait = (deadlines.firstKey() - clock.nsecsElapsed() + 999999) / 1000000;
+    deadlineTimer.start(int(qBound(qint64(0), wait, qint64(INT_MAX))));
+}
+
+void QxtRPCServicePrivate::expireRequests()
+{
+    qint64 now = clock.nsecsElapsed();
+    while(!deadlines.isEmpty() && deadlines.firstKey() <= now) {
+        QxtRPCReply* reply = pendingReplies.value(deadlines.first());
+        if(reply)
+            finishReply(reply, QxtRPCReply::TimeoutError, QVariant(), QLatin1String("Request timed out"));
+        else
+            deadlines.erase(deadlines.begin());
+    }
+    scheduleDeadlines();
+}
+
 /*!
  * Creates a QxtRPCService object with the given \a parent.
  */
@@ -483,7 +1105,19 @@ QxtRPCService::QxtRPCService(QIODevice* device, QObject* parent) : QObject(paren
  */
 QxtRPCService::~QxtRPCService()
 {
+    // Workers in other threads refer back to the service, so they go first. Each one is deleted in its own thread.
+    foreach(QxtRPCServiceWorker* worker, qxt_d().workers) {
+        if(worker && worker->thread()->isRunning())
+            QMetaObject::invokeMethod(worker, [worker]() { delete worker; }, Qt::BlockingQueuedConnection);
+    }
+    delete qxt_d().localWorker;
+
+    // Replies are children of the service and outlive its private part; cut them loose.
+    foreach(QxtRPCReply* reply, qxt_d().pendingReplies)
+        reply->qxt_d().service = NULL;
+
     // QxtAbstractSignalSerializer isn't a QObject, so we have to explicitly clean it up.
+    delete qxt_d().serverSerializer;
     delete qxt_d().serializer;
 }
 
@@ -602,14 +1236,21 @@ QIODevice* QxtRPCService::device() const
  */
 void QxtRPCService::setDevice(QIODevice* dev)
 {
-    // First, delete the old device if one is set.
-    if(qxt_d().device)
+    // First, delete the old device if one is set. Requests sent through it will not be answered.
+    if(qxt_d().device) {
         delete qxt_d().device;
+        qxt_d().failReplies(0, QLatin1String("Disconnected from server"));
+    }
 
     // Then set the device and claim ownership of it.
     qxt_d().device = dev;
     dev->setParent(this);
 
+    // A new connection starts with an empty read buffer and, for stateful serializers, a fresh clone.
+    qxt_d().serverBuffer = QxtRPCServicePrivate::ReadBuffer();
+    delete qxt_d().serverSerializer;
+    qxt_d().serverSerializer = qxt_d().serializer->clone();
+
     // Listen for data arriving on the device.
     QObject::connect(dev, SIGNAL(readyRead()), &qxt_d(), SLOT(serverData()));
 
@@ -633,6 +1274,9 @@ QIODevice* QxtRPCService::takeDevice()
         QObject::disconnect(oldDevice, 0, this, 0);
         QObject::disconnect(oldDevice, 0, &qxt_d(), 0);
         qxt_d().device = NULL;
+
+        // Requests sent through the device will not be answered.
+        qxt_d().failReplies(0, QLatin1String("Disconnected from server"));
     }
     return oldDevice;
 }
@@ -648,12 +1292,119 @@ QxtAbstractSignalSerializer* QxtRPCService::serializer() const
 
 /*!
  * Sets the signal \a serializer used to encode signals before transmission. The existing serializer will be deleted.
+ * If the serializer keeps per-connection state, every open connection starts over with a fresh clone of it, so the
+ * peers must switch serializers at the same time. The serializer cannot be replaced while clients are being served
+ * from the worker threads of the connection manager.
  * \sa serializer()
  */
 void QxtRPCService::setSerializer(QxtAbstractSignalSerializer* serializer)
 {
     delete qxt_d().serializer;
     qxt_d().serializer = serializer;
+    qxt_d().resetSerializers();
+}
+
+/*!
+ * Returns the largest number of bytes that may be waiting to be sent to a client before highWaterPolicy() applies.
+ * The default value, 0, puts no limit on the backlog.
+ *
+ * \sa setHighWaterMark()
+ */
+qint64 QxtRPCService::highWaterMark() const
+{
+    return qxt_d().highWaterMark.load();
+}
+
+/*!
+ * Sets the largest number of \a bytes that may be waiting to be sent to a client before highWaterPolicy() applies.
+ * The backlog includes both the frames queued by QxtRPCService and the device's own write buffer. Use 0 to put no
+ * limit on the backlog.
+ *
+ * \sa highWaterMark()
+ */
+void QxtRPCService::setHighWaterMark(qint64 bytes)
+{
+    qxt_d().highWaterMark.store(qMax(qint64(0), bytes));
+}
+
+/*!
+ * Returns what happens to a client that exceeds highWaterMark(). The default is DropOnHighWater.
+ *
+ * \sa setHighWaterPolicy()
+ */
+QxtRPCService::HighWaterPolicy QxtRPCService::highWaterPolicy() const
+{
+    return HighWaterPolicy(qxt_d().highWaterPolicy.load());
+}
+
+/*!
+ * Sets what happens to a client that exceeds highWaterMark() to \a policy.
+ *
+ * \sa highWaterPolicy()
+ */
+void QxtRPCService::setHighWaterPolicy(HighWaterPolicy policy)
+{
+    qxt_d().highWaterPolicy.store(policy);
+}
+
+/*!
+ * Returns the number of calls that were not sent to a client because it exceeded highWaterMark().
+ */
+quint64 QxtRPCService::droppedCallCount() const
+{
+    return qxt_d().droppedCalls.load();
+}
+
+/*!
+ * Returns the time in milliseconds after which a request without a response fails with QxtRPCReply::TimeoutError.
+ * The default value, 0, lets requests wait for as long as the connection lasts.
+ *
+ * \sa setRequestTimeout(), QxtRPCReply::setTimeout()
+ */
+int QxtRPCService::requestTimeout() const
+{
+    return qxt_d().requestTimeout;
+}
+
+/*!
+ * Sets the time in milliseconds after which a request without a response fails to \a msec. The timeout applies to
+ * requests sent after the call; use QxtRPCReply::setTimeout() to change it for a single request. Use 0 to let
+ * requests wait for as long as the connection lasts.
+ *
+ * \sa requestTimeout()
+ */
+void QxtRPCService::setRequestTimeout(int msec)
+{
+    qxt_d().requestTimeout = qMax(0, msec);
+}
+
+/*!
+ * Returns the round-trip latency histogram of the requests to the function \a fn that have been answered, including
+ * those answered with QxtRPCReply::RemoteError.
+ *
+ * Entry \c i of the list counts the requests that took at least 2^i and less than 2^(i+1) microseconds; the first
+ * entry also counts faster requests and the last entry also counts slower ones. An empty list is returned if no
+ * request to \a fn has been answered.
+ *
+ * \sa resetLatencyHistograms(), QxtRPCReply::latency()
+ */
+QList<quint64> QxtRPCService::latencyHistogram(const QString& fn) const
+{
+    QString name = fn;
+    QByteArray latin = fn.toLatin1();
+    if(QxtMetaObject::isSignalOrSlot(latin.constData()))
+        name = QxtMetaObject::methodSignature(latin.constData());
+    return qxt_d().latencies.value(name).toList();
+}
+
+/*!
+ * Clears the latency histograms of all functions.
+ *
+ * \sa latencyHistogram()
+ */
+void QxtRPCService::resetLatencyHistograms()
+{
+    qxt_d().latencies.clear();
 }
 
 /*!
@@ -682,7 +1433,7 @@ void QxtRPCService::setConnectionManager(QxtAbstractConnectionManager* manager)
 
     // Listen for connections and disconnections.
     QObject::connect(manager, SIGNAL(newConnection(QIODevice*, quint64)),
-                     &qxt_d(), SLOT(clientConnected(QIODevice*, quint64)));
+                     &qxt_d(), SLOT(connectionAdded(QIODevice*, quint64)), Qt::DirectConnection);
     QObject::connect(manager, SIGNAL(disconnected(QIODevice*, quint64)),
                      &qxt_d(), SLOT(clientDisconnected(QIODevice*, quint64)));
 }
@@ -716,6 +1467,7 @@ bool QxtRPCService::attachSignal(QObject* sender, const char* signal, const QStr
  */
 bool QxtRPCService::attachSlot(const QString& rpcFunction, QObject* recv, const char* slot, Qt::ConnectionType type)
 {
+    QWriteLocker locker(&qxt_d().slotLock);
     const QMetaObject* meta = recv->metaObject();
     QByteArray name = QxtMetaObject::methodName(slot);
     QxtRPCServicePrivate::MetaMethodDef info = qMakePair(meta, name);
@@ -741,8 +1493,9 @@ bool QxtRPCService::attachSlot(const QString& rpcFunction, QObject* recv, const
             }
         }
 
-        // Cache the looked-up parameter list.
+        // Cache the looked-up parameter list and the return type, which answers requests.
         qxt_d().slotParameters[info] = types;
+        qxt_d().slotReturnTypes[info] = meta->method(methodID).returnType();
     }
 
     // If the RPC function name appears to be a signal or slot, normalize the signature.
@@ -784,6 +1537,7 @@ bool QxtRPCService::attachSlot(const QString& rpcFunction, QObject* recv, const
  */
 bool QxtRPCService::setFallbackSlot(QObject* recv, const char* slot, Qt::ConnectionType type)
 {
+    QWriteLocker locker(&qxt_d().slotLock);
     const QMetaObject* meta = recv->metaObject();
     QByteArray name = QxtMetaObject::methodName(slot);
     QxtRPCServicePrivate::MetaMethodDef info = qMakePair(meta, name);
@@ -842,6 +1596,7 @@ void QxtRPCService::detachSignals(QObject* obj)
  */
 void QxtRPCService::detachSlots(QObject* obj)
 {
+    QWriteLocker locker(&qxt_d().slotLock);
     foreach(const QString& name, qxt_d().connectedSlots.keys()) {
         // Iterate over all connected slots.
         foreach(const QxtRPCServicePrivate::SlotDef& slot, qxt_d().connectedSlots.value(name)) {
@@ -869,17 +1624,21 @@ void QxtRPCService::call(QString fn, const QVariant& p1, const QVariant& p2, con
             qDebug() << "QxtRPCService: calling" << fn << "on peer with parameters" << p1 << p2 << p3 << p4 << p5 << p6 << p7 << p8;
 
         // Normalize the function name if it has the form of a signal or slot.
-        if(QxtMetaObject::isSignalOrSlot(fn.toLatin1().constData()))
-            fn = QxtMetaObject::methodSignature(fn.toLatin1().constData());
+        fn = qxt_d().normalizedName(fn);
 
         // Serialize the parameters and write the result to the device.
-        QByteArray data = qxt_d().serializer->serialize(fn, p1, p2, p3, p4, p5, p6, p7, p8);
+        QByteArray data = qxt_d().deviceSerializer()->serialize(fn, p1, p2, p3, p4, p5, p6, p7, p8);
         qxt_d().device->write(data);
     }
 
     if(isServer()) {
-        // Delegate the call to the other overload of call().
-        call(clients(), fn, p1, p2, p3, p4, p5, p6, p7, p8);
+        // Send the call to every client straight from the worker tables instead of building a list of IDs.
+        QxtRPCServicePrivate::OutgoingCall out;
+        out.fn = fn;
+        out.params[0] = p1; out.params[1] = p2; out.params[2] = p3; out.params[3] = p4;
+        out.params[4] = p5; out.params[5] = p6; out.params[6] = p7; out.params[7] = p8;
+        out.target = QxtRPCServicePrivate::OutgoingCall::All;
+        qxt_d().post(out);
     }
 }
 
@@ -895,20 +1654,13 @@ void QxtRPCService::call(QList<quint64> ids, QString fn, const QVariant& p1, con
     if(qxt_rpcservice_debug)
         qDebug() << "QxtRPCService: calling" << fn << "on" << ids << "with parameters" << p1 << p2 << p3 << p4 << p5 << p6 << p7 << p8;
 
-    // Serialize the parameters first.
-    QByteArray data = qxt_d().serializer->serialize(fn, p1, p2, p3, p4, p5, p6, p7, p8);
-
-    foreach(quint64 id, ids) {
-        // Find the specified client.
-        QIODevice* dev = qxt_d().manager->client(id);
-        if(!dev) {
-            qWarning() << "QxtRPCService::call: client ID not connected";
-            continue;
-        }
-
-        // Transmit the data to the client.
-        dev->write(data);
-    }
+    // A shared serializer only has to encode the call once for all clients.
+    QxtRPCServicePrivate::OutgoingCall out;
+    out.fn = fn;
+    out.params[0] = p1; out.params[1] = p2; out.params[2] = p3; out.params[3] = p4;
+    out.params[4] = p5; out.params[5] = p6; out.params[6] = p7; out.params[7] = p8;
+    out.ids = ids;
+    qxt_d().post(out);
 }
 
 /*!
@@ -933,10 +1685,71 @@ void QxtRPCService::call(quint64 id, QString fn, const QVariant& p1, const QVari
 void QxtRPCService::callExcept(quint64 id, QString fn, const QVariant& p1, const QVariant& p2, const QVariant& p3,
         const QVariant& p4, const QVariant& p5, const QVariant& p6, const QVariant& p7, const QVariant& p8)
 {
-    // Get the list of clients and remove the exception, then delegate the call to the appropriate overload of call().
-    QList<quint64> ids = clients();
-    ids.removeAll(id);
-    call(ids, fn, p1, p2, p3, p4, p5, p6, p7, p8);
+    if(!isServer()) {
+        qWarning() << "QxtRPCService::callExcept: not a server";
+        return;
+    }
+
+    // Send the call to every client but the exception.
+    QxtRPCServicePrivate::OutgoingCall out;
+    out.fn = fn;
+    out.params[0] = p1; out.params[1] = p2; out.params[2] = p3; out.params[3] = p4;
+    out.params[4] = p5; out.params[5] = p6; out.params[6] = p7; out.params[7] = p8;
+    out.target = QxtRPCServicePrivate::OutgoingCall::AllExcept;
+    out.ids << id;
+    qxt_d().post(out);
+}
+
+/*!
+ * Sends a request to call \a fn with the given parameter list to the server and returns a reply that finishes when the
+ * server has answered.
+ *
+ * The request is answered by the first slot the server has attached to \a fn; the slot's return value becomes the
+ * reply's result. Requests do not wait for each other, so any number of them can be in flight at once. The reply is
+ * a child of the QxtRPCService; delete it with deleteLater() once it is no longer needed.
+ *
+ * This function must be called from the thread the QxtRPCService lives in. If not connected to a server, the reply
+ * fails with QxtRPCReply::ConnectionError.
+ *
+ * \sa QxtRPCReply, requestTimeout()
+ */
+QxtRPCReply* QxtRPCService::request(QString fn, const QVariant& p1, const QVariant& p2, const QVariant& p3,
+        const QVariant& p4, const QVariant& p5, const QVariant& p6, const QVariant& p7, const QVariant& p8)
+{
+    if(QThread::currentThread() != thread()) {
+        qWarning() << "QxtRPCService::request: must be called from the service's thread";
+        return NULL;
+    }
+    if(qxt_rpcservice_debug)
+        qDebug() << "QxtRPCService: requesting" << fn << "from peer with parameters" << p1 << p2 << p3 << p4 << p5 << p6 << p7 << p8;
+
+    QVariant params[8] = { p1, p2, p3, p4, p5, p6, p7, p8 };
+    return qxt_d().sendRequest(0, fn, params);
+}
+
+/*!
+ * Sends a request to call \a fn with the given parameter list to the specified client and returns a reply that
+ * finishes when the client has answered.
+ *
+ * The request is answered by the first slot the client has attached to \a fn. If no client with the given ID is
+ * connected, the reply fails with QxtRPCReply::ConnectionError. Like other calls, requests to a client that is behind
+ * by more than highWaterMark() are subject to highWaterPolicy(); give such requests a timeout.
+ *
+ * \sa request(QString, const QVariant&, const QVariant&, const QVariant&, const QVariant&, const QVariant&,
+ * const QVariant&, const QVariant&, const QVariant&)
+ */
+QxtRPCReply* QxtRPCService::request(quint64 id, QString fn, const QVariant& p1, const QVariant& p2, const QVariant& p3,
+        const QVariant& p4, const QVariant& p5, const QVariant& p6, const QVariant& p7, const QVariant& p8)
+{
+    if(QThread::currentThread() != thread()) {
+        qWarning() << "QxtRPCService::request: must be called from the service's thread";
+        return NULL;
+    }
+    if(qxt_rpcservice_debug)
+        qDebug() << "QxtRPCService: requesting" << fn << "from" << id << "with parameters" << p1 << p2 << p3 << p4 << p5 << p6 << p7 << p8;
+
+    QVariant params[8] = { p1, p2, p3, p4, p5, p6, p7, p8 };
+    return qxt_d().sendRequest(id, fn, params);
 }
 
 /*!
@@ -947,3 +1760,169 @@ void QxtRPCService::detachSender()
     detachObject(sender());
 }
 
+
+/*!
+ * \class QxtRPCReply
+ * \inmodule QxtCore
+ * \brief The QxtRPCReply class holds the answer to a request sent with QxtRPCService::request()
+ *
+ * A QxtRPCReply is created for every request. It emits finished() once the peer has answered, the request has timed
+ * out, the connection has been lost or the request has been canceled; error() tells these cases apart. The value
+ * returned by the peer's slot is available from result().
+ *
+ * Replies are owned by the QxtRPCService that created them and live in its thread. Delete a reply with deleteLater()
+ * once it is no longer needed; deleting an unfinished reply discards the response.
+ *
+ * \sa QxtRPCService::request()
+ */
+
+/*!
+ * \enum QxtRPCReply::Error
+ *
+ * This enum describes how a request ended.
+ *
+ * \value NoError         The peer answered the request; result() holds the value returned by its slot.
+ * \value TimeoutError    No answer arrived within timeout().
+ * \value CanceledError   The request was canceled with cancel().
+ * \value ConnectionError The connection was lost, or did not exist, before an answer arrived.
+ * \value RemoteError     The peer could not answer the request, for instance because no slot is attached to the
+ *                        function. errorString() holds the peer's explanation.
+ */
+
+QxtRPCReplyPrivate::QxtRPCReplyPrivate()
+: service(NULL), requestID(0), clientID(0), finished(false), error(QxtRPCReply::NoError), started(0), deadline(0),
+  latency(-1), timeout(0)
+{
+    // initializers only
+}
+
+QxtRPCReply::QxtRPCReply(QObject* parent) : QObject(parent)
+{
+    QXT_INIT_PRIVATE(QxtRPCReply);
+}
+
+/*!
+ * Destroys the reply. If the request has not finished yet, its response will be ignored.
+ */
+QxtRPCReply::~QxtRPCReply()
+{
+    if(!qxt_d().finished && qxt_d().service)
+        qxt_d().service->forgetReply(this);
+}
+
+/*!
+ * Returns the ID of the client the request was sent to, or 0 if it was sent to the server.
+ */
+quint64 QxtRPCReply::clientID() const
+{
+    return qxt_d().clientID;
+}
+
+/*!
+ * Returns the name of the requested function.
+ */
+QString QxtRPCReply::method() const
+{
+    return qxt_d().method;
+}
+
+/*!
+ * Returns \c true once the request has ended, successfully or not.
+ *
+ * \sa finished(), error()
+ */
+bool QxtRPCReply::isFinished() const
+{
+    return qxt_d().finished;
+}
+
+/*!
+ * Returns how the request ended. The value is only meaningful once the reply has finished.
+ *
+ * \sa errorString()
+ */
+QxtRPCReply::Error QxtRPCReply::error() const
+{
+    return qxt_d().error;
+}
+
+/*!
+ * Returns a human-readable description of error(), or an empty string if the request succeeded.
+ */
+QString QxtRPCReply::errorString() const
+{
+    return qxt_d().errorString;
+}
+
+/*!
+ * Returns the value returned by the peer's slot. The result is invalid until the reply has finished, if the slot
+ * returns void, or if the request failed.
+ */
+QVariant QxtRPCReply::result() const
+{
+    return qxt_d().result;
+}
+
+/*!
+ * Returns the time in microseconds from sending the request until it finished, or -1 if it has not finished yet.
+ *
+ * \sa QxtRPCService::latencyHistogram()
+ */
+qint64 QxtRPCReply::latency() const
+{
+    return qxt_d().latency;
+}
+
+/*!
+ * Returns the timeout of the request in milliseconds, or 0 if it never times out.
+ *
+ * \sa setTimeout()
+ */
+int QxtRPCReply::timeout() const
+{
+    return qxt_d().timeout;
+}
+
+/*!
+ * Sets the timeout of the request to \a msec milliseconds, counted from the time the request was sent. A request
+ * that has not been answered by then finishes with TimeoutError. Use 0 to remove the timeout. The initial timeout is
+ * QxtRPCService::requestTimeout().
+ *
+ * Setting a timeout that has already passed fails the request when control returns to the event loop.
+ */
+void QxtRPCReply::setTimeout(int msec)
+{
+    qxt_d().timeout = qMax(0, msec);
+    if(!qxt_d().finished && qxt_d().service)
+        qxt_d().service->setDeadline(this, qxt_d().timeout);
+}
+
+/*!
+ * Waits until the request has finished, for at most \a msec milliseconds, or forever if \a msec is -1. Events are
+ * processed while waiting. Returns \c true if the request has finished.
+ */
+bool QxtRPCReply::waitForFinished(int msec)
+{
+    if(qxt_d().finished)
+        return true;
+    QxtSignalWaiter::wait(this, SIGNAL(finished()), msec);
+    return qxt_d().finished;
+}
+
+/*!
+ * Cancels the request. The reply finishes right away with CanceledError and a response that arrives later is
+ * ignored. The peer is not told; its slot still runs. Canceling a finished request does nothing.
+ */
+void QxtRPCReply::cancel()
+{
+    if(qxt_d().finished)
+        return;
+    if(qxt_d().service) {
+        qxt_d().service->finishReply(this, CanceledError, QVariant(), QLatin1String("Request canceled"));
+    } else {
+        qxt_d().finished = true;
+        qxt_d().error = CanceledError;
+        qxt_d().errorString = QLatin1String("Request canceled");
+        emit finished();
+    }
+}
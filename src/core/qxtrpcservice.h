@@ -43,11 +43,19 @@ QT_FORWARD_DECLARE_CLASS(QIODevice)
 class QxtAbstractConnectionManager;
 class QxtAbstractSignalSerializer;
 
+class QxtRPCReply;
+
 class QxtRPCServicePrivate;
 class QXT_CORE_EXPORT QxtRPCService : public QObject
 {
 Q_OBJECT
 public:
+    enum HighWaterPolicy
+    {
+        DropOnHighWater,
+        DisconnectOnHighWater
+    };
+
     QxtRPCService(QObject* parent = 0);
     explicit QxtRPCService(QIODevice* device, QObject* parent = 0);
     virtual ~QxtRPCService();
@@ -66,6 +74,24 @@ public:
     QxtAbstractConnectionManager* connectionManager() const;
     void setConnectionManager(QxtAbstractConnectionManager* manager);
 
+    qint64 highWaterMark() const;
+    void setHighWaterMark(qint64 bytes);
+    HighWaterPolicy highWaterPolicy() const;
+    void setHighWaterPolicy(HighWaterPolicy policy);
+    quint64 droppedCallCount() const;
+
+    int requestTimeout() const;
+    void setRequestTimeout(int msec);
+    QList<quint64> latencyHistogram(const QString& fn) const;
+    void resetLatencyHistograms();
+
+    QxtRPCReply* request(QString fn, const QVariant& p1 = QVariant(), const QVariant& p2 = QVariant(),
+              const QVariant& p3 = QVariant(), const QVariant& p4 = QVariant(), const QVariant& p5 = QVariant(),
+              const QVariant& p6 = QVariant(), const QVariant& p7 = QVariant(), const QVariant& p8 = QVariant());
+    QxtRPCReply* request(quint64 id, QString fn, const QVariant& p1 = QVariant(), const QVariant& p2 = QVariant(),
+              const QVariant& p3 = QVariant(), const QVariant& p4 = QVariant(), const QVariant& p5 = QVariant(),
+              const QVariant& p6 = QVariant(), const QVariant& p7 = QVariant(), const QVariant& p8 = QVariant());
+
     bool attachSignal(QObject* sender, const char* signal, const QString& rpcFunction = QString());
     bool attachSlot(const QString& rpcFunction, QObject* recv, const char* slot,
             Qt::ConnectionType type = Qt::AutoConnection);
@@ -110,4 +136,50 @@ Q_SIGNALS:
 private:
     QXT_DECLARE_PRIVATE(QxtRPCService)
 };
+
+class QxtRPCReplyPrivate;
+class QXT_CORE_EXPORT QxtRPCReply : public QObject
+{
+Q_OBJECT
+public:
+    enum Error
+    {
+        NoError,
+        TimeoutError,
+        CanceledError,
+        ConnectionError,
+        RemoteError
+    };
+
+    virtual ~QxtRPCReply();
+
+    quint64 clientID() const;
+    QString method() const;
+
+    bool isFinished() const;
+    Error error() const;
+    QString errorString() const;
+    QVariant result() const;
+    qint64 latency() const;
+
+    int timeout() const;
+    void setTimeout(int msec);
+
+    bool waitForFinished(int msec = -1);
+
+public Q_SLOTS:
+    void cancel();
+
+Q_SIGNALS:
+    /*!
+     * This signal is emitted once the request has been answered, has failed, or has been canceled.
+     */
+    void finished();
+
+private:
+    friend class QxtRPCService;
+    friend class QxtRPCServicePrivate;
+    explicit QxtRPCReply(QObject* parent);
+    QXT_DECLARE_PRIVATE(QxtRPCReply)
+};
 #endif
@@ -33,13 +33,23 @@
 #define QXTRPCSERVICE_P_H
 
 #include "qxtrpcservice.h"
+#include "qxtabstractsignalserializer.h"
 #include <QPointer>
 #include <QHash>
 #include <QByteArray>
 #include <QString>
 #include <QPair>
+#include <QQueue>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QReadWriteLock>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QMap>
+#include <QVector>
 
 class QxtBoundFunction;
+class QxtRPCServiceWorker;
 
 class QxtRPCServiceIntrospector;
 class QxtRPCServicePrivate : public QObject, public QxtPrivate<QxtRPCService>
@@ -52,11 +62,57 @@ public:
     QxtRPCServiceIntrospector* introspector;
     QxtAbstractConnectionManager* manager;
     QxtAbstractSignalSerializer* serializer;
+
+    // Serializers that keep state between messages are cloned for every connection; stateless serializers are
+    // shared. See QxtAbstractSignalSerializer::clone().
+    bool statefulSerializer;
+    QxtAbstractSignalSerializer* serverSerializer;
     QPointer<QIODevice> device;
 
-    // One buffer is needed for the "server" connection, and one buffer is needed for each connected client.
-    QByteArray serverBuffer;
-    QHash<quint64, QByteArray> buffers;
+    // Incoming data is consumed by advancing a read offset instead of removing each message from the front of the
+    // buffer. The unread tail is only moved back to the start once it is smaller than the consumed part, so every
+    // byte is moved at most a constant number of times no matter how many messages arrive in a single read.
+    struct ReadBuffer
+    {
+        ReadBuffer() : offset(0) {}
+        QByteArray data;
+        int offset;
+
+        void read(QIODevice* dev);
+    };
+
+    // One buffer is needed for the "server" connection; client buffers are kept by the workers.
+    ReadBuffer serverBuffer;
+
+    // One call on its way to the clients. With a stateless serializer the frame is encoded once and shared by all
+    // receivers; otherwise it is left null and every receiver encodes the call with its own serializer.
+    struct OutgoingCall
+    {
+        enum Target { Listed, All, AllExcept };
+        OutgoingCall() : target(Listed) {}
+        QString fn;
+        QVariant params[8];
+        QByteArray frame;
+        Target target;
+        QList<quint64> ids;             // the receivers, or the client left out for AllExcept
+
+        QByteArray encode(QxtAbstractSignalSerializer* serializer) const;
+    };
+    void post(OutgoingCall& call);
+    void postTo(QxtRPCServiceWorker* worker, const OutgoingCall& call);
+
+    // Each client is served by a worker living in the thread of its device. The local worker serves devices owned
+    // by the service's thread; connection managers that run their own I/O threads get one worker per thread.
+    QxtRPCServiceWorker* localWorker;
+    QList<QPointer<QxtRPCServiceWorker> > workers;
+    QHash<quint64, QxtRPCServiceWorker*> clientWorkers;
+    QxtRPCServiceWorker* workerFor(QThread* thread);
+
+    // Frames going to a client are handed to its device only while the device's own write buffer is small.
+    enum { DirectWriteLimit = 65536 };
+    QAtomicInteger<qint64> highWaterMark;
+    QAtomicInt highWaterPolicy;
+    QAtomicInteger<quint64> droppedCalls;
 
     // A Qt invokable, such as a signal or slot, can be identified by the metaobject containing its description plus
     // its signature or name. It is worth noting that QxtRPCService uses the same structure for both signals and slots,
@@ -80,6 +136,9 @@ public:
         }
     };
 
+    // Workers dispatch from their own threads, so the slot tables below are guarded by slotLock.
+    mutable QReadWriteLock slotLock;
+
     // Maps an RPC function name to a list of slot connections.
     QHash<QString, QList<SlotDef> > connectedSlots;
 
@@ -89,27 +148,126 @@ public:
     // Maps a slot's metamethod to an array of parameter type names.
     QHash<MetaMethodDef, QList<QByteArray> > slotParameters;
 
-    // Maps the connected client id with bound parameters of the slot
-    QHash<quint64, QxtBoundFunction*>  clientsDataArgument;
+    inline QxtAbstractSignalSerializer* deviceSerializer() const
+    {
+        return serverSerializer ? serverSerializer : serializer;
+    }
+    void resetSerializers();
+
+    // Function names passed to call() are normalized once and remembered.
+    QHash<QString, QString> normalizedNames;
+    QString normalizedName(const QString& fn);
+
+    // A slot to invoke and the number of parameters it takes.
+    typedef QPair<SlotDef, int> SlotTarget;
+    bool lookupSlots(const QString& fn, QList<SlotTarget>& targets, SlotTarget& fallback) const;
 
     // As described in the main class's documentation, QMetaObject::invokeMethod is limited to 10 parameters, so
-    // QxtRPCService is limited to 8.
-    void dispatchFromServer(const QString& fn, const QVariant& p0 = QVariant(), const QVariant& p1 = QVariant(),
-                            const QVariant& p2 = QVariant(), const QVariant& p3 = QVariant(),
-                            const QVariant& p4 = QVariant(), const QVariant& p5 = QVariant(),
-                            const QVariant& p6 = QVariant(), const QVariant& p7 = QVariant()) const;
-    void dispatchFromClient(quint64 id, const QString& fn, const QVariant& p0 = QVariant(),
-                            const QVariant& p1 = QVariant(), const QVariant& p2 = QVariant(),
-                            const QVariant& p3 = QVariant(), const QVariant& p4 = QVariant(),
-                            const QVariant& p5 = QVariant(), const QVariant& p6 = QVariant(),
-                            const QVariant& p7 = QVariant()) const;
+    // QxtRPCService is limited to 8. Only the parameters that were actually received are passed in.
+    void dispatchFromServer(const QString& fn, const QList<QVariant>& params) const;
+    void dispatchFromClient(quint64 id, const QString& fn, const QList<QVariant>& params) const;
+
+    // Requests and responses travel as calls to reserved function names. A request carries the request ID, the
+    // function name and the argument list; a response carries the request ID, a status and the result or an error
+    // message. Requests are answered on the connection they arrived on.
+    enum ResponseStatus { ResponseOk, ResponseNoSlot, ResponseInvokeFailed };
+    bool dispatchReserved(quint64 id, const QxtAbstractSignalSerializer::DeserializedData& data);
+    void dispatchRequest(quint64 id, const QList<QVariant>& frame);
+    void dispatchResponse(quint64 id, const QList<QVariant>& frame);
+    void respond(quint64 id, quint64 requestID, int status, const QVariant& value);
+
+    // Maps a slot's metamethod to its return type, used to answer requests.
+    QHash<MetaMethodDef, int> slotReturnTypes;
+
+    // Outstanding requests, by request ID. Replies belong to the service's thread and so does everything below.
+    quint64 nextRequestID;
+    QHash<quint64, QxtRPCReply*> pendingReplies;
+    QxtRPCReply* sendRequest(quint64 id, const QString& fn, const QVariant* params);
+    void finishReply(QxtRPCReply* reply, int error, const QVariant& result, const QString& errorString);
+    void failReplies(quint64 id, const QString& errorString);
+    void forgetReply(QxtRPCReply* reply);
+
+    // Deadlines are kept in a single ordered map on the service's clock so that many requests in flight share one
+    // timer.
+    int requestTimeout;
+    QElapsedTimer clock;
+    QMultiMap<qint64, quint64> deadlines;   // deadline in nanoseconds -> request ID
+    QTimer deadlineTimer;
+    void setDeadline(QxtRPCReply* reply, int msec);
+    void scheduleDeadlines();
+
+    // Round-trip latencies of answered requests by function name, in power-of-two buckets of microseconds.
+    enum { LatencyBuckets = 32 };
+    QHash<QString, QVector<quint64> > latencies;
+
+    void clientConnected(QIODevice* dev, quint64 id, const QPointer<QThread>& thread);
 
 public Q_SLOTS:
-    void clientConnected(QIODevice* dev, quint64 id);
+    void connectionAdded(QIODevice* dev, quint64 id);
     void clientDisconnected(QIODevice* dev, quint64 id);
-    void clientData(quint64 id);
 
     void serverData();
+    void expireRequests();
+};
+
+class QxtRPCReplyPrivate : public QxtPrivate<QxtRPCReply>
+{
+public:
+    QxtRPCReplyPrivate();
+    QXT_DECLARE_PUBLIC(QxtRPCReply)
+
+    QxtRPCServicePrivate* service;          // 0 once the service is gone
+    quint64 requestID;
+    quint64 clientID;
+    QString method;
+    bool finished;
+    QxtRPCReply::Error error;
+    QString errorString;
+    QVariant result;
+    qint64 started;                         // on the service's clock, in nanoseconds
+    qint64 deadline;                        // 0 if the request never times out
+    qint64 latency;                         // in microseconds, -1 until finished
+    int timeout;
+};
+
+/*
+ * A worker owns the per-client state of the connections whose devices live in its thread: read buffers, send
+ * queues and per-connection serializers. Everything here is only touched from that thread, so a client's messages
+ * are read, dispatched and written in order without locking.
+ */
+class QxtRPCServiceWorker : public QObject
+{
+Q_OBJECT
+public:
+    QxtRPCServiceWorker(QxtRPCServicePrivate* service);
+    ~QxtRPCServiceWorker();
+
+    struct Client
+    {
+        Client() : onReadyRead(0), onBytesWritten(0), serializer(0), queued(0) {}
+        QPointer<QIODevice> device;
+        QxtBoundFunction* onReadyRead;
+        QxtBoundFunction* onBytesWritten;
+        QxtAbstractSignalSerializer* serializer;    // per-connection clone, or 0 for the shared serializer
+        QxtRPCServicePrivate::ReadBuffer buffer;
+        QQueue<QByteArray> frames;                  // frames waiting for room in the device's write buffer
+        qint64 queued;                              // bytes in frames
+    };
+
+    QxtRPCServicePrivate* service;
+    QHash<quint64, Client> clients;
+
+    void attach(QIODevice* dev, quint64 id);
+    void detach(quint64 id);
+    void deliver(const QxtRPCServicePrivate::OutgoingCall& call);
+    void resetSerializers();
+
+public Q_SLOTS:
+    void clientData(quint64 id);
+    void clientBytesWritten(quint64 id);
+
+private:
+    void send(quint64 id, Client& client, const QxtRPCServicePrivate::OutgoingCall& call, QList<quint64>& slow);
 };
 
 #endif
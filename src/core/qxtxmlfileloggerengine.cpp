@@ -28,9 +28,9 @@
 **
 ** <http://libqxt.org>  <foundation@libqxt.org>
 *****************************************************************************/
-
 #include "qxtxmlfileloggerengine.h"
 #include <QTime>
+#include <QDateTime>
 
 /*!
     \class QxtXmlFileLoggerEngine
@@ -51,6 +51,14 @@
     </log>
     \endcode
 
+    By default the closing \c{</log>} tag is rewritten after every entry, so
+    the file is well-formed at all times. In append-only mode entries are
+    only ever appended to the file: the closing tag is written when the
+    engine is killed and removed again when an existing file is opened. A file
+    left without its closing tag, for example after a crash, is continued as
+    it is. Append-only files are cheaper to write and safe to read while they
+    are written.
+
     \sa QxtLogger
  */
 
@@ -60,12 +68,60 @@ class QxtXmlFileLoggerEnginePrivate : public QxtPrivate<QxtXmlFileLoggerEngine>
 
 public:
     QxtXmlFileLoggerEnginePrivate();
-    QString tab;
+    QByteArray tab;
+    bool appendOnly;
+    bool tagOpen;                   // the closing tag is missing from the file
+
+    QByteArray buffer;              // reused for every entry
+    qint64 stampTime;
+    QByteArray stamp;
 };
 
 QxtXmlFileLoggerEnginePrivate::QxtXmlFileLoggerEnginePrivate()
-        : tab("    ")
+        : tab("    "), appendOnly(false), tagOpen(false), stampTime(-1)
+{
+    buffer.reserve(1024);
+}
+
+static const char qxtXmlHeader[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<log>\n";
+static const char qxtXmlFooter[] = "</log>";
+
+/*
+ * Appends the UTF-8 text to out with the reserved characters replaced by
+ * entities, copying the runs between them in one piece.
+ */
+static void qxtAppendXmlEscaped(QByteArray& out, const QByteArray& text)
 {
+    const char* data = text.constData();
+    int run = 0;
+    for (int i = 0; i < text.size(); i++)
+    {
+        const char* entity;
+        switch (data[i])
+        {
+        case '&':
+            entity = "&amp;";
+            break;
+        case '<':
+            entity = "&lt;";
+            break;
+        case '>':
+            entity = "&gt;";
+            break;
+        case '\'':
+            entity = "&apos;";
+            break;
+        case '"':
+            entity = "&quot;";
+            break;
+        default:
+            continue;
+        }
+        out.append(data + run, i - run);
+        out.append(entity);
+        run = i + 1;
+    }
+    out.append(data + run, text.size() - run);
 }
 
 /*!
@@ -75,6 +131,40 @@ QxtXmlFileLoggerEngine::QxtXmlFileLoggerEngine(const QString& fileName)
         : QxtAbstractFileLoggerEngine(fileName, QIODevice::ReadWrite | QIODevice::Unbuffered)
 {
     QXT_INIT_PRIVATE(QxtXmlFileLoggerEngine);
+    // the base class could only run its own initLoggerEngine()
+    if (!fileName.isEmpty()) initLoggerEngine();
+}
+
+/*!
+    Destructs the XML file logger engine. In append-only mode the closing tag
+    is written.
+ */
+QxtXmlFileLoggerEngine::~QxtXmlFileLoggerEngine()
+{
+    killLoggerEngine();
+}
+
+/*!
+    Returns \c true if the engine only appends to its file. The default is \c false.
+
+    \sa setAppendOnly()
+ */
+bool QxtXmlFileLoggerEngine::isAppendOnly() const
+{
+    return qxt_d().appendOnly;
+}
+
+/*!
+    Sets whether the engine only appends to its file to \a enable. An open
+    file is closed and opened again in the new mode.
+ */
+void QxtXmlFileLoggerEngine::setAppendOnly(bool enable)
+{
+    if (qxt_d().appendOnly == enable) return;
+    bool open = isInitialized();
+    if (open) killLoggerEngine();
+    qxt_d().appendOnly = enable;
+    if (open) initLoggerEngine();
 }
 
 /*!
@@ -96,24 +186,49 @@ void QxtXmlFileLoggerEngine::initLoggerEngine()
     </log>
     */
     QIODevice* file = device();
-    Q_ASSERT(file);
+    if (!file) return;
     if (file->size() == 0)
     {
-        file->write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-        file->write("<log>\n");
-        file->write("</log>");
+        file->write(qxtXmlHeader);
+        if (!qxt_d().appendOnly) file->write(qxtXmlFooter);
+        qxt_d().tagOpen = qxt_d().appendOnly;
+        return;
     }
-    else
+
+    QByteArray data = file->read(64);
+    if (!data.startsWith(QByteArray("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<log>")))
     {
-        QByteArray data = file->read(64);
-        if (!data.startsWith(QByteArray("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<log>")))
-        {
-            QFile* ptr_fileTarget = static_cast<QFile*>(file);
-            qxtLog->warning(QString(" is not a valid XML log file.").prepend(ptr_fileTarget->fileName()));
-            killLoggerEngine();
-            return;
-        }
+        QFile* ptr_fileTarget = static_cast<QFile*>(file);
+        qxtLog->warning(QString(" is not a valid XML log file.").prepend(ptr_fileTarget->fileName()));
+        killLoggerEngine();
+        return;
+    }
+    if (!qxt_d().appendOnly) return;
+
+    // Cut the closing tag of a cleanly closed file once, then only append.
+    qint64 size = file->size();
+    qint64 tail = qMin(size, qint64(16));
+    file->seek(size - tail);
+    QByteArray end = file->read(tail);
+    int footer = end.lastIndexOf(qxtXmlFooter);
+    if (footer >= 0 && end.mid(footer + 6).trimmed().isEmpty())
+    {
+        size -= tail - footer;
+        static_cast<QFile*>(file)->resize(size);
     }
+    file->seek(size);
+    qxt_d().tagOpen = true;
+}
+
+/*!
+    \reimp
+ */
+void QxtXmlFileLoggerEngine::killLoggerEngine()
+{
+    if (qxt_d().tagOpen && device())
+        device()->write(qxtXmlFooter);
+    qxt_d().tagOpen = false;
+    QxtAbstractFileLoggerEngine::killLoggerEngine();
 }
 
 /*!
@@ -121,29 +236,42 @@ void QxtXmlFileLoggerEngine::initLoggerEngine()
  */
 void QxtXmlFileLoggerEngine::writeToFile(const QString &level, const QVariantList &messages)
 {
+    QxtXmlFileLoggerEnginePrivate& d = qxt_d();
     QIODevice* ptr_fileTarget = device();
     Q_ASSERT(ptr_fileTarget);
-    ptr_fileTarget->seek(ptr_fileTarget->size() - 6);
-    ptr_fileTarget->write(qxt_d().tab.toUtf8());
-    ptr_fileTarget->write("<entry type=\"");
-    ptr_fileTarget->write(level.toUtf8());
-    ptr_fileTarget->write("\" time=\"");
-    ptr_fileTarget->write(QTime::currentTime().toString("hh:mm:ss.zzzz").toUtf8());
-    ptr_fileTarget->write("\">");
-    ptr_fileTarget->write("\n");
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (now != d.stampTime)
+    {
+        d.stamp = QTime::currentTime().toString("hh:mm:ss.zzzz").toUtf8();
+        d.stampTime = now;
+    }
+
+    QByteArray& entry = d.buffer;
+    entry.resize(0);
+    entry.append(d.tab);
+    entry.append("<entry type=\"");
+    entry.append(level.toUtf8());
+    entry.append("\" time=\"");
+    entry.append(d.stamp);
+    entry.append("\">\n");
     Q_FOREACH(const QVariant& m, messages)
     {
-        ptr_fileTarget->write(qxt_d().tab.toUtf8());
-        ptr_fileTarget->write(qxt_d().tab.toUtf8());
-        ptr_fileTarget->write("<message>");
-        ptr_fileTarget->write(toXmlSafeString(m.toString()).toUtf8());
-        ptr_fileTarget->write("</message>\n");
+        entry.append(d.tab);
+        entry.append(d.tab);
+        entry.append("<message>");
+        qxtAppendXmlEscaped(entry, m.toString().toUtf8());
+        entry.append("</message>\n");
     }
+    entry.append(d.tab);
+    entry.append("</entry>\n");
 
-    ptr_fileTarget->write(qxt_d().tab.toUtf8());
-    ptr_fileTarget->write("</entry>");
-    ptr_fileTarget->write("\n");
-    ptr_fileTarget->write("</log>");
+    if (!d.appendOnly)
+    {
+        ptr_fileTarget->seek(ptr_fileTarget->size() - 6);
+        entry.append(qxtXmlFooter);
+    }
+    ptr_fileTarget->write(entry);
 }
 
 /*!
@@ -157,8 +285,8 @@ QString QxtXmlFileLoggerEngine::toXmlSafeString(const QString &raw)
     > &lt;
     ' &apos;
     " &quot;
-
-    Convert ampersands first, then the rest.
     */
-    return QByteArray(raw.toUtf8()).replace('&', "&amp;").replace('<', "&lt;").replace('>', "&gt;").replace('\'', "&apos;").replace('"', "&quot;");
+    QByteArray escaped;
+    qxtAppendXmlEscaped(escaped, raw.toUtf8());
+    return QString::fromUtf8(escaped);
 }
@@ -45,8 +45,13 @@ class QXT_CORE_EXPORT QxtXmlFileLoggerEngine : public QxtAbstractFileLoggerEngin
 
 public:
     QxtXmlFileLoggerEngine(const QString& fileName = QString());
+    ~QxtXmlFileLoggerEngine();
+
+    bool isAppendOnly() const;
+    void setAppendOnly(bool enable);
 
     virtual void initLoggerEngine();
+    virtual void killLoggerEngine();
 
 protected:
     virtual void   writeToFile(const QString &level, const QVariantList &messages);
@@ -113,5 +113,5 @@ QxtJSONRpcCall * QxtJSONRpcClient::call(QString method, QVariantList arguments)
     request.setRawHeader("Connection", "close");
     request.setUrl(d->url);
 
-    return new QxtJSONRpcCall(d->networkManager->post(request, QxtJSON::stringify(m).toUtf8()));
+    return new QxtJSONRpcCall(d->networkManager->post(request, QxtJSON::stringifyUtf8(m)));
 }
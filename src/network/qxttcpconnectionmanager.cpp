@@ -32,6 +32,7 @@
 #include "qxttcpconnectionmanager.h"
 #include "qxttcpconnectionmanager_p.h"
 #include <QTcpSocket>
+#include <QThread>
 #include <QtDebug>
 
 /*!
@@ -52,6 +53,10 @@
  * is, for instance, where you could create a QSslSocket to encrypt communications
  * (but see QxtSslConnectionManager).
  *
+ * By default every connection is served from the thread the connection manager
+ * lives in. With setWorkerThreadCount(), accepted connections are instead handed
+ * out in turn to a pool of I/O threads, which own the sockets from then on.
+ *
  * \sa QTcpServer, QxtSslConnectionManager
  */
 
@@ -66,12 +71,22 @@ QxtTcpConnectionManager::QxtTcpConnectionManager(QObject* parent) : QxtAbstractC
 #endif
 }
 
+/*!
+ * Destroys the connection manager. Connections served by worker threads are
+ * closed before the threads are stopped.
+ */
+QxtTcpConnectionManager::~QxtTcpConnectionManager()
+{
+    qxt_d().stopWorkers();
+}
+
 QxtTcpConnectionManagerPrivate::QxtTcpConnectionManagerPrivate()
 #ifndef QT_NO_OPENSSL
 : QxtSslServer(0)
 #else
 : QTcpServer(0)
 #endif
+, workerThreadCount(0)
 {
     QObject::connect(&mapper, SIGNAL(mapped(QObject*)), this, SLOT(socketDisconnected(QObject*)));
 }
@@ -83,7 +98,16 @@ void QxtTcpConnectionManagerPrivate::incomingConnection(int socketDescriptor)
 #endif
 {
     QIODevice* device = qxt_p().incomingConnection(socketDescriptor);
-    if (device)
+    QxtTcpConnectionWorker* worker = device ? acceptingWorker() : 0;
+    if (worker)
+    {
+        // Hand the connection over to an I/O thread; the worker adopts the
+        // device and adds it to the connection pool from there.
+        device->setParent(0);
+        device->moveToThread(worker->thread());
+        QMetaObject::invokeMethod(worker, "attachConnection", Qt::QueuedConnection, Q_ARG(QIODevice*, device));
+    }
+    else if (device)
     {
         qxt_p().addConnection(device, (quint64)static_cast<QObject*>(device));
         mapper.setMapping(device, device);
@@ -105,6 +129,7 @@ void QxtTcpConnectionManagerPrivate::incomingConnection(int socketDescriptor)
  */
 bool QxtTcpConnectionManager::listen(QHostAddress iface, int port)
 {
+    qxt_d().startWorkers();
     return qxt_d().listen(iface, port);
 }
 
@@ -154,7 +179,13 @@ QIODevice* QxtTcpConnectionManager::incomingConnection(int socketDescriptor)
 void QxtTcpConnectionManager::removeConnection(QIODevice* device, quint64 clientID)
 {
     Q_UNUSED(clientID);
-    if (device)
+    if (device && device->thread() != QThread::currentThread())
+    {
+        // The socket belongs to a worker thread; close it there. The call is
+        // dropped if the socket has been destroyed in the meantime.
+        QMetaObject::invokeMethod(device, [this, device]() { removeConnection(device, 0); }, Qt::QueuedConnection);
+    }
+    else if (device)
     {
         QAbstractSocket* sock = qobject_cast<QAbstractSocket*>(device);
         if (sock) sock->disconnectFromHost();
@@ -183,6 +214,35 @@ QNetworkProxy QxtTcpConnectionManager::proxy() const
     return qxt_d().proxy();
 }
 
+/*!
+ * Returns the number of I/O threads used to serve connections.
+ * \sa setWorkerThreadCount()
+ */
+int QxtTcpConnectionManager::workerThreadCount() const
+{
+    return qxt_d().workerThreadCount;
+}
+
+/*!
+ * Sets the number of I/O threads used to serve connections to \a count.
+ *
+ * The default value is 0, which serves every connection from the thread the
+ * connection manager lives in. With a positive count, listen() launches that
+ * many worker threads and each accepted connection is handed to one of them
+ * in turn. The socket is moved to the worker's thread, so its signals are
+ * delivered there; users of the connection manager such as QxtRPCService
+ * follow the socket to its thread.
+ *
+ * \note The worker count takes effect the first time the connection manager
+ * starts listening.
+ *
+ * \sa listen()
+ */
+void QxtTcpConnectionManager::setWorkerThreadCount(int count)
+{
+    qxt_d().workerThreadCount = qMax(0, count);
+}
+
 void QxtTcpConnectionManagerPrivate::socketDisconnected(QObject* client)
 {
     QTcpSocket* sock = qobject_cast<QTcpSocket*>(client);
@@ -193,3 +253,78 @@ void QxtTcpConnectionManagerPrivate::socketDisconnected(QObject* client)
     }
     qxt_p().disconnect((quint64)(client));
 }
+
+void QxtTcpConnectionManagerPrivate::startWorkers()
+{
+    if (!workers.isEmpty()) return;
+    for (int i = 0; i < workerThreadCount; i++)
+    {
+        QThread* thread = new QThread;
+        QxtTcpConnectionWorker* worker = new QxtTcpConnectionWorker(this);
+        worker->moveToThread(thread);
+        QObject::connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+        thread->start();
+        workers.append(worker);
+    }
+}
+
+void QxtTcpConnectionManagerPrivate::stopWorkers()
+{
+    QList<QxtTcpConnectionWorker*> stopping = workers;
+    workers.clear();
+    foreach(QxtTcpConnectionWorker* worker, stopping)
+    {
+        QThread* thread = worker->thread();
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+}
+
+QxtTcpConnectionWorker* QxtTcpConnectionManagerPrivate::acceptingWorker()
+{
+    if (workers.isEmpty()) return 0;
+    // Round-robin over the I/O threads
+    uint next = uint(nextWorker.fetchAndAddRelaxed(1));
+    return workers.at(next % uint(workers.count()));
+}
+
+QxtTcpConnectionWorker::QxtTcpConnectionWorker(QxtTcpConnectionManagerPrivate* manager) : QObject(0), manager(manager)
+{
+    // initializers only
+}
+
+QxtTcpConnectionWorker::~QxtTcpConnectionWorker()
+{
+    // The worker goes away with its thread; close the connections it still
+    // serves so that they leave the connection pool before being destroyed.
+    foreach(QObject* child, children())
+    {
+        QObject::disconnect(child, 0, this, 0);
+        if (manager->qxt_p().client((quint64)child) == child)
+            manager->qxt_p().disconnect((quint64)child);
+    }
+}
+
+void QxtTcpConnectionWorker::attachConnection(QIODevice* device)
+{
+    // The device was pushed to this thread without a parent; adopt it so it
+    // is cleaned up along with the worker.
+    device->setParent(this);
+    manager->qxt_p().addConnection(device, (quint64)static_cast<QObject*>(device));
+    QObject::connect(device, SIGNAL(destroyed()), this, SLOT(socketDisconnected()));
+    QTcpSocket* sock = qobject_cast<QTcpSocket*>(device);
+    if (sock)
+    {
+        QObject::connect(sock, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketDisconnected()));
+        QObject::connect(sock, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+    }
+}
+
+void QxtTcpConnectionWorker::socketDisconnected()
+{
+    QObject* client = sender();
+    if (!client) return;
+    QObject::disconnect(client, 0, this, 0);
+    manager->qxt_p().disconnect((quint64)(client));
+}
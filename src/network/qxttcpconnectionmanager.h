@@ -40,9 +40,12 @@ QT_FORWARD_DECLARE_CLASS(QIODevice)
 class QxtTcpConnectionManagerPrivate;
 class QXT_NETWORK_EXPORT QxtTcpConnectionManager : public QxtAbstractConnectionManager
 {
+    friend class QxtTcpConnectionWorker;
     Q_OBJECT
+    Q_PROPERTY(int workerThreadCount READ workerThreadCount WRITE setWorkerThreadCount)
 public:
     QxtTcpConnectionManager(QObject* parent);
+    ~QxtTcpConnectionManager();
 
     bool listen(QHostAddress iface = QHostAddress::Any, int port = 80);
     void stopListening();
@@ -51,6 +54,9 @@ public:
     void setProxy(const QNetworkProxy& proxy);
     QNetworkProxy proxy() const;
 
+    int workerThreadCount() const;
+    void setWorkerThreadCount(int count);
+
 protected:
 #if QT_VERSION >= 0x050000
 	virtual QIODevice* incomingConnection(qintptr socketDescriptor);
@@ -36,6 +36,10 @@
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QSignalMapper>
+#include <QList>
+#include <QAtomicInt>
+
+class QxtTcpConnectionWorker;
 
 #ifdef QT_NO_OPENSSL
 class QxtTcpConnectionManagerPrivate : public QTcpServer, public QxtPrivate<QxtTcpConnectionManager>
@@ -51,6 +55,14 @@ public:
     QxtTcpConnectionManagerPrivate();
     QXT_DECLARE_PUBLIC(QxtTcpConnectionManager)
 
+    int workerThreadCount;
+    QList<QxtTcpConnectionWorker*> workers;
+    QAtomicInt nextWorker;
+
+    void startWorkers();
+    void stopWorkers();
+    QxtTcpConnectionWorker* acceptingWorker();
+
 protected:
 #if QT_VERSION >= 0x050000
 	void incomingConnection(qintptr socketDescriptor);
@@ -65,4 +77,24 @@ private:
     QSignalMapper mapper;
 };
 
+/*
+ * An I/O worker owns the sockets handed to it by the connection manager.
+ * Reads and writes for those sockets happen on the worker's thread, and the
+ * worker reports their disconnection back to the connection manager.
+ */
+class QxtTcpConnectionWorker : public QObject
+{
+Q_OBJECT
+public:
+    QxtTcpConnectionWorker(QxtTcpConnectionManagerPrivate* manager);
+    ~QxtTcpConnectionWorker();
+
+private Q_SLOTS:
+    void attachConnection(QIODevice* device);
+    void socketDisconnected();
+
+private:
+    QxtTcpConnectionManagerPrivate* manager;
+};
+
 #endif
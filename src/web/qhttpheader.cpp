@@ -43,19 +43,76 @@
 
 #include "qhttpheader.h"
 #include <QtCore/QSet>
+#include <QtCore/QVector>
 
 
 class QHttpHeaderPrivate
 {
     Q_DECLARE_PUBLIC(QHttpHeader)
 public:
+    struct RawValue
+    {
+        int keyOffset;
+        int keyLength;
+        int valueOffset;
+        int valueLength;
+        bool folded;
+    };
+
     inline virtual ~QHttpHeaderPrivate() {}
 
+    bool rawKeyIs(const RawValue &entry, const QByteArray &key) const;
+    QString rawKey(const RawValue &entry) const;
+    QString rawValue(const RawValue &entry) const;
+    void decodeRawValues();
+
     QList<QPair<QString, QString> > values;
+    // A header received by QxtHttpRequestParser keeps its fields as byte ranges into raw. Lookups decode only the
+    // values they return; the first change to the fields decodes all of them into values.
+    QByteArray raw;
+    QVector<RawValue> rawValues;
     bool valid;
     QHttpHeader *q_ptr;
 };
 
+bool QHttpHeaderPrivate::rawKeyIs(const RawValue &entry, const QByteArray &key) const
+{
+    return entry.keyLength == key.size() && qstrnicmp(raw.constData() + entry.keyOffset, key.constData(), key.size()) == 0;
+}
+
+QString QHttpHeaderPrivate::rawKey(const RawValue &entry) const
+{
+    return QString::fromLatin1(raw.constData() + entry.keyOffset, entry.keyLength);
+}
+
+QString QHttpHeaderPrivate::rawValue(const RawValue &entry) const
+{
+    QByteArray value = QByteArray::fromRawData(raw.constData() + entry.valueOffset, entry.valueLength);
+    if (!entry.folded)
+        return QString::fromUtf8(value);
+    // Obsolete line folding: the continuation lines are joined with single spaces
+    QByteArray joined;
+    foreach (const QByteArray &line, value.split('\n')) {
+        QByteArray part = line.trimmed();
+        if (part.isEmpty())
+            continue;
+        if (!joined.isEmpty())
+            joined += ' ';
+        joined += part;
+    }
+    return QString::fromUtf8(joined);
+}
+
+void QHttpHeaderPrivate::decodeRawValues()
+{
+    if (rawValues.isEmpty())
+        return;
+    values.reserve(values.count() + rawValues.count());
+    for (int i = 0; i < rawValues.count(); ++i)
+        values.append(qMakePair(rawKey(rawValues.at(i)), rawValue(rawValues.at(i))));
+    rawValues.clear();
+}
+
 /****************************************************
  *
  * QHttpHeader
@@ -130,6 +187,8 @@ QHttpHeader::QHttpHeader(const QHttpHeader &header)
     d->q_ptr = this;
     d->valid = header.d_func()->valid;
     d->values = header.d_func()->values;
+    d->raw = header.d_func()->raw;
+    d->rawValues = header.d_func()->rawValues;
 }
 
 /*!
@@ -170,6 +229,8 @@ QHttpHeader::QHttpHeader(QHttpHeaderPrivate &dd, const QHttpHeader &header)
     d->q_ptr = this;
     d->valid = header.d_func()->valid;
     d->values = header.d_func()->values;
+    d->raw = header.d_func()->raw;
+    d->rawValues = header.d_func()->rawValues;
 }
 /*!
     Destructor.
@@ -185,6 +246,8 @@ QHttpHeader &QHttpHeader::operator=(const QHttpHeader &h)
 {
     Q_D(QHttpHeader);
     d->values = h.d_func()->values;
+    d->raw = h.d_func()->raw;
+    d->rawValues = h.d_func()->rawValues;
     d->valid = h.d_func()->valid;
     return *this;
 }
@@ -266,6 +329,14 @@ void QHttpHeader::setValid(bool v)
 QString QHttpHeader::value(const QString &key) const
 {
     Q_D(const QHttpHeader);
+    if (!d->rawValues.isEmpty()) {
+        QByteArray rawKey = key.toLatin1();
+        for (int i = 0; i < d->rawValues.count(); ++i) {
+            if (d->rawKeyIs(d->rawValues.at(i), rawKey))
+                return d->rawValue(d->rawValues.at(i));
+        }
+        return QString();
+    }
     QString lowercaseKey = key.toLower();
     QList<QPair<QString, QString> >::ConstIterator it = d->values.constBegin();
     while (it != d->values.constEnd()) {
@@ -283,8 +354,16 @@ QString QHttpHeader::value(const QString &key) const
 QStringList QHttpHeader::allValues(const QString &key) const
 {
     Q_D(const QHttpHeader);
-    QString lowercaseKey = key.toLower();
     QStringList valueList;
+    if (!d->rawValues.isEmpty()) {
+        QByteArray rawKey = key.toLatin1();
+        for (int i = 0; i < d->rawValues.count(); ++i) {
+            if (d->rawKeyIs(d->rawValues.at(i), rawKey))
+                valueList.append(d->rawValue(d->rawValues.at(i)));
+        }
+        return valueList;
+    }
+    QString lowercaseKey = key.toLower();
     QList<QPair<QString, QString> >::ConstIterator it = d->values.constBegin();
     while (it != d->values.constEnd()) {
         if ((*it).first.toLower() == lowercaseKey)
@@ -304,6 +383,17 @@ QStringList QHttpHeader::keys() const
     Q_D(const QHttpHeader);
     QStringList keyList;
     QSet<QString> seenKeys;
+    if (!d->rawValues.isEmpty()) {
+        for (int i = 0; i < d->rawValues.count(); ++i) {
+            QString key = d->rawKey(d->rawValues.at(i));
+            QString lowercaseKey = key.toLower();
+            if (!seenKeys.contains(lowercaseKey)) {
+                keyList.append(key);
+                seenKeys.insert(lowercaseKey);
+            }
+        }
+        return keyList;
+    }
     QList<QPair<QString, QString> >::ConstIterator it = d->values.constBegin();
     while (it != d->values.constEnd()) {
         const QString &key = (*it).first;
@@ -326,6 +416,14 @@ QStringList QHttpHeader::keys() const
 bool QHttpHeader::hasKey(const QString &key) const
 {
     Q_D(const QHttpHeader);
+    if (!d->rawValues.isEmpty()) {
+        QByteArray rawKey = key.toLatin1();
+        for (int i = 0; i < d->rawValues.count(); ++i) {
+            if (d->rawKeyIs(d->rawValues.at(i), rawKey))
+                return true;
+        }
+        return false;
+    }
     QString lowercaseKey = key.toLower();
     QList<QPair<QString, QString> >::ConstIterator it = d->values.constBegin();
     while (it != d->values.constEnd()) {
@@ -349,6 +447,7 @@ bool QHttpHeader::hasKey(const QString &key) const
 void QHttpHeader::setValue(const QString &key, const QString &value)
 {
     Q_D(QHttpHeader);
+    d->decodeRawValues();
     QString lowercaseKey = key.toLower();
     QList<QPair<QString, QString> >::Iterator it = d->values.begin();
     while (it != d->values.end()) {
@@ -369,6 +468,7 @@ void QHttpHeader::setValues(const QList<QPair<QString, QString> > &values)
 {
     Q_D(QHttpHeader);
     d->values = values;
+    d->rawValues.clear();
 }
 
 /*!
@@ -377,6 +477,7 @@ void QHttpHeader::setValues(const QList<QPair<QString, QString> > &values)
 void QHttpHeader::addValue(const QString &key, const QString &value)
 {
     Q_D(QHttpHeader);
+    d->decodeRawValues();
     d->values.append(qMakePair(key, value));
 }
 
@@ -386,6 +487,13 @@ void QHttpHeader::addValue(const QString &key, const QString &value)
 QList<QPair<QString, QString> > QHttpHeader::values() const
 {
     Q_D(const QHttpHeader);
+    if (!d->rawValues.isEmpty()) {
+        QList<QPair<QString, QString> > valueList;
+        valueList.reserve(d->rawValues.count());
+        for (int i = 0; i < d->rawValues.count(); ++i)
+            valueList.append(qMakePair(d->rawKey(d->rawValues.at(i)), d->rawValue(d->rawValues.at(i))));
+        return valueList;
+    }
     return d->values;
 }
 
@@ -397,6 +505,7 @@ QList<QPair<QString, QString> > QHttpHeader::values() const
 void QHttpHeader::removeValue(const QString &key)
 {
     Q_D(QHttpHeader);
+    d->decodeRawValues();
     QString lowercaseKey = key.toLower();
     QList<QPair<QString, QString> >::Iterator it = d->values.begin();
     while (it != d->values.end()) {
@@ -414,6 +523,7 @@ void QHttpHeader::removeValue(const QString &key)
 void QHttpHeader::removeAllValues(const QString &key)
 {
     Q_D(QHttpHeader);
+    d->decodeRawValues();
     QString lowercaseKey = key.toLower();
     QList<QPair<QString, QString> >::Iterator it = d->values.begin();
     while (it != d->values.end()) {
@@ -453,14 +563,14 @@ bool QHttpHeader::parseLine(const QString &line, int)
 */
 QString QHttpHeader::toString() const
 {
-    Q_D(const QHttpHeader);
     if (!isValid())
         return QLatin1String("");
 
     QString ret = QLatin1String("");
 
-    QList<QPair<QString, QString> >::ConstIterator it = d->values.constBegin();
-    while (it != d->values.constEnd()) {
+    QList<QPair<QString, QString> > valueList = values();
+    QList<QPair<QString, QString> >::ConstIterator it = valueList.constBegin();
+    while (it != valueList.constEnd()) {
         ret += (*it).first + QLatin1String(": ") + (*it).second + QLatin1String("\r\n");
         ++it;
     }
@@ -753,6 +863,12 @@ public:
     QString p;
     int majVer;
     int minVer;
+    // The request line of a received header, as byte ranges into raw; see setRawRequest()
+    bool rawRequest = false;
+    int methodOffset = 0;
+    int methodLength = 0;
+    int pathOffset = 0;
+    int pathLength = 0;
 };
 
 /****************************************************
@@ -828,6 +944,11 @@ QHttpRequestHeader::QHttpRequestHeader(const QHttpRequestHeader &header)
     d->p = header.d_func()->p;
     d->majVer = header.d_func()->majVer;
     d->minVer = header.d_func()->minVer;
+    d->rawRequest = header.d_func()->rawRequest;
+    d->methodOffset = header.d_func()->methodOffset;
+    d->methodLength = header.d_func()->methodLength;
+    d->pathOffset = header.d_func()->pathOffset;
+    d->pathLength = header.d_func()->pathLength;
 }
 
 /*!
@@ -841,6 +962,11 @@ QHttpRequestHeader &QHttpRequestHeader::operator=(const QHttpRequestHeader &head
     d->p = header.d_func()->p;
     d->majVer = header.d_func()->majVer;
     d->minVer = header.d_func()->minVer;
+    d->rawRequest = header.d_func()->rawRequest;
+    d->methodOffset = header.d_func()->methodOffset;
+    d->methodLength = header.d_func()->methodLength;
+    d->pathOffset = header.d_func()->pathOffset;
+    d->pathLength = header.d_func()->pathLength;
     return *this;
 }
 
@@ -869,12 +995,47 @@ void QHttpRequestHeader::setRequest(const QString &method, const QString &path,
 {
     Q_D(QHttpRequestHeader);
     setValid(true);
+    d->rawRequest = false;
     d->m = method;
     d->p = path;
     d->majVer = majorVer;
     d->minVer = minorVer;
 }
 
+/*! \internal
+    Makes this the header of a request received as \a raw, which holds the
+    request line and the header fields. The method, the request-URI and the
+    fields are decoded from \a raw when they are looked up.
+*/
+void QHttpRequestHeader::setRawRequest(const QByteArray &raw, int methodOffset, int methodLength, int pathOffset,
+                                       int pathLength, int majorVer, int minorVer)
+{
+    Q_D(QHttpRequestHeader);
+    setValid(true);
+    d->raw = raw;
+    d->rawValues.clear();
+    d->values.clear();
+    d->rawRequest = true;
+    d->methodOffset = methodOffset;
+    d->methodLength = methodLength;
+    d->pathOffset = pathOffset;
+    d->pathLength = pathLength;
+    d->majVer = majorVer;
+    d->minVer = minorVer;
+}
+
+/*! \internal
+    Adds a field of the request passed to setRawRequest(). The key and the
+    value are the given byte ranges of the raw request; a \a folded value
+    spans several lines.
+*/
+void QHttpRequestHeader::addRawValue(int keyOffset, int keyLength, int valueOffset, int valueLength, bool folded)
+{
+    Q_D(QHttpRequestHeader);
+    QHttpHeaderPrivate::RawValue entry = { keyOffset, keyLength, valueOffset, valueLength, folded };
+    d->rawValues.append(entry);
+}
+
 /*!
     Returns the method of the HTTP request header.
 
@@ -883,6 +1044,8 @@ void QHttpRequestHeader::setRequest(const QString &method, const QString &path,
 QString QHttpRequestHeader::method() const
 {
     Q_D(const QHttpRequestHeader);
+    if (d->rawRequest)
+        return QString::fromLatin1(d->raw.constData() + d->methodOffset, d->methodLength);
     return d->m;
 }
 
@@ -894,6 +1057,8 @@ QString QHttpRequestHeader::method() const
 QString QHttpRequestHeader::path() const
 {
     Q_D(const QHttpRequestHeader);
+    if (d->rawRequest)
+        return QString::fromUtf8(d->raw.constData() + d->pathOffset, d->pathLength);
     return d->p;
 }
 
@@ -927,6 +1092,7 @@ bool QHttpRequestHeader::parseLine(const QString &line, int number)
     if (number != 0)
         return QHttpHeader::parseLine(line, number);
 
+    d->rawRequest = false;
     QStringList lst = line.simplified().split(QLatin1String(" "));
     if (lst.count() > 0) {
         d->m = lst[0];
@@ -954,7 +1120,7 @@ QString QHttpRequestHeader::toString() const
     Q_D(const QHttpRequestHeader);
     QString first(QLatin1String("%1 %2"));
     QString last(QLatin1String(" HTTP/%3.%4\r\n%5\r\n"));
-    return first.arg(d->m).arg(d->p) +
+    return first.arg(method()).arg(path()) +
         last.arg(d->majVer).arg(d->minVer).arg(QHttpHeader::toString());
 }
 
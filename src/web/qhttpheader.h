@@ -49,6 +49,8 @@
 #include <QScopedPointer>
 #include <qxtglobal.h>
 
+class QxtHttpRequestParser;
+
 QT_BEGIN_HEADER
 
 QT_BEGIN_NAMESPACE
@@ -169,6 +171,10 @@ protected:
 
 private:
     Q_DECLARE_PRIVATE(QHttpRequestHeader)
+    friend class QxtHttpRequestParser;
+    void setRawRequest(const QByteArray &raw, int methodOffset, int methodLength, int pathOffset, int pathLength,
+                       int majorVer, int minorVer);
+    void addRawValue(int keyOffset, int keyLength, int valueOffset, int valueLength, bool folded);
 };
 
 #endif // QT_NO_HTTP
@@ -52,12 +52,21 @@ headers (by implementing writeHeaders(QIODevice*, const QHttpResponseHeader&)).
 */
 
 #include "qxthttpsessionmanager.h"
+#include "qxthttpsessionmanager_p.h"
 #include "qxtwebcontent.h"
 #include <QReadWriteLock>
+#include <QMutex>
+#include <QTimer>
+#include <QAbstractSocket>
 #include <QHash>
+#include <QVector>
+#include <QAtomicInt>
+#include <QAtomicInteger>
 #include <QIODevice>
 #include <QByteArray>
 #include <QPointer>
+#include <climits>
+#include "qxthttprequestparser.h"
 #if QXT_HAVE_WEBSOCKETS
 #include <QWebSocketServer>
 #include <QWebSocket>
@@ -67,12 +76,91 @@ headers (by implementing writeHeaders(QIODevice*, const QHttpResponseHeader&)).
 class QxtAbstractHttpConnectorPrivate : public QxtPrivate<QxtAbstractHttpConnector>
 {
 public:
+    // A request ID carries the slot of its connection in the low bits and a
+    // per-slot sequence number in the high bits, so both the connection and
+    // the validity of the ID can be checked without searching.
+    enum
+    {
+        SlotBits = 17,
+        SlotMask = (1 << SlotBits) - 1,
+        SequenceMask = (1 << (32 - SlotBits)) - 1,
+        BlockSize = 64,
+        PipelineDepth = 16,     // requests read ahead of their responses
+        WheelSize = 64          // timer wheel slots, one per second
+    };
+
+    // What a connection is waiting for, as far as timeouts are concerned
+    enum Phase { Busy, Idle, ReadingHeader };
+
+    struct Connection
+    {
+        Connection() : device(0), offset(0), slot(0), discarding(false), phase(Busy), nextFree(0) {}
+
+        QIODevice* device;
+        QByteArray buffer;
+        int offset;                                         // start of unconsumed data in buffer
+        QxtHttpRequestParser parser;
+        QPointer<QxtWebContent> content;
+        quint32 slot;
+        // Sequence numbers of the requests still awaiting a response,
+        // [doneRequest, nextRequest). Responses are looked up from other
+        // threads, so both are published atomically.
+        QAtomicInteger<quint32> nextRequest, doneRequest;
+        bool discarding;                                    // input after a rejected request is dropped
+        Phase phase;
+        QAtomicInt deadline;                                // wheel tick, 0 if none
+        QAtomicInt scheduled;                               // slot is on the timer wheel
+        Connection* nextFree;                               // free list link
+
+        inline int pendingRequests() const
+        {
+            return int((nextRequest.loadAcquire() - doneRequest.loadAcquire()) & SequenceMask);
+        }
+
+        // Only a request that is still awaiting its response belongs to the
+        // connection. Finished requests, and those of an earlier connection
+        // that used the same slot, fall outside the window.
+        inline bool ownsRequest(quint32 sequence) const
+        {
+            quint32 done = doneRequest.loadAcquire();
+            return ((sequence - done) & SequenceMask) < ((nextRequest.loadAcquire() - done) & SequenceMask);
+        }
+    };
+
+    QxtAbstractHttpConnectorPrivate() : manager(0), freeList(0), maximumConnections(0), idleTimeout(0), headerTimeout(0), timer(0), tick(1)
+#ifdef QXT_HAVE_WEBSOCKETS
+    , wss(QString(), QWebSocketServer::NonSecureMode)
+#endif
+    {}
+
+    ~QxtAbstractHttpConnectorPrivate()
+    {
+        foreach(Connection* block, blocks)
+            delete[] block;
+    }
+
     QxtHttpSessionManager* manager;
-    QReadWriteLock bufferLock, requestLock;
-    QHash<QIODevice*, QByteArray> buffers;  // connection->buffer
-    QHash<QIODevice*, QPointer<QxtWebContent> > contents;  // connection->content
-    QHash<quint32, QIODevice*> requests;    // requestID->connection
-    quint32 nextRequestID;
+
+    // The lock only guards the slab and the device lookup. The contents of a
+    // Connection are touched solely by the thread that owns its device.
+    mutable QReadWriteLock connectionLock;
+    QVector<Connection*> blocks;
+    QHash<QIODevice*, Connection*> connections;     // connection->state
+    Connection* freeList;
+    QAtomicInt connectionCount, requestCount;
+
+    int maximumConnections;
+    int idleTimeout, headerTimeout;
+
+    // Timeouts are kept on a coarse timer wheel. The owning thread of a
+    // connection only moves its deadline; the wheel, driven by the
+    // connector's thread, re-files entries whose deadline moved and hands
+    // expired ones back to the owning thread to be closed.
+    QTimer* timer;
+    QAtomicInt tick;
+    QMutex wheelLock;
+    QVector<quint32> wheel[WheelSize];
+
 #ifdef QXT_HAVE_WEBSOCKETS
     QWebSocketServer wss;
 
@@ -81,42 +169,222 @@ public:
       QPointer<QTcpSocket> device;
     };
     QHash<QString, WebSocketRequest> webSockets;
-
-    QxtAbstractHttpConnectorPrivate() : wss(QString(), QWebSocketServer::NonSecureMode) {}
 #endif
 
-    inline quint32 getNextRequestID(QIODevice* connection)
+    inline Connection* slotAt(quint32 slot) const
+    {
+        return blocks[slot / BlockSize] + (slot % BlockSize);
+    }
+
+    Connection* acquire(QIODevice* device)
     {
-        QWriteLocker locker(&requestLock);
-        do
+        QWriteLocker locker(&connectionLock);
+        if (!freeList)
         {
-            nextRequestID++;
-            if (nextRequestID == 0xFFFFFFFF) nextRequestID = 1;
+            quint32 base = quint32(blocks.count()) * BlockSize;
+            if (base + BlockSize > quint32(SlotMask) + 1) return 0;
+            Connection* block = new Connection[BlockSize];
+            blocks.append(block);
+            // Slot 0 is never handed out so that a request ID is never 0
+            for (int i = BlockSize - 1; i >= (base ? 0 : 1); i--)
+            {
+                block[i].slot = base + i;
+                block[i].nextFree = freeList;
+                freeList = block + i;
+            }
         }
-        while (requests.contains(nextRequestID)); // yeah, right
-        requests[nextRequestID] = connection;
-        return nextRequestID;
+        Connection* connection = freeList;
+        freeList = connection->nextFree;
+        connection->nextFree = 0;
+        connection->device = device;
+        connection->doneRequest.storeRelease(connection->nextRequest.loadAcquire());
+        connection->discarding = false;
+        connections.insert(device, connection);
+        connectionCount.ref();
+        // A new connection has to deliver its first request in time
+        connection->phase = ReadingHeader;
+        arm(connection, headerTimeout);
+        return connection;
+    }
+
+    void release(QIODevice* device)
+    {
+        QWriteLocker locker(&connectionLock);
+        Connection* connection = connections.take(device);
+        if (!connection) return;
+        requestCount.fetchAndAddRelaxed(-connection->pendingRequests());
+        connectionCount.deref();
+        connection->device = 0;
+        connection->buffer.clear();
+        connection->offset = 0;
+        connection->parser.reset();
+        connection->content = 0;
+        connection->deadline.storeRelease(0);
+        connection->doneRequest.storeRelease(connection->nextRequest.loadAcquire());
+        connection->nextFree = freeList;
+        freeList = connection;
+    }
+
+    inline Connection* connection(QIODevice* device) const
+    {
+        QReadLocker locker(&connectionLock);
+        return connections.value(device);
     }
 
-    inline void doneWithBuffer(QIODevice* device)
+    inline quint32 getNextRequestID(QIODevice* device)
     {
-        QWriteLocker locker(&bufferLock);
-        buffers.remove(device);
-	contents.remove(device);
+        Connection* c = connection(device);
+        if (!c) return 0;
+        quint32 sequence = c->nextRequest.loadAcquire();
+        c->nextRequest.storeRelease((sequence + 1) & SequenceMask);
+        requestCount.ref();
+        return (sequence << SlotBits) | c->slot;
+    }
+
+    Connection* requestConnection(quint32 requestID) const
+    {
+        quint32 slot = requestID & SlotMask;
+        if (!slot) return 0;
+        QReadLocker locker(&connectionLock);
+        if (slot >= quint32(blocks.count()) * BlockSize) return 0;
+        Connection* c = slotAt(slot);
+        if (!c->device || !c->ownsRequest(requestID >> SlotBits)) return 0;
+        return c;
     }
 
     inline void doneWithRequest(quint32 requestID)
     {
-        QWriteLocker locker(&requestLock);
-        requests.remove(requestID);
+        Connection* c = requestConnection(requestID);
+        if (!c) return;
+        // Responses on a connection complete in order
+        quint32 done = ((requestID >> SlotBits) + 1) & SequenceMask;
+        int finished = int((done - c->doneRequest.loadAcquire()) & SequenceMask);
+        if (finished <= 0 || finished > c->pendingRequests()) return;
+        c->doneRequest.storeRelease(done);
+        requestCount.fetchAndAddRelaxed(-finished);
     }
 
-    inline QIODevice* getRequestConnection(quint32 requestID)
+    inline QIODevice* getRequestConnection(quint32 requestID) const
     {
-        QReadLocker locker(&requestLock);
-        return requests[requestID];
+        Connection* c = requestConnection(requestID);
+        return c ? c->device : 0;
     }
+
+    void updateTimer()
+    {
+        if (idleTimeout > 0 || headerTimeout > 0)
+        {
+            if (!timer->isActive()) timer->start(1000);
+        }
+        else
+        {
+            timer->stop();
+        }
+    }
+
+    void schedule(Connection* c, int deadline)
+    {
+        if (!c->scheduled.testAndSetOrdered(0, 1)) return;
+        QMutexLocker locker(&wheelLock);
+        wheel[deadline % WheelSize].append(c->slot);
+    }
+
+    // Called by the thread that owns the connection's device.
+    void arm(Connection* c, int msecs)
+    {
+        if (msecs <= 0)
+        {
+            c->deadline.storeRelease(0);
+            return;
+        }
+        // One extra tick since the current one is already partly over
+        int deadline = tick.loadAcquire() + (msecs + 999) / 1000 + 1;
+        c->deadline.storeRelease(deadline);
+        schedule(c, deadline);
+    }
+
+    // Starts the idle or header timeout of a connection that has no request
+    // in progress. The header clock is not restarted by further data, so a
+    // client trickling in its header cannot hold on to the connection.
+    void waitForRequest(Connection* c)
+    {
+        if (c->pendingRequests() || c->content)
+        {
+            c->phase = Busy;
+            c->deadline.storeRelease(0);
+            return;
+        }
+        if (c->phase == ReadingHeader) return;
+        if (c->offset < c->buffer.size())
+        {
+            c->phase = ReadingHeader;
+            arm(c, headerTimeout);
+        }
+        else if (c->phase != Idle)
+        {
+            c->phase = Idle;
+            arm(c, idleTimeout);
+        }
+    }
+
+    void advanceWheel();
+    void expire(QIODevice* device);
 };
+
+void QxtAbstractHttpConnectorPrivate::advanceWheel()
+{
+    int now = tick.fetchAndAddOrdered(1) + 1;
+    QVector<quint32> due;
+    {
+        QMutexLocker locker(&wheelLock);
+        due.swap(wheel[now % WheelSize]);
+    }
+    QReadLocker locker(&connectionLock);
+    foreach(quint32 slot, due)
+    {
+        Connection* c = slotAt(slot);
+        int deadline = c->deadline.loadAcquire();
+        if (!c->device || !deadline)
+        {
+            c->scheduled.storeRelease(0);
+            // The owner may have armed it again in the meantime
+            deadline = c->deadline.loadAcquire();
+            if (!c->device || !deadline || !c->scheduled.testAndSetOrdered(0, 1)) continue;
+        }
+        if (deadline > now)
+        {
+            QMutexLocker wheelLocker(&wheelLock);
+            wheel[deadline % WheelSize].append(slot);
+            continue;
+        }
+        // The owning thread decides; the connection may have become busy
+        c->scheduled.storeRelease(0);
+        QIODevice* device = c->device;
+        QPointer<QxtAbstractHttpConnector> connector(&qxt_p());
+        QMetaObject::invokeMethod(device, [connector, device]() {
+            if (connector) connector->qxt_d().expire(device);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void QxtAbstractHttpConnectorPrivate::expire(QIODevice* device)
+{
+    Connection* c = connection(device);
+    if (!c) return;
+    int deadline = c->deadline.loadAcquire();
+    if (!deadline) return;
+    if (deadline > tick.loadAcquire())
+    {
+        schedule(c, deadline);
+        return;
+    }
+    c->deadline.storeRelease(0);
+    QAbstractSocket* socket = qobject_cast<QAbstractSocket*>(device);
+    if (socket)
+        socket->disconnectFromHost();
+    else
+        device->close();
+}
 #endif
 
 /*!
@@ -127,7 +395,8 @@ public:
 QxtAbstractHttpConnector::QxtAbstractHttpConnector(QObject* parent) : QObject(parent)
 {
     QXT_INIT_PRIVATE(QxtAbstractHttpConnector);
-    qxt_d().nextRequestID = 0;
+    qxt_d().timer = new QTimer(this);
+    QObject::connect(qxt_d().timer, SIGNAL(timeout()), this, SLOT(checkTimeouts()));
 #ifdef QXT_HAVE_WEBSOCKETS
     QObject::connect(&qxt_d().wss, SIGNAL(newConnection()), this, SLOT(websocketConnection()));
 #endif
@@ -151,6 +420,20 @@ QxtHttpSessionManager* QxtAbstractHttpConnector::sessionManager() const
     return qxt_d().manager;
 }
 
+/*!
+ * \internal
+ * Returns the object that handles signals for \a device: the I/O worker that
+ * owns it when the session manager runs worker threads, otherwise the
+ * connector itself.
+ */
+QObject* QxtAbstractHttpConnector::connectionHandler(QIODevice* device) const
+{
+    if (!qxt_d().manager) return const_cast<QxtAbstractHttpConnector*>(this);
+    QObject* handler = qxt_d().manager->qxt_d().handler(device);
+    if (handler == qxt_d().manager) return const_cast<QxtAbstractHttpConnector*>(this);
+    return handler;
+}
+
 /*!
  * \internal
  * Returns the QIODevice associated with a \a requestID.
@@ -171,8 +454,28 @@ QIODevice* QxtAbstractHttpConnector::getRequestConnection(quint32 requestID)
 void QxtAbstractHttpConnector::addConnection(QIODevice* device)
 {
     if(!device) return;
-    QWriteLocker locker(&qxt_d().bufferLock);
-    qxt_d().buffers[device] = QByteArray();
+    int limit = qxt_d().maximumConnections;
+    if ((limit > 0 && connectionCount() >= limit) || !qxt_d().acquire(device))
+    {
+        qWarning("QxtAbstractHttpConnector: too many connections, refusing a new one");
+        device->close();
+        device->deleteLater();
+        return;
+    }
+    QxtHttpSessionWorker* worker = qxt_d().manager ? qxt_d().manager->qxt_d().acceptingWorker() : 0;
+    if (worker)
+    {
+        // Hand the connection over to an I/O thread; it adopts the device
+        // and picks up any data that arrived in the meantime.
+        device->setParent(0);
+        device->moveToThread(worker->thread());
+        QObject::connect(device, SIGNAL(readyRead()), worker, SLOT(incomingData()));
+        QObject::connect(device, SIGNAL(aboutToClose()), worker, SLOT(disconnected()));
+        QObject::connect(device, SIGNAL(disconnected()), worker, SLOT(disconnected()));
+        QObject::connect(device, SIGNAL(destroyed()), worker, SLOT(disconnected()));
+        QMetaObject::invokeMethod(worker, "attachConnection", Qt::QueuedConnection, Q_ARG(QIODevice*, device));
+        return;
+    }
     QObject::connect(device, SIGNAL(readyRead()), this, SLOT(incomingData()));
     QObject::connect(device, SIGNAL(aboutToClose()), this, SLOT(disconnected()));
     QObject::connect(device, SIGNAL(disconnected()), this, SLOT(disconnected()));
@@ -189,19 +492,38 @@ void QxtAbstractHttpConnector::incomingData(QIODevice* device)
         device = qobject_cast<QIODevice*>(sender());
         if (!device) return;
     }
-    // Scope things so we don't block access during incomingRequest()
+    QxtAbstractHttpConnectorPrivate::Connection* connection = qxt_d().connection(device);
+    if (!connection) return;
     QHttpRequestHeader header;
     QxtWebContent *content = nullptr;
+    int rejectStatus = 0;
     {
-      if (!device->isTransactionStarted()) {
+      // Check for a current content "device"
+      content = connection->content;
+      bool wantsBody = content && (content->wantAll() || content->bytesNeeded() > 0);
+      // Reading resumes when a response completes; until then the data
+      // stays in the device.
+      if (!wantsBody && !connection->discarding
+          && connection->pendingRequests() >= QxtAbstractHttpConnectorPrivate::PipelineDepth) return;
+#ifdef QXT_HAVE_WEBSOCKETS
+      // A WebSocket upgrade hands the header back to the socket, so a header
+      // is read inside a transaction. One is only started at the beginning of
+      // a request, which keeps earlier requests and body data out of it.
+      if (!wantsBody && !connection->discarding && connection->offset >= connection->buffer.size()
+          && !device->isTransactionStarted()) {
         device->startTransaction();
       }
+#endif
       // Fetch the incoming data block
       QByteArray block = device->readAll();
-      // Check for a current content "device"
-      QReadLocker locker(&qxt_d().bufferLock);
-      content = qxt_d().contents[device];
-      if(content && (content->wantAll() || content->bytesNeeded() > 0)){
+      if (connection->discarding) {
+        // A request was refused before its body; the connection closes
+        // once the error has been sent and nothing more is parsed.
+        if (device->isTransactionStarted())
+          device->commitTransaction();
+        return;
+      }
+      if(wantsBody){
         // This block (or part of it) belongs to content device
         qint64 needed = block.size();
         if(!content->wantAll() && needed > content->bytesNeeded())
@@ -212,65 +534,122 @@ void QxtAbstractHttpConnector::incomingData(QIODevice* device)
         block.remove(0, needed);
       }
       // The data received represents a new request (or start thereof)
-      qxt_d().contents[device] = content = NULL;
-      QByteArray& buffer = qxt_d().buffers[device];
+      connection->content = content = NULL;
+      QByteArray& buffer = connection->buffer;
+      int& offset = connection->offset;
       buffer.append(block);
-      if (!canParseRequest(buffer)) return;
+      if (!readRequestHeader(connection->parser, buffer, offset, header)) {
+        qxt_d().waitForRequest(connection);
+        return;
+      }
       // Have received all of the headers so we can start processing
-      header = parseRequest(buffer);
 #ifdef QXT_HAVE_WEBSOCKETS
-      if (header.value("upgrade").contains("websocket") && qobject_cast<QTcpSocket*>(device) && header.hasKey("sec-websocket-key")) {
+      // A pipelined upgrade has no transaction to roll back and is served
+      // as a plain request.
+      if (device->isTransactionStarted() && header.value("upgrade").contains("websocket")
+          && qobject_cast<QTcpSocket*>(device) && header.hasKey("sec-websocket-key")) {
         // Prepare to receive the connection
         QString key = header.value("sec-websocket-key");
-        qxt_d().webSockets[key] = QxtAbstractHttpConnectorPrivate::WebSocketRequest{
-          header,
-          static_cast<QTcpSocket*>(device),
-        };
+        {
+          QWriteLocker locker(&qxt_d().connectionLock);
+          qxt_d().webSockets[key] = QxtAbstractHttpConnectorPrivate::WebSocketRequest{
+            header,
+            static_cast<QTcpSocket*>(device),
+          };
+        }
         // Disconnect the readyRead signal to avoid disrupting the protocol.
-        QObject::disconnect(device, SIGNAL(readyRead()), this, SLOT(incomingData()));
+        QObject::disconnect(device, SIGNAL(readyRead()), connectionHandler(device), SLOT(incomingData()));
         // Put the headers back in the input buffer and pass off control.
         device->rollbackTransaction();
+        if (device->thread() != thread()) {
+          // The WebSocket server lives on the connector's thread
+          QTcpSocket* socket = static_cast<QTcpSocket*>(device);
+          socket->setParent(0);
+          socket->moveToThread(thread());
+          QMetaObject::invokeMethod(this, [this, socket]() {
+            qxt_d().wss.handleConnection(socket);
+          }, Qt::QueuedConnection);
+          return;
+        }
         qxt_d().wss.handleConnection(static_cast<QTcpSocket*>(device));
         return;
       }
+      if (device->isTransactionStarted())
+        device->commitTransaction();
 #endif
-      device->commitTransaction();
       QByteArray start;
-      int len = header.hasContentLength() ? int(header.contentLength()) : -1;
-      if (len > 0) {
-        if (len <= buffer.size()) {
+      // The length stays 64-bit until it has been checked; a value that
+      // does not fit is refused rather than truncated, since a short read
+      // would leave the rest of the body to be parsed as another request.
+      qint64 len = -1;
+      if (header.hasKey("content-length")) {
+        bool ok = false;
+        len = header.value("content-length").trimmed().toLongLong(&ok);
+        if (!ok || len < 0)
+          rejectStatus = 400;
+      }
+      qint64 maximumLength = sessionManager()->maximumContentLength();
+      qint64 limit = maximumLength > 0 ? qMin(maximumLength, qint64(INT_MAX)) : qint64(INT_MAX);
+      if (!rejectStatus && len > limit)
+        rejectStatus = 413;
+      if (rejectStatus) {
+        // The body is never read. Whatever follows the header is dropped so
+        // that none of it can be taken for a pipelined request.
+        connection->discarding = true;
+        offset = buffer.size();
+      } else if (len > 0) {
+        if (len <= buffer.size() - offset) {
           // This request is fully-received & excess is another request
           // Leave in buffer & we'll fake a following "readyRead()"
-          start = buffer.left(len);
-          buffer = buffer.mid(len);
-          content = new QxtWebContent(start, this);
-          if(buffer.size() > 0)
-            QMetaObject::invokeMethod(this, "incomingData",
-                Qt::QueuedConnection, Q_ARG(QIODevice*, device));
+          start = buffer.mid(offset, int(len));
+          offset += int(len);
+          content = new QxtWebContent(start, connectionHandler(device));
         } else {
           // This request isn't finished yet but may still have one to
           // follow it. Remember the content device so we can append to
           // it until we've got it all.
-          start = buffer;
-          buffer.clear();
-          qxt_d().contents[device] = content =
-            new QxtWebContent(len, start, this, device);
+          start = buffer.mid(offset);
+          offset = buffer.size();
+          connection->content = content =
+            new QxtWebContent(int(len), start, connectionHandler(device), device);
         }
       } else if (header.hasKey("connection") && header.value("connection").toLower() == "close") {
         // Not pipelining so we want to pass all remaining data to the
         // content device. Although 'len' will be -1, we're using an
         // explict value for clarity. This causes the content device
         // to indicate it wants all remaining data.
-        start = buffer;
-        buffer.clear();
-        qxt_d().contents[device] = content =
-          new QxtWebContent(-1, start, this, device);
+        start = buffer.mid(offset);
+        offset = buffer.size();
+        connection->content = content =
+          new QxtWebContent(-1, start, connectionHandler(device), device);
       } // else no content
-      // NOTE: Buffer lock goes out of scope after this point
+      if (content && maximumLength > 0)
+        content->setMaximumSize(maximumLength);
+      // Consumed data is dropped lazily so that a burst of pipelined
+      // requests is not shifted down the buffer once per request.
+      if (offset >= buffer.size()) {
+        buffer.clear();
+        offset = 0;
+      } else if (offset > buffer.size() / 2) {
+        buffer.remove(0, offset);
+        offset = 0;
+      }
+      connection->parser.reset(offset);
+      // Pipelined requests are read ahead; the session manager writes
+      // their responses in order.
+      if (!connection->content && offset < buffer.size())
+        QMetaObject::invokeMethod(connectionHandler(device), "incomingData",
+            Qt::QueuedConnection, Q_ARG(QIODevice*, device));
     }
     // Allocate request ID and process it
     quint32 requestID = qxt_d().getNextRequestID(device);
-    sessionManager()->incomingRequest(requestID, header, content);
+    qxt_d().waitForRequest(connection);
+    if (rejectStatus == 413)
+        sessionManager()->rejectRequest(requestID, header, 413, "Request Entity Too Large");
+    else if (rejectStatus)
+        sessionManager()->rejectRequest(requestID, header, 400, "Bad Request");
+    else
+        sessionManager()->incomingRequest(requestID, header, content);
 }
 
 #ifdef QXT_HAVE_WEBSOCKETS
@@ -285,7 +664,11 @@ void QxtAbstractHttpConnector::websocketConnection()
     return;
   }
   QString key = QString::fromLatin1(ws->request().rawHeader("sec-websocket-key"));
-  auto req = qxt_d().webSockets.take(key);
+  QxtAbstractHttpConnectorPrivate::WebSocketRequest req;
+  {
+    QWriteLocker locker(&qxt_d().connectionLock);
+    req = qxt_d().webSockets.take(key);
+  }
   if (!req.device) {
     ws->close(QWebSocketProtocol::CloseCodeBadOperation);
     ws->deleteLater();
@@ -304,16 +687,135 @@ void QxtAbstractHttpConnector::websocketConnection()
  */
 void QxtAbstractHttpConnector::disconnected()
 {
-    quint32 requestID=0;
     QIODevice* device = qobject_cast<QIODevice*>(sender());
     if (!device) return;
+    removeConnection(device);
+}
 
-    requestID = qxt_d().requests.key(device);
-    qxt_d().doneWithRequest(requestID);
-    qxt_d().doneWithBuffer(device);
+/*!
+ * \internal
+ */
+void QxtAbstractHttpConnector::checkTimeouts()
+{
+    qxt_d().advanceWheel();
+}
+
+/*!
+ * \internal
+ */
+void QxtAbstractHttpConnector::removeConnection(QIODevice* device)
+{
+    qxt_d().release(device);
     sessionManager()->disconnected(device);
 }
 
+/*!
+ * \internal
+ * Marks the request identified by \a requestID as answered. Requests on a
+ * connection are answered in order, so this also retires any earlier
+ * request still counted on the same connection.
+ */
+void QxtAbstractHttpConnector::doneWithRequest(quint32 requestID)
+{
+    qxt_d().doneWithRequest(requestID);
+}
+
+/*!
+ * Returns the number of connections currently managed by the connector.
+ *
+ * \sa requestCount()
+ */
+int QxtAbstractHttpConnector::connectionCount() const
+{
+    return qxt_d().connectionCount.load();
+}
+
+/*!
+ * Returns the number of requests that have been received on open
+ * connections but not yet fully answered.
+ *
+ * \sa connectionCount()
+ */
+int QxtAbstractHttpConnector::requestCount() const
+{
+    return qxt_d().requestCount.load();
+}
+
+/*!
+ * Returns the maximum number of connections the connector manages at once.
+ * Connections beyond this limit are refused. The default value of 0 only
+ * limits connections by the number of request IDs available.
+ *
+ * \sa setMaximumConnections(), connectionCount()
+ */
+int QxtAbstractHttpConnector::maximumConnections() const
+{
+    return qxt_d().maximumConnections;
+}
+
+/*!
+ * Sets the maximum number of connections the connector manages at once to
+ * \a count. Connections that are already open are not affected.
+ *
+ * \sa maximumConnections()
+ */
+void QxtAbstractHttpConnector::setMaximumConnections(int count)
+{
+    qxt_d().maximumConnections = qMax(0, count);
+}
+
+/*!
+ * Returns the number of milliseconds a connection may stay open without a
+ * request in progress before it is closed. The default value of 0 leaves
+ * idle connections open.
+ *
+ * Timeouts are checked once per second, so they are rounded up to whole
+ * seconds and may run up to a second longer.
+ *
+ * \sa setIdleTimeout(), headerTimeout()
+ */
+int QxtAbstractHttpConnector::idleTimeout() const
+{
+    return qxt_d().idleTimeout;
+}
+
+/*!
+ * Sets the idle timeout to \a msecs milliseconds; 0 disables it. The new
+ * value applies to connections as they next become idle.
+ *
+ * \sa idleTimeout()
+ */
+void QxtAbstractHttpConnector::setIdleTimeout(int msecs)
+{
+    qxt_d().idleTimeout = qMax(0, msecs);
+    qxt_d().updateTimer();
+}
+
+/*!
+ * Returns the number of milliseconds a client has to send a complete request
+ * header, counted from the arrival of its first byte or, for the first
+ * request, from the moment the connection was accepted. Receiving more of
+ * the header does not extend the timeout. The default value of 0 disables
+ * the timeout.
+ *
+ * \sa setHeaderTimeout(), idleTimeout()
+ */
+int QxtAbstractHttpConnector::headerTimeout() const
+{
+    return qxt_d().headerTimeout;
+}
+
+/*!
+ * Sets the header timeout to \a msecs milliseconds; 0 disables it.
+ *
+ * \sa headerTimeout()
+ */
+void QxtAbstractHttpConnector::setHeaderTimeout(int msecs)
+{
+    qxt_d().headerTimeout = qMax(0, msecs);
+    qxt_d().updateTimer();
+}
+
 /*!
  *  Returns the current local server port assigned during binding. This will
  *  be 0 if the connector isn't currently bound or when a port number isn't
@@ -354,6 +856,29 @@ quint16 QxtAbstractHttpConnector::serverPort() const
  * \sa listen()
  */
 
+/*!
+ * Reads the next request header from \a buffer, starting at \a offset.
+ *
+ * Returns true and stores the request in \a header if a complete header is
+ * available; \a offset is then advanced past it. Returns false if more data
+ * is needed. \a parser is reset to the offset of each new request and keeps
+ * its state between calls, so a subclass that uses it only needs to examine
+ * newly received data.
+ *
+ * The default implementation ignores \a parser and calls canParseRequest()
+ * and parseRequest() on a copy of the unconsumed data.
+ */
+bool QxtAbstractHttpConnector::readRequestHeader(QxtHttpRequestParser& parser, const QByteArray& buffer, int& offset, QHttpRequestHeader& header)
+{
+    Q_UNUSED(parser);
+    QByteArray pending = offset ? buffer.mid(offset) : buffer;
+    if (!canParseRequest(pending)) return false;
+    int size = pending.size();
+    header = parseRequest(pending);
+    offset += size - pending.size();
+    return true;
+}
+
 /*!
  * \fn virtual bool QxtAbstractHttpConnector::canParseRequest(const QByteArray& buffer)
  * Returns true if a complete set of request headers can be extracted from the provided \a buffer.
@@ -40,12 +40,14 @@
 QT_FORWARD_DECLARE_CLASS(QIODevice)
 QT_FORWARD_DECLARE_CLASS(QTcpServer)
 class QxtHttpSessionManager;
+class QxtHttpRequestParser;
 class QxtSslServer;
 
 class QxtAbstractHttpConnectorPrivate;
 class QXT_WEB_EXPORT QxtAbstractHttpConnector : public QObject
 {
     friend class QxtHttpSessionManager;
+    friend class QxtHttpSessionWorker;
     Q_OBJECT
 public:
     QxtAbstractHttpConnector(QObject* parent = 0);
@@ -53,11 +55,22 @@ public:
     virtual bool shutdown() = 0;
     virtual quint16 serverPort() const;
 
+    int connectionCount() const;
+    int requestCount() const;
+
+    int maximumConnections() const;
+    void setMaximumConnections(int count);
+    int idleTimeout() const;
+    void setIdleTimeout(int msecs);
+    int headerTimeout() const;
+    void setHeaderTimeout(int msecs);
+
 protected:
     QxtHttpSessionManager* sessionManager() const;
 
     void addConnection(QIODevice* device);
     QIODevice* getRequestConnection(quint32 requestID);
+    virtual bool readRequestHeader(QxtHttpRequestParser& parser, const QByteArray& buffer, int& offset, QHttpRequestHeader& header);
     virtual bool canParseRequest(const QByteArray& buffer) = 0;
     virtual QHttpRequestHeader parseRequest(QByteArray& buffer) = 0;
     virtual void writeHeaders(QIODevice* device, const QHttpResponseHeader& header) = 0;
@@ -68,9 +81,13 @@ private Q_SLOTS:
     void websocketConnection();
 #endif
     void disconnected();
+    void checkTimeouts();
 
 private:
     void setSessionManager(QxtHttpSessionManager* manager);
+    void removeConnection(QIODevice* device);
+    void doneWithRequest(quint32 requestID);
+    QObject* connectionHandler(QIODevice* device) const;
     QXT_DECLARE_PRIVATE(QxtAbstractHttpConnector)
 };
 
@@ -87,6 +104,7 @@ public:
     QTcpServer* tcpServer() const;
 
 protected:
+    virtual bool readRequestHeader(QxtHttpRequestParser& parser, const QByteArray& buffer, int& offset, QHttpRequestHeader& header);
     virtual bool canParseRequest(const QByteArray& buffer);
     virtual QHttpRequestHeader parseRequest(QByteArray& buffer);
     virtual void writeHeaders(QIODevice* device, const QHttpResponseHeader& header);
@@ -135,19 +153,31 @@ private Q_SLOTS:
 private:
     QXT_DECLARE_PRIVATE(QxtScgiServerConnector)
 };
-/* Commented out pending implementation
-
-class QxtFcgiConnectorPrivate;
-class QXT_WEB_EXPORT QxtFcgiConnector : public QxtAbstractHttpConnector {
-Q_OBJECT
+class QxtFcgiServerConnectorPrivate;
+class QXT_WEB_EXPORT QxtFcgiServerConnector : public QxtAbstractHttpConnector
+{
+    friend class QxtFcgiConnection;
+    Q_OBJECT
 public:
-    QxtFcgiConnector(QObject* parent = 0);
+    QxtFcgiServerConnector(QObject* parent = 0);
     virtual bool listen(const QHostAddress& iface, quint16 port);
     virtual bool shutdown();
+    virtual quint16 serverPort() const;
+
+    int maximumRequestsPerConnection() const;
+    void setMaximumRequestsPerConnection(int count);
+
+protected:
+    virtual bool readRequestHeader(QxtHttpRequestParser& parser, const QByteArray& buffer, int& offset, QHttpRequestHeader& header);
+    virtual bool canParseRequest(const QByteArray& buffer);
+    virtual QHttpRequestHeader parseRequest(QByteArray& buffer);
+    virtual void writeHeaders(QIODevice* device, const QHttpResponseHeader& header);
+
+private Q_SLOTS:
+    void acceptConnection();
 
 private:
-    QXT_DECLARE_PRIVATE(QxtFcgiConnector)
+    QXT_DECLARE_PRIVATE(QxtFcgiServerConnector)
 };
-*/
 
 #endif // QXTABSTRACTHTTPCONNECTOR_H
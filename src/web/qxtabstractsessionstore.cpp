@@ -0,0 +1,327 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+/*!
+\class QxtAbstractSessionStore
+
+\inmodule QxtWeb
+
+\brief The QxtAbstractSessionStore class is an interface for persistent session storage
+
+A session store keeps the state of sessions outside of the process, so that a
+session survives a restart of the server or can be picked up by another
+server process sharing the same store.
+
+The session manager identifies sessions in the store by their session key
+(for QxtHttpSessionManager, the value of the session cookie). Sessions are
+written back in batches: save() receives every session used since the
+previous call, together with the keys of sessions that have ended. A session
+is loaded with load() the first time a request presents a key that is unknown
+to the running session manager.
+
+load() may be called from any of the session manager's I/O threads, so
+implementations must be thread-safe.
+
+\sa QxtAbstractWebSessionManager::setSessionStore(), QxtFileSessionStore
+*/
+
+/*!
+\class QxtFileSessionStore
+
+\inmodule QxtWeb
+
+\brief The QxtFileSessionStore class stores sessions as files in a directory
+
+QxtFileSessionStore keeps each session in its own file, named after the
+hex-encoded session key, in directory(). Files are replaced atomically, so a
+crash during a write-back never leaves a truncated session behind. Each file
+carries the length and a checksum of the state; a file that does not match
+them is treated as missing and deleted.
+
+Only keys that pass isValidKey() are looked up. Keys that have no file are
+remembered for a few seconds, so a client repeating an unknown session
+cookie does not cause a file system lookup per request.
+
+Sessions whose files have not been written for longer than maximumAge() are
+treated as expired; see setMaximumAge().
+*/
+
+#include "qxtabstractsessionstore.h"
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QMutex>
+#include <cstring>
+
+/*!
+ * Constructs a QxtAbstractSessionStore with the specified \a parent.
+ */
+QxtAbstractSessionStore::QxtAbstractSessionStore(QObject* parent) : QObject(parent)
+{
+}
+
+/*!
+ * \fn virtual QByteArray QxtAbstractSessionStore::load(const QByteArray& key)
+ * Returns the state stored for the session \a key, or a null QByteArray if the
+ * store has no such session. A session stored without any state must be
+ * returned as an empty, non-null QByteArray.
+ */
+
+/*!
+ * \fn virtual bool QxtAbstractSessionStore::save(const QHash<QByteArray, QByteArray>& sessions, const QList<QByteArray>& removed)
+ * Stores \a sessions, a hash from session keys to session state, and deletes
+ * the sessions whose keys are listed in \a removed. Returns true on success.
+ */
+
+#ifndef QXT_DOXYGEN_RUN
+static const char qxtSessionFileMagic[4] = { 'Q', 'x', 't', 'S' };
+static const int qxtSessionHeaderSize = 10;        // magic, length, checksum
+static const qint64 qxtMissCacheTime = 5000;      // ms a missing key is remembered
+static const int qxtMaxMissCacheSize = 4096;
+
+class QxtFileSessionStorePrivate : public QxtPrivate<QxtFileSessionStore>
+{
+public:
+    QXT_DECLARE_PUBLIC(QxtFileSessionStore)
+    QxtFileSessionStorePrivate() : maximumAge(0) {}
+
+    QDir dir;
+    QMutex lock;
+    int maximumAge;
+    QHash<QByteArray, qint64> misses;   // key -> time of the failed lookup
+
+    inline QString path(const QByteArray& key) const
+    {
+        return dir.filePath(QString::fromLatin1(key.toHex()));
+    }
+
+    bool expired(const QFileInfo& info, qint64 now) const
+    {
+        return maximumAge > 0 && info.lastModified().toMSecsSinceEpoch() + qint64(maximumAge) * 1000 < now;
+    }
+
+    void addMiss(const QByteArray& key, qint64 now)
+    {
+        if (misses.count() >= qxtMaxMissCacheSize)
+            misses.clear();
+        misses.insert(key, now);
+    }
+};
+
+static QByteArray qxtEncodeSession(const QByteArray& state)
+{
+    QByteArray data;
+    data.reserve(qxtSessionHeaderSize + state.size());
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.writeRawData(qxtSessionFileMagic, 4);
+    out << quint32(state.size()) << quint16(qChecksum(state.constData(), state.size()));
+    out.writeRawData(state.constData(), state.size());
+    return data;
+}
+
+// Returns a null QByteArray if data is not a complete session file
+static QByteArray qxtDecodeSession(const QByteArray& data)
+{
+    if (data.size() < qxtSessionHeaderSize || memcmp(data.constData(), qxtSessionFileMagic, 4) != 0)
+        return QByteArray();
+    QDataStream in(data.mid(4, 6));
+    quint32 length;
+    quint16 checksum;
+    in >> length >> checksum;
+    if (length != quint32(data.size() - qxtSessionHeaderSize))
+        return QByteArray();
+    QByteArray state = data.mid(qxtSessionHeaderSize);
+    if (state.isNull())
+        state = QByteArray("");
+    if (qChecksum(state.constData(), state.size()) != checksum)
+        return QByteArray();
+    return state;
+}
+#endif
+
+/*!
+ * Constructs a QxtFileSessionStore with the specified \a parent that keeps
+ * its files in \a directory. The directory is created if it does not exist.
+ */
+QxtFileSessionStore::QxtFileSessionStore(const QString& directory, QObject* parent) : QxtAbstractSessionStore(parent)
+{
+    QXT_INIT_PRIVATE(QxtFileSessionStore);
+    qxt_d().dir = QDir(directory);
+    if (!qxt_d().dir.exists() && !qxt_d().dir.mkpath(QLatin1String(".")))
+        qWarning("QxtFileSessionStore: unable to create %s", qPrintable(directory));
+}
+
+/*!
+ * Returns the directory the sessions are stored in.
+ */
+QString QxtFileSessionStore::directory() const
+{
+    return qxt_d().dir.absolutePath();
+}
+
+/*!
+ * Returns the number of seconds after its last write-back at which a stored
+ * session expires, or 0 if stored sessions never expire. The default is 0.
+ *
+ * \sa setMaximumAge()
+ */
+int QxtFileSessionStore::maximumAge() const
+{
+    return qxt_d().maximumAge;
+}
+
+/*!
+ * Sets the age after which a stored session expires to \a seconds; 0 keeps
+ * sessions until they are removed. An expired session is deleted when it is
+ * next loaded, or by removeExpired().
+ *
+ * The session manager removes sessions that time out while it is running.
+ * The maximum age covers sessions left in the store while no server was
+ * running, so it is normally set to the session timeout.
+ *
+ * \sa maximumAge(), QxtAbstractWebSessionManager::setSessionTimeout()
+ */
+void QxtFileSessionStore::setMaximumAge(int seconds)
+{
+    QMutexLocker locker(&qxt_d().lock);
+    qxt_d().maximumAge = qMax(0, seconds);
+}
+
+/*!
+ * Deletes the files of all expired sessions and returns how many were
+ * deleted.
+ *
+ * \sa setMaximumAge()
+ */
+int QxtFileSessionStore::removeExpired()
+{
+    QMutexLocker locker(&qxt_d().lock);
+    if (qxt_d().maximumAge <= 0) return 0;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    int removed = 0;
+    foreach(const QFileInfo& info, qxt_d().dir.entryInfoList(QDir::Files))
+    {
+        if (qxt_d().expired(info, now) && QFile::remove(info.filePath()))
+            removed++;
+    }
+    return removed;
+}
+
+/*!
+ * Returns true if \a key can name a stored session: 1 to 128 characters
+ * from letters, digits and "-_{}". The keys of QxtHttpSessionManager, which
+ * are UUIDs in braces, always qualify.
+ */
+bool QxtFileSessionStore::isValidKey(const QByteArray& key)
+{
+    if (key.isEmpty() || key.size() > 128) return false;
+    for (int i = 0; i < key.size(); i++)
+    {
+        char c = key.at(i);
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                || c == '-' || c == '_' || c == '{' || c == '}'))
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * \reimp
+ */
+QByteArray QxtFileSessionStore::load(const QByteArray& key)
+{
+    if (!isValidKey(key)) return QByteArray();
+    QxtFileSessionStorePrivate& d = qxt_d();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker locker(&d.lock);
+    QHash<QByteArray, qint64>::iterator miss = d.misses.find(key);
+    if (miss != d.misses.end())
+    {
+        if (now - *miss < qxtMissCacheTime)
+            return QByteArray();
+        d.misses.erase(miss);
+    }
+    QFile file(d.path(key));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        d.addMiss(key, now);
+        return QByteArray();
+    }
+    if (d.expired(QFileInfo(file), now))
+    {
+        file.remove();
+        d.addMiss(key, now);
+        return QByteArray();
+    }
+    QByteArray state = qxtDecodeSession(file.readAll());
+    if (state.isNull())
+    {
+        qWarning("QxtFileSessionStore: discarding corrupt session file %s", qPrintable(file.fileName()));
+        file.remove();
+        d.addMiss(key, now);
+    }
+    return state;
+}
+
+/*!
+ * \reimp
+ */
+bool QxtFileSessionStore::save(const QHash<QByteArray, QByteArray>& sessions, const QList<QByteArray>& removed)
+{
+    QMutexLocker locker(&qxt_d().lock);
+    bool ok = true;
+    for (QHash<QByteArray, QByteArray>::const_iterator it = sessions.constBegin(); it != sessions.constEnd(); ++it)
+    {
+        if (!isValidKey(it.key()))
+        {
+            qWarning("QxtFileSessionStore: refusing to store a session with an invalid key");
+            ok = false;
+            continue;
+        }
+        qxt_d().misses.remove(it.key());
+        QByteArray data = qxtEncodeSession(it.value());
+        QSaveFile file(qxt_d().path(it.key()));
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+        {
+            qWarning("QxtFileSessionStore: unable to write %s", qPrintable(file.fileName()));
+            ok = false;
+        }
+    }
+    foreach(const QByteArray& key, removed)
+    {
+        if (isValidKey(key))
+            QFile::remove(qxt_d().path(key));
+    }
+    return ok;
+}
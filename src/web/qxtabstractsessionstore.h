@@ -0,0 +1,73 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTABSTRACTSESSIONSTORE_H
+#define QXTABSTRACTSESSIONSTORE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <qxtglobal.h>
+
+class QXT_WEB_EXPORT QxtAbstractSessionStore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QxtAbstractSessionStore(QObject* parent = 0);
+
+    virtual QByteArray load(const QByteArray& key) = 0;
+    virtual bool save(const QHash<QByteArray, QByteArray>& sessions, const QList<QByteArray>& removed) = 0;
+};
+
+class QxtFileSessionStorePrivate;
+class QXT_WEB_EXPORT QxtFileSessionStore : public QxtAbstractSessionStore
+{
+    Q_OBJECT
+public:
+    explicit QxtFileSessionStore(const QString& directory, QObject* parent = 0);
+
+    QString directory() const;
+
+    int maximumAge() const;
+    void setMaximumAge(int seconds);
+    int removeExpired();
+
+    static bool isValidKey(const QByteArray& key);
+
+    virtual QByteArray load(const QByteArray& key);
+    virtual bool save(const QHash<QByteArray, QByteArray>& sessions, const QList<QByteArray>& removed);
+
+private:
+    QXT_DECLARE_PRIVATE(QxtFileSessionStore)
+};
+
+#endif // QXTABSTRACTSESSIONSTORE_H
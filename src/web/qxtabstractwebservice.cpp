@@ -62,6 +62,11 @@ subclasses of QxtAbstractWebService are free to create threads themselves.
 A web service object may delete itself (see QObject::deleteLater()) to end
 the associated session.
 
+If the session manager has a session store (see
+QxtAbstractWebSessionManager::setSessionStore()), a service that keeps state
+for its session should reimplement saveState() and restoreState() so that the
+session survives a restart of the server.
+
 \sa QxtAbstractWebSessionManager::ServiceFactory
 */
 
@@ -133,6 +138,36 @@ QxtAbstractWebSessionManager* QxtAbstractWebService::sessionManager() const
  * \sa QxtWebRequestEvent
  */
 
+/*!
+ * Returns the state of the service's session to be kept in the session store.
+ *
+ * This is called from the thread the service lives in whenever the session
+ * manager writes back sessions that have been used since the last write-back.
+ * The default implementation returns an empty QByteArray, which stores the
+ * session without any state.
+ *
+ * \sa restoreState(), QxtAbstractWebSessionManager::setSessionStore()
+ */
+QByteArray QxtAbstractWebService::saveState() const
+{
+    return QByteArray("");
+}
+
+/*!
+ * Restores the \a state previously returned by saveState() when a session is
+ * brought back from the session store, and returns true on success. This is
+ * called on a newly created service before it receives its first request.
+ *
+ * The default implementation ignores the state and returns true.
+ *
+ * \sa saveState()
+ */
+bool QxtAbstractWebService::restoreState(const QByteArray& state)
+{
+    Q_UNUSED(state);
+    return true;
+}
+
 #ifdef QXT_HAVE_WEBSOCKETS
 /*!
  * This event handler must be reimplemented in subclasses to receive incoming
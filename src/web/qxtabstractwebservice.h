@@ -33,6 +33,7 @@
 #define QXTABSTRACTWEBSERVICE_H
 
 #include <QObject>
+#include <QByteArray>
 #include "qxtabstractwebsessionmanager.h"
 class QxtWebEvent;
 class QxtWebRequestEvent;
@@ -54,6 +55,8 @@ public:
 #ifdef QXT_HAVE_WEBSOCKETS
     virtual void websocketEvent(QxtWebSocketEvent* event);
 #endif
+    virtual QByteArray saveState() const;
+    virtual bool restoreState(const QByteArray& state);
     // virtual void functionInvokedEvent(QxtWebRequestEvent* event) = 0; // todo: implement
 
 private:
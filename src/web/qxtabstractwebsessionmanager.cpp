@@ -47,6 +47,16 @@ A service object that wishes to end its corresponding session may destroy itself
 (see QObject::deleteLater()) and QxtAbstractWebSessionManager will automatically
 clean up its internal session tracking data.
 
+Sessions can also be ended by the session manager: after a period of
+inactivity (see setSessionTimeout()) or, when the number of sessions exceeds
+maximumSessions(), by closing the least recently used session. In both cases
+the service is deleted as by closeSession().
+
+With a session store (see setSessionStore()), sessions also outlive the
+process: used sessions are periodically written to the store, and a session
+that is not known to the running session manager is brought back from the
+store when a request for it arrives.
+
 \sa QxtAbstractWebService
 */
 
@@ -69,28 +79,21 @@ clean up its internal session tracking data.
 #include "qxtabstractwebsessionmanager_p.h"
 #include "qxtabstractwebservice.h"
 #include "qxtmetaobject.h"
+#include <QThread>
 #include <QtDebug>
 
 #ifndef QXT_DOXYGEN_RUN
 QxtAbstractWebSessionManagerPrivate::QxtAbstractWebSessionManagerPrivate()
-: factory(0), sessionMutex(QMutex::Recursive), maxID(1)
+: factory(0), maxID(1), sessionMutex(QMutex::Recursive), timeout(0), tickInterval(1000), lastTick(0), maxSessions(0)
 {
-  // initializers only
-}
-
-void QxtAbstractWebSessionManagerPrivate::sessionDestroyed(int sessionID)
-{
-  QMutexLocker locker(&sessionMutex);
-  if (sessions.contains(sessionID))
-  {
-    freeList.enqueue(sessionID);
-    sessions.remove(sessionID);
-    qxt_p().sessionDestroyed(sessionID);
-  }
+  clock.start();
+  writeBackTimer.setInterval(1000);
+  QObject::connect(&expiryTimer, SIGNAL(timeout()), this, SLOT(expireSessions()));
 }
 
 int QxtAbstractWebSessionManagerPrivate::getNextID()
 {
+  QMutexLocker locker(&idLock);
   if (freeList.empty())
   {
     int next = maxID;
@@ -99,6 +102,169 @@ int QxtAbstractWebSessionManagerPrivate::getNextID()
   }
   return freeList.dequeue();
 }
+
+void QxtAbstractWebSessionManagerPrivate::link(Shard& shard, Session* session)
+{
+  session->prev = 0;
+  session->next = shard.head;
+  if (shard.head) shard.head->prev = session;
+  shard.head = session;
+  if (!shard.tail) shard.tail = session;
+}
+
+void QxtAbstractWebSessionManagerPrivate::unlink(Shard& shard, Session* session)
+{
+  if (session->prev) session->prev->next = session->next;
+  else if (shard.head == session) shard.head = session->next;
+  if (session->next) session->next->prev = session->prev;
+  else if (shard.tail == session) shard.tail = session->prev;
+  session->prev = session->next = 0;
+}
+
+/*
+ * Puts the session in the wheel slot of its deadline, but never in the slot
+ * of a tick that has already been processed. Touching a session only updates
+ * lastAccess; the wheel entry is moved when its slot comes up.
+ */
+void QxtAbstractWebSessionManagerPrivate::schedule(Shard& shard, Session* session, qint64 tick)
+{
+  qint64 due = qMax((session->lastAccess + timeout) / tickInterval, tick + 1);
+  session->bucket = int(due % WheelSize);
+  shard.wheel[session->bucket].append(session->id);
+}
+
+void QxtAbstractWebSessionManagerPrivate::markDirty(Shard& shard, Session* session)
+{
+  if (session->dirty || session->key.isEmpty() || !store) return;
+  session->dirty = true;
+  shard.dirty.append(session->id);
+}
+
+/*
+ * Ends a session. The session stays in the table, marked as closing, until
+ * its service has been destroyed so that its ID is not reused too early.
+ */
+bool QxtAbstractWebSessionManagerPrivate::close(int sessionID)
+{
+  Shard& s = shard(sessionID);
+  QxtAbstractWebService* service;
+  QByteArray key;
+  {
+    QMutexLocker locker(&s.lock);
+    Session* session = s.sessions.value(sessionID);
+    if (!session || session->closing) return false;
+    unlink(s, session);
+    session->closing = true;
+    session->bucket = -1;
+    sessionCount.deref();
+    service = session->service;
+    if (!service)
+    {
+      key = session->key;
+      s.sessions.remove(sessionID);
+      delete session;
+    }
+  }
+  if (service)
+    service->deleteLater();   // sessionDestroyed() finishes the cleanup
+  else
+    release(sessionID, key);
+  return true;
+}
+
+void QxtAbstractWebSessionManagerPrivate::release(int sessionID, const QByteArray& key)
+{
+  if (!key.isEmpty() && store)
+  {
+    QMutexLocker locker(&removedLock);
+    removedKeys.append(key);
+  }
+  {
+    QMutexLocker locker(&idLock);
+    freeList.enqueue(sessionID);
+  }
+  qxt_p().sessionDestroyed(sessionID);
+}
+
+/*
+ * Closes the least recently used session other than keepID. Every shard keeps
+ * its own LRU list, so this is only approximately the least recently used
+ * session overall.
+ */
+void QxtAbstractWebSessionManagerPrivate::evictOne(int keepID)
+{
+  uint first = uint(keepID) % ShardCount;
+  for (uint i = 0; i < ShardCount; i++)
+  {
+    Shard& s = shards[(first + i) % ShardCount];
+    int victim = 0;
+    {
+      QMutexLocker locker(&s.lock);
+      Session* session = s.tail;
+      if (session && session->id == keepID) session = session->prev;
+      if (session) victim = session->id;
+    }
+    if (victim && close(victim))
+    {
+      evictedCount.ref();
+      return;
+    }
+  }
+}
+
+void QxtAbstractWebSessionManagerPrivate::sessionDestroyed(int sessionID)
+{
+  Shard& s = shard(sessionID);
+  QByteArray key;
+  {
+    QMutexLocker locker(&s.lock);
+    Session* session = s.sessions.take(sessionID);
+    if (!session) return;
+    if (!session->closing)
+    {
+      unlink(s, session);
+      sessionCount.deref();
+    }
+    key = session->key;
+    delete session;
+  }
+  release(sessionID, key);
+}
+
+void QxtAbstractWebSessionManagerPrivate::expireSessions()
+{
+  if (timeout <= 0) return;
+  qint64 now = clock.elapsed();
+  qint64 tick = now / tickInterval;
+  qint64 first = qMax(lastTick + 1, tick - WheelSize + 1);
+  lastTick = tick;
+  QList<int> expired;
+  for (int i = 0; i < ShardCount; i++)
+  {
+    Shard& s = shards[i];
+    QMutexLocker locker(&s.lock);
+    for (qint64 t = first; t <= tick; t++)
+    {
+      int slot = int(t % WheelSize);
+      QList<int> bucket;
+      bucket.swap(s.wheel[slot]);
+      foreach(int id, bucket)
+      {
+        Session* session = s.sessions.value(id);
+        if (!session || session->closing || session->bucket != slot) continue;
+        if (session->lastAccess + timeout <= now)
+          expired << id;
+        else
+          schedule(s, session, tick);
+      }
+    }
+  }
+  foreach(int id, expired)
+  {
+    if (close(id))
+      expiredCount.ref();
+  }
+}
 #endif
 
 /*!
@@ -109,6 +275,16 @@ int QxtAbstractWebSessionManagerPrivate::getNextID()
 QxtAbstractWebSessionManager::QxtAbstractWebSessionManager(QObject* parent) : QObject(parent)
 {
   QXT_INIT_PRIVATE(QxtAbstractWebSessionManager);
+  QObject::connect(&qxt_d().writeBackTimer, SIGNAL(timeout()), this, SLOT(flushSessions()));
+}
+
+/*!
+ * Destroys the session manager. Sessions that have not been written back to
+ * the session store yet are written back first.
+ */
+QxtAbstractWebSessionManager::~QxtAbstractWebSessionManager()
+{
+  flushSessions();
 }
 
 /*!
@@ -142,19 +318,20 @@ QxtAbstractWebSessionManager::ServiceFactory* QxtAbstractWebSessionManager::serv
  */
 QxtAbstractWebService* QxtAbstractWebSessionManager::session(int sessionID) const
 {
-  QMutexLocker locker(sessionMutex());
-  if (qxt_d().sessions.contains(sessionID))
-    return qxt_d().sessions[sessionID];
+  QxtAbstractWebSessionManagerPrivate::Shard& shard = const_cast<QxtAbstractWebSessionManagerPrivate&>(qxt_d()).shard(sessionID);
+  QMutexLocker locker(&shard.lock);
+  QxtAbstractWebSessionManagerPrivate::Session* session = shard.sessions.value(sessionID);
+  if (session && !session->closing)
+    return session->service;
   return 0;
 }
 
 /*!
- * Returns the mutex used to serialize access to session data structures.
+ * Returns a recursive mutex that subclasses may use to synchronize their own
+ * session data structures.
  *
- * Subclasses may use this mutex to synchronize their own session data
- * structures. This is a recursive mutex, so subclasses do not need to
- * worry about deadlocking against QxtAbstractWebSessionManager's internal
- * functions.
+ * QxtAbstractWebSessionManager does not hold this mutex itself; its session
+ * table is split into independently locked shards.
  */
 QMutex* QxtAbstractWebSessionManager::sessionMutex() const
 {
@@ -165,45 +342,350 @@ QMutex* QxtAbstractWebSessionManager::sessionMutex() const
  * Creates a new session and returns its session ID.
  *
  * This function uses the serviceFactory() to request an instance of the web service.
+ * If this makes the number of sessions exceed maximumSessions(), the least
+ * recently used session is closed.
+ *
  * \sa serviceFactory()
  */
 int QxtAbstractWebSessionManager::createService()
 {
-  QMutexLocker locker(sessionMutex());
-  int sessionID = qxt_d().getNextID();
-  if (!qxt_d().factory) {
-    qxt_d().sessions[sessionID] = nullptr;
-    return sessionID;
-  }
+  QxtAbstractWebSessionManagerPrivate& d = qxt_d();
+  int sessionID = d.getNextID();
+  QxtAbstractWebService* service = d.factory ? d.factory(this, sessionID) : 0;
 
-  QxtAbstractWebService* service = serviceFactory()(this, sessionID);
-  qxt_d().sessions[sessionID] = service;
-  // Using QxtBoundFunction to bind the sessionID to the slot invocation
-  QxtMetaObject::connect(service, SIGNAL(destroyed()), QxtMetaObject::bind(&qxt_d(), SLOT(sessionDestroyed(int)), Q_ARG(int, sessionID)), Qt::QueuedConnection);
+  QxtAbstractWebSessionManagerPrivate::Session* session = new QxtAbstractWebSessionManagerPrivate::Session;
+  session->id = sessionID;
+  session->service = service;
+  session->lastAccess = d.clock.elapsed();
+  session->bucket = -1;
+  session->closing = false;
+  session->dirty = false;
+  {
+    QxtAbstractWebSessionManagerPrivate::Shard& shard = d.shard(sessionID);
+    QMutexLocker locker(&shard.lock);
+    shard.sessions.insert(sessionID, session);
+    d.link(shard, session);
+    if (d.timeout > 0)
+      d.schedule(shard, session, session->lastAccess / d.tickInterval);
+  }
+  int count = d.sessionCount.fetchAndAddRelaxed(1) + 1;
+  if (service)
+  {
+    // Using QxtBoundFunction to bind the sessionID to the slot invocation
+    QxtMetaObject::connect(service, SIGNAL(destroyed()), QxtMetaObject::bind(&d, SLOT(sessionDestroyed(int)), Q_ARG(int, sessionID)), Qt::QueuedConnection);
+  }
+  if (d.maxSessions > 0 && count > d.maxSessions)
+    d.evictOne(sessionID);
   return sessionID; // you can always get the service with this
 }
 
+/*!
+ * Records that the session \a sessionID is in use, restarting its idle
+ * timeout and making it the most recently used session.
+ *
+ * Subclasses should call this for every request that belongs to a session.
+ *
+ * \sa setSessionTimeout(), setMaximumSessions()
+ */
+void QxtAbstractWebSessionManager::touchSession(int sessionID)
+{
+  QxtAbstractWebSessionManagerPrivate& d = qxt_d();
+  QxtAbstractWebSessionManagerPrivate::Shard& shard = d.shard(sessionID);
+  QMutexLocker locker(&shard.lock);
+  QxtAbstractWebSessionManagerPrivate::Session* session = shard.sessions.value(sessionID);
+  if (!session || session->closing) return;
+  session->lastAccess = d.clock.elapsed();
+  if (shard.head != session)
+  {
+    d.unlink(shard, session);
+    d.link(shard, session);
+  }
+  d.markDirty(shard, session);
+}
+
+/*!
+ * Associates the session \a sessionID with \a key in the session store and
+ * schedules it to be written back.
+ *
+ * Subclasses that support persistent sessions call this when they create a
+ * session; the key must identify the session across restarts.
+ *
+ * \sa restoreSession(), setSessionStore()
+ */
+void QxtAbstractWebSessionManager::setSessionKey(int sessionID, const QByteArray& key)
+{
+  QxtAbstractWebSessionManagerPrivate& d = qxt_d();
+  QxtAbstractWebSessionManagerPrivate::Shard& shard = d.shard(sessionID);
+  QMutexLocker locker(&shard.lock);
+  QxtAbstractWebSessionManagerPrivate::Session* session = shard.sessions.value(sessionID);
+  if (!session || session->closing) return;
+  session->key = key;
+  d.markDirty(shard, session);
+}
+
+/*!
+ * Brings the session stored under \a key back from the session store.
+ *
+ * A new session is created with the service factory, associated with \a key,
+ * and its service's state is restored with QxtAbstractWebService::restoreState().
+ * Returns the new session ID, or -1 if there is no session store or it has no
+ * session called \a key.
+ *
+ * \sa setSessionKey(), setSessionStore()
+ */
+int QxtAbstractWebSessionManager::restoreSession(const QByteArray& key)
+{
+  QxtAbstractSessionStore* store = qxt_d().store;
+  if (!store || key.isEmpty()) return -1;
+  QByteArray state = store->load(key);
+  if (state.isNull()) return -1;
+  int sessionID = createService();
+  QxtAbstractWebService* service = session(sessionID);
+  if (service && !service->restoreState(state))
+  {
+    qWarning("QxtAbstractWebSessionManager: unable to restore session state");
+  }
+  setSessionKey(sessionID, key);
+  return sessionID;
+}
+
 /*!
  * Destroys an existing session.
  *
  * If there is a service associated with the session, it will be deleted.
- * The session ID may be reused.
+ * The session ID may be reused once the service has been destroyed.
  *
  * If the session ID is not in use, this function does nothing.
  */
 void QxtAbstractWebSessionManager::closeSession(int sessionID)
 {
-  QMutexLocker locker(sessionMutex());
-  if (!qxt_d().sessions.contains(sessionID)) {
-    return;
+  qxt_d().close(sessionID);
+}
+
+/*!
+ * Returns the idle timeout of sessions, in seconds.
+ *
+ * \sa setSessionTimeout()
+ */
+int QxtAbstractWebSessionManager::sessionTimeout() const
+{
+  return qxt_d().timeout / 1000;
+}
+
+/*!
+ * Sets the idle timeout of sessions to \a seconds. A session that has not
+ * received a request for this long is closed, as by closeSession().
+ *
+ * The default value is 0, which means that sessions never expire. Expiry is
+ * checked by a timer wheel in the session manager's thread that ticks every
+ * 1/32 of the timeout, but no more often than every 100 milliseconds and no
+ * less often than once a minute. A session may outlive its timeout by up to
+ * one tick.
+ *
+ * \sa sessionTimeout(), expiredSessionCount()
+ */
+void QxtAbstractWebSessionManager::setSessionTimeout(int seconds)
+{
+  QxtAbstractWebSessionManagerPrivate& d = qxt_d();
+  d.timeout = qMax(0, seconds) * 1000;
+  d.expiryTimer.stop();
+  if (d.timeout <= 0) return;
+  d.tickInterval = qBound(100, d.timeout / 32, 60000);
+  d.lastTick = d.clock.elapsed() / d.tickInterval;
+  for (int i = 0; i < QxtAbstractWebSessionManagerPrivate::ShardCount; i++)
+  {
+    QxtAbstractWebSessionManagerPrivate::Shard& shard = d.shards[i];
+    QMutexLocker locker(&shard.lock);
+    for (int slot = 0; slot < QxtAbstractWebSessionManagerPrivate::WheelSize; slot++)
+      shard.wheel[slot].clear();
+    foreach(QxtAbstractWebSessionManagerPrivate::Session* session, shard.sessions)
+    {
+      if (!session->closing)
+        d.schedule(shard, session, d.lastTick);
+    }
   }
-  QxtAbstractWebService* service = qxt_d().sessions.take(sessionID);
-  if (service) {
-    // This will trigger sessionDestroyed automatically
-    service->deleteLater();
-  } else {
-    qxt_d().sessionDestroyed(sessionID);
+  d.expiryTimer.start(int(d.tickInterval));
+}
+
+/*!
+ * Returns the maximum number of sessions.
+ *
+ * \sa setMaximumSessions()
+ */
+int QxtAbstractWebSessionManager::maximumSessions() const
+{
+  return qxt_d().maxSessions;
+}
+
+/*!
+ * Sets the maximum number of sessions to \a count. When a new session would
+ * exceed it, the least recently used session is closed, as by closeSession().
+ * Sessions are tracked in several independent lists, so the session chosen is
+ * approximately, not exactly, the least recently used one.
+ *
+ * The default value is 0, which means that the number of sessions is not
+ * limited.
+ *
+ * \sa maximumSessions(), evictedSessionCount()
+ */
+void QxtAbstractWebSessionManager::setMaximumSessions(int count)
+{
+  qxt_d().maxSessions = qMax(0, count);
+}
+
+/*!
+ * Returns the session store, or 0 if sessions are not persistent.
+ *
+ * \sa setSessionStore()
+ */
+QxtAbstractSessionStore* QxtAbstractWebSessionManager::sessionStore() const
+{
+  return qxt_d().store;
+}
+
+/*!
+ * Sets the \a store that sessions are persisted to. The session manager does
+ * not take ownership of the store.
+ *
+ * Sessions that have been used are written back to the store in one batch
+ * every writeBackInterval() milliseconds, using the state returned by
+ * QxtAbstractWebService::saveState(). Sessions that end are deleted from the
+ * store with the next batch. Pass 0 to stop persisting sessions.
+ *
+ * \sa setWriteBackInterval(), flushSessions(), QxtFileSessionStore
+ */
+void QxtAbstractWebSessionManager::setSessionStore(QxtAbstractSessionStore* store)
+{
+  flushSessions();
+  qxt_d().store = store;
+  if (store && qxt_d().writeBackTimer.interval() > 0)
+    qxt_d().writeBackTimer.start();
+  else
+    qxt_d().writeBackTimer.stop();
+}
+
+/*!
+ * Returns the time between write-backs to the session store, in milliseconds.
+ *
+ * \sa setWriteBackInterval()
+ */
+int QxtAbstractWebSessionManager::writeBackInterval() const
+{
+  return qxt_d().writeBackTimer.interval();
+}
+
+/*!
+ * Sets the time between write-backs to the session store to \a msecs
+ * milliseconds. The default is 1000. A session used by several requests
+ * within the interval is written only once. Set it to 0 to write back only
+ * when flushSessions() is called.
+ *
+ * \sa writeBackInterval(), setSessionStore()
+ */
+void QxtAbstractWebSessionManager::setWriteBackInterval(int msecs)
+{
+  qxt_d().writeBackTimer.setInterval(qMax(0, msecs));
+  if (qxt_d().store && msecs > 0)
+    qxt_d().writeBackTimer.start();
+  else
+    qxt_d().writeBackTimer.stop();
+}
+
+/*!
+ * Writes every session used since the last write-back to the session store
+ * and deletes ended sessions from it.
+ *
+ * The state of each service is collected in the thread the service lives in.
+ *
+ * \sa setSessionStore()
+ */
+void QxtAbstractWebSessionManager::flushSessions()
+{
+  QxtAbstractWebSessionManagerPrivate& d = qxt_d();
+  QxtAbstractSessionStore* store = d.store;
+  if (!store) return;
+
+  QList<QByteArray> removed;
+  {
+    QMutexLocker locker(&d.removedLock);
+    removed.swap(d.removedKeys);
   }
+  struct DirtySession
+  {
+    QByteArray key;
+    bool hasService;
+    QPointer<QxtAbstractWebService> service;
+  };
+  QList<DirtySession> dirty;
+  for (int i = 0; i < QxtAbstractWebSessionManagerPrivate::ShardCount; i++)
+  {
+    QxtAbstractWebSessionManagerPrivate::Shard& shard = d.shards[i];
+    QMutexLocker locker(&shard.lock);
+    foreach(int id, shard.dirty)
+    {
+      QxtAbstractWebSessionManagerPrivate::Session* session = shard.sessions.value(id);
+      if (!session || !session->dirty) continue;
+      session->dirty = false;
+      if (session->closing || session->key.isEmpty()) continue;
+      DirtySession entry = { session->key, session->service != 0, session->service };
+      dirty.append(entry);
+    }
+    shard.dirty.clear();
+  }
+
+  QHash<QByteArray, QByteArray> sessions;
+  foreach(const DirtySession& entry, dirty)
+  {
+    QByteArray state("");   // sessions without a service are stored without state
+    if (entry.hasService)
+    {
+      QxtAbstractWebService* service = entry.service;
+      if (!service) continue;     // destroyed in the meantime; the session has ended
+      QThread* thread = service->thread();
+      if (thread != QThread::currentThread() && thread->isRunning())
+      {
+        QMetaObject::invokeMethod(service, [service, &state]() {
+          state = service->saveState();
+        }, Qt::BlockingQueuedConnection);
+      }
+      else
+      {
+        state = service->saveState();
+      }
+    }
+    sessions.insert(entry.key, state);
+  }
+  if (!sessions.isEmpty() || !removed.isEmpty())
+    store->save(sessions, removed);
+}
+
+/*!
+ * Returns the number of open sessions.
+ */
+int QxtAbstractWebSessionManager::sessionCount() const
+{
+  return qxt_d().sessionCount.load();
+}
+
+/*!
+ * Returns the number of sessions closed because they exceeded the idle
+ * timeout.
+ *
+ * \sa setSessionTimeout()
+ */
+int QxtAbstractWebSessionManager::expiredSessionCount() const
+{
+  return qxt_d().expiredCount.load();
+}
+
+/*!
+ * Returns the number of sessions closed to stay within maximumSessions().
+ *
+ * \sa setMaximumSessions()
+ */
+int QxtAbstractWebSessionManager::evictedSessionCount() const
+{
+  return qxt_d().evictedCount.load();
 }
 
 /*!
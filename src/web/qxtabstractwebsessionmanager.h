@@ -33,9 +33,11 @@
 #define QXTABSTRACTWEBSESSIONMANAGER_H
 
 #include <QObject>
+#include <QByteArray>
 #include <qxtglobal.h>
 class QxtAbstractWebService;
 class QxtWebEvent;
+class QxtAbstractSessionStore;
 class QMutex;
 
 class QxtAbstractWebSessionManagerPrivate;
@@ -46,6 +48,7 @@ public:
     typedef QxtAbstractWebService* ServiceFactory(QxtAbstractWebSessionManager*, int);
 
     QxtAbstractWebSessionManager(QObject* parent = 0);
+    virtual ~QxtAbstractWebSessionManager();
 
     virtual bool start() = 0;
     virtual void postEvent(QxtWebEvent* event) = 0;
@@ -55,13 +58,33 @@ public:
     QxtAbstractWebService* session(int sessionID) const;
     void closeSession(int sessionID);
 
+    int sessionTimeout() const;
+    void setSessionTimeout(int seconds);
+
+    int maximumSessions() const;
+    void setMaximumSessions(int count);
+
+    int sessionCount() const;
+    int expiredSessionCount() const;
+    int evictedSessionCount() const;
+
+    QxtAbstractSessionStore* sessionStore() const;
+    void setSessionStore(QxtAbstractSessionStore* store);
+
+    int writeBackInterval() const;
+    void setWriteBackInterval(int msecs);
+
 public Q_SLOTS:
     virtual bool shutdown() = 0;
+    void flushSessions();
 
 protected:
     QMutex* sessionMutex() const;
 
     int createService();
+    void touchSession(int sessionID);
+    void setSessionKey(int sessionID, const QByteArray& key);
+    int restoreSession(const QByteArray& key);
     virtual void sessionDestroyed(int sessionID);
 
 protected Q_SLOTS:
@@ -35,28 +35,91 @@
 #include <QObject>
 #include <QPointer>
 #include <QHash>
+#include <QList>
+#include <QVector>
 #include <QQueue>
 #include <QMutex>
+#include <QTimer>
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include "qxtabstractwebsessionmanager.h"
+#include "qxtabstractsessionstore.h"
 
 #ifndef QXT_DOXYGEN_RUN
 class QxtAbstractWebSessionManagerPrivate : public QObject, public QxtPrivate<QxtAbstractWebSessionManager>
 {
     Q_OBJECT
 public:
+    // Sessions are spread over shards by ID so that requests for different
+    // sessions rarely contend for the same lock.
+    enum { ShardCount = 16, WheelSize = 64 };
+
+    struct Session
+    {
+        int id;
+        QxtAbstractWebService* service;
+        qint64 lastAccess;          // ms on the manager's clock
+        int bucket;                 // timer wheel slot, or -1
+        bool closing;               // the service has been asked to delete itself
+        bool dirty;                 // used since the last write-back
+        QByteArray key;             // key in the session store, if any
+        Session* prev;              // LRU links; more recently used towards the head
+        Session* next;
+    };
+
+    struct Shard
+    {
+        Shard() : head(0), tail(0), wheel(WheelSize) {}
+        ~Shard() { qDeleteAll(sessions); }
+
+        QMutex lock;
+        QHash<int, Session*> sessions;
+        Session* head;
+        Session* tail;
+        QVector<QList<int> > wheel;  // session IDs by expiry tick; checked lazily
+        QList<int> dirty;            // sessions to write back
+    };
+
     QxtAbstractWebSessionManagerPrivate();
     QXT_DECLARE_PUBLIC(QxtAbstractWebSessionManager)
 
     QxtAbstractWebSessionManager::ServiceFactory* factory;
-    QHash<int, QxtAbstractWebService*> sessions;
+    Shard shards[ShardCount];
+    QMutex idLock;
     QQueue<int> freeList;
-    mutable QMutex sessionMutex;
     int maxID;
+    mutable QMutex sessionMutex;
+
+    QElapsedTimer clock;
+    QTimer expiryTimer;
+    int timeout;                    // idle timeout in ms, 0 for none
+    qint64 tickInterval;
+    qint64 lastTick;
+    int maxSessions;
+    QAtomicInt sessionCount, expiredCount, evictedCount;
+
+    QPointer<QxtAbstractSessionStore> store;
+    QTimer writeBackTimer;
+    QMutex removedLock;
+    QList<QByteArray> removedKeys;      // ended sessions to delete from the store
+
+    inline Shard& shard(int sessionID)
+    {
+        return shards[uint(sessionID) % ShardCount];
+    }
 
     int getNextID();
+    void link(Shard& shard, Session* session);
+    void unlink(Shard& shard, Session* session);
+    void schedule(Shard& shard, Session* session, qint64 tick);
+    void markDirty(Shard& shard, Session* session);
+    bool close(int sessionID);
+    void release(int sessionID, const QByteArray& key);
+    void evictOne(int keepID);
 
 public Q_SLOTS:
     void sessionDestroyed(int sessionID);
+    void expireSessions();
 };
 #endif // QXT_DOXYGEN_RUN
 
@@ -0,0 +1,138 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTFCGI_P_H
+#define QXTFCGI_P_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+#ifndef QXT_DOXYGEN_RUN
+// FastCGI record framing shared by QxtFcgiServerConnector, which speaks the
+// application side of the protocol, and the worker pool of QxtWebCgiService,
+// which speaks the web server side.
+enum
+{
+    FcgiVersion = 1,
+    FcgiHeaderSize = 8,
+    FcgiMaxContent = 65528,             // largest 8-byte aligned record body
+
+    FcgiBeginRequest = 1,
+    FcgiAbortRequest = 2,
+    FcgiEndRequest = 3,
+    FcgiParams = 4,
+    FcgiStdin = 5,
+    FcgiStdout = 6,
+    FcgiStderr = 7,
+    FcgiGetValues = 9,
+    FcgiGetValuesResult = 10,
+    FcgiUnknownType = 11,
+
+    FcgiResponder = 1,
+    FcgiKeepConn = 1,
+
+    FcgiRequestComplete = 0,
+    FcgiOverloaded = 2,
+    FcgiUnknownRole = 3
+};
+
+/*
+ * Appends size bytes of data to out as records of the given type,
+ * splitting them where a record would overflow. Empty data produces
+ * the single empty record that terminates a stream.
+ */
+static inline void qxtFcgiAppendRecords(QByteArray& out, int type, quint16 id, const char* data, qint64 size)
+{
+    do
+    {
+        int chunk = int(qMin<qint64>(size, FcgiMaxContent));
+        int padding = (8 - (chunk & 7)) & 7;
+        const char header[FcgiHeaderSize] = {
+            char(FcgiVersion), char(type), char(id >> 8), char(id & 0xff),
+            char(chunk >> 8), char(chunk & 0xff), char(padding), 0
+        };
+        out.append(header, FcgiHeaderSize);
+        out.append(data, chunk);
+        out.append(padding, '\0');
+        data += chunk;
+        size -= chunk;
+    }
+    while (size > 0);
+}
+
+static inline void qxtFcgiAppendEndRequest(QByteArray& out, quint16 id, quint32 appStatus, int protocolStatus)
+{
+    const char body[8] = {
+        char(appStatus >> 24), char(appStatus >> 16), char(appStatus >> 8), char(appStatus),
+        char(protocolStatus), 0, 0, 0
+    };
+    qxtFcgiAppendRecords(out, FcgiEndRequest, id, body, 8);
+}
+
+/*
+ * Reads a name or value length at pos in a name-value pair block.
+ */
+static inline bool qxtFcgiReadLength(const uchar* data, int size, int& pos, int& length)
+{
+    if (pos >= size)
+        return false;
+    if (data[pos] & 0x80)
+    {
+        if (size - pos < 4)
+            return false;
+        length = ((data[pos] & 0x7f) << 24) | (data[pos + 1] << 16) | (data[pos + 2] << 8) | data[pos + 3];
+        pos += 4;
+    }
+    else
+    {
+        length = data[pos];
+        pos += 1;
+    }
+    return true;
+}
+
+static inline void qxtFcgiAppendLength(QByteArray& out, int length)
+{
+    if (length < 128)
+    {
+        out.append(char(length));
+    }
+    else
+    {
+        out.append(char((length >> 24) | 0x80));
+        out.append(char(length >> 16));
+        out.append(char(length >> 8));
+        out.append(char(length));
+    }
+}
+#endif // QXT_DOXYGEN_RUN
+
+#endif // QXTFCGI_P_H
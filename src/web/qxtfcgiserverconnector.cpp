@@ -0,0 +1,647 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+/*!
+\class QxtFcgiServerConnector
+
+\inmodule QxtWeb
+
+\brief The QxtFcgiServerConnector class provides a FastCGI connector for QxtHttpSessionManager
+
+
+QxtFcgiServerConnector implements the responder role of the FastCGI protocol.
+Unlike SCGI, a FastCGI front-end may keep its connection to the application
+open across requests and multiplex several requests over it, which saves a
+connection setup per request. With nginx this requires
+\c{fastcgi_keep_conn on;} in the upstream configuration.
+
+Every FastCGI request is presented to the session manager as a device of its
+own, so requests sharing a connection are served independently and may be
+handed to different I/O worker threads. Responses are sent without chunked
+transfer encoding; the end of a response is signalled by completing the
+FastCGI request.
+
+The number of concurrent requests accepted on one connection is limited by
+maximumRequestsPerConnection(); further requests are refused with
+FCGI_OVERLOADED.
+
+\sa QxtHttpSessionManager, QxtScgiServerConnector
+*/
+#include "qxthttpsessionmanager.h"
+#include "qxtfcgiserverconnector_p.h"
+#include "qxtfcgi_p.h"
+#include "qxthttprequestparser.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <string.h>
+
+enum
+{
+    FcgiLowWaterMark = 65536            // socket backlog below which writers are resumed
+};
+
+static inline bool qxtNameIs(const char* name, int length, const char* expected)
+{
+    return int(strlen(expected)) == length && !memcmp(name, expected, length);
+}
+
+#ifndef QXT_DOXYGEN_RUN
+void QxtFcgiChannel::schedule()
+{
+    // called with the lock held
+    if (flushScheduled || !connection)
+        return;
+    flushScheduled = true;
+    QMetaObject::invokeMethod(connection, "flush", Qt::QueuedConnection);
+}
+
+QxtFcgiConnection::QxtFcgiConnection(QxtFcgiServerConnector* connector, QTcpSocket* socket)
+    : QObject(connector), connector(connector), socket(socket), channel(new QxtFcgiChannel), offset(0)
+{
+    channel->connection = this;
+    socket->setParent(this);
+    QObject::connect(socket, SIGNAL(readyRead()), this, SLOT(readRecords()));
+    QObject::connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(socketBytesWritten()));
+    QObject::connect(socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+}
+
+QxtFcgiConnection::~QxtFcgiConnection()
+{
+    detachAll();
+}
+
+void QxtFcgiConnection::readRecords()
+{
+    buffer.append(socket->readAll());
+    while (buffer.size() - offset >= FcgiHeaderSize)
+    {
+        const uchar* header = reinterpret_cast<const uchar*>(buffer.constData()) + offset;
+        if (header[0] != FcgiVersion)
+        {
+            qWarning("QxtFcgiServerConnector: unsupported protocol version %d", header[0]);
+            socket->abort();
+            return;
+        }
+        int type = header[1];
+        quint16 id = (header[2] << 8) | header[3];
+        int size = (header[4] << 8) | header[5];
+        int padding = header[6];
+        if (buffer.size() - offset < FcgiHeaderSize + size + padding)
+            break;
+        const char* data = buffer.constData() + offset + FcgiHeaderSize;
+        offset += FcgiHeaderSize + size + padding;
+        handleRecord(type, id, data, size);
+        if (socket->state() != QAbstractSocket::ConnectedState)
+            return;
+    }
+    // Drop consumed records lazily, as the HTTP connector does.
+    if (offset >= buffer.size())
+    {
+        buffer.clear();
+        offset = 0;
+    }
+    else if (offset > buffer.size() / 2)
+    {
+        buffer.remove(0, offset);
+        offset = 0;
+    }
+}
+
+void QxtFcgiConnection::handleRecord(int type, quint16 id, const char* data, int size)
+{
+    switch (type)
+    {
+    case FcgiBeginRequest:
+        beginRequest(id, data, size);
+        break;
+    case FcgiAbortRequest:
+        if (requests.contains(id))
+        {
+            Request request = requests.value(id);
+            {
+                QMutexLocker locker(&channel->lock);
+                QxtFcgiRequestDevice* device = channel->devices.take(id);
+                if (!device)
+                    break;      // already completed, END_REQUEST is on its way
+                if (request.started)
+                    QMetaObject::invokeMethod(device, "abort", Qt::QueuedConnection);
+                qxtFcgiAppendEndRequest(channel->output, id, 0, FcgiRequestComplete);
+            }
+            requests.remove(id);
+            if (!request.started)
+                delete request.device;
+            flush();
+            if (!request.keepConnection)
+                socket->disconnectFromHost();
+        }
+        break;
+    case FcgiParams:
+        if (requests.contains(id))
+        {
+            Request& request = requests[id];
+            if (request.started)
+                break;
+            if (size > 0)
+            {
+                request.params.append(data, size);
+                break;
+            }
+            // The parameter stream is complete; the device yields its length
+            // and the raw name-value pairs ahead of the request body.
+            QByteArray block(4, '\0');
+            quint32 length = request.params.size();
+            block[0] = char(length >> 24);
+            block[1] = char(length >> 16);
+            block[2] = char(length >> 8);
+            block[3] = char(length);
+            block.append(request.params);
+            request.params.clear();
+            request.started = true;
+            request.device->appendInput(block);
+            connector->addConnection(request.device);
+        }
+        break;
+    case FcgiStdin:
+        if (size > 0 && requests.contains(id))
+        {
+            QMutexLocker locker(&channel->lock);
+            QxtFcgiRequestDevice* device = channel->devices.value(id);
+            if (device)
+                device->appendInput(QByteArray(data, size));
+        }
+        break;
+    case FcgiGetValues:
+        getValues(data, size);
+        break;
+    default:
+        if (id == 0)
+        {
+            const char body[8] = { char(type), 0, 0, 0, 0, 0, 0, 0 };
+            writeRecord(FcgiUnknownType, 0, body, 8);
+        }
+        break;
+    }
+}
+
+void QxtFcgiConnection::beginRequest(quint16 id, const char* data, int size)
+{
+    if (size < 8 || id == 0 || requests.contains(id))
+        return;
+    const uchar* body = reinterpret_cast<const uchar*>(data);
+    int role = (body[0] << 8) | body[1];
+    bool keepConnection = body[2] & FcgiKeepConn;
+    if (role != FcgiResponder)
+    {
+        endRequest(id, 0, FcgiUnknownRole);
+    }
+    else if (requests.count() >= connector->maximumRequestsPerConnection())
+    {
+        endRequest(id, 0, FcgiOverloaded);
+    }
+    else
+    {
+        Request request;
+        request.device = new QxtFcgiRequestDevice(channel, id);
+        request.keepConnection = keepConnection;
+        requests.insert(id, request);
+        return;
+    }
+    if (!keepConnection)
+        socket->disconnectFromHost();
+}
+
+void QxtFcgiConnection::writeRecord(int type, quint16 id, const char* data, int size)
+{
+    {
+        QMutexLocker locker(&channel->lock);
+        qxtFcgiAppendRecords(channel->output, type, id, data, size);
+    }
+    flush();
+}
+
+void QxtFcgiConnection::endRequest(quint16 id, quint32 appStatus, int protocolStatus)
+{
+    {
+        QMutexLocker locker(&channel->lock);
+        qxtFcgiAppendEndRequest(channel->output, id, appStatus, protocolStatus);
+    }
+    flush();
+}
+
+void QxtFcgiConnection::getValues(const char* data, int size)
+{
+    const uchar* pairs = reinterpret_cast<const uchar*>(data);
+    QByteArray reply;
+    int pos = 0;
+    int nameLength, valueLength;
+    while (qxtFcgiReadLength(pairs, size, pos, nameLength) && qxtFcgiReadLength(pairs, size, pos, valueLength))
+    {
+        if (nameLength < 0 || valueLength < 0 || nameLength + valueLength > size - pos)
+            break;
+        const char* name = data + pos;
+        pos += nameLength + valueLength;
+        QByteArray value;
+        if (qxtNameIs(name, nameLength, "FCGI_MPXS_CONNS"))
+            value = "1";
+        else if (qxtNameIs(name, nameLength, "FCGI_MAX_REQS"))
+            value = QByteArray::number(connector->maximumRequestsPerConnection());
+        else
+            continue;
+        qxtFcgiAppendLength(reply, nameLength);
+        qxtFcgiAppendLength(reply, value.size());
+        reply.append(name, nameLength);
+        reply.append(value);
+    }
+    writeRecord(FcgiGetValuesResult, 0, reply.constData(), reply.size());
+}
+
+void QxtFcgiConnection::flush()
+{
+    QByteArray out;
+    QList<quint16> ended;
+    {
+        QMutexLocker locker(&channel->lock);
+        out.swap(channel->output);
+        ended.swap(channel->ended);
+        channel->flushScheduled = false;
+    }
+    bool close = false;
+    foreach (quint16 id, ended)
+    {
+        if (requests.contains(id) && !requests.take(id).keepConnection)
+            close = true;
+    }
+    if (!out.isEmpty())
+        socket->write(out);
+    if (close)
+        socket->disconnectFromHost();
+}
+
+void QxtFcgiConnection::socketBytesWritten()
+{
+    if (socket->bytesToWrite() > FcgiLowWaterMark)
+        return;
+    QMutexLocker locker(&channel->lock);
+    foreach (QxtFcgiRequestDevice* device, channel->devices)
+    {
+        if (device->pending.loadAcquire() > 0)
+            QMetaObject::invokeMethod(device, "acknowledge", Qt::QueuedConnection);
+    }
+}
+
+void QxtFcgiConnection::socketDisconnected()
+{
+    detachAll();
+    deleteLater();
+}
+
+void QxtFcgiConnection::detachAll()
+{
+    QList<QxtFcgiRequestDevice*> unstarted;
+    {
+        QMutexLocker locker(&channel->lock);
+        channel->connection = 0;
+        QHash<quint16, Request>::const_iterator it = requests.constBegin();
+        for (; it != requests.constEnd(); ++it)
+        {
+            QxtFcgiRequestDevice* device = channel->devices.value(it.key());
+            if (!device)
+                continue;
+            if (it->started)
+                QMetaObject::invokeMethod(device, "abort", Qt::QueuedConnection);
+            else
+                unstarted.append(device);
+        }
+        channel->devices.clear();
+        channel->output.clear();
+        channel->ended.clear();
+    }
+    requests.clear();
+    qDeleteAll(unstarted);
+}
+
+QxtFcgiRequestDevice::QxtFcgiRequestDevice(const QxtFcgiChannelPointer& channel, quint16 id)
+    : QIODevice(), channel(channel), id(id), ended(false), inputPos(0), pending(0)
+{
+    {
+        QMutexLocker locker(&channel->lock);
+        channel->devices.insert(id, this);
+    }
+    open(QIODevice::ReadWrite);
+}
+
+QxtFcgiRequestDevice::~QxtFcgiRequestDevice()
+{
+    detach();
+}
+
+bool QxtFcgiRequestDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 QxtFcgiRequestDevice::bytesAvailable() const
+{
+    QMutexLocker locker(&inputLock);
+    return input.size() - inputPos + QIODevice::bytesAvailable();
+}
+
+qint64 QxtFcgiRequestDevice::bytesToWrite() const
+{
+    return pending.loadAcquire();
+}
+
+void QxtFcgiRequestDevice::close()
+{
+    if (!isOpen())
+        return;
+    if (!ended)
+    {
+        ended = true;
+        QMutexLocker locker(&channel->lock);
+        if (channel->devices.value(id) == this)
+        {
+            qxtFcgiAppendRecords(channel->output, FcgiStdout, id, 0, 0);
+            qxtFcgiAppendEndRequest(channel->output, id, 0, FcgiRequestComplete);
+            channel->devices.remove(id);
+            channel->ended.append(id);
+            channel->schedule();
+        }
+    }
+    QIODevice::close();
+}
+
+void QxtFcgiRequestDevice::appendInput(const QByteArray& data)
+{
+    {
+        QMutexLocker locker(&inputLock);
+        if (inputPos > 0)
+        {
+            input.remove(0, inputPos);
+            inputPos = 0;
+        }
+        input.append(data);
+    }
+    QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
+}
+
+void QxtFcgiRequestDevice::acknowledge()
+{
+    qint64 written = pending.fetchAndStoreOrdered(0);
+    if (written > 0)
+        emit bytesWritten(written);
+}
+
+void QxtFcgiRequestDevice::abort()
+{
+    ended = true;
+    emit disconnected();
+}
+
+qint64 QxtFcgiRequestDevice::readData(char* data, qint64 maxSize)
+{
+    QMutexLocker locker(&inputLock);
+    qint64 size = qMin<qint64>(maxSize, input.size() - inputPos);
+    if (size <= 0)
+        return 0;
+    memcpy(data, input.constData() + inputPos, size);
+    inputPos += size;
+    if (inputPos == input.size())
+    {
+        input.clear();
+        inputPos = 0;
+    }
+    return size;
+}
+
+qint64 QxtFcgiRequestDevice::writeData(const char* data, qint64 maxSize)
+{
+    if (maxSize <= 0)
+        return 0;
+    QMutexLocker locker(&channel->lock);
+    // Output for a request that has been aborted or whose connection is
+    // gone is discarded.
+    if (ended || !channel->connection || channel->devices.value(id) != this)
+        return maxSize;
+    qxtFcgiAppendRecords(channel->output, FcgiStdout, id, data, maxSize);
+    pending.fetchAndAddOrdered(maxSize);
+    channel->schedule();
+    return maxSize;
+}
+
+void QxtFcgiRequestDevice::detach()
+{
+    QMutexLocker locker(&channel->lock);
+    if (channel->devices.value(id) != this)
+        return;
+    // Destroyed without completing the request; end it so that the
+    // front-end does not wait for it.
+    channel->devices.remove(id);
+    if (!channel->connection)
+        return;
+    qxtFcgiAppendRecords(channel->output, FcgiStdout, id, 0, 0);
+    qxtFcgiAppendEndRequest(channel->output, id, 1, FcgiRequestComplete);
+    channel->ended.append(id);
+    channel->schedule();
+}
+#endif
+
+/*!
+ * Creates a QxtFcgiServerConnector with the given \a parent.
+ */
+QxtFcgiServerConnector::QxtFcgiServerConnector(QObject* parent) : QxtAbstractHttpConnector(parent)
+{
+    QXT_INIT_PRIVATE(QxtFcgiServerConnector);
+    qxt_d().server = new QTcpServer(this);
+    QObject::connect(qxt_d().server, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+}
+
+/*!
+ * \reimp
+ */
+bool QxtFcgiServerConnector::listen(const QHostAddress& iface, quint16 port)
+{
+    return qxt_d().server->listen(iface, port);
+}
+
+/*!
+ * \reimp
+ */
+bool QxtFcgiServerConnector::shutdown()
+{
+    if (qxt_d().server->isListening())
+    {
+        qxt_d().server->close();
+        return true;
+    }
+    return false;
+}
+
+/*!
+ * \reimp
+ */
+quint16 QxtFcgiServerConnector::serverPort() const
+{
+    return qxt_d().server->serverPort();
+}
+
+/*!
+ * Returns the maximum number of requests served concurrently over one
+ * connection from the front-end.
+ * \sa setMaximumRequestsPerConnection()
+ */
+int QxtFcgiServerConnector::maximumRequestsPerConnection() const
+{
+    return qxt_d().maximumRequests;
+}
+
+/*!
+ * Sets the maximum number of requests served concurrently over one connection
+ * to \a count. Requests beyond the limit are refused with FCGI_OVERLOADED and
+ * the value is reported to front-ends that ask for FCGI_MAX_REQS.
+ *
+ * The default value is 100.
+ * \sa maximumRequestsPerConnection()
+ */
+void QxtFcgiServerConnector::setMaximumRequestsPerConnection(int count)
+{
+    qxt_d().maximumRequests = qMax(1, count);
+}
+
+/*!
+ * \internal
+ */
+void QxtFcgiServerConnector::acceptConnection()
+{
+    while (qxt_d().server->hasPendingConnections())
+        new QxtFcgiConnection(this, qxt_d().server->nextPendingConnection());
+}
+
+/*!
+ * \reimp
+ *
+ * The request device starts with the length of the FastCGI parameter block
+ * followed by the block itself. CGI variables are stored under their
+ * lowercase names, as QxtScgiServerConnector does, and HTTP_* variables
+ * additionally become the corresponding request headers.
+ */
+bool QxtFcgiServerConnector::readRequestHeader(QxtHttpRequestParser& parser, const QByteArray& buffer, int& offset, QHttpRequestHeader& header)
+{
+    Q_UNUSED(parser);
+    if (buffer.size() - offset < 4)
+        return false;
+    const uchar* data = reinterpret_cast<const uchar*>(buffer.constData()) + offset;
+    int size = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    if (size < 0 || buffer.size() - offset - 4 < size)
+        return false;
+    data += 4;
+    offset += 4 + size;
+
+    QString method, uri;
+    int pos = 0;
+    int nameLength, valueLength;
+    while (qxtFcgiReadLength(data, size, pos, nameLength) && qxtFcgiReadLength(data, size, pos, valueLength))
+    {
+        if (nameLength < 0 || valueLength < 0 || nameLength + valueLength > size - pos)
+            break;
+        const char* name = reinterpret_cast<const char*>(data) + pos;
+        QString value = QString::fromLatin1(name + nameLength, valueLength);
+        pos += nameLength + valueLength;
+        if (nameLength > 5 && !memcmp(name, "HTTP_", 5))
+        {
+            QString key = QString::fromLatin1(name + 5, nameLength - 5).toLower();
+            key.replace(QLatin1Char('_'), QLatin1Char('-'));
+            header.setValue(key, value);
+            continue;
+        }
+        if (qxtNameIs(name, nameLength, "REQUEST_METHOD"))
+            method = value;
+        else if (qxtNameIs(name, nameLength, "REQUEST_URI"))
+            uri = value;
+        else if (qxtNameIs(name, nameLength, "CONTENT_TYPE") && !value.isEmpty())
+            header.setValue("content-type", value);
+        else if (qxtNameIs(name, nameLength, "CONTENT_LENGTH") && !value.isEmpty())
+            header.setValue("content-length", value);
+        header.setValue(QString::fromLatin1(name, nameLength).toLower(), value);
+    }
+    // HTTP/1.0 keeps the response free of chunked framing; the request is
+    // completed when the session manager closes the device.
+    header.setRequest(method, uri, 1, 0);
+    return true;
+}
+
+/*!
+ * \reimp
+ */
+bool QxtFcgiServerConnector::canParseRequest(const QByteArray& buffer)
+{
+    if (buffer.size() < 4)
+        return false;
+    const uchar* data = reinterpret_cast<const uchar*>(buffer.constData());
+    int size = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    return size >= 0 && buffer.size() - 4 >= size;
+}
+
+/*!
+ * \reimp
+ */
+QHttpRequestHeader QxtFcgiServerConnector::parseRequest(QByteArray& buffer)
+{
+    QxtHttpRequestParser parser;
+    QHttpRequestHeader header;
+    int offset = 0;
+    if (!readRequestHeader(parser, buffer, offset, header))
+        return QHttpRequestHeader();
+    buffer.remove(0, offset);
+    return header;
+}
+
+/*!
+ * \reimp
+ */
+void QxtFcgiServerConnector::writeHeaders(QIODevice* device, const QHttpResponseHeader& response)
+{
+    QByteArray out = "Status: " + QByteArray::number(response.statusCode()) + ' ' + response.reasonPhrase().toLatin1() + "\r\n";
+    typedef QPair<QString, QString> Line;
+    foreach (const Line& line, response.values())
+    {
+        // Connection management belongs to the front-end.
+        if (line.first.compare(QLatin1String("connection"), Qt::CaseInsensitive) == 0 ||
+            line.first.compare(QLatin1String("keep-alive"), Qt::CaseInsensitive) == 0 ||
+            line.first.compare(QLatin1String("transfer-encoding"), Qt::CaseInsensitive) == 0)
+            continue;
+        out += line.first.toLatin1() + ": " + line.second.toLatin1() + "\r\n";
+    }
+    out += "\r\n";
+    device->write(out);
+}
@@ -0,0 +1,170 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTFCGISERVERCONNECTOR_P_H
+#define QXTFCGISERVERCONNECTOR_P_H
+
+#include "qxtabstracthttpconnector.h"
+#include <QObject>
+#include <QIODevice>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QAtomicInteger>
+
+QT_FORWARD_DECLARE_CLASS(QTcpSocket)
+QT_FORWARD_DECLARE_CLASS(QTcpServer)
+class QxtFcgiConnection;
+class QxtFcgiRequestDevice;
+
+#ifndef QXT_DOXYGEN_RUN
+class QxtFcgiServerConnectorPrivate : public QxtPrivate<QxtFcgiServerConnector>
+{
+public:
+    QxtFcgiServerConnectorPrivate() : server(0), maximumRequests(100) {}
+    QTcpServer* server;
+    int maximumRequests;
+};
+
+/*
+ * State shared by a front-end connection and the devices of its requests.
+ * The request devices may live in I/O worker threads while the socket stays
+ * with the connector, so records are queued here and written by the
+ * connection's thread. The lock also guarantees that neither side invokes
+ * a method on the other after it has been destroyed.
+ */
+struct QxtFcgiChannel
+{
+    QxtFcgiChannel() : connection(0), flushScheduled(false) {}
+
+    QMutex lock;
+    QxtFcgiConnection* connection;                  // 0 once the connection is gone
+    QHash<quint16, QxtFcgiRequestDevice*> devices;  // requestId->device
+    QByteArray output;                              // records waiting for the socket
+    QList<quint16> ended;                           // requests completed since the last flush
+    bool flushScheduled;
+
+    void schedule();
+};
+typedef QSharedPointer<QxtFcgiChannel> QxtFcgiChannelPointer;
+
+/*
+ * One long-lived connection from the front-end web server. Records are
+ * parsed as they arrive and demultiplexed onto one request device per
+ * FastCGI request ID.
+ */
+class QxtFcgiConnection : public QObject
+{
+    Q_OBJECT
+public:
+    QxtFcgiConnection(QxtFcgiServerConnector* connector, QTcpSocket* socket);
+    ~QxtFcgiConnection();
+
+private Q_SLOTS:
+    void readRecords();
+    void flush();
+    void socketBytesWritten();
+    void socketDisconnected();
+
+private:
+    struct Request
+    {
+        Request() : device(0), started(false), keepConnection(true) {}
+
+        QxtFcgiRequestDevice* device;
+        QByteArray params;
+        bool started;                               // handed to the session manager
+        bool keepConnection;                        // FCGI_KEEP_CONN was set
+    };
+
+    void handleRecord(int type, quint16 id, const char* data, int size);
+    void beginRequest(quint16 id, const char* data, int size);
+    void writeRecord(int type, quint16 id, const char* data, int size);
+    void endRequest(quint16 id, quint32 appStatus, int protocolStatus);
+    void getValues(const char* data, int size);
+    void detachAll();
+
+    QxtFcgiServerConnector* connector;
+    QTcpSocket* socket;
+    QxtFcgiChannelPointer channel;
+    QHash<quint16, Request> requests;
+    QByteArray buffer;
+    int offset;
+};
+
+/*
+ * The view of a single FastCGI request that the session manager works with:
+ * reading yields the request parameters followed by the FCGI_STDIN stream,
+ * and writing produces FCGI_STDOUT records. Closing the device completes
+ * the request without closing the front-end connection.
+ */
+class QxtFcgiRequestDevice : public QIODevice
+{
+    Q_OBJECT
+public:
+    QxtFcgiRequestDevice(const QxtFcgiChannelPointer& channel, quint16 id);
+    ~QxtFcgiRequestDevice();
+
+    virtual bool isSequential() const;
+    virtual qint64 bytesAvailable() const;
+    virtual qint64 bytesToWrite() const;
+    virtual void close();
+
+    void appendInput(const QByteArray& data);
+
+Q_SIGNALS:
+    void disconnected();
+
+private Q_SLOTS:
+    void acknowledge();
+    void abort();
+
+protected:
+    virtual qint64 readData(char* data, qint64 maxSize);
+    virtual qint64 writeData(const char* data, qint64 maxSize);
+
+private:
+    friend class QxtFcgiConnection;
+    void detach();
+
+    QxtFcgiChannelPointer channel;
+    quint16 id;
+    bool ended;
+    mutable QMutex inputLock;
+    QByteArray input;
+    int inputPos;
+    QAtomicInteger<qint64> pending;                 // written, not yet acknowledged
+};
+#endif // QXT_DOXYGEN_RUN
+
+#endif // QXTFCGISERVERCONNECTOR_P_H
@@ -83,11 +83,292 @@
     </body>
   </html>
   \endcode
+
+  A template is compiled into a list of operations when it is loaded, so
+  rendering it only copies the text between the tags and looks up each
+  variable once. Templates loaded with open() are compiled once per process
+  and shared until the file is modified.
 */
 
 #include "qxthtmltemplate.h"
 #include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QCache>
+#include <QIODevice>
+#include <QMutex>
 #include <QStringList>
+#include <QVector>
+#include <QVarLengthArray>
+
+#ifndef QXT_DOXYGEN_RUN
+/*
+ * A compiled template: the text between tags becomes literal spans, variables
+ * become slots referring to a table of names, and conditional sections record
+ * where they end so that a discarded section is skipped in one step.
+ */
+struct QxtHtmlTemplateProgram
+{
+  enum OpType { Literal, Slot, IfSet, IfUnset };
+  struct Op
+  {
+    OpType type;
+    int offset, length;           // Literal: span of text; Slot: tag position
+    int byteOffset, byteLength;   // Literal: span of utf8
+    int slot;                     // Slot, IfSet, IfUnset: index into names
+    int indent;                   // Slot: index into indents, or -1
+    int end;                      // IfSet, IfUnset: first op after the section
+  };
+
+  QxtHtmlTemplateProgram(const QString& data);
+
+  QString text;
+  QByteArray utf8;
+  QVector<Op> ops;
+  QStringList names;
+  QStringList indents;
+
+private:
+  void compile(int& i, QString& indent, int depth);
+  void addLiteral(int start, int end);
+  int slotIndex(const QString& name);
+  QString readTagAt(int& offset, int len) const;
+};
+
+QxtHtmlTemplateProgram::QxtHtmlTemplateProgram(const QString& data)
+: text(data)
+{
+  QString indent = "\n";
+  int offset = 0;
+  compile(offset, indent, 0);
+  ops.squeeze();
+}
+
+void QxtHtmlTemplateProgram::addLiteral(int start, int end)
+{
+  if (end <= start) {
+    return;
+  }
+  QByteArray bytes = text.mid(start, end - start).toUtf8();
+  Op op;
+  op.type = Literal;
+  op.offset = start;
+  op.length = end - start;
+  op.byteOffset = utf8.size();
+  op.byteLength = bytes.size();
+  op.slot = op.indent = op.end = -1;
+  utf8 += bytes;
+  ops << op;
+}
+
+int QxtHtmlTemplateProgram::slotIndex(const QString& name)
+{
+  int index = names.indexOf(name);
+  if (index == -1) {
+    names << name;
+    index = names.size() - 1;
+  }
+  return index;
+}
+
+/*
+ * Compiles the template until the next <?/>, tracking the position and current
+ * indent level by reference. Both branches of every conditional are compiled;
+ * which one is rendered is decided by render().
+ */
+void QxtHtmlTemplateProgram::compile(int& i, QString& indent, int depth)
+{
+  int len = text.size();
+  bool inIndent = true;
+  int copyStart = i;
+
+  for (; i < len; i++) {
+    QChar ch = text.at(i);
+    if (ch == '\n') {
+      indent = "\n";
+      inIndent = true;
+    } else if (inIndent && ch.isSpace()) {
+      indent += ch;
+    } else {
+      inIndent = false;
+    }
+
+    if (ch == '<') {
+      QString peek = text.mid(i, 3);
+      if (peek == "<?=" || peek == "<??" || peek == "<?!") {
+        addLiteral(copyStart, i);
+        int varStart = i;
+        QString var = readTagAt(i, len);
+        copyStart = i + 1;
+        if (var.isEmpty()) {
+          if (i >= len) {
+            qWarning("QxtHtmlTemplate::render(): unterminated %s", qPrintable(peek));
+            return;
+          }
+          qWarning("QxtHtmlTemplate::render(): empty tag at %d", varStart);
+        }
+        Op op;
+        op.offset = varStart;
+        op.length = 0;
+        op.byteOffset = op.byteLength = 0;
+        op.slot = slotIndex(var);
+        op.indent = op.end = -1;
+        if (peek == "<?=") {
+          op.type = Slot;
+          if (indent.size() > 1) {
+            op.indent = indents.indexOf(indent);
+            if (op.indent == -1) {
+              indents << indent;
+              op.indent = indents.size() - 1;
+            }
+          }
+          ops << op;
+        } else {
+          op.type = (peek == "<??") ? IfSet : IfUnset;
+          int at = ops.size();
+          ops << op;
+          ++i;
+          compile(i, indent, depth + 1);
+          ops[at].end = ops.size();
+          copyStart = i + 1;
+        }
+      } else if (peek == "<?/") {
+        addLiteral(copyStart, i);
+        if (depth == 0) {
+          qWarning("QxtHtmlTemplate::render(): unexpected <?/> at %d", i);
+        }
+        i += 3;
+        while (i < len && text[i] != '>') {
+          ++i;
+        }
+        if (depth > 0) {
+          return;
+        }
+        copyStart = i + 1;
+      }
+    }
+  }
+  addLiteral(copyStart, len);
+}
+
+/*
+ * Gets the variable name starting at the provided offset. Updates the offset
+ * by reference to point to the last character of the tag.
+ */
+QString QxtHtmlTemplateProgram::readTagAt(int& offset, int len) const
+{
+  offset += 3;
+  int varStart = offset;
+  while (offset < len && (text.at(offset) != '?' || text.mid(offset, 2) != "?>")) {
+    ++offset;
+  }
+  ++offset;
+  if (offset >= text.size()) {
+    return QString();
+  }
+  return text.mid(varStart, offset - varStart - 1).trimmed();
+}
+
+struct QxtHtmlTemplateCacheEntry
+{
+  QDateTime modified;
+  qint64 size;
+  QSharedPointer<const QxtHtmlTemplateProgram> program;
+};
+
+struct QxtHtmlTemplateCache
+{
+  enum { DefaultLimit = 256 };
+  QxtHtmlTemplateCache() : entries(DefaultLimit) {}
+
+  QMutex lock;
+  QCache<QString, QxtHtmlTemplateCacheEntry> entries;    // absolute path->entry, least recently used first out
+};
+Q_GLOBAL_STATIC(QxtHtmlTemplateCache, qxtHtmlTemplateCache)
+
+class QxtHtmlTemplateStringSink
+{
+public:
+  QxtHtmlTemplateStringSink(QString& out) : out(out) {}
+  inline void literal(const QxtHtmlTemplateProgram& program, const QxtHtmlTemplateProgram::Op& op)
+  {
+    out.append(program.text.constData() + op.offset, op.length);
+  }
+  inline void value(const QString& value)
+  {
+    out.append(value);
+  }
+  QString& out;
+};
+
+class QxtHtmlTemplateDeviceSink
+{
+public:
+  QxtHtmlTemplateDeviceSink(QIODevice* device) : device(device), ok(true) {}
+  inline void literal(const QxtHtmlTemplateProgram& program, const QxtHtmlTemplateProgram::Op& op)
+  {
+    if (device->write(program.utf8.constData() + op.byteOffset, op.byteLength) != op.byteLength) {
+      ok = false;
+    }
+  }
+  inline void value(const QString& value)
+  {
+    QByteArray bytes = value.toUtf8();
+    if (device->write(bytes) != bytes.size()) {
+      ok = false;
+    }
+  }
+  QIODevice* device;
+  bool ok;
+};
+
+typedef QVarLengthArray<const QString*, 32> QxtHtmlTemplateValues;
+
+template <typename Sink>
+static void qxtRenderProgram(const QxtHtmlTemplateProgram& program, const QxtHtmlTemplateValues& values, bool keepIndent, Sink& sink)
+{
+  static const QString empty;
+  int count = program.ops.size();
+  for (int pc = 0; pc < count;) {
+    const QxtHtmlTemplateProgram::Op& op = program.ops.at(pc);
+    switch (op.type) {
+    case QxtHtmlTemplateProgram::Literal:
+      sink.literal(program, op);
+      break;
+    case QxtHtmlTemplateProgram::Slot:
+    {
+      const QString* value = values[op.slot];
+      if (!value) {
+        if (!program.names.at(op.slot).isEmpty()) {
+          qWarning("QxtHtmlTemplate::render(): unassigned variable \"%s\" at %d", qPrintable(program.names.at(op.slot)), op.offset);
+        }
+        value = &empty;
+      }
+      if (keepIndent && op.indent != -1 && value->contains('\n')) {
+        sink.value(QString(*value).replace("\n", program.indents.at(op.indent)));
+      } else {
+        sink.value(*value);
+      }
+      break;
+    }
+    default:
+    {
+      const QString* value = values[op.slot];
+      bool discard = program.names.at(op.slot).isEmpty() || !value || value->isEmpty();
+      if (op.type == QxtHtmlTemplateProgram::IfUnset) {
+        discard = !discard;
+      }
+      if (discard) {
+        pc = op.end;
+        continue;
+      }
+      break;
+    }
+    }
+    ++pc;
+  }
+}
+#endif
 
 /*!
   Constructs a new QxtHtmlTemplate.
@@ -125,7 +406,7 @@ void QxtHtmlTemplate::setIndentPreserved(bool on)
 */
 void QxtHtmlTemplate::load(const QString& d)
 {
-  data = d;
+  program = QSharedPointer<const QxtHtmlTemplateProgram>(new QxtHtmlTemplateProgram(d));
 }
 
 /*!
@@ -135,11 +416,43 @@ void QxtHtmlTemplate::load(const QString& d)
   or contained no data.
 
   The content is interpreted as UTF-8.
+
+  The compiled template is cached for the whole process and shared by every
+  QxtHtmlTemplate that opens the same file, until the file's size or
+  modification time changes. When more than cacheLimit() files have been
+  opened, the least recently opened template is dropped from the cache.
+
+  \sa clearCache(), setCacheLimit()
 */
 bool QxtHtmlTemplate::open(const QString& filename)
 {
+  QFileInfo info(filename);
+  QString key = info.absoluteFilePath();
+  QDateTime modified = info.lastModified();
+  qint64 size = info.size();
+  QxtHtmlTemplateCache* cache = qxtHtmlTemplateCache();
+  if (info.exists()) {
+    QMutexLocker locker(&cache->lock);
+    const QxtHtmlTemplateCacheEntry* cached = cache->entries.object(key);
+    if (cached && cached->modified == modified && cached->size == size) {
+      program = cached->program;
+      return true;
+    }
+  }
+
   QFile f(filename);
-  return load(&f);
+  if (!load(&f)) {
+    return false;
+  }
+  if (info.exists()) {
+    QxtHtmlTemplateCacheEntry* entry = new QxtHtmlTemplateCacheEntry;
+    entry->modified = modified;
+    entry->size = size;
+    entry->program = program;
+    QMutexLocker locker(&cache->lock);
+    cache->entries.insert(key, entry);
+  }
+  return true;
 }
 
 /*!
@@ -157,7 +470,7 @@ bool QxtHtmlTemplate::load(QIODevice* source)
     return false;
   }
 
-  data = QString::fromUtf8(source->readAll()).replace("\r", "");
+  QString data = QString::fromUtf8(source->readAll()).replace("\r", "");
   while (!data.isEmpty() && data.back().isSpace()) {
     data.chop(1);
   }
@@ -165,125 +478,93 @@ bool QxtHtmlTemplate::load(QIODevice* source)
     qWarning("QxtHtmlTemplate::open(): source is empty");
     return false;
   }
+  load(data);
   return true;
 }
 
 /*!
-  Renders the HTML template.
+  Discards the compiled templates cached by open(). Templates that are
+  already loaded are not affected.
+*/
+void QxtHtmlTemplate::clearCache()
+{
+  QxtHtmlTemplateCache* cache = qxtHtmlTemplateCache();
+  QMutexLocker locker(&cache->lock);
+  cache->entries.clear();
+}
 
-  See the description above for information about the syntax of template tags.
+/*!
+  Returns the maximum number of compiled templates kept by open(). The
+  default is 256.
+
+  \sa setCacheLimit()
 */
-QString QxtHtmlTemplate::render() const
+int QxtHtmlTemplate::cacheLimit()
 {
-  QString indent = "\n";
-  int offset = 0;
-  return renderRecursive(offset, indent, false, 0).join("");
+  QxtHtmlTemplateCache* cache = qxtHtmlTemplateCache();
+  QMutexLocker locker(&cache->lock);
+  return cache->entries.maxCost();
 }
 
 /*!
-  \internal
+  Keeps at most \a entries compiled templates in the cache used by open(),
+  dropping the least recently opened ones first. A limit of 0 disables the
+  cache.
 
-  Renders the template until the next <?/>, tracking the position and current
-  indent level by reference. If skip is true, then all replacements are ignored,
-  all conditions are omitted whether true or false, and the function returns an
-  empty list.
+  \sa cacheLimit()
 */
-QStringList QxtHtmlTemplate::renderRecursive(int& i, QString& indent, bool skip, int depth) const
+void QxtHtmlTemplate::setCacheLimit(int entries)
 {
-  QStringList output;
-  int len = data.size();
-  bool inIndent = true;
-  int copyStart = i;
+  QxtHtmlTemplateCache* cache = qxtHtmlTemplateCache();
+  QMutexLocker locker(&cache->lock);
+  cache->entries.setMaxCost(qMax(0, entries));
+}
 
-  for (; i < len; i++) {
-    QChar ch = data.at(i);
-    if (ch == '\n') {
-      indent = "\n";
-      inIndent = keepIndent;
-    } else if (inIndent && ch.isSpace()) {
-      indent += ch;
-    } else {
-      inIndent = false;
-    }
+/*!
+  Renders the HTML template.
 
-    if (ch == '<') {
-      QString peek = data.mid(i, 3);
-      if (peek == "<?=" || peek == "<??" || peek == "<?!") {
-        if (!skip) {
-          output << data.mid(copyStart, i - copyStart);
-        }
-        int varStart = i;
-        QString var = readTagAt(i, len);
-        copyStart = i + 1;
-        if (var.isEmpty()) {
-          if (i >= len) {
-            qWarning("QxtHtmlTemplate::render(): unterminated %s", qPrintable(peek));
-            return output;
-          }
-          qWarning("QxtHtmlTemplate::render(): empty tag at %d", varStart);
-        }
-        if (peek == "<?=") {
-          if (skip) {
-            continue;
-          }
-          if (!var.isEmpty() && !contains(var)) {
-            qWarning("QxtHtmlTemplate::render(): unassigned variable \"%s\" at %d", qPrintable(var), varStart);
-          }
-          QString replacement = value(var);
-          if (keepIndent && indent.size() > 1) {
-            replacement.replace("\n", indent);
-          }
-          output << replacement;
-        } else {
-          bool discard = skip || var.isEmpty() || value(var).isEmpty();
-          if (!skip && peek == "<?!") {
-            discard = !discard;
-          }
-          ++i;
-          output << renderRecursive(i, indent, discard, depth + 1);
-          copyStart = i + 1;
-        }
-      } else if (peek == "<?/") {
-        if (!skip) {
-          output << data.mid(copyStart, i - copyStart);
-        }
-        if (depth == 0) {
-          qWarning("QxtHtmlTemplate::render(): unexpected <?/> at %d", i);
-        }
-        i += 3;
-        while (i < len && data[i] != '>') {
-          ++i;
-        }
-        if (depth > 0) {
-          return output;
-        }
-        copyStart = i + 1;
-      }
-    }
+  See the description above for information about the syntax of template tags.
+*/
+QString QxtHtmlTemplate::render() const
+{
+  QString output;
+  if (!program) {
+    return output;
   }
-  if (!skip && copyStart < len) {
-    output << data.mid(copyStart);
+  QxtHtmlTemplateValues values(program->names.size());
+  int size = program->text.size();
+  for (int i = 0; i < values.size(); i++) {
+    const_iterator it = constFind(program->names.at(i));
+    values[i] = (it == constEnd()) ? 0 : &it.value();
+    if (values[i]) {
+      size += values[i]->size();
+    }
   }
-
+  output.reserve(size);
+  QxtHtmlTemplateStringSink sink(output);
+  qxtRenderProgram(*program, values, keepIndent, sink);
   return output;
 }
 
 /*!
-  \internal
+  Renders the HTML template as UTF-8 directly to \a device, without building
+  the whole page in memory first.
+
+  Returns \c true on success, or \c false if writing to \a device failed.
 
-  Gets the variable name starting at the provided offset. Updates the offset
-  by reference to point to the last character of the tag.
+  \sa render()
 */
-QString QxtHtmlTemplate::readTagAt(int& offset, int len) const
+bool QxtHtmlTemplate::render(QIODevice* device) const
 {
-  offset += 3;
-  int varStart = offset;
-  while (offset < len && (data.at(offset) != '?' || data.mid(offset, 2) != "?>")) {
-    ++offset;
+  if (!program) {
+    return true;
   }
-  ++offset;
-  if (offset >= data.size()) {
-    return QString();
+  QxtHtmlTemplateValues values(program->names.size());
+  for (int i = 0; i < values.size(); i++) {
+    const_iterator it = constFind(program->names.at(i));
+    values[i] = (it == constEnd()) ? 0 : &it.value();
   }
-  return data.mid(varStart, offset - varStart - 1).trimmed();
+  QxtHtmlTemplateDeviceSink sink(device);
+  qxtRenderProgram(*program, values, keepIndent, sink);
+  return sink.ok;
 }
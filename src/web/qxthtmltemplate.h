@@ -35,8 +35,10 @@
 #include <QMap>
 #include <QString>
 #include <QHash>
+#include <QSharedPointer>
 #include <qxtglobal.h>
 QT_FORWARD_DECLARE_CLASS(QIODevice)
+struct QxtHtmlTemplateProgram;
 
 class QXT_WEB_EXPORT QxtHtmlTemplate : public QMap<QString, QString>
 {
@@ -51,12 +53,14 @@ public:
   void load(const QString& data);
 
   QString render() const;
+  bool render(QIODevice* device) const;
 
-private:
-  QStringList renderRecursive(int& offset, QString& indent, bool skip, int depth) const;
-  QString readTagAt(int& offset, int len) const;
+  static void clearCache();
+  static int cacheLimit();
+  static void setCacheLimit(int entries);
 
-  QString data;
+private:
+  QSharedPointer<const QxtHtmlTemplateProgram> program;
   bool keepIndent;
 };
 
@@ -0,0 +1,334 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#include "qxthttpcompressor_p.h"
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QStringList>
+#ifdef QXT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+QxtHttpCompressor::QxtHttpCompressor(QIODevice* source, Encoding encoding, int level, bool streaming, int requestID)
+: QIODevice(), source(source), stream(0), streaming(streaming), inputClosed(false), done(true), requestID(requestID),
+  backlogPos(0), outputSize(0), outputPos(0), bytesIn(0), bytesOut(0), nsecs(0)
+{
+#ifdef QXT_HAVE_ZLIB
+    stream = new z_stream;
+    stream->zalloc = Z_NULL;
+    stream->zfree = Z_NULL;
+    stream->opaque = Z_NULL;
+    // A window of 15 bits with 16 added selects the gzip container
+    if (deflateInit2(stream, qBound(1, level, 9), Z_DEFLATED, encoding == Gzip ? 31 : 15, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+    {
+        done = false;
+    }
+    else
+    {
+        delete stream;
+        stream = 0;
+    }
+#else
+    Q_UNUSED(encoding);
+    Q_UNUSED(level);
+#endif
+    connect(source, SIGNAL(readyRead()), this, SLOT(sourceReadyRead()));
+    connect(source, SIGNAL(aboutToClose()), this, SLOT(sourceClosed()));
+    if (source->metaObject()->indexOfSignal("finished(int,QProcess::ExitStatus)") != -1)
+    {
+        qRegisterMetaType<QProcess::ExitStatus>();
+        connect(source, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(sourceFinished()));
+    }
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+QxtHttpCompressor::~QxtHttpCompressor()
+{
+#ifdef QXT_HAVE_ZLIB
+    if (stream)
+    {
+        deflateEnd(stream);
+        delete stream;
+    }
+#endif
+    if (source)
+        source->deleteLater();
+}
+
+/*
+ * Returns true if responses can be compressed, that is, if QxtWeb was
+ * built with zlib.
+ */
+bool QxtHttpCompressor::isAvailable()
+{
+#ifdef QXT_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Picks the encoding for a response from the value of the request's
+ * Accept-Encoding header. gzip is preferred over deflate unless the client
+ * gives deflate a higher quality value.
+ */
+QxtHttpCompressor::Encoding QxtHttpCompressor::negotiate(const QString& acceptEncoding)
+{
+    if (!isAvailable() || acceptEncoding.isEmpty()) return Identity;
+    double gzip = -1, deflate = -1, any = -1;
+    foreach(const QString& item, acceptEncoding.split(','))
+    {
+        QStringList params = item.split(';');
+        QString coding = params.takeFirst().trimmed().toLower();
+        double quality = 1;
+        foreach(const QString& param, params)
+        {
+            QString value = param.trimmed();
+            if (!value.startsWith(QLatin1String("q="), Qt::CaseInsensitive)) continue;
+            bool ok;
+            double q = value.mid(2).toDouble(&ok);
+            if (ok) quality = q;
+        }
+        if (coding == QLatin1String("gzip") || coding == QLatin1String("x-gzip"))
+            gzip = quality;
+        else if (coding == QLatin1String("deflate"))
+            deflate = quality;
+        else if (coding == QLatin1String("*"))
+            any = quality;
+    }
+    if (gzip < 0) gzip = any;
+    if (deflate < 0) deflate = any;
+    if (gzip > 0 && gzip >= deflate) return Gzip;
+    if (deflate > 0) return Deflate;
+    return Identity;
+}
+
+/*
+ * Returns false for media types that are compressed already, where another
+ * pass only costs CPU time.
+ */
+bool QxtHttpCompressor::isCompressible(const QByteArray& contentType)
+{
+    int end = contentType.indexOf(';');
+    QByteArray type = (end == -1 ? contentType : contentType.left(end)).trimmed().toLower();
+    if (type.isEmpty()) return true;
+    if (type.endsWith("+xml") || type.endsWith("+json")) return true;
+    if (type.startsWith("image/") || type.startsWith("audio/") || type.startsWith("video/")) return false;
+    if (type.startsWith("font/woff")) return false;
+    static const char* const compressed[] = {
+        "application/zip", "application/gzip", "application/x-gzip", "application/x-bzip2",
+        "application/x-xz", "application/x-7z-compressed", "application/x-rar-compressed",
+        "application/zstd", "application/pdf", "application/octet-stream", 0
+    };
+    for (int i = 0; compressed[i]; i++)
+    {
+        if (type == compressed[i]) return false;
+    }
+    return true;
+}
+
+QByteArray QxtHttpCompressor::encodingName(Encoding encoding)
+{
+    switch (encoding)
+    {
+    case Gzip:
+        return "gzip";
+    case Deflate:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+bool QxtHttpCompressor::isSequential() const
+{
+    return true;
+}
+
+qint64 QxtHttpCompressor::bytesAvailable() const
+{
+    qint64 available = outputSize - outputPos;
+    // Input that has not been read yet, or the trailer, produces more output
+    if (!done && (!streaming || inputClosed || (source && source->bytesAvailable() > 0)))
+        available++;
+    return available + QIODevice::bytesAvailable();
+}
+
+qint64 QxtHttpCompressor::readData(char* data, qint64 maxSize)
+{
+    qint64 copied = 0;
+    while (copied < maxSize)
+    {
+        if (outputPos < outputSize)
+        {
+            int size = int(qMin(qint64(outputSize - outputPos), maxSize - copied));
+            memcpy(data + copied, output.constData() + outputPos, size);
+            outputPos += size;
+            copied += size;
+        }
+        else if (!fill())
+        {
+            break;
+        }
+    }
+    return copied;
+}
+
+qint64 QxtHttpCompressor::writeData(const char*, qint64)
+{
+    return -1;
+}
+
+/*
+ * Deflates the input that is available and appends the result to the
+ * output buffer. Streaming sources are flushed after every read so that
+ * the client is not kept waiting for data that has already been produced.
+ * Returns false if no progress could be made.
+ */
+bool QxtHttpCompressor::fill()
+{
+#ifdef QXT_HAVE_ZLIB
+    if (done) return false;
+    if (outputPos == outputSize)
+        outputPos = outputSize = 0;
+
+    int size = 0;
+    const char* in = input.constData();
+    qint64 available = source ? source->bytesAvailable() : 0;
+    if (backlogPos < backlog.size())
+    {
+        // What the source held when it was closed goes first, one input
+        // block at a time
+        in = backlog.constData() + backlogPos;
+        size = qMin(backlog.size() - backlogPos, int(InputSize));
+        backlogPos += size;
+        bytesIn += size;
+    }
+    else if (available > 0)
+    {
+        if (input.size() < InputSize)
+            input.resize(InputSize);
+        size = int(qMax(Q_INT64_C(0), source->read(input.data(), qMin(available, qint64(InputSize)))));
+        in = input.constData();
+        bytesIn += size;
+    }
+    bool drained = backlogPos >= backlog.size() && (!source || source->bytesAvailable() <= 0);
+    int flush = Z_NO_FLUSH;
+    if (drained && (!streaming || inputClosed))
+        flush = Z_FINISH;
+    else if (drained)
+        flush = Z_SYNC_FLUSH;
+    if (!size && flush != Z_FINISH) return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+    stream->avail_in = size;
+    int result;
+    do
+    {
+        if (output.size() - outputSize < OutputStep)
+            output.resize(outputSize + OutputStep);
+        stream->next_out = reinterpret_cast<Bytef*>(output.data()) + outputSize;
+        stream->avail_out = output.size() - outputSize;
+        result = deflate(stream, flush);
+        int produced = output.size() - outputSize - stream->avail_out;
+        outputSize += produced;
+        bytesOut += produced;
+    } while (result != Z_STREAM_ERROR && stream->avail_out == 0);
+    nsecs += timer.nsecsElapsed();
+    if (backlogPos >= backlog.size())
+    {
+        backlog.clear();
+        backlogPos = 0;
+    }
+
+    if (result == Z_STREAM_ERROR)
+    {
+        setErrorString(QLatin1String("deflate failed"));
+        finish();
+    }
+    else if (flush == Z_FINISH)
+    {
+        finish();
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void QxtHttpCompressor::finish()
+{
+#ifdef QXT_HAVE_ZLIB
+    if (stream)
+    {
+        deflateEnd(stream);
+        delete stream;
+        stream = 0;
+    }
+#endif
+    done = true;
+    emit finished(requestID, bytesIn, bytesOut, nsecs);
+}
+
+void QxtHttpCompressor::sourceReadyRead()
+{
+    emit readyRead();
+}
+
+/*
+ * The source drops its buffer once it is closed, so the data it still holds
+ * is taken over here. It is compressed as the connection reads it rather
+ * than all at once, which would put the rest of the response in memory a
+ * second time.
+ */
+void QxtHttpCompressor::sourceClosed()
+{
+    if (source && source->bytesAvailable() > 0)
+    {
+        backlog = backlog.mid(backlogPos) + source->readAll();
+        backlogPos = 0;
+    }
+    sourceFinished();
+}
+
+/*
+ * A finished process stays readable, so nothing needs to be taken over.
+ */
+void QxtHttpCompressor::sourceFinished()
+{
+    if (inputClosed) return;
+    inputClosed = true;
+    emit readyRead();
+    emit aboutToClose();
+}
@@ -0,0 +1,105 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTHTTPCOMPRESSOR_P_H
+#define QXTHTTPCOMPRESSOR_P_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QPointer>
+#include <QString>
+
+struct z_stream_s;
+
+#ifndef QXT_DOXYGEN_RUN
+/*
+ * Compresses a response body on its way to the connection. The compressor
+ * is a read-only sequential device in front of the page's data source, so
+ * the chunked and block writers of QxtHttpSessionManager use it like any
+ * other source: data is deflated as it is read, and only the output of the
+ * current read is kept in memory.
+ *
+ * bytesAvailable() reports at least one byte until the stream is finished,
+ * because buffered input and the trailer are only produced on demand.
+ */
+class QxtHttpCompressor : public QIODevice
+{
+    Q_OBJECT
+public:
+    enum Encoding { Identity = 0, Deflate, Gzip };
+    enum { InputSize = 65536, OutputStep = 16384 };
+
+    QxtHttpCompressor(QIODevice* source, Encoding encoding, int level, bool streaming, int requestID);
+    ~QxtHttpCompressor();
+
+    static bool isAvailable();
+    static Encoding negotiate(const QString& acceptEncoding);
+    static bool isCompressible(const QByteArray& contentType);
+    static QByteArray encodingName(Encoding encoding);
+
+    virtual bool isSequential() const;
+    virtual qint64 bytesAvailable() const;
+
+Q_SIGNALS:
+    void finished(int requestID, qint64 bytesIn, qint64 bytesOut, qint64 nsecs);
+
+protected:
+    virtual qint64 readData(char* data, qint64 maxSize);
+    virtual qint64 writeData(const char* data, qint64 maxSize);
+
+private Q_SLOTS:
+    void sourceReadyRead();
+    void sourceClosed();
+    void sourceFinished();
+
+private:
+    bool fill();
+    void finish();
+
+    QPointer<QIODevice> source;
+    struct z_stream_s* stream;
+    bool streaming;
+    bool inputClosed;
+    bool done;
+    int requestID;
+    QByteArray input;
+    QByteArray backlog;
+    int backlogPos;
+    QByteArray output;
+    int outputSize;
+    int outputPos;
+    qint64 bytesIn;
+    qint64 bytesOut;
+    qint64 nsecs;
+};
+#endif // QXT_DOXYGEN_RUN
+
+#endif // QXTHTTPCOMPRESSOR_P_H
@@ -0,0 +1,357 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+/*!
+\class QxtHttpRequestParser
+
+\inmodule QxtWeb
+
+\brief The QxtHttpRequestParser class incrementally parses HTTP request headers
+
+QxtHttpRequestParser scans a receive buffer for an HTTP/0.9, HTTP/1.0 or
+HTTP/1.1 request header. Data may arrive in arbitrary pieces: each call to
+parse() resumes where the previous one stopped, so no byte of the buffer is
+examined twice no matter how many times it is called.
+
+The parser does not copy the buffer. The request line and the header fields
+are recorded as offsets into it, and the accessors return views created with
+QByteArray::fromRawData(). These views are only valid as long as the buffer
+is neither modified nor destroyed. header() copies the request header out
+of the buffer once; QStrings are only built when its fields are looked up.
+
+A buffer may hold several pipelined requests. Pass the offset of the request
+to reset(); after parsing is complete, endOffset() is the offset of whatever
+follows the header (the request body or the next request).
+
+\code
+QxtHttpRequestParser parser;
+buffer.append(socket->readAll());
+if (parser.parse(buffer) == QxtHttpRequestParser::Complete) {
+    QHttpRequestHeader header = parser.header(buffer);
+    parser.reset(parser.endOffset());
+}
+\endcode
+
+\sa QHttpRequestHeader, QxtHttpServerConnector
+*/
+
+#include "qxthttprequestparser.h"
+#include <string.h>
+
+static inline bool qxtIsSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/*!
+ * Constructs a parser expecting a request at the beginning of the buffer.
+ */
+QxtHttpRequestParser::QxtHttpRequestParser()
+{
+    reset(0);
+}
+
+/*!
+ * Discards all parsing state and prepares to parse a new request starting at
+ * \a offset in the buffer.
+ */
+void QxtHttpRequestParser::reset(int offset)
+{
+    m_status = Incomplete;
+    m_requestLine = true;
+    m_start = m_lineStart = m_pos = m_end = offset;
+    m_method.offset = m_path.offset = offset;
+    m_method.length = m_path.length = 0;
+    m_major = 1;
+    m_minor = 0;
+    m_fields.clear();
+}
+
+/*!
+ * Continues parsing the request header contained in \a buffer.
+ *
+ * The buffer must be the same one passed to previous calls, although more data
+ * may have been appended to it in the meantime. Returns Complete once the
+ * entire header has been received, and Incomplete otherwise.
+ */
+QxtHttpRequestParser::Status QxtHttpRequestParser::parse(const QByteArray& buffer)
+{
+    if (m_status == Complete) return Complete;
+    const char* data = buffer.constData();
+    int size = buffer.size();
+    while (m_pos < size)
+    {
+        const char* newline = static_cast<const char*>(memchr(data + m_pos, '\n', size - m_pos));
+        if (!newline)
+        {
+            // Remember how far we got; the partial line starts at m_lineStart
+            m_pos = size;
+            return Incomplete;
+        }
+        int begin = m_lineStart;
+        int end = int(newline - data);
+        m_lineStart = m_pos = end + 1;
+        if (end > begin && data[end - 1] == '\r') end--;
+
+        if (m_requestLine)
+        {
+            if (begin == end)
+            {
+                // Tolerate stray line breaks between pipelined requests
+                m_start = m_pos;
+                continue;
+            }
+            parseRequestLine(data, begin, end);
+            m_requestLine = false;
+            if (m_major != 0) continue;
+            // HTTP/0.9 has no header fields
+        }
+        else if (begin != end)
+        {
+            parseFieldLine(data, begin, end);
+            continue;
+        }
+        m_status = Complete;
+        m_end = m_pos;
+        return Complete;
+    }
+    return Incomplete;
+}
+
+/*!
+ * Returns Complete if the entire request header has been parsed, and
+ * Incomplete otherwise.
+ */
+QxtHttpRequestParser::Status QxtHttpRequestParser::status() const
+{
+    return m_status;
+}
+
+/*!
+ * Returns the offset of the request within the buffer.
+ */
+int QxtHttpRequestParser::requestOffset() const
+{
+    return m_start;
+}
+
+/*!
+ * Returns the offset just past the end of the request header, or the current
+ * parse position if the header is not complete yet.
+ */
+int QxtHttpRequestParser::endOffset() const
+{
+    return m_status == Complete ? m_end : m_pos;
+}
+
+/*!
+ * Returns the request method from the request line in \a buffer.
+ */
+QByteArray QxtHttpRequestParser::method(const QByteArray& buffer) const
+{
+    return QByteArray::fromRawData(buffer.constData() + m_method.offset, m_method.length);
+}
+
+/*!
+ * Returns the request-URI from the request line in \a buffer.
+ */
+QByteArray QxtHttpRequestParser::path(const QByteArray& buffer) const
+{
+    return QByteArray::fromRawData(buffer.constData() + m_path.offset, m_path.length);
+}
+
+/*!
+ * Returns the major protocol version of the request. This is 0 for an
+ * HTTP/0.9 request.
+ */
+int QxtHttpRequestParser::majorVersion() const
+{
+    return m_major;
+}
+
+/*!
+ * Returns the minor protocol version of the request.
+ */
+int QxtHttpRequestParser::minorVersion() const
+{
+    return m_minor;
+}
+
+/*!
+ * Returns the number of header fields parsed so far.
+ */
+int QxtHttpRequestParser::fieldCount() const
+{
+    return m_fields.count();
+}
+
+/*!
+ * Returns the name of the header field at \a index, as it appears in \a buffer.
+ */
+QByteArray QxtHttpRequestParser::fieldName(const QByteArray& buffer, int index) const
+{
+    const Span& name = m_fields.at(index).name;
+    return QByteArray::fromRawData(buffer.constData() + name.offset, name.length);
+}
+
+/*!
+ * Returns the value of the header field at \a index in \a buffer.
+ *
+ * Values continued over several lines are joined with single spaces; only
+ * these require a copy.
+ */
+QByteArray QxtHttpRequestParser::fieldValue(const QByteArray& buffer, int index) const
+{
+    return fieldValue(buffer, m_fields.at(index));
+}
+
+/*!
+ * Returns the value of the first header field called \a name in \a buffer, or
+ * a null QByteArray if there is none. The comparison is case-insensitive.
+ */
+QByteArray QxtHttpRequestParser::value(const QByteArray& buffer, const QByteArray& name) const
+{
+    const char* data = buffer.constData();
+    for (int i = 0; i < m_fields.count(); i++)
+    {
+        const Field& field = m_fields.at(i);
+        if (field.name.length == name.size() && qstrnicmp(data + field.name.offset, name.constData(), name.size()) == 0)
+            return fieldValue(buffer, field);
+    }
+    return QByteArray();
+}
+
+/*!
+ * Builds a QHttpRequestHeader from the request parsed out of \a buffer.
+ *
+ * The header gets its own copy of the request header bytes, so it stays
+ * valid after \a buffer changes. Its method, path and field values are kept
+ * as byte ranges and only converted into QStrings when they are looked up.
+ */
+QHttpRequestHeader QxtHttpRequestParser::header(const QByteArray& buffer) const
+{
+    int start = m_start;
+    QHttpRequestHeader header;
+    header.setRawRequest(buffer.mid(start, endOffset() - start), m_method.offset - start, m_method.length,
+                         m_path.offset - start, m_path.length, m_major, m_minor);
+    for (int i = 0; i < m_fields.count(); i++)
+    {
+        const Field& field = m_fields.at(i);
+        header.addRawValue(field.name.offset - start, field.name.length, field.value.offset - start,
+                           field.value.length, field.folded);
+    }
+    return header;
+}
+
+/*!
+ * \internal
+ */
+void QxtHttpRequestParser::parseRequestLine(const char* data, int begin, int end)
+{
+    int pos = begin;
+    while (pos < end && qxtIsSpace(data[pos])) pos++;
+    m_method.offset = pos;
+    while (pos < end && !qxtIsSpace(data[pos])) pos++;
+    m_method.length = pos - m_method.offset;
+
+    while (pos < end && qxtIsSpace(data[pos])) pos++;
+    m_path.offset = pos;
+    while (pos < end && !qxtIsSpace(data[pos])) pos++;
+    m_path.length = pos - m_path.offset;
+
+    while (pos < end && qxtIsSpace(data[pos])) pos++;
+    int version = pos;
+    while (end > version && qxtIsSpace(data[end - 1])) end--;
+    if (version == end)
+    {
+        // No protocol version: this is a HTTP/0.9 simple request
+        m_major = 0;
+        m_minor = 9;
+    }
+    else if (end - version >= 8 && qstrncmp(data + version, "HTTP/", 5) == 0
+             && data[version + 5] >= '0' && data[version + 5] <= '9' && data[version + 6] == '.'
+             && data[version + 7] >= '0' && data[version + 7] <= '9')
+    {
+        m_major = data[version + 5] - '0';
+        m_minor = data[version + 7] - '0';
+    }
+}
+
+/*!
+ * \internal
+ */
+void QxtHttpRequestParser::parseFieldLine(const char* data, int begin, int end)
+{
+    while (end > begin && qxtIsSpace(data[end - 1])) end--;
+    if (qxtIsSpace(data[begin]))
+    {
+        // Obsolete line folding: the value continues from the previous line
+        if (!m_fields.isEmpty())
+        {
+            Field& field = m_fields.last();
+            field.value.length = end - field.value.offset;
+            field.folded = true;
+        }
+        return;
+    }
+    const char* colon = static_cast<const char*>(memchr(data + begin, ':', end - begin));
+    if (!colon) return; // not a header field; ignore it
+    Field field;
+    field.folded = false;
+    field.name.offset = begin;
+    int nameEnd = int(colon - data);
+    while (nameEnd > begin && qxtIsSpace(data[nameEnd - 1])) nameEnd--;
+    field.name.length = nameEnd - begin;
+    int valueStart = int(colon - data) + 1;
+    while (valueStart < end && qxtIsSpace(data[valueStart])) valueStart++;
+    field.value.offset = valueStart;
+    field.value.length = end - valueStart;
+    m_fields.append(field);
+}
+
+/*!
+ * \internal
+ */
+QByteArray QxtHttpRequestParser::fieldValue(const QByteArray& buffer, const Field& field) const
+{
+    QByteArray raw = QByteArray::fromRawData(buffer.constData() + field.value.offset, field.value.length);
+    if (!field.folded) return raw;
+    QByteArray joined;
+    joined.reserve(raw.size());
+    foreach(const QByteArray& line, raw.split('\n'))
+    {
+        QByteArray part = line.trimmed();
+        if (part.isEmpty()) continue;
+        if (!joined.isEmpty()) joined += ' ';
+        joined += part;
+    }
+    return joined;
+}
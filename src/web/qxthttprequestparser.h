@@ -0,0 +1,91 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTHTTPREQUESTPARSER_H
+#define QXTHTTPREQUESTPARSER_H
+
+#include <qxtglobal.h>
+#include <QByteArray>
+#include <QVarLengthArray>
+#include "qhttpheader.h"
+
+class QXT_WEB_EXPORT QxtHttpRequestParser
+{
+public:
+    enum Status { Incomplete, Complete };
+
+    QxtHttpRequestParser();
+
+    void reset(int offset = 0);
+    Status parse(const QByteArray& buffer);
+    Status status() const;
+
+    int requestOffset() const;
+    int endOffset() const;
+
+    QByteArray method(const QByteArray& buffer) const;
+    QByteArray path(const QByteArray& buffer) const;
+    int majorVersion() const;
+    int minorVersion() const;
+
+    int fieldCount() const;
+    QByteArray fieldName(const QByteArray& buffer, int index) const;
+    QByteArray fieldValue(const QByteArray& buffer, int index) const;
+    QByteArray value(const QByteArray& buffer, const QByteArray& name) const;
+
+    QHttpRequestHeader header(const QByteArray& buffer) const;
+
+private:
+    struct Span
+    {
+        int offset;
+        int length;
+    };
+    struct Field
+    {
+        Span name;
+        Span value;
+        bool folded;
+    };
+
+    void parseRequestLine(const char* data, int begin, int end);
+    void parseFieldLine(const char* data, int begin, int end);
+    QByteArray fieldValue(const QByteArray& buffer, const Field& field) const;
+
+    Status m_status;
+    bool m_requestLine;
+    int m_start, m_lineStart, m_pos, m_end;
+    Span m_method, m_path;
+    int m_major, m_minor;
+    QVarLengthArray<Field, 16> m_fields;
+};
+
+#endif // QXTHTTPREQUESTPARSER_H
@@ -45,6 +45,14 @@ not require an external web server to function. However, it provides very
 little control over the behavior of the web server and may not suitable for
 high traffic scenarios or virtual hosting configurations.
 
+HTTP/1.1 connections are kept alive between requests and may pipeline
+requests; responses are sent in the order the requests arrived. To keep
+slow or idle clients from tying up sockets, a connection is closed if it
+does not deliver a complete request header within 30 seconds or stays idle
+for 15 seconds between requests. These limits can be changed with
+setHeaderTimeout() and setIdleTimeout(). When maximumConnections() is set,
+clients beyond the limit receive a "503 Service Unavailable" response.
+
 \sa QxtHttpSessionManager
 */
 
@@ -73,17 +81,41 @@ QxtHttpsServerConnector is only available if Qt was compiled with OpenSSL suppor
 #include "qxthttpsessionmanager.h"
 #include "qxtwebevent.h"
 #include "qxtsslserver.h"
+#include "qxthttprequestparser.h"
 #include <QTcpServer>
 #include <QHash>
 #include <QTcpSocket>
 #include <QString>
+#include <QMutex>
 
 #ifndef QXT_DOXYGEN_RUN
 class QxtHttpServerConnectorPrivate : public QxtPrivate<QxtHttpServerConnector>
 {
 public:
     QTcpServer* server;
+
+    // The buffer last accepted by canParseRequest() and its parse, so that
+    // the parseRequest() call following it does not parse the header again.
+    QMutex legacyLock;
+    QByteArray legacyBuffer;
+    QxtHttpRequestParser legacyParser;
+
+    bool parseLegacy(const QByteArray& buffer);
 };
+
+bool QxtHttpServerConnectorPrivate::parseLegacy(const QByteArray& buffer)
+{
+    // A buffer sharing the remembered data is unchanged, as any change would
+    // have detached it.
+    if (legacyBuffer.isNull() || buffer.constData() != legacyBuffer.constData() || buffer.size() != legacyBuffer.size())
+    {
+        legacyBuffer.clear();
+        legacyParser.reset();
+        if (legacyParser.parse(buffer) != QxtHttpRequestParser::Complete) return false;
+        legacyBuffer = buffer;
+    }
+    return true;
+}
 #endif
 
 /*!
@@ -101,6 +133,8 @@ QxtHttpServerConnector::QxtHttpServerConnector(QObject* parent, QTcpServer* serv
     else
         qxt_d().server = new QTcpServer(this);
     QObject::connect(qxt_d().server, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+    setHeaderTimeout(30000);
+    setIdleTimeout(15000);
 }
 
 /*!
@@ -147,38 +181,57 @@ QTcpServer* QxtHttpServerConnector::tcpServer() const
 void QxtHttpServerConnector::acceptConnection()
 {
     QTcpSocket* socket = qxt_d().server->nextPendingConnection();
+    if (!socket) return;
+    int limit = maximumConnections();
+    if (limit > 0 && connectionCount() >= limit)
+    {
+        // Tell the client to come back later instead of just dropping it
+        socket->write("HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        QObject::connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        socket->disconnectFromHost();
+        return;
+    }
     addConnection(socket);
 }
 
+/*!
+ * \reimp
+ *
+ * Uses \a parser to scan only the data that arrived since the previous call;
+ * the request header is not copied out of \a buffer.
+ */
+bool QxtHttpServerConnector::readRequestHeader(QxtHttpRequestParser& parser, const QByteArray& buffer, int& offset, QHttpRequestHeader& header)
+{
+    if (parser.parse(buffer) != QxtHttpRequestParser::Complete) return false;
+    header = parser.header(buffer);
+    offset = parser.endOffset();
+    return true;
+}
+
 /*!
  * \reimp
  */
 bool QxtHttpServerConnector::canParseRequest(const QByteArray& buffer)
 {
-    if (buffer.indexOf("\r\n\r\n") >= 0) return true; // 1.0+
-    if (buffer.indexOf("\r\n") >= 0 && buffer.indexOf("HTTP/") == -1) return true; // 0.9
-    return false;
+    QMutexLocker locker(&qxt_d().legacyLock);
+    return qxt_d().parseLegacy(buffer);
 }
 
 /*!
  * \reimp
+ *
+ * A header already found by canParseRequest() in the same \a buffer is not
+ * parsed again.
  */
 QHttpRequestHeader QxtHttpServerConnector::parseRequest(QByteArray& buffer)
 {
-    int pos = buffer.indexOf("\r\n\r\n"), endpos = pos + 3;
-    if (pos == -1)
-    {
-        pos = buffer.indexOf("\r\n"); // 0.9
-        endpos = pos + 1;
-    }
-
-    QHttpRequestHeader header(QString::fromUtf8(buffer.left(endpos)));
-    QByteArray firstLine = buffer.left(buffer.indexOf('\r'));
-    if (firstLine.indexOf("HTTP/") == -1)
-    {
-        header.setRequest(header.method(), header.path(), 0, 9);
-    }
-    buffer.remove(0, endpos + 1);
+    QMutexLocker locker(&qxt_d().legacyLock);
+    if (!qxt_d().parseLegacy(buffer)) return QHttpRequestHeader();
+    QHttpRequestHeader header = qxt_d().legacyParser.header(buffer);
+    int end = qxt_d().legacyParser.endOffset();
+    // Let go of the data first so that removing the header does not copy the buffer
+    qxt_d().legacyBuffer.clear();
+    buffer.remove(0, end);
     return header;
 }
 
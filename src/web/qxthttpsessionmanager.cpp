@@ -50,10 +50,17 @@ service, even one that only returns a more useful error message.
 QxtHttpSessionManager attempts to be thread-safe in accepting connections and
 posting events. It is reentrant for all other functionality.
 
+By default every connection is served from the thread the connector lives in.
+To spread the work over several cores, set workerThreadCount() before calling
+start(); accepted connections are then distributed over a pool of I/O threads
+and each session is pinned to one of them.
+
 \sa class QxtAbstractWebService
 */
 
 #include "qxthttpsessionmanager.h"
+#include "qxthttpsessionmanager_p.h"
+#include "qxthttpcompressor_p.h"
 #include "qxtwebevent.h"
 #include "qxtwebcontent.h"
 #include "qxtabstractwebservice.h"
@@ -74,51 +81,392 @@ posting events. It is reentrant for all other functionality.
 #endif
 
 #ifndef QXT_DOXYGEN_RUN
-class QxtHttpSessionManagerPrivate : public QxtPrivate<QxtHttpSessionManager>
-{
-public:
-    struct ConnectionState
-    {
-        QxtBoundFunction *onBytesWritten, *onReadyRead, *onAboutToClose;
-        bool readyRead;
-        bool finishedTransfer;
-        bool keepAlive;
-        bool streaming;
-        bool chunked;
-        bool sourceClosed;
-        int httpMajorVersion;
-        int httpMinorVersion;
-        int sessionID;
-
-        void clearHandlers() {
-            delete onBytesWritten;
-            delete onReadyRead;
-            delete onAboutToClose;
-            onBytesWritten = onReadyRead = onAboutToClose = 0;
-        }
-    };
+QxtHttpSessionManagerPrivate::ConnectionState::~ConnectionState()
+{
+    clearHandlers();
+    foreach(const PipelinedRequest& request, pipeline)
+        delete request.response;
+}
+
+void QxtHttpSessionManagerPrivate::ConnectionState::clearHandlers()
+{
+    delete onBytesWritten;
+    delete onReadyRead;
+    delete onAboutToClose;
+    delete drainMeter;
+    onBytesWritten = onReadyRead = onAboutToClose = 0;
+    drainMeter = 0;
+}
+
+QxtHttpEventQueue::Node::~Node()
+{
+    delete page;
+    qDeleteAll(cookies);
+}
+
+QxtHttpEventQueue::QxtHttpEventQueue() : head(&stub), tail(&stub), wakeupPending(0)
+{
+    // initializers only
+}
+
+QxtHttpEventQueue::~QxtHttpEventQueue()
+{
+    while (Node* node = pop())
+        delete node;
+}
+
+void QxtHttpEventQueue::link(Node* node)
+{
+    node->next.storeRelease(0);
+    Node* prev = head.fetchAndStoreOrdered(node);
+    prev->next.storeRelease(node);
+}
+
+bool QxtHttpEventQueue::push(Node* node)
+{
+    link(node);
+    return wakeupPending.testAndSetOrdered(0, 1);
+}
+
+/*
+ * Returns 0 when the queue is empty, and also when a producer is between
+ * its two steps in link(). That producer has not set the wakeup flag yet,
+ * so the consumer is woken up again once the node is reachable.
+ */
+QxtHttpEventQueue::Node* QxtHttpEventQueue::pop()
+{
+    Node* node = tail;
+    Node* next = node->next.loadAcquire();
+    if (node == &stub)
+    {
+        if (!next) return 0;
+        tail = next;
+        node = next;
+        next = next->next.loadAcquire();
+    }
+    if (next)
+    {
+        tail = next;
+        return node;
+    }
+    if (node != head.loadAcquire()) return 0;
+    // Put the stub back so that the last node can be detached
+    link(&stub);
+    next = node->next.loadAcquire();
+    if (!next) return 0;
+    tail = next;
+    return node;
+}
+
+/*
+ * Called by the consumer before it drains the queue; pushes after this
+ * point schedule another wakeup.
+ */
+void QxtHttpEventQueue::acknowledge()
+{
+    wakeupPending.storeRelease(0);
+}
+
+QxtHttpSessionManagerPrivate::~QxtHttpSessionManagerPrivate()
+{
+    stopWorkers();
+    qDeleteAll(connectionState);
+    foreach(const QList<QxtWebEvent*>& cookies, pendingCookies)
+        qDeleteAll(cookies);
+}
+
+QxtHttpEventQueue& QxtHttpSessionManagerPrivate::eventQueue(QObject* handler)
+{
+    if (handler == &qxt_p()) return events;
+    return static_cast<QxtHttpSessionWorker*>(handler)->events;
+}
+
+void QxtHttpSessionManagerPrivate::post(QObject* handler, QxtHttpEventQueue::Node* node)
+{
+    if (eventQueue(handler).push(node))
+        QMetaObject::invokeMethod(handler, "processEvents", Qt::QueuedConnection);
+}
+
+QList<QxtWebEvent*> QxtHttpSessionManagerPrivate::takeCookies(int sessionID)
+{
+    if (!pendingCookieCount.loadAcquire()) return QList<QxtWebEvent*>();
+    QMutexLocker locker(&cookieLock);
+    QList<QxtWebEvent*> cookies = pendingCookies.take(sessionID);
+    pendingCookieCount.fetchAndAddOrdered(-cookies.count());
+    return cookies;
+}
 
-    QxtHttpSessionManagerPrivate()
-    : iface(QHostAddress::Any), port(80), sessionCookieName("sessionID"), connector(0), staticService(0),
-      autoCreateSession(true), eventLock(QMutex::Recursive) {}
-    QXT_DECLARE_PUBLIC(QxtHttpSessionManager)
+QxtHttpSessionManagerPrivate::ConnectionState& QxtHttpSessionManagerPrivate::state(QIODevice* device)
+{
+    QMutexLocker locker(&connectionLock);
+    ConnectionState*& state = connectionState[device];
+    if (!state)
+        state = new ConnectionState();
+    return *state;
+}
 
-    QHostAddress iface;
-    quint16 port;
-    QByteArray sessionCookieName;
-    QxtAbstractHttpConnector* connector;
-    QxtAbstractWebService* staticService;
-    bool autoCreateSession;
+QxtHttpSessionManagerPrivate::ConnectionState* QxtHttpSessionManagerPrivate::findState(QIODevice* device)
+{
+    QMutexLocker locker(&connectionLock);
+    return connectionState.value(device);
+}
 
-    QMutex eventLock;
-    QList<QxtWebEvent*> eventQueue;
-    QHash<QPair<int,int>, QxtWebRequestEvent*> pendingRequests;
+void QxtHttpSessionManagerPrivate::removeState(QIODevice* device)
+{
+    ConnectionState* state;
+    {
+        QMutexLocker locker(&connectionLock);
+        state = connectionState.take(device);
+    }
+    delete state;
+}
 
-    QHash<QUuid, int> sessionKeys;                      // sessionKey->sessionID
-    QHash<QIODevice*, ConnectionState> connectionState; // connection->state
+/*
+ * Records a request in the pipeline of its connection. Responses are written
+ * in this order no matter in which order the services post them. A rejected
+ * request is answered without compression and closes the connection.
+ */
+void QxtHttpSessionManagerPrivate::queueRequest(QIODevice* device, int requestID, int sessionID, const QHttpRequestHeader& header, bool rejected)
+{
+    PipelinedRequest request;
+    request.requestID = requestID;
+    request.sessionID = sessionID;
+    request.httpMajorVersion = header.majorVersion();
+    request.httpMinorVersion = header.minorVersion();
+    // Only HTTP/1.1 connections persist; the HTTP/1.0 keep-alive extension
+    // is not honoured because the SCGI and FastCGI connectors present their
+    // requests as HTTP/1.0 and end each response by closing the device.
+    request.keepAlive = !rejected && (request.httpMajorVersion > 1 || (request.httpMajorVersion == 1 && request.httpMinorVersion > 0))
+                        && header.value("connection").toLower() != "close";
+    if (compression && !rejected)
+        request.acceptEncoding = QxtHttpCompressor::negotiate(header.value("accept-encoding"));
+    else
+        request.acceptEncoding = QxtHttpCompressor::Identity;
+    request.response = 0;
+    state(device).pipeline.append(request);
+}
 
-    Qt::HANDLE mainThread;
-};
+/*
+ * Attaches a posted response to its request. Returns false if the request is
+ * not waiting on this connection.
+ */
+bool QxtHttpSessionManagerPrivate::queueResponse(ConnectionState& state, QxtHttpEventQueue::Node* node)
+{
+    for (int i = 0; i < state.pipeline.count(); i++)
+    {
+        PipelinedRequest& request = state.pipeline[i];
+        if (request.requestID != node->page->requestID) continue;
+        if (request.response) return false;
+        request.response = node;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Reads the next piece of the response from source into the connection's
+ * write buffer, which is allocated once and reused for every chunk. With
+ * adaptive sizing the chunk is resized after every drain sample to what the
+ * connection handed on in DrainTarget milliseconds at the measured rate,
+ * rounded up to a power of two.
+ */
+qint64 QxtHttpSessionManagerPrivate::readChunk(ConnectionState& state, QIODevice* source)
+{
+    if (state.chunkSize <= 0)
+        state.chunkSize = writeChunkSize;
+    if (adaptiveChunkSize && state.drainMeter && state.drainClock.elapsed() >= DrainSampleInterval)
+    {
+        qint64 elapsed = state.drainClock.restart();
+        qint64 drained = state.drainMeter->drained - state.drainSampled;
+        state.drainSampled = state.drainMeter->drained;
+        qint64 target = drained * DrainTarget / elapsed;
+        int size = MinChunkSize;
+        while (size < MaxChunkSize && size < target)
+            size *= 2;
+        state.chunkSize = size;
+    }
+    if (state.writeBuffer.size() < state.chunkSize)
+        state.writeBuffer.resize(state.chunkSize);
+    qint64 size = source->read(state.writeBuffer.data(), state.chunkSize);
+    if (size > 0)
+        bytesCopied.fetchAndAddRelaxed(size);
+    return size;
+}
+
+int QxtHttpSessionManagerPrivate::sessionForKey(const QUuid& key)
+{
+    if (key.isNull()) return -1;
+    KeyShard& shard = keyShard(key);
+    QMutexLocker locker(&shard.lock);
+    return shard.sessions.value(key, -1);
+}
+
+QUuid QxtHttpSessionManagerPrivate::keyForSession(int sessionID)
+{
+    KeyShard& shard = idShard(sessionID);
+    QMutexLocker locker(&shard.lock);
+    return shard.keys.value(sessionID);
+}
+
+bool QxtHttpSessionManagerPrivate::insertKey(const QUuid& key, int sessionID)
+{
+    {
+        KeyShard& shard = keyShard(key);
+        QMutexLocker locker(&shard.lock);
+        if (shard.sessions.contains(key)) return false;
+        shard.sessions.insert(key, sessionID);
+    }
+    KeyShard& shard = idShard(sessionID);
+    QMutexLocker locker(&shard.lock);
+    shard.keys.insert(sessionID, key);
+    return true;
+}
+
+QUuid QxtHttpSessionManagerPrivate::removeKey(int sessionID)
+{
+    QUuid key;
+    {
+        KeyShard& shard = idShard(sessionID);
+        QMutexLocker locker(&shard.lock);
+        key = shard.keys.take(sessionID);
+    }
+    if (key.isNull()) return key;
+    KeyShard& shard = keyShard(key);
+    QMutexLocker locker(&shard.lock);
+    if (shard.sessions.value(key) == sessionID)
+        shard.sessions.remove(key);
+    return key;
+}
+
+void QxtHttpSessionManagerPrivate::startWorkers()
+{
+    if (!workers.isEmpty()) return;
+    for (int i = 0; i < workerThreadCount; i++)
+    {
+        QThread* thread = new QThread;
+        QxtHttpSessionWorker* worker = new QxtHttpSessionWorker(&qxt_p());
+        worker->moveToThread(thread);
+        QObject::connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+        thread->start();
+        workers.append(worker);
+    }
+}
+
+void QxtHttpSessionManagerPrivate::stopWorkers()
+{
+    QList<QxtHttpSessionWorker*> stopping = workers;
+    workers.clear();
+    foreach(QxtHttpSessionWorker* worker, stopping)
+    {
+        QThread* thread = worker->thread();
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+}
+
+QxtHttpSessionWorker* QxtHttpSessionManagerPrivate::acceptingWorker()
+{
+    if (workers.isEmpty()) return 0;
+    // Round-robin over the I/O threads
+    uint next = uint(nextWorker.fetchAndAddRelaxed(1));
+    return workers.at(next % uint(workers.count()));
+}
+
+QxtHttpSessionWorker* QxtHttpSessionManagerPrivate::sessionWorker(int sessionID) const
+{
+    if (workers.isEmpty() || sessionID <= 0) return 0;
+    return workers.at(sessionID % workers.count());
+}
+
+QxtHttpSessionWorker* QxtHttpSessionManagerPrivate::threadWorker(QThread* thread) const
+{
+    foreach(QxtHttpSessionWorker* worker, workers)
+    {
+        if (worker->thread() == thread) return worker;
+    }
+    return 0;
+}
+
+QObject* QxtHttpSessionManagerPrivate::handler(QIODevice* device)
+{
+    if (device && !workers.isEmpty())
+    {
+        QxtHttpSessionWorker* worker = threadWorker(device->thread());
+        if (worker) return worker;
+    }
+    return &qxt_p();
+}
+
+QxtHttpSessionWorker::QxtHttpSessionWorker(QxtHttpSessionManager* manager) : QObject(0), manager(manager)
+{
+    // initializers only
+}
+
+void QxtHttpSessionWorker::attachConnection(QIODevice* device)
+{
+    // The device was pushed to this thread without a parent; adopt it so it
+    // is cleaned up along with the worker.
+    device->setParent(this);
+    manager->connector()->incomingData(device);
+}
+
+void QxtHttpSessionWorker::incomingData(QIODevice* device)
+{
+    if (!device)
+    {
+        device = qobject_cast<QIODevice*>(sender());
+        if (!device) return;
+    }
+    manager->connector()->incomingData(device);
+}
+
+void QxtHttpSessionWorker::disconnected()
+{
+    QIODevice* device = qobject_cast<QIODevice*>(sender());
+    if (!device) return;
+    manager->connector()->removeConnection(device);
+}
+
+void QxtHttpSessionWorker::processEvents()
+{
+    manager->processEvents();
+}
+
+void QxtHttpSessionWorker::closeConnection(int requestID)
+{
+    manager->closeConnection(requestID);
+}
+
+void QxtHttpSessionWorker::chunkReadyRead(int requestID, QObject* dataSource)
+{
+    manager->chunkReadyRead(requestID, dataSource);
+}
+
+void QxtHttpSessionWorker::sendNextChunk(int requestID, QObject* dataSource)
+{
+    manager->sendNextChunk(requestID, dataSource);
+}
+
+void QxtHttpSessionWorker::sourceClosed(int requestID, QObject* dataSource)
+{
+    manager->sourceClosed(requestID, dataSource);
+}
+
+void QxtHttpSessionWorker::sendEmptyChunk(int requestID, QObject* dataSource)
+{
+    manager->sendEmptyChunk(requestID, dataSource);
+}
+
+void QxtHttpSessionWorker::blockReadyRead(int requestID, QObject* dataSource)
+{
+    manager->blockReadyRead(requestID, dataSource);
+}
+
+void QxtHttpSessionWorker::sendNextBlock(int requestID, QObject* dataSource)
+{
+    manager->sendNextBlock(requestID, dataSource);
+}
 #endif
 
 /*!
@@ -205,6 +553,7 @@ quint16 QxtHttpSessionManager::serverPort() const
 bool QxtHttpSessionManager::start()
 {
     Q_ASSERT(qxt_d().connector);
+    qxt_d().startWorkers();
     return connector()->listen(listenInterface(), port());
 }
 
@@ -264,11 +613,8 @@ void QxtHttpSessionManager::setConnector(Connector connector)
         setConnector(new QxtHttpServerConnector(this));
     else if (connector == Scgi)
         setConnector(new QxtScgiServerConnector(this));
-    /* commented out pending implementation
-
-    else if(connector == Fcgi)
-        setConnector(new QxtFcgiConnector(this));
-    */
+    else if (connector == Fcgi)
+        setConnector(new QxtFcgiServerConnector(this));
 }
 
 /*!
@@ -305,6 +651,236 @@ void QxtHttpSessionManager::setAutoCreateSession(bool enable)
     qxt_d().autoCreateSession = enable;
 }
 
+/*!
+ * Returns the number of I/O threads used to serve connections.
+ * \sa setWorkerThreadCount()
+ */
+int QxtHttpSessionManager::workerThreadCount() const
+{
+    return qxt_d().workerThreadCount;
+}
+
+/*!
+ * Sets the number of I/O threads used to serve connections to \a count.
+ *
+ * The default value is 0, which serves every connection from the thread the
+ * connector lives in. With a positive count, start() launches that many
+ * worker threads and each accepted connection is handed to one of them in
+ * turn. The worker owns the socket from then on: the request is parsed,
+ * dispatched and answered on that thread.
+ *
+ * Sessions are pinned to a worker by session ID. A service created for a
+ * session is moved to its worker's thread (provided the service factory did
+ * not give it a parent), and requests arriving on other workers are queued
+ * to it, so a given service is only ever invoked from one thread. The static
+ * content service is invoked directly from whichever worker received the
+ * request and therefore must be reentrant.
+ *
+ * \note The worker count takes effect the first time the session manager
+ * is started.
+ *
+ * \sa start()
+ */
+void QxtHttpSessionManager::setWorkerThreadCount(int count)
+{
+    qxt_d().workerThreadCount = qMax(0, count);
+}
+
+/*!
+ * Returns the size of the pieces in which response bodies are written.
+ * \sa setWriteChunkSize()
+ */
+int QxtHttpSessionManager::writeChunkSize() const
+{
+    return qxt_d().writeChunkSize;
+}
+
+/*!
+ * Sets the size of the pieces in which response bodies are written to the
+ * connection to \a size bytes. The default is 32768.
+ *
+ * If adaptiveChunkSize() is enabled, this is only the size used for the first
+ * piece of each response.
+ *
+ * \sa setAdaptiveChunkSize()
+ */
+void QxtHttpSessionManager::setWriteChunkSize(int size)
+{
+    qxt_d().writeChunkSize = qBound(int(QxtHttpSessionManagerPrivate::MinChunkSize), size, int(QxtHttpSessionManagerPrivate::MaxChunkSize));
+}
+
+/*!
+ * Returns true if the chunk size adapts to the speed of each connection.
+ * \sa setAdaptiveChunkSize()
+ */
+bool QxtHttpSessionManager::adaptiveChunkSize() const
+{
+    return qxt_d().adaptiveChunkSize;
+}
+
+/*!
+ * Enables or disables adapting the response chunk size to each connection
+ * according to \a enable. The default is enabled.
+ *
+ * While a response is written, the session manager counts the bytes the
+ * connection reports through its bytesWritten() signal. Every 50
+ * milliseconds it divides them by the time elapsed and sets the chunk size
+ * to what the connection passes on in 10 milliseconds at that rate, rounded
+ * up to a power of two. A fast connection therefore gets large chunks and
+ * few writes, and a connection that stalls gets small chunks so that less
+ * data piles up in its send buffer. The chunk size stays between 4 KiB and
+ * 256 KiB.
+ *
+ * \sa setWriteChunkSize()
+ */
+void QxtHttpSessionManager::setAdaptiveChunkSize(bool enable)
+{
+    qxt_d().adaptiveChunkSize = enable;
+}
+
+/*!
+ * Returns the number of response body bytes the session manager has copied
+ * out of data sources into its own staging buffer.
+ *
+ * Only that one copy is counted. Copies made elsewhere are not: by the data
+ * source when it produces the body, by the compressor, by the connection's
+ * write buffer or by the operating system. The counter therefore shows how
+ * much data passed through the manager, not the total copy cost of a
+ * response.
+ *
+ * \sa concatenationBytesSaved()
+ */
+qint64 QxtHttpSessionManager::bytesCopied() const
+{
+    return qxt_d().bytesCopied.load();
+}
+
+/*!
+ * Returns the number of bytes that building chunked responses by
+ * concatenation would have copied, and that were not copied.
+ *
+ * Each chunk of a chunked response is written as its size line, its payload
+ * and a line break. Joining these into one buffer before writing copies all
+ * three once more; writing them to the connection one after the other does
+ * not. The counter adds up the size of every such buffer. Responses written
+ * without chunked encoding are not counted, since they never needed framing.
+ *
+ * \sa bytesCopied()
+ */
+qint64 QxtHttpSessionManager::concatenationBytesSaved() const
+{
+    return qxt_d().concatenationBytesSaved.load();
+}
+
+/*!
+ * Returns true if response bodies are compressed for clients that accept it.
+ * \sa setCompressionEnabled()
+ */
+bool QxtHttpSessionManager::compressionEnabled() const
+{
+    return qxt_d().compression;
+}
+
+/*!
+ * Enables or disables compression of response bodies according to \a enable.
+ * The default is disabled.
+ *
+ * When enabled, the session manager negotiates gzip or deflate through the
+ * Accept-Encoding header of each request and compresses the body while it is
+ * being sent, so chunked and fixed-length responses are never buffered as a
+ * whole. Fixed-length bodies lose their Content-Length and are sent with the
+ * chunked transfer encoding to HTTP/1.1 clients.
+ *
+ * Responses are sent unmodified if they are smaller than
+ * compressionThreshold(), if their content type is compressed already (such
+ * as images, video or archives), if they are partial content, or if the
+ * service has set a Content-Encoding header itself.
+ *
+ * Compression requires QxtWeb to be built with zlib; otherwise this setting
+ * has no effect.
+ *
+ * \sa responseCompressed()
+ */
+void QxtHttpSessionManager::setCompressionEnabled(bool enable)
+{
+    qxt_d().compression = enable;
+}
+
+/*!
+ * Returns the zlib compression level used for response bodies.
+ * \sa setCompressionLevel()
+ */
+int QxtHttpSessionManager::compressionLevel() const
+{
+    return qxt_d().compressionLevel;
+}
+
+/*!
+ * Sets the zlib compression \a level used for response bodies, from 1
+ * (fastest) to 9 (smallest). The default is 6.
+ */
+void QxtHttpSessionManager::setCompressionLevel(int level)
+{
+    qxt_d().compressionLevel = qBound(1, level, 9);
+}
+
+/*!
+ * Returns the size below which fixed-length response bodies are not
+ * compressed.
+ * \sa setCompressionThreshold()
+ */
+int QxtHttpSessionManager::compressionThreshold() const
+{
+    return qxt_d().compressionThreshold;
+}
+
+/*!
+ * Sets the size, in \a bytes, below which fixed-length response bodies are
+ * not compressed. The default is 1024. Streaming responses are compressed
+ * regardless of their size.
+ */
+void QxtHttpSessionManager::setCompressionThreshold(int bytes)
+{
+    qxt_d().compressionThreshold = qMax(0, bytes);
+}
+
+/*!
+ * Returns the largest request body that is accepted, or 0 if the size of
+ * request bodies is not limited.
+ * \sa setMaximumContentLength()
+ */
+qint64 QxtHttpSessionManager::maximumContentLength() const
+{
+    return qxt_d().maximumContentLength;
+}
+
+/*!
+ * Limits request bodies to \a bytes; 0, the default, removes the limit.
+ *
+ * Requests that announce a larger Content-Length are answered with "413
+ * Request Entity Too Large" without being passed to a service, and their
+ * body is discarded as it arrives. Bodies of unknown length are cut off at
+ * the limit.
+ *
+ * \sa QxtWebContent::setMaximumSize()
+ */
+void QxtHttpSessionManager::setMaximumContentLength(qint64 bytes)
+{
+    qxt_d().maximumContentLength = qMax(Q_INT64_C(0), bytes);
+}
+
+/*!
+ * \fn QxtHttpSessionManager::responseCompressed(int requestID, qint64 bytesIn, qint64 bytesOut, qint64 nsecs)
+ *
+ * This signal is emitted when the compressed body of the response to
+ * \a requestID has been produced completely. \a bytesIn and \a bytesOut are
+ * the sizes of the body before and after compression, and \a nsecs is the
+ * time spent compressing it, in nanoseconds.
+ *
+ * When worker threads are used, the signal is emitted from the thread that
+ * writes the response.
+ */
+
 /*!
  * Returns the QxtAbstractWebService that is used to respond to requests from
  * connections that are not associated with a session.
@@ -335,10 +911,27 @@ void QxtHttpSessionManager::setStaticContentService(QxtAbstractWebService* servi
  */
 void QxtHttpSessionManager::postEvent(QxtWebEvent* h)
 {
-    qxt_d().eventLock.lock();
-    qxt_d().eventQueue.append(h);
-    qxt_d().eventLock.unlock();
-    QMetaObject::invokeMethod(this, "processEvents", Qt::QueuedConnection);
+    QxtHttpSessionManagerPrivate& d = qxt_d();
+    if (h->type() == QxtWebEvent::StoreCookie || h->type() == QxtWebEvent::RemoveCookie)
+    {
+        QMutexLocker locker(&d.cookieLock);
+        d.pendingCookies[h->sessionID].append(h);
+        d.pendingCookieCount.ref();
+        return;
+    }
+    if (h->type() != QxtWebEvent::Page && h->type() != QxtWebEvent::Redirect)
+    {
+        // Nothing else is ever sent to the client
+        delete h;
+        return;
+    }
+
+    QxtHttpEventQueue::Node* node = new QxtHttpEventQueue::Node;
+    node->page = static_cast<QxtWebPageEvent*>(h);
+    node->cookies = d.takeCookies(h->sessionID);
+    // Wake the thread that owns the connection
+    QIODevice* device = connector()->getRequestConnection(node->page->requestID);
+    d.post(d.handler(device), node);
 }
 
 /*!
@@ -347,10 +940,8 @@ void QxtHttpSessionManager::postEvent(QxtWebEvent* h)
  */
 void QxtHttpSessionManager::sessionDestroyed(int sessionID)
 {
-  QMutexLocker locker(sessionMutex());
-  QUuid key = qxt_d().sessionKeys.key(sessionID);
-  if(!key.isNull())
-    qxt_d().sessionKeys.remove(key);
+  qxt_d().removeKey(sessionID);
+  qDeleteAll(qxt_d().takeCookies(sessionID));
 }
 
 /*!
@@ -362,31 +953,55 @@ void QxtHttpSessionManager::sessionDestroyed(int sessionID)
  */
 int QxtHttpSessionManager::newSession()
 {
-    QMutexLocker locker(sessionMutex());
     int sessionID = createService();
+    QxtAbstractWebService* service = session(sessionID);
+    QxtHttpSessionWorker* worker = qxt_d().sessionWorker(sessionID);
+    if (service && worker && !service->parent() && service->thread() == QThread::currentThread())
+        service->moveToThread(worker->thread());
     QUuid key;
     do
     {
         key = QUuid::createUuid();
     }
-    while (qxt_d().sessionKeys.contains(key));
-    qxt_d().sessionKeys[key] = sessionID;
+    while (!qxt_d().insertKey(key, sessionID));
+    setSessionKey(sessionID, key.toByteArray());
     postEvent(new QxtWebStoreCookieEvent(sessionID, qxt_d().sessionCookieName, key.toString()));
     return sessionID;
 }
 
+/*!
+ * \internal
+ * Brings the session with the given \a key back from the session store after
+ * a restart, keeping the key the browser already has. Returns -1 if the store
+ * does not know the key.
+ */
+int QxtHttpSessionManager::restoreSession(const QUuid& key)
+{
+    int sessionID = QxtAbstractWebSessionManager::restoreSession(key.toByteArray());
+    if (sessionID == -1) return -1;
+    QxtAbstractWebService* service = session(sessionID);
+    QxtHttpSessionWorker* worker = qxt_d().sessionWorker(sessionID);
+    if (service && worker && !service->parent() && service->thread() == QThread::currentThread())
+        service->moveToThread(worker->thread());
+    if (!qxt_d().insertKey(key, sessionID))
+    {
+        // Another request restored the same session first; drop this copy
+        // without deleting the stored session
+        setSessionKey(sessionID, QByteArray());
+        closeSession(sessionID);
+        return qxt_d().sessionForKey(key);
+    }
+    return sessionID;
+}
+
 /*!
  * Returns the session key for a specified session.
  *
  * If the specified session does not exist, returns a null QString.
- *
- * Be aware that this function is slow. Cache its result and avoid using it
- * in performance-sensitive contexts.
  */
 QString QxtHttpSessionManager::sessionKey(int sessionID) const
 {
-  QMutexLocker locker(sessionMutex());
-  QUuid uuid = qxt_d().sessionKeys.key(sessionID);
+  QUuid uuid = const_cast<QxtHttpSessionManagerPrivate&>(qxt_d()).keyForSession(sessionID);
   if (uuid.isNull()) {
     return QString();
   }
@@ -421,12 +1036,16 @@ void QxtHttpSessionManager::incomingRequest(quint32 requestID, const QHttpReques
     int sessionID;
     QString sessionCookie = cookies.value(qxt_d().sessionCookieName);
 
-    sessionMutex()->lock();
-    if (qxt_d().sessionKeys.contains(sessionCookie))
+    QUuid sessionUuid(sessionCookie);
+    sessionID = qxt_d().sessionForKey(sessionUuid);
+    if (sessionID == -1 && !sessionUuid.isNull() && sessionStore())
+        sessionID = restoreSession(sessionUuid);
+    if (sessionID != -1)
     {
-        sessionID = qxt_d().sessionKeys[sessionCookie];
         if(!sessionID && header.majorVersion() > 0 && qxt_d().autoCreateSession)
             sessionID = newSession();
+        else if (sessionID)
+            touchSession(sessionID);
     }
     else if (header.majorVersion() > 0 && qxt_d().autoCreateSession)
     {
@@ -438,15 +1057,7 @@ void QxtHttpSessionManager::incomingRequest(quint32 requestID, const QHttpReques
     }
 
     QIODevice* device = connector()->getRequestConnection(requestID);
-    QxtHttpSessionManagerPrivate::ConnectionState& state = qxt_d().connectionState[device];
-    state.sessionID = sessionID;
-    state.httpMajorVersion = header.majorVersion();
-    state.httpMinorVersion = header.minorVersion();
-    if (state.httpMajorVersion == 0 || (state.httpMajorVersion == 1 && state.httpMinorVersion == 0) || header.value("connection").toLower() == "close")
-        state.keepAlive = false;
-    else
-        state.keepAlive = true;
-    sessionMutex()->unlock();
+    qxt_d().queueRequest(device, requestID, sessionID, header);
 
     QxtWebRequestEvent* event;
 #ifdef QXT_HAVE_WEBSOCKETS
@@ -458,9 +1069,9 @@ void QxtHttpSessionManager::incomingRequest(quint32 requestID, const QHttpReques
     {
       event = new QxtWebRequestEvent(sessionID, requestID, QUrl::fromEncoded(header.path().toUtf8()));
     }
-    qxt_d().eventLock.lock();
+    qxt_d().requestLock.lock();
     qxt_d().pendingRequests.insert(QPair<int,int>(sessionID, requestID), event);
-    qxt_d().eventLock.unlock();
+    qxt_d().requestLock.unlock();
     QTcpSocket* socket = qobject_cast<QTcpSocket*>(device);
     if (socket)
     {
@@ -488,14 +1099,37 @@ void QxtHttpSessionManager::incomingRequest(quint32 requestID, const QHttpReques
         if (line.first.toLower() == "cookie") continue;
         event->headers.insert(line.first.toLower(), line.second);
     }
-    event->headers.insert("x-request-protocol", "HTTP/" + QString::number(state.httpMajorVersion) + '.' + QString::number(state.httpMinorVersion));
+    event->headers.insert("x-request-protocol", "HTTP/" + QString::number(header.majorVersion()) + '.' + QString::number(header.minorVersion()));
     QxtAbstractWebService* service = sessionID ? session(sessionID) : nullptr;
     if (!service) {
         service = qxt_d().staticService;
         if (!service) {
             postEvent(new QxtWebErrorEvent(0, requestID, 500, "Internal Configuration Error"));
+            return;
         }
     }
+    if (service->thread() != QThread::currentThread() && qxt_d().threadWorker(service->thread()))
+    {
+        // The session is pinned to another worker; hand the request over.
+        if (content) {
+            content->setParent(0);
+            content->moveToThread(service->thread());
+        }
+        QMetaObject::invokeMethod(service, [service, event, content]() {
+            if (content) {
+                content->setParent(service);
+            }
+#ifdef QXT_HAVE_WEBSOCKETS
+            if (content && content->webSocket()) {
+                service->websocketEvent(static_cast<QxtWebSocketEvent*>(event));
+            } else
+#endif
+            {
+                service->pageRequestedEvent(event);
+            }
+        }, Qt::QueuedConnection);
+        return;
+    }
     if (content) {
         content->setParent(service);
     }
@@ -509,16 +1143,24 @@ void QxtHttpSessionManager::incomingRequest(quint32 requestID, const QHttpReques
     }
 }
 
+/*!
+ * \internal
+ * Answers a request with an error without passing it to a service. The
+ * connection is closed after the response.
+ */
+void QxtHttpSessionManager::rejectRequest(quint32 requestID, const QHttpRequestHeader& header, int status, const QString& message)
+{
+    QIODevice* device = connector()->getRequestConnection(requestID);
+    qxt_d().queueRequest(device, requestID, 0, header, true);
+    postEvent(new QxtWebErrorEvent(0, requestID, status, message.toUtf8()));
+}
+
 /*!
  * \internal
  */
 void QxtHttpSessionManager::disconnected(QIODevice* device)
 {
-    QMutexLocker locker(sessionMutex());
-    if (qxt_d().connectionState.contains(device)) {
-        qxt_d().connectionState[device].clearHandlers();
-    }
-    qxt_d().connectionState.remove(device);
+    qxt_d().removeState(device);
     device->deleteLater();
 }
 
@@ -527,40 +1169,121 @@ void QxtHttpSessionManager::disconnected(QIODevice* device)
  */
 void QxtHttpSessionManager::processEvents()
 {
-    if (QThread::currentThreadId() != qxt_d().mainThread)
+    QxtHttpSessionManagerPrivate& d = qxt_d();
+    QObject* self = d.threadWorker(QThread::currentThread());
+    if (!self)
     {
-        QMetaObject::invokeMethod(this, "processEvents", Qt::QueuedConnection);
-        return;
+        if (QThread::currentThreadId() != d.mainThread)
+        {
+            QMetaObject::invokeMethod(this, "processEvents", Qt::QueuedConnection);
+            return;
+        }
+        self = this;
     }
-    QxtHttpSessionManagerPrivate& d = qxt_d();
-    QMutexLocker locker(&d.eventLock);
-    if (!d.eventQueue.count()) return;
 
-    int ct = d.eventQueue.count(), sessionID = 0, requestID = 0, pagePos = -1;
-    QxtWebRedirectEvent* re = 0;
-    QxtWebPageEvent* pe = 0;
-    for (int i = 0; i < ct; i++)
+    QxtHttpEventQueue& queue = d.eventQueue(self);
+    queue.acknowledge();
+    while (QxtHttpEventQueue::Node* node = queue.pop())
     {
-        if (d.eventQueue[i]->type() != QxtWebEvent::Page && d.eventQueue[i]->type() != QxtWebEvent::Redirect) continue;
-        pagePos = i;
-        sessionID = d.eventQueue[i]->sessionID;
-        if (d.eventQueue[pagePos]->type() == QxtWebEvent::Redirect)
+        QIODevice* device = connector()->getRequestConnection(node->page->requestID);
+        QObject* owner = d.handler(device);
+        if (owner != self)
         {
-            re = static_cast<QxtWebRedirectEvent*>(d.eventQueue[pagePos]);
+            // Responses must be written from the thread that owns the connection
+            d.post(owner, node);
+            continue;
         }
-        pe = static_cast<QxtWebPageEvent*>(d.eventQueue[pagePos]);
-        requestID = pe->requestID;
-        break;
+        QxtHttpSessionManagerPrivate::ConnectionState* state = device ? d.findState(device) : 0;
+        if (!state)
+        {
+            // The connection is gone; this only cleans up the request
+            sendPage(node->page, node->cookies);
+            delete node;
+            continue;
+        }
+        if (!d.queueResponse(*state, node))
+        {
+            qWarning("QxtHttpSessionManager: discarding a second response to request %d", node->page->requestID);
+            delete node;
+            continue;
+        }
+        startResponses(device);
+    }
+}
+
+/*!
+ * \internal
+ * Writes the responses that are next in line on \a device, stopping at the
+ * first request that has not been answered yet or while a response is still
+ * being transferred.
+ */
+void QxtHttpSessionManager::startResponses(QIODevice* device)
+{
+    QxtHttpSessionManagerPrivate::ConnectionState* state = qxt_d().findState(device);
+    if (!state || state->flushing) return;
+    state->flushing = true;
+    while (!state->responding && !state->pipeline.isEmpty() && state->pipeline.first().response)
+    {
+        QxtHttpSessionManagerPrivate::PipelinedRequest request = state->pipeline.takeFirst();
+        state->requestID = request.requestID;
+        state->sessionID = request.sessionID;
+        state->httpMajorVersion = request.httpMajorVersion;
+        state->httpMinorVersion = request.httpMinorVersion;
+        state->keepAlive = request.keepAlive;
+        state->acceptEncoding = request.acceptEncoding;
+        state->responding = true;
+        sendPage(request.response->page, request.response->cookies);
+        delete request.response;
+        // Closing the connection may have released its state
+        state = qxt_d().findState(device);
+        if (!state) return;
     }
-    if (pagePos == -1) return; // no pages to send yet
+    state->flushing = false;
+}
+
+/*!
+ * \internal
+ * Completes the response to \a requestID once its body has been written
+ * and releases \a dataSource. A persistent connection moves on to the next
+ * pipelined response and resumes reading requests; any other connection is
+ * closed.
+ */
+void QxtHttpSessionManager::finishResponse(int requestID, QObject* dataSource)
+{
+    QIODevice* device = connector()->getRequestConnection(requestID);
+    QxtHttpSessionManagerPrivate::ConnectionState* state = qxt_d().findState(device);
+    if (!state) return;
+    state->finishedTransfer = true;
+    state->clearHandlers();
+    if (dataSource)
+        dataSource->deleteLater();
+    if (!state->keepAlive)
+    {
+        closeConnection(requestID);
+        return;
+    }
+    connector()->doneWithRequest(requestID);
+    state->writeBuffer.clear();     // don't hold on to it while the connection idles
+    state->responding = false;
+    startResponses(device);
+    connector()->incomingData(device);
+}
+
+/*!
+ * \internal
+ * Writes the response described by \a pe, along with the cookies the
+ * service set for its session before posting it.
+ */
+void QxtHttpSessionManager::sendPage(QxtWebPageEvent* pe, const QList<QxtWebEvent*>& cookies)
+{
+    int sessionID = pe->sessionID, requestID = pe->requestID;
+    QxtWebRedirectEvent* re = 0;
+    if (pe->type() == QxtWebEvent::Redirect)
+        re = static_cast<QxtWebRedirectEvent*>(pe);
 
     QHttpResponseHeader header;
-    QList<int> removeIDs;
-    QxtWebEvent* e = 0;
-    for (int i = 0; i < pagePos; i++)
+    foreach(QxtWebEvent* e, cookies)
     {
-        if (d.eventQueue[i]->sessionID != sessionID) continue;
-        e = d.eventQueue[i];
         if (e->type() == QxtWebEvent::StoreCookie)
         {
             QxtWebStoreCookieEvent* ce = static_cast<QxtWebStoreCookieEvent*>(e);
@@ -573,7 +1296,6 @@ void QxtHttpSessionManager::processEvents()
                           + "; expires=" + ce->expiration.toUTC().toString("ddd, dd-MMM-YYYY hh:mm:ss GMT");
             }
             header.addValue("set-cookie", cookie);
-            removeIDs.push_front(i);
         }
         else if (e->type() == QxtWebEvent::RemoveCookie)
         {
@@ -581,10 +1303,8 @@ void QxtHttpSessionManager::processEvents()
             QString path;
             if(!ce->path.isEmpty()) path = "path=" + ce->path + "; ";
             header.addValue("set-cookie", ce->name + "=; "+path+"max-age=0; expires=" + QDateTime(QDate(1970, 1, 1)).toString("ddd, dd-MMM-YYYY hh:mm:ss GMT"));
-            removeIDs.push_front(i);
         }
     }
-    removeIDs.push_front(pagePos);
 
     QIODevice* device = connector()->getRequestConnection(requestID);
     // XXX: This line segfaulted in testing once.
@@ -592,17 +1312,15 @@ void QxtHttpSessionManager::processEvents()
     // TODO: This should only be invoked when pipelining occurs
     // In theory it shouldn't cause any problems as POST is specced to not be pipelined
     if (content) content->ignoreRemainingContent();
-    QHash<QPair<int,int>,QxtWebRequestEvent*>::iterator iPending =
-	qxt_d().pendingRequests.find(QPair<int,int>(sessionID, requestID));
-    if(iPending != qxt_d().pendingRequests.end()) {
-        delete *iPending;
-        qxt_d().pendingRequests.erase(iPending);
-    }
+    qxt_d().requestLock.lock();
+    delete qxt_d().pendingRequests.take(QPair<int,int>(sessionID, requestID));
+    qxt_d().requestLock.unlock();
 
     // If no device is returned, the request was aborted before the request body was ready.
     if(device)
     {
-        QxtHttpSessionManagerPrivate::ConnectionState& state = qxt_d().connectionState[connector()->getRequestConnection(requestID)];
+        QxtHttpSessionManagerPrivate::ConnectionState& state = qxt_d().state(device);
+        QObject* relay = qxt_d().handler(device);
         QIODevice* source;
         header.setStatusLine(pe->status, pe->statusMessage, state.httpMajorVersion, state.httpMinorVersion);
 
@@ -618,45 +1336,86 @@ void QxtHttpSessionManager::processEvents()
         }
 
         header.setContentType(pe->contentType);
-        if (state.httpMajorVersion == 0 || (state.httpMajorVersion == 1 && state.httpMinorVersion == 0))
+        bool http10 = state.httpMajorVersion == 0 || (state.httpMajorVersion == 1 && state.httpMinorVersion == 0);
+        if (http10)
             pe->chunked = false;
 
         source = pe->dataSource;
+        bool emptyContent = !source->bytesAvailable() && !pe->streaming;
+
+        QxtHttpCompressor::Encoding encoding = QxtHttpCompressor::Identity;
+        if (qxt_d().compression && QxtHttpCompressor::isCompressible(pe->contentType))
+        {
+            QString vary = header.value("vary");
+            header.setValue("vary", vary.isEmpty() ? QString("Accept-Encoding") : vary + ", Accept-Encoding");
+            if (!emptyContent && pe->status != 206 && !header.hasKey("content-encoding")
+                    && (pe->streaming || source->bytesAvailable() >= qxt_d().compressionThreshold))
+                encoding = QxtHttpCompressor::Encoding(state.acceptEncoding);
+        }
+        if (encoding != QxtHttpCompressor::Identity)
+        {
+            header.setValue("content-encoding", QxtHttpCompressor::encodingName(encoding));
+            // The compressed length is not known in advance
+            if (!http10)
+                pe->chunked = true;
+        }
+
         state.finishedTransfer = false;
         state.sourceClosed = false;
         state.chunked = pe->chunked;
-        bool emptyContent = !source->bytesAvailable() && !pe->streaming;
+        state.chunkSize = qxt_d().writeChunkSize;
         state.readyRead = source->bytesAvailable();
         state.streaming = pe->streaming;
 
         if (emptyContent)
         {
-            header.setValue("connection", "close");
+            // Statuses that never carry a body don't need a length to keep
+            // the connection usable
+            if (pe->status >= 200 && pe->status != 204 && pe->status != 304 && !header.hasKey("content-length"))
+                header.setValue("content-length", "0");
+            header.setValue("connection", state.keepAlive ? "keep-alive" : "close");
             connector()->writeHeaders(device, header);
-            closeConnection(requestID);
+            finishResponse(requestID, 0);
         }
         else
         {
             pe->dataSource = 0;     // so that it isn't destroyed when the event is deleted
             state.clearHandlers();  // disconnect old handlers
-            if (!pe->streaming)
+            if (qxt_d().adaptiveChunkSize)
+            {
+                state.drainMeter = new QxtHttpDrainMeter(device);
+                state.drainSampled = 0;
+                state.drainClock.start();
+            }
+            if (encoding != QxtHttpCompressor::Identity)
+            {
+                // The compressor takes ownership of the page's data source
+                QxtHttpCompressor* compressor = new QxtHttpCompressor(source, encoding, qxt_d().compressionLevel, pe->streaming, requestID);
+                connect(compressor, SIGNAL(finished(int, qint64, qint64, qint64)),
+                        this, SIGNAL(responseCompressed(int, qint64, qint64, qint64)), Qt::DirectConnection);
+                source = compressor;
+            }
+            else if (!pe->streaming)
             {
                 header.setValue("content-length", QString::number(source->bytesAvailable()));
             }
 
             if (!pe->chunked)
             {
-                state.keepAlive = false;
-                state.onBytesWritten = QxtMetaObject::bind(this, SLOT(sendNextBlock(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
-                state.onReadyRead = QxtMetaObject::bind(this, SLOT(blockReadyRead(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
+                // Without a length the end of the body is marked by closing
+                // the connection
+                if (!header.hasKey("content-length"))
+                    state.keepAlive = false;
+                state.onBytesWritten = QxtMetaObject::bind(relay, SLOT(sendNextBlock(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
+                state.onReadyRead = QxtMetaObject::bind(relay, SLOT(blockReadyRead(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
             }
             else
             {
                 header.setValue("transfer-encoding", "chunked");
-                state.onBytesWritten = QxtMetaObject::bind(this, SLOT(sendNextChunk(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
-                state.onReadyRead = QxtMetaObject::bind(this, SLOT(chunkReadyRead(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
+                state.onBytesWritten = QxtMetaObject::bind(relay, SLOT(sendNextChunk(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
+                state.onReadyRead = QxtMetaObject::bind(relay, SLOT(chunkReadyRead(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
             }
-            state.onAboutToClose = QxtMetaObject::bind(this, SLOT(sourceClosed(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
+            state.onAboutToClose = QxtMetaObject::bind(relay, SLOT(sourceClosed(int, QObject*)), Q_ARG(int, requestID), Q_ARG(QObject*, source));
             QxtMetaObject::connect(device, SIGNAL(bytesWritten(qint64)), state.onBytesWritten, Qt::QueuedConnection);
             QxtMetaObject::connect(source, SIGNAL(readyRead()), state.onReadyRead, Qt::QueuedConnection);
             QxtMetaObject::connect(source, SIGNAL(aboutToClose()), state.onAboutToClose, Qt::QueuedConnection);
@@ -684,14 +1443,6 @@ void QxtHttpSessionManager::processEvents()
             }
         }
     }
-
-    foreach(int id, removeIDs)
-    {
-        delete d.eventQueue.takeAt(id);
-    }
-
-    if (d.eventQueue.count())
-        QMetaObject::invokeMethod(this, "processEvents", Qt::QueuedConnection);
 }
 
 /*!
@@ -702,9 +1453,12 @@ void QxtHttpSessionManager::chunkReadyRead(int requestID, QObject* dataSourceObj
     QIODevice* dataSource = static_cast<QIODevice*>(dataSourceObject);
     if (!dataSource->bytesAvailable()) return;
     QIODevice* device = connector()->getRequestConnection(requestID);
-    if (!device->bytesToWrite() || qxt_d().connectionState[device].readyRead == false)
+    QxtHttpSessionManagerPrivate::ConnectionState* found = qxt_d().findState(device);
+    if (!found) return;  // the response has already completed
+    QxtHttpSessionManagerPrivate::ConnectionState& state = *found;
+    if (!device->bytesToWrite() || state.readyRead == false)
     {
-        qxt_d().connectionState[device].readyRead = true;
+        state.readyRead = true;
         sendNextChunk(requestID, dataSourceObject);
     }
 }
@@ -716,8 +1470,10 @@ void QxtHttpSessionManager::sendNextChunk(int requestID, QObject* dataSourceObje
 {
     QIODevice* dataSource = static_cast<QIODevice*>(dataSourceObject);
     QIODevice* device = connector()->getRequestConnection(requestID);
-    QxtHttpSessionManagerPrivate::ConnectionState& state = qxt_d().connectionState[device];
-    if (state.finishedTransfer)
+    QxtHttpSessionManagerPrivate::ConnectionState* found = qxt_d().findState(device);
+    if (!found) return;  // the response has already completed
+    QxtHttpSessionManagerPrivate::ConnectionState& state = *found;
+    if (state.finishedTransfer || state.requestID != requestID)
     {
         // This is just the last block written; we're done with it
         return;
@@ -727,15 +1483,21 @@ void QxtHttpSessionManager::sendNextChunk(int requestID, QObject* dataSourceObje
         state.readyRead = false;
         return;
     }
-    QByteArray chunk = dataSource->read(32768); // this is a good chunk size
-    if (chunk.size())
+    qint64 size = qxt_d().readChunk(state, dataSource);
+    if (size > 0)
     {
-        QByteArray data = QString::number(chunk.size(), 16).toUtf8() + "\r\n" + chunk + "\r\n";
-        device->write(data);
+        // Write the framing around the payload instead of concatenating them
+        char frame[20];
+        int frameSize = qsnprintf(frame, sizeof(frame), "%llx\r\n", static_cast<unsigned long long>(size));
+        device->write(frame, frameSize);
+        device->write(state.writeBuffer.constData(), size);
+        device->write("\r\n", 2);
+        // Joining the three into one buffer would have copied all of them
+        qxt_d().concatenationBytesSaved.fetchAndAddRelaxed(frameSize + size + 2);
     }
     state.readyRead = false;
     if ((!state.streaming || state.sourceClosed) && !dataSource->bytesAvailable())
-        QMetaObject::invokeMethod(this, "sendEmptyChunk", Q_ARG(int, requestID), Q_ARG(QObject*, dataSource));
+        QMetaObject::invokeMethod(qxt_d().handler(device), "sendEmptyChunk", Q_ARG(int, requestID), Q_ARG(QObject*, dataSource));
 }
 
 /*!
@@ -744,16 +1506,17 @@ void QxtHttpSessionManager::sendNextChunk(int requestID, QObject* dataSourceObje
 void QxtHttpSessionManager::sourceClosed(int requestID, QObject* dataSourceObject)
 {
     QIODevice* device = connector()->getRequestConnection(requestID);
-    if (!qxt_d().connectionState.contains(device)) return;  // in case a disconnect signal and a bytesWritten signal get fired in the wrong order
-    QxtHttpSessionManagerPrivate::ConnectionState& state = qxt_d().connectionState[device];
-    if (state.finishedTransfer) return;
+    QxtHttpSessionManagerPrivate::ConnectionState* found = qxt_d().findState(device);
+    if (!found) return;  // in case a disconnect signal and a bytesWritten signal get fired in the wrong order
+    QxtHttpSessionManagerPrivate::ConnectionState& state = *found;
+    if (state.finishedTransfer || state.requestID != requestID) return;
     state.sourceClosed = true;
     QIODevice* dataSource = static_cast<QIODevice*>(dataSourceObject);
     if (!dataSource->bytesAvailable()) {
       if (state.chunked) {
         sendEmptyChunk(requestID, dataSource);
       } else {
-        closeConnection(requestID);
+        finishResponse(requestID, dataSource);
       }
     }
 }
@@ -764,22 +1527,12 @@ void QxtHttpSessionManager::sourceClosed(int requestID, QObject* dataSourceObjec
 void QxtHttpSessionManager::sendEmptyChunk(int requestID, QObject* dataSource)
 {
     QIODevice* device = connector()->getRequestConnection(requestID);
-    if (!qxt_d().connectionState.contains(device)) return;  // in case a disconnect signal and a bytesWritten signal get fired in the wrong order
-    QxtHttpSessionManagerPrivate::ConnectionState& state = qxt_d().connectionState[device];
-    if (state.finishedTransfer) return;
-    state.finishedTransfer = true;
+    QxtHttpSessionManagerPrivate::ConnectionState* found = qxt_d().findState(device);
+    if (!found) return;  // in case a disconnect signal and a bytesWritten signal get fired in the wrong order
+    QxtHttpSessionManagerPrivate::ConnectionState& state = *found;
+    if (state.finishedTransfer || state.requestID != requestID) return;
     device->write("0\r\n\r\n");
-    dataSource->deleteLater();
-    if (state.keepAlive)
-    {
-        delete state.onBytesWritten;
-        state.onBytesWritten = 0;
-        connector()->incomingData(device);
-    }
-    else
-    {
-        closeConnection(requestID);
-    }
+    finishResponse(requestID, dataSource);
 }
 
 /*!
@@ -789,8 +1542,9 @@ void QxtHttpSessionManager::closeConnection(int requestID)
 {
     QIODevice* device = connector()->getRequestConnection(requestID);
     if(!device) return;
-    QxtHttpSessionManagerPrivate::ConnectionState& state = qxt_d().connectionState[device];
+    QxtHttpSessionManagerPrivate::ConnectionState& state = qxt_d().state(device);
     state.finishedTransfer = true;
+    connector()->doneWithRequest(requestID);
     QTcpSocket* socket = qobject_cast<QTcpSocket*>(device);
     if (socket)
         socket->disconnectFromHost();
@@ -807,9 +1561,12 @@ void QxtHttpSessionManager::blockReadyRead(int requestID, QObject* dataSourceObj
     if (!dataSource->bytesAvailable()) return;
 
     QIODevice* device = connector()->getRequestConnection(requestID);
-    if (!device->bytesToWrite() || qxt_d().connectionState[device].readyRead == false)
+    QxtHttpSessionManagerPrivate::ConnectionState* found = qxt_d().findState(device);
+    if (!found) return;  // the response has already completed
+    QxtHttpSessionManagerPrivate::ConnectionState& state = *found;
+    if (!device->bytesToWrite() || state.readyRead == false)
     {
-        qxt_d().connectionState[device].readyRead = true;
+        state.readyRead = true;
         sendNextBlock(requestID, dataSourceObject);
     }
 }
@@ -821,21 +1578,19 @@ void QxtHttpSessionManager::sendNextBlock(int requestID, QObject* dataSourceObje
 {
     QIODevice* dataSource = static_cast<QIODevice*>(dataSourceObject);
     QIODevice* device = connector()->getRequestConnection(requestID);
-    if (!qxt_d().connectionState.contains(device)) return;  // in case a disconnect signal and a bytesWritten signal get fired in the wrong order
-    QxtHttpSessionManagerPrivate::ConnectionState& state = qxt_d().connectionState[device];
-    if (state.finishedTransfer) return;
+    QxtHttpSessionManagerPrivate::ConnectionState* found = qxt_d().findState(device);
+    if (!found) return;  // in case a disconnect signal and a bytesWritten signal get fired in the wrong order
+    QxtHttpSessionManagerPrivate::ConnectionState& state = *found;
+    if (state.finishedTransfer || state.requestID != requestID) return;
     if (!dataSource->bytesAvailable())
     {
         state.readyRead = false;
         return;
     }
-    QByteArray chunk = dataSource->read(32768); // empirically determined to be a good chunk size
-    device->write(chunk);
+    qint64 size = qxt_d().readChunk(state, dataSource);
+    if (size > 0)
+        device->write(state.writeBuffer.constData(), size);
     state.readyRead = false;
     if ((!state.streaming || state.sourceClosed) && !dataSource->bytesAvailable())
-    {
-        closeConnection(requestID);
-        dataSource->deleteLater();
-        state.clearHandlers();
-    }
+        finishResponse(requestID, dataSource);
 }
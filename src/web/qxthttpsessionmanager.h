@@ -35,21 +35,33 @@
 #include "qxtabstractwebsessionmanager.h"
 #include "qxtabstracthttpconnector.h"
 #include <QHostAddress>
+#include <QUuid>
 #include "qhttpheader.h"
 
 class QxtWebEvent;
+class QxtWebPageEvent;
 class QxtWebContent;
 
 class QxtHttpSessionManagerPrivate;
 class QXT_WEB_EXPORT QxtHttpSessionManager : public QxtAbstractWebSessionManager
 {
     friend class QxtAbstractHttpConnector;
+    friend class QxtHttpSessionWorker;
     Q_OBJECT
     Q_PROPERTY(QHostAddress listenInterface READ listenInterface WRITE setListenInterface)
     Q_PROPERTY(QByteArray sessionCookieName READ sessionCookieName WRITE setSessionCookieName)
     Q_PROPERTY(quint16 port READ port WRITE setPort)
     Q_PROPERTY(quint16 serverPort READ serverPort)
     Q_PROPERTY(bool autoCreateSession READ autoCreateSession WRITE setAutoCreateSession)
+    Q_PROPERTY(int workerThreadCount READ workerThreadCount WRITE setWorkerThreadCount)
+    Q_PROPERTY(int writeChunkSize READ writeChunkSize WRITE setWriteChunkSize)
+    Q_PROPERTY(bool adaptiveChunkSize READ adaptiveChunkSize WRITE setAdaptiveChunkSize)
+    Q_PROPERTY(qint64 bytesCopied READ bytesCopied)
+    Q_PROPERTY(qint64 concatenationBytesSaved READ concatenationBytesSaved)
+    Q_PROPERTY(bool compressionEnabled READ compressionEnabled WRITE setCompressionEnabled)
+    Q_PROPERTY(int compressionLevel READ compressionLevel WRITE setCompressionLevel)
+    Q_PROPERTY(int compressionThreshold READ compressionThreshold WRITE setCompressionThreshold)
+    Q_PROPERTY(qint64 maximumContentLength READ maximumContentLength WRITE setMaximumContentLength)
 public:
     enum Connector { HttpServer, Scgi, Fcgi };
 
@@ -73,6 +85,26 @@ public:
     virtual int newSession();
     QString sessionKey(int sessionID) const;
 
+    int workerThreadCount() const;
+    void setWorkerThreadCount(int count);
+
+    int writeChunkSize() const;
+    void setWriteChunkSize(int size);
+    bool adaptiveChunkSize() const;
+    void setAdaptiveChunkSize(bool enable);
+    qint64 bytesCopied() const;
+    qint64 concatenationBytesSaved() const;
+
+    bool compressionEnabled() const;
+    void setCompressionEnabled(bool enable);
+    int compressionLevel() const;
+    void setCompressionLevel(int level);
+    int compressionThreshold() const;
+    void setCompressionThreshold(int bytes);
+
+    qint64 maximumContentLength() const;
+    void setMaximumContentLength(qint64 bytes);
+
     QxtAbstractWebService* staticContentService() const;
     void setStaticContentService(QxtAbstractWebService* service);
 
@@ -83,6 +115,9 @@ public:
     virtual bool start();
     virtual bool shutdown();
 
+Q_SIGNALS:
+    void responseCompressed(int requestID, qint64 bytesIn, qint64 bytesOut, qint64 nsecs);
+
 protected:
     virtual void sessionDestroyed(int sessionID);
     virtual void incomingRequest(quint32 requestID, const QHttpRequestHeader& header, QxtWebContent* device);
@@ -101,6 +136,11 @@ private Q_SLOTS:
 
 private:
     void disconnected(QIODevice* device);
+    void sendPage(QxtWebPageEvent* event, const QList<QxtWebEvent*>& cookies);
+    void startResponses(QIODevice* device);
+    void finishResponse(int requestID, QObject* dataSource);
+    void rejectRequest(quint32 requestID, const QHttpRequestHeader& header, int status, const QString& message);
+    int restoreSession(const QUuid& key);
     QXT_DECLARE_PRIVATE(QxtHttpSessionManager)
 };
 
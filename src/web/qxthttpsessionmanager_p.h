@@ -0,0 +1,285 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTHTTPSESSIONMANAGER_P_H
+#define QXTHTTPSESSIONMANAGER_P_H
+
+#include "qxthttpsessionmanager.h"
+#include <QObject>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QUuid>
+#include <QThread>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QIODevice>
+
+class QxtBoundFunction;
+class QxtWebRequestEvent;
+class QxtWebPageEvent;
+class QxtHttpSessionWorker;
+
+#ifndef QXT_DOXYGEN_RUN
+/*
+ * Responses are handed to the thread that writes them through an intrusive
+ * multi-producer, single-consumer queue: services post from any thread
+ * without taking a lock and only the owning thread pops. The wakeup flag
+ * coalesces the queued processEvents() calls, so a burst of responses costs
+ * a single cross-thread event.
+ */
+/*
+ * Counts the bytes a connection hands on while a response is written, from
+ * its bytesWritten() signal. Adaptive chunk sizing divides this by the time
+ * it took.
+ */
+class QxtHttpDrainMeter : public QObject
+{
+public:
+    QxtHttpDrainMeter(QIODevice* device) : drained(0)
+    {
+        QObject::connect(device, &QIODevice::bytesWritten, this, [this](qint64 bytes) { drained += bytes; });
+    }
+
+    qint64 drained;
+};
+
+class QxtHttpEventQueue
+{
+public:
+    struct Node
+    {
+        Node() : page(0) {}
+        ~Node();
+
+        QxtWebPageEvent* page;
+        QList<QxtWebEvent*> cookies;    // cookie events sent along with the page
+        QAtomicPointer<Node> next;
+    };
+
+    QxtHttpEventQueue();
+    ~QxtHttpEventQueue();
+
+    // Returns true if the consumer has to be woken up.
+    bool push(Node* node);
+    Node* pop();
+    void acknowledge();
+
+private:
+    Q_DISABLE_COPY(QxtHttpEventQueue)
+    void link(Node* node);
+
+    QAtomicPointer<Node> head;          // most recently pushed node
+    Node* tail;                         // next node to pop; consumer only
+    Node stub;
+    QAtomicInt wakeupPending;
+};
+
+class QxtHttpSessionManagerPrivate : public QxtPrivate<QxtHttpSessionManager>
+{
+public:
+    // A request read from a connection, kept in arrival order until its
+    // response has been started so that pipelined responses go out in the
+    // order the requests came in.
+    struct PipelinedRequest
+    {
+        int requestID;
+        int sessionID;
+        int httpMajorVersion;
+        int httpMinorVersion;
+        bool keepAlive;
+        int acceptEncoding;
+        QxtHttpEventQueue::Node* response;  // 0 until the service answers
+    };
+
+    struct ConnectionState
+    {
+        ~ConnectionState();
+
+        QxtBoundFunction *onBytesWritten, *onReadyRead, *onAboutToClose;
+        QList<PipelinedRequest> pipeline;
+        int requestID;                  // request currently being answered
+        bool responding;
+        bool flushing;                  // inside startResponses()
+        bool readyRead;
+        bool finishedTransfer;
+        bool keepAlive;
+        bool streaming;
+        bool chunked;
+        bool sourceClosed;
+        int httpMajorVersion;
+        int httpMinorVersion;
+        int sessionID;
+        int chunkSize;                  // current response chunk size
+        QxtHttpDrainMeter* drainMeter;  // only with adaptive chunk sizing
+        QElapsedTimer drainClock;       // start of the current drain sample
+        qint64 drainSampled;            // drainMeter->drained at that time
+        int acceptEncoding;             // QxtHttpCompressor::Encoding negotiated for the request
+        QByteArray writeBuffer;         // reused for every chunk of the response
+
+        void clearHandlers();
+    };
+
+    QxtHttpSessionManagerPrivate()
+    : iface(QHostAddress::Any), port(80), sessionCookieName("sessionID"), connector(0), staticService(0),
+      autoCreateSession(true), workerThreadCount(0),
+      writeChunkSize(DefaultChunkSize), adaptiveChunkSize(true),
+      compression(false), compressionLevel(6), compressionThreshold(1024), maximumContentLength(0) {}
+    ~QxtHttpSessionManagerPrivate();
+    QXT_DECLARE_PUBLIC(QxtHttpSessionManager)
+
+    enum { DefaultChunkSize = 32768, MinChunkSize = 4096, MaxChunkSize = 262144 };
+    enum { DrainSampleInterval = 50, DrainTarget = 10 };     // milliseconds
+
+    QHostAddress iface;
+    quint16 port;
+    QByteArray sessionCookieName;
+    QxtAbstractHttpConnector* connector;
+    QxtAbstractWebService* staticService;
+    bool autoCreateSession;
+
+    QxtHttpEventQueue events;                            // responses written by the main thread
+
+    // Cookie events wait here until the next page of their session is posted
+    // and then travel with that page.
+    QMutex cookieLock;
+    QHash<int, QList<QxtWebEvent*> > pendingCookies;     // sessionID->cookie events
+    QAtomicInt pendingCookieCount;
+
+    QMutex requestLock;
+    QHash<QPair<int,int>, QxtWebRequestEvent*> pendingRequests;
+
+    // Session keys are sharded like the session table. Each key is stored
+    // in the shard of its hash and, for the reverse lookup, in the shard of
+    // its session ID.
+    enum { KeyShardCount = 16 };
+    struct KeyShard
+    {
+        QMutex lock;
+        QHash<QUuid, int> sessions;                      // sessionKey->sessionID
+        QHash<int, QUuid> keys;                          // sessionID->sessionKey
+    };
+    KeyShard keyShards[KeyShardCount];
+
+    inline KeyShard& keyShard(const QUuid& key)
+    {
+        return keyShards[qHash(key) % KeyShardCount];
+    }
+    inline KeyShard& idShard(int sessionID)
+    {
+        return keyShards[uint(sessionID) % KeyShardCount];
+    }
+    int sessionForKey(const QUuid& key);
+    QUuid keyForSession(int sessionID);
+    bool insertKey(const QUuid& key, int sessionID);
+    QUuid removeKey(int sessionID);
+
+    // Connections may be served from several I/O threads at once, so the
+    // states are heap-allocated: a reference stays valid while the hash grows.
+    QMutex connectionLock;
+    QHash<QIODevice*, ConnectionState*> connectionState; // connection->state
+
+    Qt::HANDLE mainThread;
+
+    int workerThreadCount;
+    QList<QxtHttpSessionWorker*> workers;
+    QAtomicInt nextWorker;
+
+    int writeChunkSize;
+    bool adaptiveChunkSize;
+    QAtomicInteger<qint64> bytesCopied;
+    QAtomicInteger<qint64> concatenationBytesSaved;
+
+    bool compression;
+    int compressionLevel;
+    int compressionThreshold;
+    qint64 maximumContentLength;
+
+    ConnectionState& state(QIODevice* device);
+    ConnectionState* findState(QIODevice* device);
+    void removeState(QIODevice* device);
+    void queueRequest(QIODevice* device, int requestID, int sessionID, const QHttpRequestHeader& header, bool rejected = false);
+    bool queueResponse(ConnectionState& state, QxtHttpEventQueue::Node* node);
+
+    void startWorkers();
+    void stopWorkers();
+    QxtHttpSessionWorker* acceptingWorker();
+    QxtHttpSessionWorker* sessionWorker(int sessionID) const;
+    QxtHttpSessionWorker* threadWorker(QThread* thread) const;
+    QObject* handler(QIODevice* device);
+    QxtHttpEventQueue& eventQueue(QObject* handler);
+    void post(QObject* handler, QxtHttpEventQueue::Node* node);
+    QList<QxtWebEvent*> takeCookies(int sessionID);
+
+    qint64 readChunk(ConnectionState& state, QIODevice* source);
+};
+
+/*
+ * An I/O worker owns the connections handed to it by the connector. All
+ * parsing, request dispatch and response writing for those connections
+ * happens on the worker's thread; the slots below only forward to the
+ * session manager so that signal connections and bound functions are
+ * delivered to the thread that owns the socket.
+ */
+class QxtHttpSessionWorker : public QObject
+{
+    Q_OBJECT
+public:
+    QxtHttpSessionWorker(QxtHttpSessionManager* manager);
+
+private Q_SLOTS:
+    void attachConnection(QIODevice* device);
+    void incomingData(QIODevice* device = 0);
+    void disconnected();
+
+    void processEvents();
+    void closeConnection(int requestID);
+    void chunkReadyRead(int requestID, QObject* dataSource);
+    void sendNextChunk(int requestID, QObject* dataSource);
+    void sourceClosed(int requestID, QObject* dataSource);
+    void sendEmptyChunk(int requestID, QObject* dataSource);
+    void blockReadyRead(int requestID, QObject* dataSource);
+    void sendNextBlock(int requestID, QObject* dataSource);
+
+private:
+    friend class QxtHttpSessionManager;
+    friend class QxtHttpSessionManagerPrivate;
+    friend class QxtAbstractHttpConnector;
+    QxtHttpSessionManager* manager;
+    QxtHttpEventQueue events;
+};
+#endif // QXT_DOXYGEN_RUN
+
+#endif // QXTHTTPSESSIONMANAGER_P_H
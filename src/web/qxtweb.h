@@ -32,15 +32,20 @@
 #define QXTWEB_H_INCLUDED
 
 #include "qxtabstracthttpconnector.h"
+#include "qxtabstractsessionstore.h"
 #include "qxtabstractwebservice.h"
 #include "qxtabstractwebsessionmanager.h"
 #include "qxthtmltemplate.h"
+#include "qxthttprequestparser.h"
 #include "qxthttpsessionmanager.h"
 #include "qxtwebcgiservice.h"
 #include "qxtwebcontent.h"
 #include "qxtwebevent.h"
 #include "qxtwebjsonrpcservice.h"
+#include "qxtwebmultipartparser.h"
+#include "qxtwebrouter.h"
 #include "qxtwebservicedirectory.h"
 #include "qxtwebslotservice.h"
+#include "qxtwebstaticfileservice.h"
 
 #endif // QXTWEB_H_INCLUDED
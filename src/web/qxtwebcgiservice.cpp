@@ -36,21 +36,73 @@
 
 \brief The QxtWebCgiService class provides a CGI/1.1 gateway for QxtWeb
 
-TODO: write docs
-TODO: implement timeout
+By default every request is handled by a new process running the configured
+binary, as described by CGI/1.1.
+
+For backends whose startup dominates the cost of a request, such as PHP,
+QxtWebCgiService can instead keep a pool of persistent worker processes; see
+setPoolSize(). Each worker is started once with a socket path on its command
+line (see setPoolArguments()) and serves requests over it with the FastCGI
+protocol, one request at a time. Requests wait in a bounded queue while all
+workers are busy and are refused with "503 Service Unavailable" when the queue
+is full. Workers that exit or exceed the timeout are restarted; their request
+is answered with "502 Bad Gateway" or "504 Gateway Timeout". A request that
+waits longer than the timeout, or 30 seconds if there is none, without a
+worker accepting it is answered with "504 Gateway Timeout".
 */
 
 #include "qxtwebcgiservice.h"
 #include "qxtwebcgiservice_p.h"
 #include "qxtwebevent.h"
 #include "qxtwebcontent.h"
+#include "qxtfcgi_p.h"
 #include <QMap>
+#include <QDir>
 #include <QFile>
 #include <QProcess>
+#include <QLocalSocket>
+#include <QTemporaryDir>
 #include <QtDebug>
 
-QxtCgiRequestInfo::QxtCgiRequestInfo() : sessionID(0), requestID(0), eventSent(false), terminateSent(false) {}
-QxtCgiRequestInfo::QxtCgiRequestInfo(QxtWebRequestEvent* req) : sessionID(req->sessionID), requestID(req->requestID), eventSent(false), terminateSent(false) {}
+QxtCgiRequestInfo::QxtCgiRequestInfo() : sessionID(0), requestID(0), eventSent(false), terminateSent(false), timeout(0) {}
+QxtCgiRequestInfo::QxtCgiRequestInfo(QxtWebRequestEvent* req) : sessionID(req->sessionID), requestID(req->requestID), eventSent(false), terminateSent(false), timeout(0) {}
+
+enum
+{
+    PoolRequestId = 1,                  // workers serve one request at a time
+    ConnectRetryInterval = 50,          // ms between attempts to reach a starting worker
+    MaximumConnectAttempts = 200,
+    RestartInterval = 1000,             // ms before an exited worker is restarted
+    QueueTimeout = 30000,               // ms a request waits for a worker if no timeout is set
+    QueueCheckInterval = 250
+};
+
+static QByteArray qxtGatewayStatusMessage(int status)
+{
+    switch (status)
+    {
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default: return "Internal Server Error";
+    }
+}
+
+QxtWebCgiServicePrivate::QxtWebCgiServicePrivate()
+    : timeout(0), timeoutOverride(false), baseEnvironmentReady(false),
+      poolSize(0), maximumQueueLength(64), workerSerial(0), socketDir(0), busyWorkers(0), servedRequests(0), rejectedRequests(0)
+{
+    poolArguments << "-b" << "%1";
+    queueTimer.setInterval(QueueCheckInterval);
+    QObject::connect(&queueTimer, SIGNAL(timeout()), this, SLOT(expireQueue()));
+}
+
+QxtWebCgiServicePrivate::~QxtWebCgiServicePrivate()
+{
+    stopPool(false);
+    while (!queue.isEmpty())
+        delete queue.dequeue();
+}
 
 #if QT_VERSION < QT_VERSION_CHECK(5,0,0)
 #define qxtEncodedQuery encodedQuery()
@@ -162,11 +214,175 @@ void QxtWebCgiService::setTimeoutOverride(bool enable)
     qxt_d().timeoutOverride = enable;
 }
 
+/*!
+ * Returns the number of persistent worker processes.
+ *
+ * \sa setPoolSize()
+ */
+int QxtWebCgiService::poolSize() const
+{
+    return qxt_d().poolSize;
+}
+
+/*!
+ * Sets the number of persistent worker processes to \a workers.
+ *
+ * When \a workers is 0, a new process is started for every request. This is
+ * the default behavior. Otherwise the workers are started with the first
+ * request and serve requests with the FastCGI protocol; the binary must be
+ * able to act as a FastCGI application listening on the path passed by
+ * poolArguments(). Changing the size of a running pool restarts it, which
+ * fails the requests in progress, so the size should be set before the
+ * service receives requests.
+ *
+ * \sa poolSize(), setPoolArguments(), setMaximumQueueLength()
+ */
+void QxtWebCgiService::setPoolSize(int workers)
+{
+    workers = qMax(0, workers);
+    if (workers == qxt_d().poolSize)
+        return;
+    qxt_d().poolSize = workers;
+    if (qxt_d().workers.isEmpty())
+        return;
+    qxt_d().stopPool(true);
+    if (workers > 0)
+        qxt_d().startPool();
+    else
+        while (!qxt_d().queue.isEmpty())
+        {
+            QxtCgiPoolRequest* request = qxt_d().queue.dequeue();
+            postEvent(new QxtWebErrorEvent(request->info.sessionID, request->info.requestID, 503, "Service Unavailable"));
+            delete request;
+        }
+}
+
+/*!
+ * Returns the command line arguments used to start pooled workers.
+ *
+ * \sa setPoolArguments()
+ */
+QStringList QxtWebCgiService::poolArguments() const
+{
+    return qxt_d().poolArguments;
+}
+
+/*!
+ * Sets the command line \a arguments used to start pooled workers. Every
+ * occurrence of "%1" is replaced with the path of the local socket on which
+ * the worker is expected to accept FastCGI connections.
+ *
+ * The default value is "-b %1", which is understood by php-cgi.
+ *
+ * \sa poolArguments(), setPoolSize()
+ */
+void QxtWebCgiService::setPoolArguments(const QStringList& arguments)
+{
+    qxt_d().poolArguments = arguments;
+}
+
+/*!
+ * Returns the maximum number of requests waiting for a pooled worker.
+ *
+ * \sa setMaximumQueueLength()
+ */
+int QxtWebCgiService::maximumQueueLength() const
+{
+    return qxt_d().maximumQueueLength;
+}
+
+/*!
+ * Sets the maximum number of requests waiting for a pooled worker to
+ * \a length. Requests arriving while the queue is full are answered with
+ * "503 Service Unavailable", so that a slow backend pushes back on clients
+ * instead of accumulating requests.
+ *
+ * The default value is 64.
+ *
+ * \sa maximumQueueLength(), rejectedRequestCount()
+ */
+void QxtWebCgiService::setMaximumQueueLength(int length)
+{
+    qxt_d().maximumQueueLength = qMax(0, length);
+}
+
+/*!
+ * Returns the number of pooled workers currently serving a request.
+ *
+ * \sa poolSize(), queuedRequestCount()
+ */
+int QxtWebCgiService::busyWorkerCount() const
+{
+    return qxt_d().busyWorkers;
+}
+
+/*!
+ * Returns the number of requests waiting for a pooled worker.
+ *
+ * \sa maximumQueueLength(), busyWorkerCount()
+ */
+int QxtWebCgiService::queuedRequestCount() const
+{
+    return qxt_d().queue.count();
+}
+
+/*!
+ * Returns the number of requests completed by pooled workers.
+ */
+qint64 QxtWebCgiService::servedRequestCount() const
+{
+    return qxt_d().servedRequests;
+}
+
+/*!
+ * Returns the number of requests refused because the queue was full.
+ *
+ * \sa setMaximumQueueLength()
+ */
+qint64 QxtWebCgiService::rejectedRequestCount() const
+{
+    return qxt_d().rejectedRequests;
+}
+
 /*!
  * \reimp
  */
 void QxtWebCgiService::pageRequestedEvent(QxtWebRequestEvent* event)
 {
+    if (qxt_d().poolSize > 0)
+    {
+        if (qxt_d().workers.isEmpty())
+            qxt_d().startPool();
+        QxtCgiPoolRequest* request = new QxtCgiPoolRequest(event);
+        request->content = event->content;
+        QMap<QString, QString> env;
+        qxt_d().requestEnvironment(env, event);
+        QMap<QString, QString>::const_iterator env_iter = env.constBegin();
+        for (; env_iter != env.constEnd(); ++env_iter)
+        {
+            QByteArray name = env_iter.key().toLatin1();
+            QByteArray value = env_iter.value().toLatin1();
+            qxtFcgiAppendLength(request->params, name.size());
+            qxtFcgiAppendLength(request->params, value.size());
+            request->params += name;
+            request->params += value;
+        }
+        request->waiting.start();
+        qxt_d().queue.enqueue(request);
+        qxt_d().dispatch();
+        if (qxt_d().queue.count() > qxt_d().maximumQueueLength)
+        {
+            // Every worker is busy and the queue is full
+            request = qxt_d().queue.takeLast();
+            qxt_d().rejectedRequests++;
+            postEvent(new QxtWebErrorEvent(request->info.sessionID, request->info.requestID, 503, "Service Unavailable"));
+            delete request;
+        }
+        if (!qxt_d().queue.isEmpty() && !qxt_d().queueTimer.isActive())
+            qxt_d().queueTimer.start();
+        return;
+    }
+
     // Create the process object and initialize connections
     QProcess* process = new QProcess(this);
     qxt_d().requests[process] = QxtCgiRequestInfo(event);
@@ -179,44 +395,90 @@ void QxtWebCgiService::pageRequestedEvent(QxtWebRequestEvent* event)
     qxt_d().timeoutMapper.setMapping(requestInfo.timeout, process);
     QObject::connect(requestInfo.timeout, SIGNAL(timeout()), &qxt_d().timeoutMapper, SLOT(map()));
 
-    // Initialize the system environment
-    QStringList s_env = process->systemEnvironment();
-    QMap<QString, QString> env;
-    foreach(const QString& entry, s_env)
+    // Start from the system environment, which is only split up once
+    if (!qxt_d().baseEnvironmentReady)
     {
-        int pos = entry.indexOf('=');
-        env[entry.left(pos)] = entry.mid(pos + 1);
+        foreach(const QString& entry, QProcess::systemEnvironment())
+        {
+            int pos = entry.indexOf('=');
+            qxt_d().baseEnvironment[entry.left(pos)] = entry.mid(pos + 1);
+        }
+        // Variables that are only set when they apply to the request
+        static const char* const requestOnly[] = {
+            "SERVER_PROTOCOL", "SERVER_PORT", "REMOTE_HOST", "AUTH_TYPE", "REMOTE_USER",
+            "REMOTE_IDENT", "CONTENT_TYPE", "CONTENT_LENGTH", "HTTP_COOKIE"
+        };
+        for (unsigned i = 0; i < sizeof(requestOnly) / sizeof(requestOnly[0]); i++)
+            qxt_d().baseEnvironment.remove(requestOnly[i]);
+        qxt_d().baseEnvironmentReady = true;
     }
+    QMap<QString, QString> env = qxt_d().baseEnvironment;
+    qxt_d().requestEnvironment(env, event);
 
+    // Load environment into process space
+    QStringList p_env;
+    p_env.reserve(env.size());
+    QMap<QString, QString>::iterator env_iter = env.begin();
+    while (env_iter != env.end())
+    {
+        p_env << env_iter.key() + '=' + env_iter.value();
+        env_iter++;
+    }
+    process->setEnvironment(p_env);
+
+    // Launch process
+    if (event->url.hasQuery() && event->url.qxtEncodedQuery.contains('='))
+    {
+        // CGI/1.1 spec says to pass the query on the command line if there's no embedded = sign
+#if QT_VERSION < QT_VERSION_CHECK(5,0,0)
+        QByteArray EncodedQuery = event->url.qxtEncodedQuery;
+#else
+        QByteArray EncodedQuery = event->url.qxtEncodedQuery.toLatin1();
+#endif
+        process->start(qxt_d().binary + ' ' + QUrl::fromPercentEncoding(EncodedQuery), QIODevice::ReadWrite);
+    }
+    else
+    {
+        process->start(qxt_d().binary, QIODevice::ReadWrite);
+    }
+
+    // Start the timeout
+    if(qxt_d().timeout > 0)
+    {
+        requestInfo.timeout->start(qxt_d().timeout);
+    }
+
+    // Transmit POST data
+    if (event->content)
+    {
+        QObject::connect(event->content, SIGNAL(readyRead()), &qxt_d(), SLOT(browserReadyRead()));
+        qxt_d().browserReadyRead(event->content);
+    }
+}
+
+/*!
+ * \internal
+ * Adds the CGI/1.1 variables describing \a event to \a env.
+ */
+void QxtWebCgiServicePrivate::requestEnvironment(QMap<QString, QString>& env, QxtWebRequestEvent* event)
+{
     // Populate CGI/1.1 environment variables
     env["SERVER_SOFTWARE"] = QString("QxtWeb/" QXT_VERSION_STR);
     env["SERVER_NAME"] = event->url.host();
     env["GATEWAY_INTERFACE"] = "CGI/1.1";
     if (event->headers.contains("X-Request-Protocol"))
         env["SERVER_PROTOCOL"] = event->headers.value("X-Request-Protocol");
-    else
-        env.remove("SERVER_PROTOCOL");
     if (event->url.port() != -1)
         env["SERVER_PORT"] = QString::number(event->url.port());
-    else
-        env.remove("SERVER_PORT");
     env["REQUEST_METHOD"] = event->method;
     env["PATH_INFO"] = event->url.path();
     env["PATH_TRANSLATED"] = event->url.path(); // CGI/1.1 says we should resolve this, but we have no logical interpretation
     env["SCRIPT_NAME"] = event->originalUrl.path().remove(QRegExp(QRegExp::escape(event->url.path()) + '$'));
-    env["SCRIPT_FILENAME"] = qxt_d().binary;    // CGI/1.1 doesn't define this but PHP demands it
-    env.remove("REMOTE_HOST");
+    env["SCRIPT_FILENAME"] = binary;    // CGI/1.1 doesn't define this but PHP demands it
     env["REMOTE_ADDR"] = event->remoteAddress.toString();
-    // TODO: If we ever support HTTP authentication, we should use these
-    env.remove("AUTH_TYPE");
-    env.remove("REMOTE_USER");
-    env.remove("REMOTE_IDENT");
-    if (event->contentType.isEmpty())
-    {
-        env.remove("CONTENT_TYPE");
-        env.remove("CONTENT_LENGTH");
-    }
-    else
+    // TODO: If we ever support HTTP authentication, we should set AUTH_TYPE,
+    // REMOTE_USER and REMOTE_IDENT
+    if (!event->contentType.isEmpty())
     {
         env["CONTENT_TYPE"] = event->contentType;
         env["CONTENT_LENGTH"] = QString::number(event->content->unreadBytes());
@@ -246,45 +508,6 @@ void QxtWebCgiService::pageRequestedEvent(QxtWebRequestEvent* event)
     }
     if (!cookies.isEmpty())
         env["HTTP_COOKIE"] = cookies;
-
-    // Load environment into process space
-    QStringList p_env;
-    QMap<QString, QString>::iterator env_iter = env.begin();
-    while (env_iter != env.end())
-    {
-        p_env << env_iter.key() + '=' + env_iter.value();
-        env_iter++;
-    }
-    process->setEnvironment(p_env);
-
-    // Launch process
-    if (event->url.hasQuery() && event->url.qxtEncodedQuery.contains('='))
-    {
-        // CGI/1.1 spec says to pass the query on the command line if there's no embedded = sign
-#if QT_VERSION < QT_VERSION_CHECK(5,0,0)
-        QByteArray EncodedQuery = event->url.qxtEncodedQuery;
-#else
-        QByteArray EncodedQuery = event->url.qxtEncodedQuery.toLatin1();
-#endif
-        process->start(qxt_d().binary + ' ' + QUrl::fromPercentEncoding(EncodedQuery), QIODevice::ReadWrite);
-    }
-    else
-    {
-        process->start(qxt_d().binary, QIODevice::ReadWrite);
-    }
-
-    // Start the timeout
-    if(qxt_d().timeout > 0)
-    {
-        requestInfo.timeout->start(qxt_d().timeout);
-    }
-
-    // Transmit POST data
-    if (event->content)
-    {
-        QObject::connect(event->content, SIGNAL(readyRead()), &qxt_d(), SLOT(browserReadyRead()));
-        qxt_d().browserReadyRead(event->content);
-    }
 }
 
 /*!
@@ -316,89 +539,101 @@ void QxtWebCgiServicePrivate::processReadyRead()
     QProcess* process = static_cast<QProcess*>(sender());
     QxtCgiRequestInfo& request = requests[process];
 
-    QByteArray line;
     while (process->canReadLine())
     {
         // Read in a CGI/1.1 header line
-        line = process->readLine().replace(QByteArray("\r"), ""); //krazy:exclude=doublequote_chars
-        if (line == "\n")
+        if (headerLine(request, process->readLine(), process))
         {
-            // An otherwise-empty line indicates the end of CGI/1.1 headers and the start of content
             QObject::disconnect(process, SIGNAL(readyRead()), this, 0);
-            QxtWebPageEvent* event = 0;
-            int code = 200;
-            if (request.headers.contains("status"))
-            {
-                // CGI/1.1 defines a "Status:" header that dictates the HTTP response code
-                code = request.headers["status"].left(3).toInt();
-                if (code >= 300 && code < 400)  // redirect
-                {
-                    event = new QxtWebRedirectEvent(request.sessionID, request.requestID, request.headers["location"], code);
-                }
-            }
-            // If a previous header (currently just status) hasn't created an event, create a normal page event here
-            if (!event)
-            {
-                event = new QxtWebPageEvent(request.sessionID, request.requestID, process);
-                event->status = code;
-            }
-            // Add other response headers passed from CGI (currently only Content-Type is supported)
-            if (request.headers.contains("content-type"))
-                event->contentType = request.headers["content-type"].toUtf8();
-            // TODO: QxtWeb doesn't support transmitting arbitrary HTTP headers right now, but it may be desirable
-            // for applications that know what kind of server frontend they're using to allow scripts to send
-            // protocol-specific headers.
-            
-            // Post the event
-            qxt_p().postEvent(event);
-            request.eventSent = true;
             return;
         }
-        else
+    }
+}
+
+/*!
+ * \internal
+ * Handles one CGI/1.1 header \a line of the response to \a request. At the
+ * end of the headers, the response event is posted with \a source as its
+ * data source and true is returned.
+ */
+bool QxtWebCgiServicePrivate::headerLine(QxtCgiRequestInfo& request, QByteArray line, QIODevice* source)
+{
+    line.replace(QByteArray("\r"), ""); //krazy:exclude=doublequote_chars
+    if (line == "\n")
+    {
+        // An otherwise-empty line indicates the end of CGI/1.1 headers and the start of content
+        QxtWebPageEvent* event = 0;
+        int code = 200;
+        if (request.headers.contains("status"))
         {
-            // Since we haven't reached the end of headers yet, parse a header
-            int pos = line.indexOf(": ");
-            QByteArray hdrName = line.left(pos).toLower();
-            QByteArray hdrValue = line.mid(pos + 2).replace(QByteArray("\n"), ""); //krazy:exclude=doublequote_chars
-            if (hdrName == "set-cookie")
+            // CGI/1.1 defines a "Status:" header that dictates the HTTP response code
+            code = request.headers["status"].left(3).toInt();
+            if (code >= 300 && code < 400)  // redirect
             {
-                // Parse a new cookie and post an event to send it to the client
-                QList<QByteArray> cookies = hdrValue.split(',');
-                foreach(const QByteArray& cookie, cookies)
-                {
-                    int equals = cookie.indexOf("=");
-                    int semi = cookie.indexOf(";");
-                    QByteArray cookieName = cookie.left(equals);
-                    int age = cookie.toLower().indexOf("max-age=", semi);
-                    int secs = -1;
-                    if (age >= 0)
-                        secs = cookie.mid(age + 8, cookie.indexOf(";", age) - age - 8).toInt();
-                    if (secs == 0)
-                    {
-                        qxt_p().postEvent(new QxtWebRemoveCookieEvent(request.sessionID, cookieName));
-                    }
-                    else
-                    {
-                        QByteArray cookieValue = cookie.mid(equals + 1, semi - equals - 1);
-                        QDateTime cookieExpires;
-                        if (secs != -1)
-                            cookieExpires = QDateTime::currentDateTime().addSecs(secs);
-                        qxt_p().postEvent(new QxtWebStoreCookieEvent(request.sessionID, cookieName, cookieValue, cookieExpires));
-                    }
-                }
+                event = new QxtWebRedirectEvent(request.sessionID, request.requestID, request.headers["location"], code);
             }
-            else if(hdrName == "x-qxtweb-timeout")
+        }
+        // If a previous header (currently just status) hasn't created an event, create a normal page event here
+        if (!event)
+        {
+            event = new QxtWebPageEvent(request.sessionID, request.requestID, source);
+            event->status = code;
+        }
+        // Add other response headers passed from CGI (currently only Content-Type is supported)
+        if (request.headers.contains("content-type"))
+            event->contentType = request.headers["content-type"].toUtf8();
+        // TODO: QxtWeb doesn't support transmitting arbitrary HTTP headers right now, but it may be desirable
+        // for applications that know what kind of server frontend they're using to allow scripts to send
+        // protocol-specific headers.
+
+        // Post the event
+        qxt_p().postEvent(event);
+        request.eventSent = true;
+        return true;
+    }
+
+    // Since we haven't reached the end of headers yet, parse a header
+    int pos = line.indexOf(": ");
+    QByteArray hdrName = line.left(pos).toLower();
+    QByteArray hdrValue = line.mid(pos + 2).replace(QByteArray("\n"), ""); //krazy:exclude=doublequote_chars
+    if (hdrName == "set-cookie")
+    {
+        // Parse a new cookie and post an event to send it to the client
+        QList<QByteArray> cookies = hdrValue.split(',');
+        foreach(const QByteArray& cookie, cookies)
+        {
+            int equals = cookie.indexOf("=");
+            int semi = cookie.indexOf(";");
+            QByteArray cookieName = cookie.left(equals);
+            int age = cookie.toLower().indexOf("max-age=", semi);
+            int secs = -1;
+            if (age >= 0)
+                secs = cookie.mid(age + 8, cookie.indexOf(";", age) - age - 8).toInt();
+            if (secs == 0)
             {
-                if(timeoutOverride)
-                    request.timeout->setInterval(hdrValue.toInt());
+                qxt_p().postEvent(new QxtWebRemoveCookieEvent(request.sessionID, cookieName));
             }
             else
             {
-                // Store other headers for later inspection
-                request.headers[hdrName] = hdrValue;
+                QByteArray cookieValue = cookie.mid(equals + 1, semi - equals - 1);
+                QDateTime cookieExpires;
+                if (secs != -1)
+                    cookieExpires = QDateTime::currentDateTime().addSecs(secs);
+                qxt_p().postEvent(new QxtWebStoreCookieEvent(request.sessionID, cookieName, cookieValue, cookieExpires));
             }
         }
     }
+    else if(hdrName == "x-qxtweb-timeout")
+    {
+        if(timeoutOverride && request.timeout)
+            request.timeout->setInterval(hdrValue.toInt());
+    }
+    else
+    {
+        // Store other headers for later inspection
+        request.headers[hdrName] = hdrValue;
+    }
+    return false;
 }
 
 /*!
@@ -443,3 +678,352 @@ void QxtWebCgiServicePrivate::terminateProcess(QObject* o_process)
         request.terminateSent = true;
     }
 }
+
+/*!
+ * \internal
+ */
+void QxtWebCgiServicePrivate::startPool()
+{
+    // The sockets live in a directory only this process can enter, so no
+    // other user can predict, occupy or replace their paths
+    if (!socketDir)
+        socketDir = new QTemporaryDir(QDir(QDir::tempPath()).filePath("qxtcgi-XXXXXX"));
+    if (!socketDir->isValid())
+    {
+        qWarning() << "QxtWebCgiService: unable to create a directory for worker sockets";
+        return;
+    }
+    for (int i = workers.count(); i < poolSize; i++)
+    {
+        QxtCgiWorker* worker = new QxtCgiWorker(this, workerSerial++);
+        workers << worker;
+        worker->start();
+    }
+}
+
+/*!
+ * \internal
+ */
+void QxtWebCgiServicePrivate::stopPool(bool failRequests)
+{
+    QList<QxtCgiWorker*> stopping = workers;
+    workers.clear();
+    if (failRequests)
+    {
+        foreach(QxtCgiWorker* worker, stopping)
+            worker->cancel();
+    }
+    qDeleteAll(stopping);
+    busyWorkers = 0;
+    delete socketDir;
+    socketDir = 0;
+}
+
+/*!
+ * \internal
+ * Answers the requests that have waited too long for a worker.
+ */
+void QxtWebCgiServicePrivate::expireQueue()
+{
+    qint64 limit = timeout > 0 ? timeout : QueueTimeout;
+    while (!queue.isEmpty() && queue.head()->waiting.hasExpired(limit))
+    {
+        QxtCgiPoolRequest* request = queue.dequeue();
+        postEvent(new QxtWebErrorEvent(request->info.sessionID, request->info.requestID, 504, "Gateway Timeout"));
+        delete request;
+    }
+    if (queue.isEmpty())
+        queueTimer.stop();
+}
+
+/*!
+ * \internal
+ * Hands queued requests to idle workers.
+ */
+void QxtWebCgiServicePrivate::dispatch()
+{
+    foreach(QxtCgiWorker* worker, workers)
+    {
+        if (queue.isEmpty())
+            return;
+        if (worker->isIdle())
+            worker->dispatch(queue.dequeue());
+    }
+}
+
+void QxtCgiResponseBuffer::finish()
+{
+    // Queued behind the readyRead() notifications of the data written so far
+    QMetaObject::invokeMethod(this, "aboutToClose", Qt::QueuedConnection);
+}
+
+QxtCgiWorker::QxtCgiWorker(QxtWebCgiServicePrivate* service, int index)
+    : QObject(service), service(service), process(new QProcess(this)), socket(new QLocalSocket(this)),
+      index(index), starts(0), offset(0), connectAttempts(0), stdinClosed(false), current(0)
+{
+    timer.setSingleShot(true);
+    process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    QObject::connect(&timer, SIGNAL(timeout()), this, SLOT(requestTimeout()));
+    QObject::connect(process, SIGNAL(stateChanged(QProcess::ProcessState)), this, SLOT(processStateChanged(QProcess::ProcessState)));
+    QObject::connect(socket, SIGNAL(connected()), this, SLOT(socketConnected()));
+    QObject::connect(socket, SIGNAL(error(QLocalSocket::LocalSocketError)), this, SLOT(socketError()));
+    QObject::connect(socket, SIGNAL(readyRead()), this, SLOT(readRecords()));
+}
+
+QxtCgiWorker::~QxtCgiWorker()
+{
+    process->disconnect(this);
+    socket->disconnect(this);
+    if (current)
+    {
+        // The service is going away; nobody is left to answer the request
+        if (!current->info.eventSent)
+            delete current->response;
+        else if (current->response)
+            current->response->finish();
+        delete current;
+    }
+    socket->abort();
+    process->kill();
+    process->waitForFinished(1000);
+}
+
+void QxtCgiWorker::start()
+{
+    if (process->state() != QProcess::NotRunning || !service->socketDir)
+        return;
+    // Every start gets a fresh socket name, so a socket left behind by a
+    // worker that died is never reused
+    path = service->socketDir->filePath(QString("%1-%2.sock").arg(index).arg(starts++));
+    buffer.clear();
+    offset = 0;
+    connectAttempts = 0;
+    QStringList arguments;
+    foreach(const QString& argument, service->poolArguments)
+        arguments << QString(argument).replace("%1", path);
+    process->start(service->binary, arguments);
+    QTimer::singleShot(ConnectRetryInterval, this, SLOT(connectSocket()));
+}
+
+bool QxtCgiWorker::isIdle() const
+{
+    return !current && socket->state() == QLocalSocket::ConnectedState;
+}
+
+void QxtCgiWorker::dispatch(QxtCgiPoolRequest* request)
+{
+    current = request;
+    stdinClosed = false;
+    service->busyWorkers++;
+    request->response = new QxtCgiResponseBuffer;
+
+    QByteArray out;
+    const char begin[8] = { 0, char(FcgiResponder), char(FcgiKeepConn), 0, 0, 0, 0, 0 };
+    qxtFcgiAppendRecords(out, FcgiBeginRequest, PoolRequestId, begin, 8);
+    if (!request->params.isEmpty())
+        qxtFcgiAppendRecords(out, FcgiParams, PoolRequestId, request->params.constData(), request->params.size());
+    qxtFcgiAppendRecords(out, FcgiParams, PoolRequestId, 0, 0);
+    request->params.clear();
+    socket->write(out);
+
+    if (request->content)
+    {
+        QObject::connect(request->content, SIGNAL(readyRead()), this, SLOT(contentReadyRead()));
+        // A body of unknown length ends when its source goes away
+        QObject::connect(request->content, SIGNAL(readChannelFinished()), this, SLOT(contentReadyRead()));
+        QObject::connect(request->content, SIGNAL(destroyed()), this, SLOT(contentReadyRead()));
+    }
+    contentReadyRead();
+    if (service->timeout > 0)
+        timer.start(service->timeout);
+}
+
+void QxtCgiWorker::cancel()
+{
+    if (current)
+        finishRequest(503);
+}
+
+void QxtCgiWorker::connectSocket()
+{
+    if (process->state() == QProcess::Starting)
+    {
+        QTimer::singleShot(ConnectRetryInterval, this, SLOT(connectSocket()));
+        return;
+    }
+    if (process->state() != QProcess::Running)
+        return;
+    connectAttempts++;
+    socket->abort();
+    socket->connectToServer(path);
+}
+
+void QxtCgiWorker::socketConnected()
+{
+    service->dispatch();
+}
+
+void QxtCgiWorker::socketError()
+{
+    if (current)
+    {
+        // The worker went away in the middle of a request
+        qWarning() << "QxtWebCgiService: lost connection to worker:" << socket->errorString();
+        finishRequest(502);
+        process->kill();
+        return;
+    }
+    if (socket->state() == QLocalSocket::ConnectedState || process->state() != QProcess::Running)
+        return;
+    if (connectAttempts < MaximumConnectAttempts)
+    {
+        QTimer::singleShot(ConnectRetryInterval, this, SLOT(connectSocket()));
+        return;
+    }
+    qWarning() << "QxtWebCgiService: worker does not accept connections on" << path;
+    process->kill();
+}
+
+void QxtCgiWorker::readRecords()
+{
+    buffer.append(socket->readAll());
+    while (buffer.size() - offset >= FcgiHeaderSize)
+    {
+        const uchar* header = reinterpret_cast<const uchar*>(buffer.constData()) + offset;
+        int type = header[1];
+        int id = (header[2] << 8) | header[3];
+        int size = (header[4] << 8) | header[5];
+        int padding = header[6];
+        if (buffer.size() - offset < FcgiHeaderSize + size + padding)
+            break;
+        const char* data = buffer.constData() + offset + FcgiHeaderSize;
+        offset += FcgiHeaderSize + size + padding;
+        if (!current || id != PoolRequestId)
+            continue;
+        if (type == FcgiStdout && size > 0)
+        {
+            handleOutput(data, size);
+        }
+        else if (type == FcgiStderr && size > 0)
+        {
+            qWarning() << "QxtWebCgiService:" << QByteArray(data, size).trimmed();
+        }
+        else if (type == FcgiEndRequest)
+        {
+            finishRequest(0);
+            service->dispatch();
+        }
+    }
+    if (offset >= buffer.size())
+    {
+        buffer.clear();
+        offset = 0;
+    }
+    else if (offset > buffer.size() / 2)
+    {
+        buffer.remove(0, offset);
+        offset = 0;
+    }
+}
+
+void QxtCgiWorker::handleOutput(const char* data, int size)
+{
+    if (current->info.eventSent)
+    {
+        if (current->response)
+            current->response->write(data, size);
+        return;
+    }
+    // Collect the CGI headers; whatever follows them is the response body
+    QByteArray& header = current->header;
+    header.append(data, size);
+    int start = 0, end;
+    while ((end = header.indexOf('\n', start)) != -1)
+    {
+        QByteArray line = header.mid(start, end + 1 - start);
+        start = end + 1;
+        if (service->headerLine(current->info, line, current->response))
+        {
+            if (start < header.size() && current->response)
+                current->response->write(header.constData() + start, header.size() - start);
+            header.clear();
+            return;
+        }
+    }
+    header.remove(0, start);
+}
+
+void QxtCgiWorker::contentReadyRead()
+{
+    if (!current || stdinClosed)
+        return;
+    QxtWebContent* content = current->content;
+    QByteArray out;
+    if (content)
+    {
+        QByteArray data = content->readAll();
+        if (!data.isEmpty())
+            qxtFcgiAppendRecords(out, FcgiStdin, PoolRequestId, data.constData(), data.size());
+    }
+    // unreadBytes() is -1 for content that wants all data until its source
+    // disconnects, and drops to what is left unread once it has.
+    if (!content || !content->unreadBytes())
+    {
+        qxtFcgiAppendRecords(out, FcgiStdin, PoolRequestId, 0, 0);
+        stdinClosed = true;
+        if (content)
+            QObject::disconnect(content, 0, this, 0);
+    }
+    if (!out.isEmpty())
+        socket->write(out);
+}
+
+void QxtCgiWorker::processStateChanged(QProcess::ProcessState state)
+{
+    if (state != QProcess::NotRunning)
+        return;
+    if (current)
+        finishRequest(502);
+    socket->abort();
+    if (process->error() == QProcess::FailedToStart)
+        qWarning() << "QxtWebCgiService: unable to start worker" << service->binary;
+    QTimer::singleShot(RestartInterval, this, SLOT(start()));
+}
+
+void QxtCgiWorker::requestTimeout()
+{
+    // A pooled worker cannot be asked to stop a single request, so it is
+    // replaced.
+    if (current)
+        finishRequest(504);
+    process->kill();
+}
+
+/*
+ * Ends the current request; status is 0 if the worker completed it, or the
+ * error to answer with if the response has not started yet.
+ */
+void QxtCgiWorker::finishRequest(int status)
+{
+    QxtCgiPoolRequest* request = current;
+    current = 0;
+    timer.stop();
+    service->busyWorkers--;
+    if (request->content)
+        QObject::disconnect(request->content, 0, this, 0);
+    if (!request->info.eventSent)
+    {
+        // The worker failed before producing a response
+        if (!status)
+            status = 502;
+        service->postEvent(new QxtWebErrorEvent(request->info.sessionID, request->info.requestID, status, qxtGatewayStatusMessage(status)));
+        delete request->response;
+    }
+    else if (request->response)
+    {
+        request->response->finish();
+    }
+    if (!status)
+        service->servedRequests++;
+    delete request;
+}
@@ -33,6 +33,7 @@
 #define QXTWEBCGISERVICE_H
 
 #include <QObject>
+#include <QStringList>
 #include <qxtglobal.h>
 #include "qxtabstractwebsessionmanager.h"
 #include "qxtabstractwebservice.h"
@@ -55,6 +56,20 @@ public:
     bool timeoutOverride() const;
     void setTimeoutOverride(bool enable);
 
+    int poolSize() const;
+    void setPoolSize(int workers);
+
+    QStringList poolArguments() const;
+    void setPoolArguments(const QStringList& arguments);
+
+    int maximumQueueLength() const;
+    void setMaximumQueueLength(int length);
+
+    int busyWorkerCount() const;
+    int queuedRequestCount() const;
+    qint64 servedRequestCount() const;
+    qint64 rejectedRequestCount() const;
+
     virtual void pageRequestedEvent(QxtWebRequestEvent* event);
 
 private:
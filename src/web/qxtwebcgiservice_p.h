@@ -33,15 +33,25 @@
 #define QXTWEBCGISERVICE_P_H
 
 #include "qxtwebcgiservice.h"
+#include <qxtfifo.h>
 #include <QString>
+#include <QStringList>
 #include <QHash>
+#include <QMap>
 #include <QPair>
+#include <QPointer>
+#include <QQueue>
 #include <QTimer>
 #include <QSignalMapper>
+#include <QProcess>
+#include <QElapsedTimer>
 
 #ifndef QXT_DOXYGEN_RUN
-QT_FORWARD_DECLARE_CLASS(QProcess)
+QT_FORWARD_DECLARE_CLASS(QLocalSocket)
+QT_FORWARD_DECLARE_CLASS(QTemporaryDir)
 class QxtWebContent;
+class QxtWebEvent;
+class QxtCgiWorker;
 
 struct QxtCgiRequestInfo
 {
@@ -53,11 +63,38 @@ struct QxtCgiRequestInfo
     QTimer* timeout;
 };
 
+/*
+ * The response body of a pooled request. The worker finishes it when the
+ * backend completes the request; the data stays readable, but the session
+ * manager sees aboutToClose() and ends the response once it is drained.
+ */
+class QxtCgiResponseBuffer : public QxtFifo
+{
+    Q_OBJECT
+public:
+    QxtCgiResponseBuffer(QObject* parent = 0) : QxtFifo(parent) {}
+    void finish();
+};
+
+struct QxtCgiPoolRequest
+{
+    QxtCgiPoolRequest(QxtWebRequestEvent* req) : info(req), response(0) {}
+
+    QxtCgiRequestInfo info;
+    QByteArray params;                          // FastCGI name-value pairs
+    QPointer<QxtWebContent> content;
+    QByteArray header;                          // response data up to the end of the CGI headers
+    QPointer<QxtCgiResponseBuffer> response;
+    QElapsedTimer waiting;                      // started when the request is queued
+};
+
 class QxtWebCgiServicePrivate : public QObject, public QxtPrivate<QxtWebCgiService>
 {
     Q_OBJECT
 public:
     QXT_DECLARE_PUBLIC(QxtWebCgiService)
+    QxtWebCgiServicePrivate();
+    ~QxtWebCgiServicePrivate();
 
     QHash<QProcess*, QxtCgiRequestInfo> requests;
     QHash<QxtWebContent*, QProcess*> processes;
@@ -66,12 +103,85 @@ public:
     bool timeoutOverride;
     QSignalMapper timeoutMapper;
 
+    // The process environment without the request variables, built once.
+    QMap<QString, QString> baseEnvironment;
+    bool baseEnvironmentReady;
+
+    int poolSize;
+    QStringList poolArguments;
+    int maximumQueueLength;
+    QList<QxtCgiWorker*> workers;
+    int workerSerial;
+    QTemporaryDir* socketDir;                   // private to the pool; holds the worker sockets
+    QQueue<QxtCgiPoolRequest*> queue;
+    QTimer queueTimer;
+    int busyWorkers;
+    qint64 servedRequests;
+    qint64 rejectedRequests;
+
+    void requestEnvironment(QMap<QString, QString>& env, QxtWebRequestEvent* event);
+    bool headerLine(QxtCgiRequestInfo& request, QByteArray line, QIODevice* source);
+    void startPool();
+    void stopPool(bool failRequests);
+    void dispatch();
+    inline void postEvent(QxtWebEvent* event)
+    {
+        qxt_p().postEvent(event);
+    }
+
 public Q_SLOTS:
     void browserReadyRead(QObject* o_content = 0);
     void processReadyRead();
     void processFinished();
     void terminateProcess(QObject* o_process);
+    void expireQueue();
+};
+
+/*
+ * A persistent backend process of the pool. The process is started with a
+ * socket path on its command line and serves requests over it with FastCGI,
+ * one at a time, without being restarted between them.
+ */
+class QxtCgiWorker : public QObject
+{
+    Q_OBJECT
+public:
+    QxtCgiWorker(QxtWebCgiServicePrivate* service, int index);
+    ~QxtCgiWorker();
+
+    bool isIdle() const;
+    void dispatch(QxtCgiPoolRequest* request);
+    void cancel();
+
+public Q_SLOTS:
+    void start();
+
+private Q_SLOTS:
+    void connectSocket();
+    void socketConnected();
+    void socketError();
+    void readRecords();
+    void contentReadyRead();
+    void processStateChanged(QProcess::ProcessState state);
+    void requestTimeout();
+
+private:
+    void handleOutput(const char* data, int size);
+    void finishRequest(int status);
+
+    QxtWebCgiServicePrivate* service;
+    QProcess* process;
+    QLocalSocket* socket;
+    QTimer timer;
+    int index;
+    int starts;
+    QString path;
+    QByteArray buffer;
+    int offset;
+    int connectAttempts;
+    bool stdinClosed;
+    QxtCgiPoolRequest* current;
 };
 #endif // QXT_DOXYGEN_RUN
 
-#endif // QXTWEBSERVICEDIRECTORY_P_H
+#endif // QXTWEBCGISERVICE_P_H
@@ -51,6 +51,10 @@ QxtWeb uses QxtWebContent as an abstraction for streaming data.
 #include <QUrl>
 #include <QCoreApplication>
 #include <QThread>
+#include <QEventLoop>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QPointer>
 
 #if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
 #include <QUrlQuery>
@@ -60,7 +64,7 @@ QxtWeb uses QxtWebContent as an abstraction for streaming data.
 class QxtWebContentPrivate : public QxtPrivate<QxtWebContent>
 {
 public:
-  QxtWebContentPrivate() : bytesNeeded(0), ignoreRemaining(false) {
+  QxtWebContentPrivate() : bytesNeeded(0), ignoreRemaining(false), sourceGone(false), received(0), maximumSize(0) {
 #ifdef QXT_HAVE_WEBSOCKETS
     webSocket = nullptr;
 #endif
@@ -76,10 +80,15 @@ public:
       Q_ASSERT(bytesNeeded >= 0);
     }
     if (device) {
+      source = device;
       // Connect a disconnected signal if it has one
       if (device->metaObject()->indexOfSignal(QMetaObject::normalizedSignature(SIGNAL(disconnected()))) >= 0) {
         QObject::connect(device, SIGNAL(disconnected()), &qxt_p(), SLOT(sourceDisconnect()), Qt::QueuedConnection);
+        // Also delivered directly, so that a thread blocked in
+        // waitForAllContent() notices the disconnect.
+        QObject::connect(device, SIGNAL(disconnected()), &qxt_p(), SLOT(sourceGone()), Qt::DirectConnection);
       }
+      QObject::connect(device, SIGNAL(destroyed()), &qxt_p(), SLOT(sourceGone()), Qt::DirectConnection);
       // Likewise, connect an error signal if it has one
       if (device->metaObject()->indexOfSignal(QMetaObject::normalizedSignature(SIGNAL(error(QAbstractSocket::SocketError)))) >= 0) {
         QObject::connect(device, SIGNAL(error(QAbstractSocket::SocketError)), &qxt_p(), SLOT(errorReceived(QAbstractSocket::SocketError)));
@@ -87,8 +96,22 @@ public:
     }
   }
 
+  void wake()
+  {
+    if (bytesNeeded == 0 || ignoreRemaining)
+      waitCondition.wakeAll();
+  }
+
   qint64 bytesNeeded;
   bool ignoreRemaining;
+  bool sourceGone;
+  qint64 received;
+  qint64 maximumSize;
+  QPointer<QIODevice> source;
+
+  // Guards the fields above against a thread waiting for the content
+  QMutex waitLock;
+  QWaitCondition waitCondition;
 
 #ifdef QXT_HAVE_WEBSOCKETS
   QWebSocket* webSocket;
@@ -205,6 +228,7 @@ qint64 QxtWebContent::writeData(const char *data, qint64 maxSize)
     if(maxSize > 0) {
 	// This must match the QxtFifo implementation for consistency
         if(maxSize > INT_MAX) maxSize = INT_MAX; // qint64 could easily exceed QAtomicInt, so let's play it safe
+	QMutexLocker locker(&qxt_d().waitLock);
 	if(qxt_d().bytesNeeded >= 0){
 	    if(maxSize > qxt_d().bytesNeeded){
 		qWarning("QxtWebContent(): size=%lld needed %lld", maxSize,
@@ -213,15 +237,61 @@ qint64 QxtWebContent::writeData(const char *data, qint64 maxSize)
 	    }
 	    qxt_d().bytesNeeded -= maxSize;
 	    Q_ASSERT(qxt_d().bytesNeeded >= 0);
+	    if(qxt_d().bytesNeeded == 0 && !qxt_d().ignoreRemaining)
+		QMetaObject::invokeMethod(this, "readChannelFinished", Qt::QueuedConnection);
 	}
-	if(qxt_d().ignoreRemaining)
+	if(qxt_d().ignoreRemaining){
+	    qxt_d().wake();
 	    return maxSize;
+	}
+	qxt_d().received += maxSize;
+	if(qxt_d().maximumSize > 0 && qxt_d().received > qxt_d().maximumSize){
+	    // Over budget: drop the rest of the body
+	    setErrorString(QLatin1String("Request entity too large"));
+	    qxt_d().ignoreRemaining = true;
+	    qxt_d().wake();
+	    QMetaObject::invokeMethod(this, "readChannelFinished", Qt::QueuedConnection);
+	    return maxSize;
+	}
+	qxt_d().wake();
+	locker.unlock();
 	return QxtFifo::writeData(data, maxSize);
     }
     // Error
     return -1;
 }
 
+/*!
+ * Returns the largest number of bytes of content that will be accepted, or
+ * \bold 0 if the content size is not limited.
+ * \sa setMaximumSize()
+ */
+qint64 QxtWebContent::maximumSize() const
+{
+    return qxt_d().maximumSize;
+}
+
+/*!
+ * Limits the content to \a bytes; \bold 0 removes the limit.
+ *
+ * If the announced content length already exceeds the limit, the content is
+ * discarded as it arrives. If the content size is not known in advance,
+ * data beyond the limit is discarded, errorString() reports the problem and
+ * readChannelFinished() is emitted.
+ *
+ * \sa QxtHttpSessionManager::setMaximumContentLength()
+ */
+void QxtWebContent::setMaximumSize(qint64 bytes)
+{
+    QMutexLocker locker(&qxt_d().waitLock);
+    qxt_d().maximumSize = qMax(Q_INT64_C(0), bytes);
+    if (qxt_d().maximumSize > 0 && !wantAll() && bytesAvailable() + qxt_d().bytesNeeded > qxt_d().maximumSize) {
+        setErrorString(QLatin1String("Request entity too large"));
+        qxt_d().ignoreRemaining = true;
+        qxt_d().wake();
+    }
+}
+
 /*!
  * \internal
  */
@@ -233,22 +303,35 @@ void QxtWebContent::errorReceived(QAbstractSocket::SocketError)
 }
 
 /*!
- *  Blocks until all of the streaming data has been read from the browser.
+ *  Blocks until all of the streaming data has been received from the browser,
+ *  or until the connection is closed.
  *
- *  Note that this method effectively runs a tight event loop. Although it
- *  will not block a thread's other activities, it may result in high CPU
- *  consumption and cause performance problems. It is suggested that you
- *  avoid use of this method and try to implement services using the
- *  readChannelFinished() signal instead.
+ *  If the data arrives through the calling thread, a local event loop runs
+ *  until it is complete; otherwise the calling thread sleeps until the
+ *  thread that receives the data wakes it up. It is still preferable to
+ *  implement services using the readChannelFinished() signal instead.
  */
 void QxtWebContent::waitForAllContent()
 {
-    while(qxt_d().bytesNeeded != 0 && !qxt_d().ignoreRemaining){
-	// Still need data ... yield processing
-	if(QCoreApplication::hasPendingEvents())
-	    QCoreApplication::processEvents();
-	if(this->thread() != QThread::currentThread())
-	    QThread::yieldCurrentThread();
+    QxtWebContentPrivate& d = qxt_d();
+    QMutexLocker locker(&d.waitLock);
+    if (d.bytesNeeded == 0 || d.ignoreRemaining || d.sourceGone) return;
+    if (d.source && d.source->thread() == QThread::currentThread()) {
+        // The data is delivered by this thread's event loop
+        locker.unlock();
+        QEventLoop loop;
+        connect(this, SIGNAL(readChannelFinished()), &loop, SLOT(quit()));
+        connect(d.source, SIGNAL(destroyed()), &loop, SLOT(quit()));
+        if (d.source->metaObject()->indexOfSignal(QMetaObject::normalizedSignature(SIGNAL(disconnected()))) >= 0)
+            connect(d.source, SIGNAL(disconnected()), &loop, SLOT(quit()));
+        loop.exec();
+        return;
+    }
+    while (d.bytesNeeded != 0 && !d.ignoreRemaining && !d.sourceGone)
+        d.waitCondition.wait(&d.waitLock);
+    if (d.sourceGone) {
+        locker.unlock();
+        sourceDisconnect();
     }
 }
 
@@ -260,10 +343,12 @@ void QxtWebContent::waitForAllContent()
  */
 void QxtWebContent::ignoreRemainingContent()
 {
+    QMutexLocker locker(&qxt_d().waitLock);
     if (qxt_d().bytesNeeded == 0) return;
     if(!qxt_d().ignoreRemaining){
 	qxt_d().ignoreRemaining = true;
 	qxt_d().bytesNeeded = 0;
+	qxt_d().wake();
     }
 }
 
@@ -277,16 +362,30 @@ void QxtWebContent::ignoreRemainingContent()
  */
 void QxtWebContent::sourceDisconnect()
 {
+    QMutexLocker locker(&qxt_d().waitLock);
     if (qxt_d().bytesNeeded == 0) return;
     if(!qxt_d().ignoreRemaining){
 	qxt_d().ignoreRemaining = true;
 	qxt_d().bytesNeeded = 0;
+	qxt_d().wake();
 	if(bytesAvailable() != 0)
 	    QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
         QMetaObject::invokeMethod(this, "readChannelFinished", Qt::QueuedConnection);
     }
 }
 
+/*!
+ *  \internal
+ *  Called from the thread of the source device when it disconnects or is
+ *  destroyed; wakes a thread blocked in waitForAllContent().
+ */
+void QxtWebContent::sourceGone()
+{
+    QMutexLocker locker(&qxt_d().waitLock);
+    qxt_d().sourceGone = true;
+    qxt_d().waitCondition.wakeAll();
+}
+
 #ifndef QXT_DOXYGEN_RUN
 typedef QPair<QString, QString> QxtQueryItem;
 #endif
@@ -58,6 +58,9 @@ public:
     qint64 bytesNeeded() const;
     qint64 unreadBytes() const;
 
+    qint64 maximumSize() const;
+    void setMaximumSize(qint64 bytes);
+
     void waitForAllContent();
 
 public Q_SLOTS:
@@ -69,6 +72,7 @@ protected:
 
 private Q_SLOTS:
     void sourceDisconnect();
+    void sourceGone();
     void errorReceived(QAbstractSocket::SocketError);
 
 private:
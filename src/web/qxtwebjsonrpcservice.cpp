@@ -56,6 +56,20 @@ curl -d '{"method":"add", "id":1, "params": [9,2] }' localhost:1339
 {"error":null,"id":1,"result":11}
 \endcode
 
+JSON-RPC 2.0 requests are answered in the 2.0 format. Several calls can be
+sent at once as a batch; the responses come back as an array in the order of
+the batch. Requests without an id are notifications and get no response.
+
+\code
+curl -d '[{"jsonrpc":"2.0", "method":"add", "id":1, "params": [9,2]}, {"jsonrpc":"2.0", "method":"add", "params": [1,1]}]' localhost:1339
+[{"id":1,"jsonrpc":"2.0","result":11}]
+\endcode
+
+Arguments are converted to the parameter types of the slot; a value that
+cannot be converted is answered with an "invalid params" error. The entries of
+a batch can be executed concurrently by setting a thread pool with
+setThreadPool().
+
 \sa QxtAbstractWebService
 */
 
@@ -68,17 +82,71 @@ curl -d '{"method":"add", "id":1, "params": [9,2] }' localhost:1339
 #include <QtCore/QMetaType>
 #include <QtCore/QGenericReturnArgument>
 #include <QtCore/QGenericArgument>
+#include <QtCore/QThreadPool>
+#include <QtCore/QRunnable>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QAtomicInt>
 
 #if QT_VERSION >= QT_VERSION_CHECK(5,0,0)
 #include <QUrlQuery>
 #endif
 
+thread_local QxtWebJsonRPCService::Private::Call *QxtWebJsonRPCService::Private::currentCall = 0;
+
+/*
+ * A batch dispatched to the thread pool. Every task writes the response of
+ * its own entry into a slot reserved up front, so the entries need no lock;
+ * the task that finishes last sends the array in the order of the request.
+ */
+struct QxtWebJsonRPCService::Private::Batch
+{
+    QxtWebJsonRPCService::Private *d;
+    int sessionID;
+    int requestID;
+    QVariantList requests;
+    QVector<QVariant> responses;
+    QAtomicInt remaining;
+};
+
+class QxtWebJsonRPCService::Private::Task : public QRunnable
+{
+public:
+    Task(const QSharedPointer<Batch> &batch, int index, QVariant *response)
+        : batch(batch), index(index), response(response) {}
+
+    void run()
+    {
+        // Entries that have not started when the service goes away are
+        // left out of the response
+        if (!batch->d->cancelled.loadAcquire())
+            *response = batch->d->call(batch->requests.at(index));
+        if (!batch->remaining.deref())
+            batch->d->finishBatch(batch.data());
+    }
+
+private:
+    QSharedPointer<Batch> batch;
+    int index;
+    QVariant *response;
+};
 
 QxtWebJsonRPCService::Private::Private(QxtWebJsonRPCService *that)
     : QObject()
     , p(that)
     , invokable(0)
+    , threadPool(0)
+    , activeBatches(0)
+{
+}
+
+/*
+ * Blocks until every dispatched batch has sent its response.
+ */
+void QxtWebJsonRPCService::Private::waitForBatches()
 {
+    QMutexLocker locker(&batchLock);
+    while (activeBatches > 0)
+        batchDone.wait(&batchLock);
 }
 
 void QxtWebJsonRPCService::Private::initTables(QObject *in)
@@ -90,14 +158,29 @@ void QxtWebJsonRPCService::Private::initTables(QObject *in)
         QxtWebJsonRPCService::Private::Method method;
         QMetaMethod mo = po->method (i);
 #if QT_VERSION >=  0x50000
-        method.name = QByteArray(mo.methodSignature()).split('(').at(0);
+        QByteArray name = QByteArray(mo.methodSignature()).split('(').at(0);
 #else
-        method.name = QByteArray(mo.signature()).split('(').at(0);
+        QByteArray name = QByteArray(mo.signature()).split('(').at(0);
 #endif
+        // QMetaMethod::invoke() takes at most ten arguments and every value
+        // has to be constructible from its type id
+        if (mo.parameterCount() > 10)
+            continue;
         method.meta = mo;
-        method.argCount = mo.parameterTypes ().count();
-        method.returns = QByteArray(mo.typeName()).count();
-        methods.insert(method.name + QByteArray::number(method.argCount), method);
+        method.returnType = mo.returnType();
+        if (method.returnType == QMetaType::UnknownType)
+            continue;
+        bool usable = true;
+        for (int j = 0; j < mo.parameterCount(); j++) {
+            int type = mo.parameterType(j);
+            if (type == QMetaType::UnknownType)
+                usable = false;
+            method.parameterTypes.append(type);
+        }
+        if (!usable)
+            continue;
+        method.parameterNames = mo.parameterNames();
+        methods.insert(name + '/' + QByteArray::number(mo.parameterCount()), method);
     }
 }
 
@@ -110,304 +193,237 @@ void QxtWebJsonRPCService::Private::readFinished()
 void QxtWebJsonRPCService::Private::handle(QxtWebContent *c)
 {
     QxtWebRequestEvent *event = content.take(c);
-    currentRequest = 0;
     c->ignoreRemainingContent();
 
-    QString data = QString::fromUtf8(c->readAll());
+    QVariant request = QxtJSON::parseUtf8(c->readAll());
 
-    QVariantMap var = QxtJSON::parse(data).toMap();
+    if (!invokable)
+        initTables(p);
 
-    if (var.isEmpty()) {
+    if (request.userType() == QMetaType::QVariantList) {
+        const QVariantList &batch = *static_cast<const QVariantList *>(request.constData());
+        if (batch.isEmpty()) {
+            Call call = { QVariant(), true, false, QVariant() };
+            reply(event, errorResponse(call, InvalidRequest, "empty batch"));
+            return;
+        }
+        if (threadPool && batch.count() > 1) {
+            dispatch(event, batch);
+            return;
+        }
+        QVariantList responses;
+        foreach (const QVariant &entry, batch) {
+            QVariant res = call(entry);
+            if (res.isValid())
+                responses.append(res);
+        }
+        reply(event, responses.isEmpty() ? QVariant() : QVariant(responses));
+        return;
+    }
+
+    if (request.userType() != QMetaType::QVariantMap || request.toMap().isEmpty()) {
         QByteArray resp = "{\"result\": null, \"error\": \"invalid json data\", \"id\": 0}\r\n";
         QxtWebPageEvent *err = new QxtWebPageEvent(event->sessionID, event->requestID, resp);
         err->status = 500;
         p->postEvent(err);
         return;
     }
-    QVariant rid = var.value("id");
-    QString action = var.value("method").toString();
-    QVariant argsE = var.value("params");
-    handle(event, rid, action, argsE);
+    reply(event, call(request));
 }
 
-void QxtWebJsonRPCService::Private::handle(QxtWebRequestEvent *event, QVariant rid, QString action,  QVariant argsE)
+/*
+ * Executes a single request object and returns its response object, or an
+ * invalid QVariant if the request was a notification.
+ */
+QVariant QxtWebJsonRPCService::Private::call(const QVariant &request)
 {
-    QVariantMap argsM;
-    QVariantList args;
+    Call call = { QVariant(), true, false, QVariant() };
+    if (request.userType() != QMetaType::QVariantMap)
+        return errorResponse(call, InvalidRequest, "invalid request");
+
+    const QVariantMap &var = *static_cast<const QVariantMap *>(request.constData());
+    call.version2 = var.value("jsonrpc").toString() == QLatin1String("2.0");
+    call.id = var.value("id");
+    // in JSON-RPC 2.0 a request without an id does not want an answer
+    bool notification = call.version2 && !var.contains("id");
+
+    QVariant method = var.value("method");
+    QVariant res;
+    if (method.userType() != QMetaType::QString)
+        res = errorResponse(call, InvalidRequest, "invalid request");
+    else
+        res = invoke(call, method.toString(), var.value("params"));
+    return notification ? QVariant() : res;
+}
 
-    if (argsE.type() == QVariant::Map) {
-        argsM = argsE.toMap();
-        args = argsM.values();
+QVariant QxtWebJsonRPCService::Private::invoke(Call &call, const QString &action, const QVariant &argsE)
+{
+    const QVariantMap *argsM = 0;
+    QVariantList args;
+    int argc;
+    if (argsE.userType() == QMetaType::QVariantMap) {
+        argsM = static_cast<const QVariantMap *>(argsE.constData());
+        argc = argsM->count();
     } else {
         args = argsE.toList();
+        argc = args.count();
     }
 
-    if (!invokable)
-        initTables(p);
+    QHash<QByteArray, Method>::const_iterator it = methods.constFind(action.toUtf8() + '/' + QByteArray::number(argc));
+    if (it == methods.constEnd())
+        return errorResponse(call, MethodNotFound, "no such method or incorrect number of arguments");
+    const Method &method = *it;
+
+    QVariant values[10];
+    QGenericArgument argv[10];
+    for (int i = 0; i < argc; i++) {
+        QVariant &value = values[i];
+        value = argsM ? argsM->value(QString::fromUtf8(method.parameterNames.at(i))) : args.at(i);
+        int type = method.parameterTypes.at(i);
+        if (type == QMetaType::QVariant) {
+            argv[i] = QGenericArgument("QVariant", &value);
+            continue;
+        }
+        if (!value.isValid())
+            value = QVariant(type, (const void *)0);
+        else if (value.userType() != type && !value.convert(type))
+            return errorResponse(call, InvalidParams, QString("invalid value for parameter %1").arg(i + 1));
+        argv[i] = QGenericArgument(QMetaType::typeName(type), value.constData());
+    }
 
+    QVariant returnValue;
+    Call *previous = currentCall;
+    currentCall = &call;
+    bool ok;
+    if (method.returnType == QMetaType::Void) {
+        ok = method.meta.invoke(invokable, Qt::DirectConnection,
+                argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6], argv[7], argv[8], argv[9]);
+    } else if (method.returnType == QMetaType::QVariant) {
+        ok = method.meta.invoke(invokable, Qt::DirectConnection, QGenericReturnArgument("QVariant", &returnValue),
+                argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6], argv[7], argv[8], argv[9]);
+    } else {
+        returnValue = QVariant(method.returnType, (const void *)0);
+        ok = method.meta.invoke(invokable, Qt::DirectConnection,
+                QGenericReturnArgument(QMetaType::typeName(method.returnType), returnValue.data()),
+                argv[0], argv[1], argv[2], argv[3], argv[4], argv[5], argv[6], argv[7], argv[8], argv[9]);
+        // the pass through QGenericReturnArgument didn't make it non null.
+        returnValue.data_ptr().is_null = 0;
+    }
+    currentCall = previous;
 
-    if (!methods.contains(action.toUtf8() + QByteArray::number(args.count()))) {
+    if (!ok)
+        return errorResponse(call, InternalError, "execution failure");
+    if (call.failed) {
         QVariantMap res;
-        res.insert("result", QVariant());
-        res.insert("error", "no such method or incorrect number of arguments");
-        res.insert("id", rid);
-        QxtWebPageEvent *err = new QxtWebPageEvent(event->sessionID, event->requestID,
-                QxtJSON::stringify(res).toUtf8() + "\r\n");
-        p->postEvent(err);
-        return;
-    }
-    Method method = methods.value(action.toUtf8() + QByteArray::number(args.count()));
-    if (argsE.type() == QVariant::Map) {
-        args.clear();
-        foreach (const QString &pname, method.meta.parameterNames ()) {
-            args.append(argsM.value(pname));
+        res.insert("id", call.id);
+        if (call.version2) {
+            QVariant error = call.error;
+            if (error.userType() != QMetaType::QVariantMap || !error.toMap().contains("code")) {
+                QVariantMap object;
+                object.insert("code", int(ServerError));
+                object.insert("message", error.toString());
+                if (error.userType() != QMetaType::QString)
+                    object.insert("data", error);
+                error = object;
+            }
+            res.insert("jsonrpc", QLatin1String("2.0"));
+            res.insert("error", error);
+        } else {
+            res.insert("result", QVariant());
+            res.insert("error", call.error);
         }
+        return res;
     }
+    return response(call, returnValue);
+}
 
-
-    QList<QGenericArgument> vargs;
-    foreach (const QVariant &ar, args) {
-        vargs.append(QGenericArgument(ar.typeName(), ar.data()));
+QVariant QxtWebJsonRPCService::Private::response(const Call &call, const QVariant &result) const
+{
+    QVariantMap res;
+    if (call.version2) {
+        res.insert("jsonrpc", QLatin1String("2.0"));
+    } else {
+        res.insert("error", QVariant());
     }
+    res.insert("result", result);
+    res.insert("id", call.id);
+    return res;
+}
 
-    QVariant returnValue;
-    currentRequest = event;
-    currentRequestId = rid;
-    requestCanceled = false;
-
-    bool ok = false;
-    if (method.returns) {
-        QVariant retA(QVariant::nameToType(method.meta.typeName()));
-        QGenericReturnArgument ret(retA.typeName(), retA.data());
-        if (args.count() > 8)
-        {
-            ok = method.meta.invoke(invokable,
-                    ret,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4)),
-                    (vargs.at(5)),
-                    (vargs.at(6)),
-                    (vargs.at(7)),
-                    (vargs.at(7))
-                    );
-        }
-        if (args.count() > 7)
-        {
-            ok = method.meta.invoke(invokable,
-                    ret,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4)),
-                    (vargs.at(5)),
-                    (vargs.at(6)),
-                    (vargs.at(7))
-                    );
-        }
-        else if (args.count() > 6)
-        {
-            ok = method.meta.invoke(invokable,
-                    ret,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4)),
-                    (vargs.at(5)),
-                    (vargs.at(6))
-                    );
-        }
-        else if (args.count() > 5)
-        {
-            ok = method.meta.invoke(invokable,
-                    ret,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4)),
-                    (vargs.at(5))
-                    );
-        }
-        else if (args.count() > 4)
-        {
-            ok = method.meta.invoke(invokable,
-                    ret,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4))
-                    );
-        }
-        else if (args.count() > 3)
-        {
-            ok = method.meta.invoke(invokable,
-                    ret,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3))
-                    );
-        }
-        else if (args.count() > 2)
-        {
-            ok = method.meta.invoke(invokable,
-                    ret,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2))
-                    );
-        }
-        else if (args.count() > 1)
-        {
-            ok = method.meta.invoke(invokable,
-                    ret,
-                    (vargs.at(0)),
-                    (vargs.at(1))
-                    );
-        }
-        else if (args.count() > 0)
-        {
-            ok = method.meta.invoke(invokable,
-                    ret,
-                    (vargs.at(0))
-                    );
-        }
-        else
-        {
-            ok = method.meta.invoke(invokable,
-                    ret
-                    );
-        }
-        returnValue = retA;
-        // the pass through QGenericReturnArgument didn't make it non null.
-        returnValue.data_ptr().is_null = 0;
+QVariant QxtWebJsonRPCService::Private::errorResponse(const Call &call, int code, const QString &message) const
+{
+    QVariantMap res;
+    if (call.version2) {
+        QVariantMap error;
+        error.insert("code", code);
+        error.insert("message", message);
+        res.insert("jsonrpc", QLatin1String("2.0"));
+        res.insert("error", error);
     } else {
-        if (args.count() > 8)
-        {
-            ok = method.meta.invoke(invokable,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4)),
-                    (vargs.at(5)),
-                    (vargs.at(6)),
-                    (vargs.at(7)),
-                    (vargs.at(7))
-                    );
-        }
-        if (args.count() > 7)
-        {
-            ok = method.meta.invoke(invokable,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4)),
-                    (vargs.at(5)),
-                    (vargs.at(6)),
-                    (vargs.at(7))
-                    );
-        }
-        else if (args.count() > 6)
-        {
-            ok = method.meta.invoke(invokable,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4)),
-                    (vargs.at(5)),
-                    (vargs.at(6))
-                    );
-        }
-        else if (args.count() > 5)
-        {
-            ok = method.meta.invoke(invokable,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4)),
-                    (vargs.at(5))
-                    );
-        }
-        else if (args.count() > 4)
-        {
-            ok = method.meta.invoke(invokable,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3)),
-                    (vargs.at(4))
-                    );
-        }
-        else if (args.count() > 3)
-        {
-            ok = method.meta.invoke(invokable,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2)),
-                    (vargs.at(3))
-                    );
-        }
-        else if (args.count() > 2)
-        {
-            ok = method.meta.invoke(invokable,
-                    (vargs.at(0)),
-                    (vargs.at(1)),
-                    (vargs.at(2))
-                    );
-        }
-        else if (args.count() > 1)
-        {
-            ok = method.meta.invoke(invokable,
-                    (vargs.at(0)),
-                    (vargs.at(1))
-                    );
-        }
-        else if (args.count() > 0)
-        {
-            ok = method.meta.invoke(invokable,
-                    (vargs.at(0))
-                    );
-        }
-        else
-        {
-            ok = method.meta.invoke(invokable
-                    );
-        }
-    }
-    if (!ok) {
-        QVariantMap res;
         res.insert("result", QVariant());
-        res.insert("error", "execution failure");
-        res.insert("id", rid);
-        QxtWebPageEvent *err = new QxtWebPageEvent(event->sessionID, event->requestID,
-                QxtJSON::stringify(res).toUtf8() + "\r\n");
-        p->postEvent(err);
-        return;
+        res.insert("error", message);
     }
-    if (requestCanceled) {
-        return;
+    res.insert("id", call.id);
+    return res;
+}
+
+void QxtWebJsonRPCService::Private::reply(QxtWebRequestEvent *event, const QVariant &body, int status)
+{
+    reply(event->sessionID, event->requestID, body, status);
+}
+
+/*
+ * Sends \a body as the response of a request. A request made only of
+ * notifications has nothing to answer and gets an empty 204 response.
+ */
+void QxtWebJsonRPCService::Private::reply(int sessionID, int requestID, const QVariant &body, int status)
+{
+    QxtWebPageEvent *page;
+    if (body.isValid()) {
+        page = new QxtWebPageEvent(sessionID, requestID, QxtJSON::stringifyUtf8(body) + "\r\n");
+        page->status = status;
+    } else {
+        page = new QxtWebPageEvent(sessionID, requestID, QByteArray());
+        page->status = 204;
+        page->statusMessage = "No Content";
     }
+    p->postEvent(page);
+}
 
-    QVariantMap res;
-    res.insert("result", returnValue);
-    res.insert("error", QVariant());
-    res.insert("id", rid);
-    QxtWebPageEvent *err = new QxtWebPageEvent(event->sessionID, event->requestID,
-            QxtJSON::stringify(res).toUtf8() + "\r\n");
-    p->postEvent(err);
-    return;
+void QxtWebJsonRPCService::Private::dispatch(QxtWebRequestEvent *event, const QVariantList &requests)
+{
+    QSharedPointer<Batch> batch(new Batch);
+    batch->d = this;
+    batch->sessionID = event->sessionID;
+    batch->requestID = event->requestID;
+    batch->requests = requests;
+    batch->responses.resize(requests.count());
+    batch->remaining = requests.count();
+
+    batchLock.lock();
+    activeBatches++;
+    batchLock.unlock();
+
+    // take the slot pointers before any task runs; the vector never detaches
+    QVariant *responses = batch->responses.data();
+    for (int i = 0; i < requests.count(); i++)
+        threadPool->start(new Task(batch, i, responses + i));
+}
 
+void QxtWebJsonRPCService::Private::finishBatch(Batch *batch)
+{
+    QVariantList responses;
+    foreach (const QVariant &res, batch->responses) {
+        if (res.isValid())
+            responses.append(res);
+    }
+    reply(batch->sessionID, batch->requestID, responses.isEmpty() ? QVariant() : QVariant(responses));
+
+    QMutexLocker locker(&batchLock);
+    if (--activeBatches == 0)
+        batchDone.wakeAll();
 }
+
 /*!
     Constructs a new QxtWebJsonRPCService with \a sm and \a parent.
  */
@@ -418,32 +434,70 @@ QxtWebJsonRPCService::QxtWebJsonRPCService(QxtAbstractWebSessionManager* sm, QOb
 
 }
 
+/*!
+    Destroys the service. Batch entries that have not started yet are
+    dropped, and the destructor waits for those that are running.
+
+    The slots run by a batch belong to the subclass, which is already gone
+    by the time this destructor runs. A subclass that sets a thread pool
+    should therefore call setThreadPool(0) in its own destructor.
+ */
 QxtWebJsonRPCService::~QxtWebJsonRPCService()
 {
+    // the tasks of a dispatched batch still refer to the private object
+    d->cancelled.storeRelease(1);
+    d->waitForBatches();
     delete d;
 }
 
+/*!
+    Returns the thread pool batch entries are dispatched to, or 0 if batches
+    are executed in order on the thread of the service. The default is 0.
+
+    \sa setThreadPool()
+ */
+QThreadPool* QxtWebJsonRPCService::threadPool() const
+{
+    return d->threadPool;
+}
+
+/*!
+    Sets the thread pool that the entries of a JSON-RPC batch are dispatched
+    to. The entries of a batch are then executed concurrently on \a pool and
+    the responses are sent back in the order of the batch. Single requests
+    are always executed on the thread of the service.
+
+    Slots called this way run on the threads of the pool, so they have to be
+    thread-safe. Pass 0 to execute batches sequentially again. The service
+    does not take ownership of \a pool.
+
+    Batches that were already dispatched are completed before this function
+    returns.
+ */
+void QxtWebJsonRPCService::setThreadPool(QThreadPool* pool)
+{
+    d->waitForBatches();
+    d->threadPool = pool;
+}
+
 /*!
  * respond to the current request with an error.
  *
  * The return value of the current slot is NOT used.
  * Instead null is returned, adhering to the jsonrpc specificaiton.
+ * For JSON-RPC 2.0 requests \a error is sent as the error object if it is a
+ * map with a "code" member, otherwise it is wrapped in one.
  *
  * Calling this function from somewhere else then a handler slot is undefined behaviour.
  */
 
 void QxtWebJsonRPCService::throwRPCError(QVariant error)
 {
-    d->requestCanceled= true;
-    QxtWebRequestEvent *event = d->currentRequest;
-
-    QVariantMap res;
-    res.insert("result", QVariant());
-    res.insert("error", error);
-    res.insert("id", d->currentRequestId);
-    QxtWebPageEvent *err = new QxtWebPageEvent(event->sessionID, event->requestID,
-            QxtJSON::stringify(res).toUtf8() + "\r\n");
-    postEvent(err);
+    Private::Call *call = Private::currentCall;
+    if (!call)
+        return;
+    call->failed = true;
+    call->error = error;
 }
 
 /*!
@@ -492,8 +546,12 @@ void QxtWebJsonRPCService::pageRequestedEvent(QxtWebRequestEvent* event)
                     QUrl::fromPercentEncoding (enc.at(i).second.toLatin1()));
 #endif
         }
-        QString method = event->url.path().split('/').last();
-        d->handle(event, QVariant(), method, params);
+        QVariantMap request;
+        request.insert("method", event->url.path().split('/').last());
+        request.insert("params", params);
+        if (!d->invokable)
+            d->initTables(this);
+        d->reply(event, d->call(request));
         return;
     }
 
@@ -504,7 +562,7 @@ void QxtWebJsonRPCService::pageRequestedEvent(QxtWebRequestEvent* event)
         res.insert("error", "missing POST data");
         res.insert("id", QVariant());
         QxtWebPageEvent *err = new QxtWebPageEvent(event->sessionID, event->requestID,
-                QxtJSON::stringify(res).toUtf8() + "\r\n");
+                QxtJSON::stringifyUtf8(res) + "\r\n");
         err->status = 500;
         postEvent(err);
         return;
@@ -35,6 +35,8 @@
 #include "qxtabstractwebservice.h"
 #include <QUrl>
 
+class QThreadPool;
+
 class QXT_WEB_EXPORT QxtWebJsonRPCService : public QxtAbstractWebService
 {
     Q_OBJECT
@@ -42,6 +44,9 @@ public:
     explicit QxtWebJsonRPCService(QxtAbstractWebSessionManager* sm, QObject* parent = 0);
     virtual ~QxtWebJsonRPCService();
 
+    QThreadPool* threadPool() const;
+    void setThreadPool(QThreadPool* pool);
+
 protected:
     void throwRPCError(QVariant error);
 
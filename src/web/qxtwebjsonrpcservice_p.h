@@ -32,6 +32,13 @@
 #include "qxtwebcontent.h"
 #include "qxtwebevent.h"
 #include <QtCore/QMetaMethod>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QAtomicInt>
+
+class QThreadPool;
 
 class QxtWebJsonRPCService::Private : public QObject
 {
@@ -42,25 +49,60 @@ public:
 
     QxtWebJsonRPCService *p;
     void initTables(QObject *invokable);
-    bool tablesInitilized;
     QObject *invokable;
 
+    enum ErrorCode
+    {
+        ParseError = -32700,
+        InvalidRequest = -32600,
+        MethodNotFound = -32601,
+        InvalidParams = -32602,
+        InternalError = -32603,
+        ServerError = -32000
+    };
+
+    // Everything needed to convert the arguments and the return value is
+    // looked up once when the tables are built, not on every call.
     struct Method
     {
         QMetaMethod meta;
-        QByteArray name;
-        bool returns;
-        int argCount;
+        int returnType;                 // QMetaType::Void if nothing is returned
+        QVector<int> parameterTypes;
+        QList<QByteArray> parameterNames;
     };
-    QMap<QByteArray, Method> methods;
+    QHash<QByteArray, Method> methods;  // "name/argc"->method
+
+    // The call being executed. Batch entries may run on several threads at
+    // once, so throwRPCError() finds its call through a thread local pointer.
+    struct Call
+    {
+        QVariant id;
+        bool version2;
+        bool failed;
+        QVariant error;
+    };
+    static thread_local Call *currentCall;
+
+    struct Batch;
+    class Task;
+    QThreadPool *threadPool;
+    QMutex batchLock;
+    QWaitCondition batchDone;
+    int activeBatches;
+    QAtomicInt cancelled;           // set once the service is being destroyed
 
-    QxtWebRequestEvent *currentRequest;
-    QVariant currentRequestId;
-    bool requestCanceled;
+    QVariant call(const QVariant &request);
+    QVariant invoke(Call &call, const QString &method, const QVariant &params);
+    QVariant response(const Call &call, const QVariant &result) const;
+    QVariant errorResponse(const Call &call, int code, const QString &message) const;
+    void reply(QxtWebRequestEvent *event, const QVariant &body, int status = 200);
+    void reply(int sessionID, int requestID, const QVariant &body, int status = 200);
+    void dispatch(QxtWebRequestEvent *event, const QVariantList &batch);
+    void finishBatch(Batch *batch);
+    void waitForBatches();
 
 public slots:
     void readFinished();
     void handle(QxtWebContent *);
-    void handle( QxtWebRequestEvent *event, QVariant id, QString method, QVariant args);
 };
 
@@ -0,0 +1,539 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+/*!
+\class QxtWebMultipartParser
+
+\inmodule QxtWeb
+
+\brief The QxtWebMultipartParser class parses multipart/form-data request bodies as they arrive
+
+QxtWebMultipartParser reads a request body, typically a QxtWebContent,
+whenever new data is received and splits it into its parts without waiting
+for the whole body. partStarted() is emitted once the headers of a part have
+been read and partReceived() once its body is complete.
+
+Part bodies up to spoolThreshold() bytes are kept in memory. Larger bodies,
+such as uploaded files, are written to a temporary directory instead, so the
+memory used for an upload does not depend on its size. The temporary files
+are removed when the parser is destroyed; move or copy them in a slot
+connected to partReceived() to keep them.
+
+\code
+void UploadService::pageRequestedEvent(QxtWebRequestEvent* event)
+{
+    QByteArray type = event->headers.value("content-type").toUtf8();
+    QxtWebMultipartParser* parser = new QxtWebMultipartParser(event->content, type, event->content);
+    connect(parser, SIGNAL(partReceived(QxtWebMultipartPart)), this, SLOT(storeUpload(QxtWebMultipartPart)));
+    ...
+}
+\endcode
+
+\sa QxtWebContent
+*/
+
+/*!
+\class QxtWebMultipartPart
+
+\inmodule QxtWeb
+
+\brief The QxtWebMultipartPart class describes one part of a multipart/form-data body
+
+\sa QxtWebMultipartParser
+*/
+
+#include "qxtwebmultipartparser.h"
+#include "qxtwebcontent.h"
+#include <qxttemporarydir.h>
+#include <QBuffer>
+#include <QFile>
+#include <QList>
+#include <QPointer>
+
+/*!
+ * \variable QxtWebMultipartPart::name
+ * The form field name from the Content-Disposition header.
+ */
+
+/*!
+ * \variable QxtWebMultipartPart::fileName
+ * The name of the uploaded file, or an empty string if the part is not a file.
+ */
+
+/*!
+ * \variable QxtWebMultipartPart::contentType
+ * The media type of the part. The default is "text/plain".
+ */
+
+/*!
+ * \variable QxtWebMultipartPart::headers
+ * All headers of the part; the names are lower case.
+ */
+
+/*!
+ * \variable QxtWebMultipartPart::size
+ * The size of the body of the part.
+ */
+
+/*!
+ * \variable QxtWebMultipartPart::data
+ * The body of the part, unless it has been spooled to a file.
+ */
+
+/*!
+ * \variable QxtWebMultipartPart::spoolFile
+ * The path of the temporary file holding the body, if it has been spooled.
+ */
+
+/*!
+ * Constructs an empty part.
+ */
+QxtWebMultipartPart::QxtWebMultipartPart() : contentType("text/plain"), size(0)
+{
+    // initializers only
+}
+
+/*!
+ * Returns true if the body of the part has been written to spoolFile()
+ * rather than kept in data.
+ */
+bool QxtWebMultipartPart::isSpooled() const
+{
+    return !spoolFile.isEmpty();
+}
+
+/*!
+ * Returns a new device, opened for reading, that provides the body of the
+ * part regardless of where it is stored, or 0 if the spool file cannot be
+ * opened. The caller takes ownership of the device.
+ */
+QIODevice* QxtWebMultipartPart::open() const
+{
+    if (isSpooled())
+    {
+        QFile* file = new QFile(spoolFile);
+        if (file->open(QIODevice::ReadOnly)) return file;
+        delete file;
+        return 0;
+    }
+    QBuffer* buffer = new QBuffer;
+    buffer->setData(data);
+    buffer->open(QIODevice::ReadOnly);
+    return buffer;
+}
+
+#ifndef QXT_DOXYGEN_RUN
+class QxtWebMultipartParserPrivate : public QxtPrivate<QxtWebMultipartParser>
+{
+public:
+    QXT_DECLARE_PUBLIC(QxtWebMultipartParser)
+    enum State { Preamble, Delimiter, Headers, Body, Done, Failed };
+    enum { ReadSize = 65536, MaxHeaderSize = 16384 };
+
+    QxtWebMultipartParserPrivate() : offset(0), state(Preamble), spoolThreshold(65536), spool(0), spoolCount(0) {}
+    ~QxtWebMultipartParserPrivate()
+    {
+        delete spool;
+    }
+
+    QPointer<QIODevice> content;
+    QByteArray delimiter;           // CRLF, "--" and the boundary
+    QByteArray buffer;
+    int offset;
+    State state;
+    qint64 spoolThreshold;
+    QxtTemporaryDir spoolDir;
+    QFile* spool;
+    int spoolCount;
+    QxtWebMultipartPart part;
+    QList<QxtWebMultipartPart> parts;
+    QString errorString;
+
+    void drain();
+    bool step();
+    void parseHeaders(const QByteArray& block);
+    bool appendBody(const char* data, int size);
+    void finishPart();
+    void fail(const QString& message);
+};
+
+/*
+ * Returns the value of the parameter \a name in a header value such as
+ * 'form-data; name="field"; filename="a.txt"'.
+ */
+static QString qxtHeaderParameter(const QByteArray& value, const QByteArray& name)
+{
+    int pos = 0;
+    while ((pos = value.indexOf(';', pos)) != -1)
+    {
+        pos++;
+        while (pos < value.size() && value.at(pos) == ' ') pos++;
+        int eq = value.indexOf('=', pos);
+        if (eq == -1) break;
+        QByteArray key = value.mid(pos, eq - pos).trimmed().toLower();
+        pos = eq + 1;
+        QByteArray result;
+        if (pos < value.size() && value.at(pos) == '"')
+        {
+            for (pos++; pos < value.size() && value.at(pos) != '"'; pos++)
+            {
+                if (value.at(pos) == '\\' && pos + 1 < value.size()) pos++;
+                result += value.at(pos);
+            }
+        }
+        else
+        {
+            int end = value.indexOf(';', pos);
+            result = value.mid(pos, end == -1 ? -1 : end - pos).trimmed();
+        }
+        if (key == name) return QString::fromUtf8(result);
+    }
+    return QString();
+}
+
+void QxtWebMultipartParserPrivate::drain()
+{
+    if (state >= Done) return;
+    if (delimiter.size() <= 4)
+    {
+        fail(QLatin1String("Not a multipart body"));
+        return;
+    }
+    while (content && state < Done && content->bytesAvailable() > 0)
+    {
+        QByteArray chunk = content->read(ReadSize);
+        if (chunk.isEmpty()) break;
+        buffer.append(chunk);
+        while (state < Done && step()) {}
+        // Drop consumed data without shifting the buffer on every read
+        if (offset >= buffer.size())
+        {
+            buffer.clear();
+            offset = 0;
+        }
+        else if (offset > buffer.size() / 2)
+        {
+            buffer.remove(0, offset);
+            offset = 0;
+        }
+    }
+}
+
+/*
+ * Advances the parser by one state transition. Returns false if more data
+ * is needed.
+ */
+bool QxtWebMultipartParserPrivate::step()
+{
+    switch (state)
+    {
+    case Preamble:
+    {
+        int pos = buffer.indexOf(delimiter, offset);
+        if (pos == -1)
+        {
+            offset = qMax(offset, buffer.size() - delimiter.size() + 1);
+            return false;
+        }
+        offset = pos + delimiter.size();
+        state = Delimiter;
+        return true;
+    }
+    case Delimiter:
+    {
+        if (buffer.size() - offset < 2) return false;
+        if (buffer.at(offset) == '-' && buffer.at(offset + 1) == '-')
+        {
+            // Close delimiter; anything after it is ignored
+            offset = buffer.size();
+            state = Done;
+            emit qxt_p().finished();
+            return false;
+        }
+        int eol = buffer.indexOf("\r\n", offset);
+        if (eol == -1)
+        {
+            if (buffer.size() - offset > 256) fail(QLatin1String("Malformed multipart boundary"));
+            return false;
+        }
+        offset = eol + 2;
+        part = QxtWebMultipartPart();
+        state = Headers;
+        return true;
+    }
+    case Headers:
+    {
+        if (buffer.size() - offset < 2) return false;
+        int end = offset, next = offset + 2;
+        if (buffer.at(offset) != '\r' || buffer.at(offset + 1) != '\n')
+        {
+            end = buffer.indexOf("\r\n\r\n", offset);
+            if (end == -1)
+            {
+                if (buffer.size() - offset > MaxHeaderSize) fail(QLatin1String("Multipart headers too large"));
+                return false;
+            }
+            next = end + 4;
+        }
+        parseHeaders(buffer.mid(offset, end - offset));
+        offset = next;
+        state = Body;
+        emit qxt_p().partStarted(part);
+        return true;
+    }
+    case Body:
+    {
+        int pos = buffer.indexOf(delimiter, offset);
+        if (pos == -1)
+        {
+            // Keep enough data to recognize a delimiter split between reads
+            int safe = buffer.size() - delimiter.size() + 1;
+            if (safe > offset)
+            {
+                if (!appendBody(buffer.constData() + offset, safe - offset)) return false;
+                offset = safe;
+            }
+            return false;
+        }
+        if (!appendBody(buffer.constData() + offset, pos - offset)) return false;
+        offset = pos + delimiter.size();
+        finishPart();
+        state = Delimiter;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+void QxtWebMultipartParserPrivate::parseHeaders(const QByteArray& block)
+{
+    foreach(const QByteArray& line, block.split('\n'))
+    {
+        int colon = line.indexOf(':');
+        if (colon == -1) continue;
+        QString name = QString::fromLatin1(line.left(colon).trimmed().toLower());
+        QByteArray value = line.mid(colon + 1).trimmed();
+        part.headers.insert(name, QString::fromUtf8(value));
+        if (name == QLatin1String("content-disposition"))
+        {
+            part.name = qxtHeaderParameter(value, "name");
+            part.fileName = qxtHeaderParameter(value, "filename");
+        }
+        else if (name == QLatin1String("content-type"))
+        {
+            part.contentType = value;
+        }
+    }
+}
+
+bool QxtWebMultipartParserPrivate::appendBody(const char* data, int size)
+{
+    if (size <= 0) return true;
+    part.size += size;
+    if (!spool && part.data.size() + size <= spoolThreshold)
+    {
+        part.data.append(data, size);
+        return true;
+    }
+    if (!spool)
+    {
+        QString path = spoolDir.dir().filePath(QString::fromLatin1("part-%1").arg(++spoolCount));
+        spool = new QFile(path);
+        if (!spool->open(QIODevice::WriteOnly | QIODevice::Truncate)
+                || spool->write(part.data) != part.data.size())
+        {
+            fail(QLatin1String("Cannot create spool file: ") + spool->errorString());
+            return false;
+        }
+        part.spoolFile = path;
+        part.data.clear();
+    }
+    if (spool->write(data, size) != size)
+    {
+        fail(QLatin1String("Cannot write spool file: ") + spool->errorString());
+        return false;
+    }
+    return true;
+}
+
+void QxtWebMultipartParserPrivate::finishPart()
+{
+    if (spool)
+    {
+        spool->close();
+        delete spool;
+        spool = 0;
+    }
+    parts.append(part);
+    emit qxt_p().partReceived(part);
+    part = QxtWebMultipartPart();
+}
+
+void QxtWebMultipartParserPrivate::fail(const QString& message)
+{
+    if (spool)
+    {
+        spool->remove();
+        delete spool;
+        spool = 0;
+    }
+    buffer.clear();
+    offset = 0;
+    state = Failed;
+    errorString = message;
+    emit qxt_p().error(message);
+}
+#endif
+
+/*!
+ * Constructs a parser for the \a content of a request whose Content-Type
+ * header is \a contentType, with the specified \a parent.
+ *
+ * Parsing starts when control returns to the event loop, so that signals
+ * can be connected first. If \a contentType does not describe a multipart
+ * body, error() is emitted.
+ */
+QxtWebMultipartParser::QxtWebMultipartParser(QIODevice* content, const QByteArray& contentType, QObject* parent)
+: QObject(parent)
+{
+    QXT_INIT_PRIVATE(QxtWebMultipartParser);
+    qxt_d().content = content;
+    // The leading CRLF lets a delimiter at the very start of the body be
+    // found like any other.
+    qxt_d().buffer = "\r\n";
+    QByteArray boundary = QxtWebMultipartParser::boundary(contentType);
+    qxt_d().delimiter = "\r\n--" + boundary;
+    if (content)
+    {
+        connect(content, SIGNAL(readyRead()), this, SLOT(readContent()));
+        connect(content, SIGNAL(readChannelFinished()), this, SLOT(contentFinished()));
+    }
+    QMetaObject::invokeMethod(this, "readContent", Qt::QueuedConnection);
+}
+
+/*!
+ * Returns the boundary parameter of a multipart \a contentType, or an empty
+ * byte array if there is none.
+ */
+QByteArray QxtWebMultipartParser::boundary(const QByteArray& contentType)
+{
+    if (!contentType.trimmed().toLower().startsWith("multipart/")) return QByteArray();
+    return qxtHeaderParameter(contentType, "boundary").toUtf8();
+}
+
+/*!
+ * Returns the size above which part bodies are written to temporary files.
+ * \sa setSpoolThreshold()
+ */
+qint64 QxtWebMultipartParser::spoolThreshold() const
+{
+    return qxt_d().spoolThreshold;
+}
+
+/*!
+ * Sets the size, in \a bytes, above which part bodies are written to
+ * temporary files instead of being kept in memory. The default is 64 KiB.
+ */
+void QxtWebMultipartParser::setSpoolThreshold(qint64 bytes)
+{
+    qxt_d().spoolThreshold = qMax(Q_INT64_C(0), bytes);
+}
+
+/*!
+ * Returns the template for the temporary directory that holds spooled
+ * part bodies.
+ * \sa QxtTemporaryDir::dirTemplate()
+ */
+QString QxtWebMultipartParser::spoolDirectory() const
+{
+    return qxt_d().spoolDir.dirTemplate();
+}
+
+/*!
+ * Sets the template for the temporary directory that holds spooled part
+ * bodies to \a dirTemplate. It must be set before the first body is spooled.
+ * \sa QxtTemporaryDir::setDirTemplate()
+ */
+void QxtWebMultipartParser::setSpoolDirectory(const QString& dirTemplate)
+{
+    qxt_d().spoolDir.setDirTemplate(dirTemplate);
+}
+
+/*!
+ * Returns true once the closing boundary has been read.
+ */
+bool QxtWebMultipartParser::isFinished() const
+{
+    return qxt_d().state == QxtWebMultipartParserPrivate::Done;
+}
+
+/*!
+ * Returns a description of the last error.
+ */
+QString QxtWebMultipartParser::errorString() const
+{
+    return qxt_d().errorString;
+}
+
+/*!
+ * Returns the parts received so far.
+ */
+QList<QxtWebMultipartPart> QxtWebMultipartParser::parts() const
+{
+    return qxt_d().parts;
+}
+
+/*!
+ * Parses the data that is available from the content device. This slot is
+ * invoked whenever new data arrives.
+ */
+void QxtWebMultipartParser::readContent()
+{
+    QxtWebMultipartParserPrivate& d = qxt_d();
+    if (d.state >= QxtWebMultipartParserPrivate::Done) return;
+    d.drain();
+    QxtWebContent* content = qobject_cast<QxtWebContent*>(d.content);
+    if (content && !content->wantAll() && content->bytesNeeded() == 0 && !content->bytesAvailable())
+        contentFinished();
+}
+
+/*!
+ * \internal
+ */
+void QxtWebMultipartParser::contentFinished()
+{
+    QxtWebMultipartParserPrivate& d = qxt_d();
+    if (d.state >= QxtWebMultipartParserPrivate::Done) return;
+    d.drain();
+    if (d.state < QxtWebMultipartParserPrivate::Done)
+        d.fail(QLatin1String("Unexpected end of multipart body"));
+}
@@ -0,0 +1,97 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTWEBMULTIPARTPARSER_H
+#define QXTWEBMULTIPARTPARSER_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QMultiHash>
+#include <QMetaType>
+#include <qxtglobal.h>
+
+class QIODevice;
+
+class QXT_WEB_EXPORT QxtWebMultipartPart
+{
+public:
+    QxtWebMultipartPart();
+
+    bool isSpooled() const;
+    QIODevice* open() const;
+
+    QString name;
+    QString fileName;
+    QByteArray contentType;
+    QMultiHash<QString, QString> headers;
+    qint64 size;
+    QByteArray data;
+    QString spoolFile;
+};
+Q_DECLARE_METATYPE(QxtWebMultipartPart)
+
+class QxtWebMultipartParserPrivate;
+class QXT_WEB_EXPORT QxtWebMultipartParser : public QObject
+{
+    Q_OBJECT
+public:
+    QxtWebMultipartParser(QIODevice* content, const QByteArray& contentType, QObject* parent = 0);
+
+    static QByteArray boundary(const QByteArray& contentType);
+
+    qint64 spoolThreshold() const;
+    void setSpoolThreshold(qint64 bytes);
+
+    QString spoolDirectory() const;
+    void setSpoolDirectory(const QString& dirTemplate);
+
+    bool isFinished() const;
+    QString errorString() const;
+    QList<QxtWebMultipartPart> parts() const;
+
+public Q_SLOTS:
+    void readContent();
+
+Q_SIGNALS:
+    void partStarted(const QxtWebMultipartPart& part);
+    void partReceived(const QxtWebMultipartPart& part);
+    void finished();
+    void error(const QString& message);
+
+private Q_SLOTS:
+    void contentFinished();
+
+private:
+    QXT_DECLARE_PRIVATE(QxtWebMultipartParser)
+};
+
+#endif // QXTWEBMULTIPARTPARSER_H
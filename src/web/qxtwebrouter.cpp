@@ -0,0 +1,457 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+/*!
+\class QxtWebRouter
+
+\inmodule QxtWeb
+
+\brief The QxtWebRouter class dispatches requests to slots and services by path pattern
+
+QxtWebRouter compiles all of its routes into a single tree over path
+segments, so that a request is resolved in one pass over its path no matter
+how deep the route is or how many routes there are. It can replace a chain of
+QxtWebServiceDirectory objects and the per-request slot lookup of
+QxtWebSlotService.
+
+A route pattern consists of literal segments and captures. A capture is
+written as "{name}" or "{name:type}", where type is one of:
+
+\list
+\li \c string (the default) matches any non-empty segment and is passed as a QString
+\li \c int matches a segment holding an integer and is passed as an int
+\li \c path matches the rest of the path and is passed as a QString; \c * is a shorthand for it
+\endlist
+
+When several routes could match, literal segments take precedence over
+\c int captures, which take precedence over \c string and \c path captures.
+
+\code
+QxtWebRouter* router = new QxtWebRouter(sm, sm);
+router->addRoute("/users/{id:int}", handler, SLOT(user(QxtWebRequestEvent*, int)));
+router->addRoute("/users/{id:int}/posts/{slug}", handler, SLOT(post(QxtWebRequestEvent*, int, QString)));
+router->addRoute("/files/{name:path}", handler, SLOT(file(QxtWebRequestEvent*, QString)));
+router->addRoute("/admin", adminService);
+\endcode
+
+A slot receives the request event followed by the captured values in the
+order in which they appear in the pattern. The slot is resolved when the
+route is added and is invoked directly from the thread delivering the
+request. A service added with a pattern handles every path below it, and
+receives the request with the matched part removed from the URL.
+
+Routes are expected to be added before the router receives requests, but
+adding routes later is safe.
+
+\sa QxtWebServiceDirectory, QxtWebSlotService
+*/
+
+#include "qxtwebrouter.h"
+#include "qxtwebrouter_p.h"
+#include "qxtwebevent.h"
+#include <QStringList>
+#include <QUrl>
+#include <QtDebug>
+#include <algorithm>
+
+#ifndef QXT_DOXYGEN_RUN
+QxtWebRouteNode::~QxtWebRouteNode()
+{
+    for (int i = 0; i < literals.count(); i++)
+        delete literals[i].second;
+    delete intChild;
+    delete stringChild;
+    delete pathChild;
+}
+
+static inline bool qxtLiteralLess(const QPair<QString, QxtWebRouteNode*>& entry, const QStringRef& segment)
+{
+    return entry.first.compare(segment) < 0;
+}
+
+QxtWebRouteNode* QxtWebRouteNode::literal(const QStringRef& segment) const
+{
+    QVector<QPair<QString, QxtWebRouteNode*> >::const_iterator it =
+        std::lower_bound(literals.constBegin(), literals.constEnd(), segment, qxtLiteralLess);
+    if (it == literals.constEnd() || it->first.compare(segment) != 0)
+        return 0;
+    return it->second;
+}
+
+QxtWebRouteNode* QxtWebRouteNode::addLiteral(const QString& segment)
+{
+    QStringRef ref(&segment);
+    QVector<QPair<QString, QxtWebRouteNode*> >::iterator it =
+        std::lower_bound(literals.begin(), literals.end(), ref, qxtLiteralLess);
+    if (it != literals.end() && it->first == segment)
+        return it->second;
+    QxtWebRouteNode* node = new QxtWebRouteNode;
+    literals.insert(it, qMakePair(segment, node));
+    return node;
+}
+
+enum QxtWebRouteSegment { LiteralSegment, IntCapture, StringCapture, PathCapture, InvalidSegment };
+
+static QxtWebRouteSegment qxtRouteSegment(const QString& segment, bool last)
+{
+    if (segment != "*" && !(segment.startsWith('{') && segment.endsWith('}')))
+        return LiteralSegment;
+    QString type = segment == "*" ? QString("path") : segment.mid(1, segment.size() - 2).section(':', 1);
+    if (type.isEmpty() || type == "string")
+        return StringCapture;
+    if (type == "int")
+        return IntCapture;
+    if (type == "path" && last)
+        return PathCapture;
+    return InvalidSegment;
+}
+
+/*
+ * Collects the capture types of pattern without touching the tree. Returns
+ * false if the pattern is malformed.
+ */
+bool QxtWebRouterPrivate::captures(const QString& pattern, QVector<int>* captureTypes)
+{
+    QStringList segments = pattern.split('/', QString::SkipEmptyParts);
+    for (int i = 0; i < segments.count(); i++)
+    {
+        switch (qxtRouteSegment(segments.at(i), i == segments.count() - 1))
+        {
+        case LiteralSegment:
+            continue;
+        case IntCapture:
+            captureTypes->append(QMetaType::Int);
+            break;
+        case StringCapture:
+        case PathCapture:
+            captureTypes->append(QMetaType::QString);
+            break;
+        case InvalidSegment:
+            qWarning() << "QxtWebRouter: invalid capture" << segments.at(i) << "in" << pattern;
+            return false;
+        }
+        if (captureTypes->count() > MaxCaptures)
+        {
+            qWarning() << "QxtWebRouter: too many captures in" << pattern;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Adds the nodes for pattern to the tree and returns the node the pattern
+ * ends at. The pattern must have been checked with captures() first, so
+ * that a rejected route leaves no nodes behind.
+ */
+QxtWebRouteNode* QxtWebRouterPrivate::insert(const QString& pattern)
+{
+    QStringList segments = pattern.split('/', QString::SkipEmptyParts);
+    QxtWebRouteNode* node = &root;
+    for (int i = 0; i < segments.count(); i++)
+    {
+        QxtWebRouteNode** child;
+        switch (qxtRouteSegment(segments.at(i), i == segments.count() - 1))
+        {
+        case LiteralSegment:
+            node = node->addLiteral(segments.at(i));
+            continue;
+        case IntCapture:
+            child = &node->intChild;
+            break;
+        case PathCapture:
+            child = &node->pathChild;
+            break;
+        default:
+            child = &node->stringChild;
+            break;
+        }
+        if (!*child)
+            *child = new QxtWebRouteNode;
+        node = *child;
+    }
+    return node;
+}
+
+/*
+ * Matches the path from pos on against the subtree at node. Literal
+ * segments are tried before captures; a failed branch is backed out of.
+ */
+bool QxtWebRouterPrivate::resolve(const QxtWebRouteNode* node, const QString& path, int pos, Match& match) const
+{
+    if (pos >= path.size())
+    {
+        if (node->route >= 0)
+        {
+            match.route = node->route;
+            return true;
+        }
+        if (node->mount >= 0)
+        {
+            match.route = node->mount;
+            match.remainder = path.size();
+            return true;
+        }
+        return false;
+    }
+
+    int end = path.indexOf('/', pos);
+    if (end == -1)
+        end = path.size();
+    QStringRef segment = path.midRef(pos, end - pos);
+
+    const QxtWebRouteNode* child = node->literal(segment);
+    if (child && resolve(child, path, end + 1, match))
+        return true;
+    if (!segment.isEmpty())
+    {
+        bool isInt = false;
+        if (node->intChild)
+            segment.toInt(&isInt);
+        if (isInt)
+        {
+            match.captures.append(segment);
+            if (resolve(node->intChild, path, end + 1, match))
+                return true;
+            match.captures.removeLast();
+        }
+        if (node->stringChild)
+        {
+            match.captures.append(segment);
+            if (resolve(node->stringChild, path, end + 1, match))
+                return true;
+            match.captures.removeLast();
+        }
+        if (node->pathChild && node->pathChild->route >= 0)
+        {
+            match.captures.append(path.midRef(pos));
+            match.route = node->pathChild->route;
+            return true;
+        }
+    }
+    if (node->mount >= 0)
+    {
+        match.route = node->mount;
+        match.remainder = pos - 1;
+        return true;
+    }
+    return false;
+}
+#endif
+
+/*!
+ * Constructs a QxtWebRouter object with the specified session manager \a sm and \a parent.
+ *
+ * Often, the session manager will also be the parent, but this is not a requirement.
+ */
+QxtWebRouter::QxtWebRouter(QxtAbstractWebSessionManager* sm, QObject* parent) : QxtAbstractWebService(sm, parent)
+{
+    QXT_INIT_PRIVATE(QxtWebRouter);
+}
+
+/*!
+ * Adds a route that invokes the slot \a member of \a receiver for paths
+ * matching \a pattern. The slot is given as with the SLOT() macro; it must
+ * take a QxtWebRequestEvent* followed by one argument per capture in the
+ * pattern, an int for \c int captures and a QString for the others.
+ *
+ * Returns the index of the route, or -1 if the pattern is malformed or the
+ * slot does not exist or does not match the pattern.
+ *
+ * \sa match()
+ */
+int QxtWebRouter::addRoute(const QString& pattern, QObject* receiver, const char* member)
+{
+    if (!receiver || !member)
+        return -1;
+    // Skip the code prepended by the SLOT() and SIGNAL() macros
+    if (*member >= '0' && *member <= '9')
+        member++;
+    QByteArray signature = QMetaObject::normalizedSignature(member);
+    int index = receiver->metaObject()->indexOfMethod(signature.constData());
+    if (index == -1)
+    {
+        qWarning() << "QxtWebRouter::addRoute: no such method" << receiver->metaObject()->className() << "::" << signature;
+        return -1;
+    }
+
+    QxtWebRoute route;
+    route.pattern = pattern;
+    route.receiver = receiver;
+    route.method = receiver->metaObject()->method(index);
+
+    if (!qxt_d().captures(pattern, &route.captureTypes))
+        return -1;
+    bool valid = route.method.parameterCount() == route.captureTypes.count() + 1
+                 && route.method.parameterTypes().at(0) == "QxtWebRequestEvent*";
+    for (int i = 0; valid && i < route.captureTypes.count(); i++)
+        valid = route.method.parameterType(i + 1) == route.captureTypes.at(i);
+    if (!valid)
+    {
+        qWarning() << "QxtWebRouter::addRoute:" << signature << "does not match the captures of" << pattern;
+        return -1;
+    }
+
+    QWriteLocker locker(&qxt_d().lock);
+    QxtWebRouteNode* node = qxt_d().insert(pattern);
+    if (node->route >= 0)
+        qWarning() << "QxtWebRouter::addRoute:" << pattern << "already registered";
+    node->route = qxt_d().routes.count();
+    qxt_d().routes.append(route);
+    return node->route;
+}
+
+/*!
+ * Adds a route that passes every request at or below \a pattern to
+ * \a service. The part of the URL matched by the pattern is removed before
+ * the request is passed on, as QxtWebServiceDirectory does. Values captured
+ * by the pattern are not passed to the service.
+ *
+ * Returns the index of the route, or -1 if the pattern is malformed.
+ */
+int QxtWebRouter::addRoute(const QString& pattern, QxtAbstractWebService* service)
+{
+    if (!service)
+        return -1;
+    QxtWebRoute route;
+    route.pattern = pattern;
+    route.service = service;
+
+    if (!qxt_d().captures(pattern, &route.captureTypes))
+        return -1;
+
+    QWriteLocker locker(&qxt_d().lock);
+    QxtWebRouteNode* node = qxt_d().insert(pattern);
+    if (node->mount >= 0)
+        qWarning() << "QxtWebRouter::addRoute:" << pattern << "already registered";
+    node->mount = qxt_d().routes.count();
+    qxt_d().routes.append(route);
+    return node->mount;
+}
+
+/*!
+ * Returns the number of routes added to the router.
+ */
+int QxtWebRouter::routeCount() const
+{
+    QReadLocker locker(&qxt_d().lock);
+    return qxt_d().routes.count();
+}
+
+/*!
+ * Returns the index of the route that handles \a path, or -1 if no route
+ * matches. If \a arguments is not null, the values captured from the path
+ * are stored in it.
+ */
+int QxtWebRouter::match(const QString& path, QVariantList* arguments) const
+{
+    QString target = path.isEmpty() ? QString("/") : path;
+    QxtWebRouterPrivate::Match match;
+    QReadLocker locker(&qxt_d().lock);
+    if (!qxt_d().resolve(&qxt_d().root, target, 1, match))
+        return -1;
+    if (arguments)
+    {
+        arguments->clear();
+        const QxtWebRoute& route = qxt_d().routes.at(match.route);
+        for (int i = 0; i < match.captures.count() && i < route.captureTypes.count(); i++)
+        {
+            if (route.captureTypes.at(i) == QMetaType::Int)
+                arguments->append(match.captures.at(i).toInt());
+            else
+                arguments->append(match.captures.at(i).toString());
+        }
+    }
+    return match.route;
+}
+
+/*!
+ * \reimp
+ */
+void QxtWebRouter::pageRequestedEvent(QxtWebRequestEvent* event)
+{
+    QString path = event->url.path();
+    if (path.isEmpty())
+        path = "/";
+    QxtWebRouterPrivate::Match match;
+    QxtWebRoute route;
+    {
+        QReadLocker locker(&qxt_d().lock);
+        if (qxt_d().resolve(&qxt_d().root, path, 1, match))
+            route = qxt_d().routes.at(match.route);
+    }
+
+    if (route.service)
+    {
+        event->url.setPath(match.remainder < path.size() ? path.mid(match.remainder) : QString("/"));
+        route.service->pageRequestedEvent(event);
+        return;
+    }
+    if (!route.receiver)
+    {
+        unmatchedRequest(event);
+        return;
+    }
+
+    int ints[QxtWebRouterPrivate::MaxCaptures];
+    QString strings[QxtWebRouterPrivate::MaxCaptures];
+    QGenericArgument args[QxtWebRouterPrivate::MaxCaptures + 1];
+    args[0] = Q_ARG(QxtWebRequestEvent*, event);
+    for (int i = 0; i < route.captureTypes.count(); i++)
+    {
+        if (route.captureTypes.at(i) == QMetaType::Int)
+        {
+            ints[i] = match.captures.at(i).toInt();
+            args[i + 1] = QGenericArgument("int", &ints[i]);
+        }
+        else
+        {
+            strings[i] = match.captures.at(i).toString();
+            args[i + 1] = QGenericArgument("QString", &strings[i]);
+        }
+    }
+    if (!route.method.invoke(route.receiver, Qt::DirectConnection,
+                             args[0], args[1], args[2], args[3], args[4], args[5], args[6], args[7], args[8], args[9]))
+    {
+        postEvent(new QxtWebErrorEvent(event->sessionID, event->requestID, 500, "Internal Server Error"));
+    }
+}
+
+/*!
+ * This \a event handler is called whenever no route matches the requested URL.
+ *
+ * The default implementation returns a 404 "Not Found" error.
+ * Subclasses may reimplement this event handler to customize this behavior.
+ */
+void QxtWebRouter::unmatchedRequest(QxtWebRequestEvent* event)
+{
+    postEvent(new QxtWebErrorEvent(event->sessionID, event->requestID, 404, "Not Found"));
+}
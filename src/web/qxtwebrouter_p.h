@@ -0,0 +1,102 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTWEBROUTER_P_H
+#define QXTWEBROUTER_P_H
+
+#include "qxtwebrouter.h"
+#include <QString>
+#include <QStringRef>
+#include <QVector>
+#include <QPair>
+#include <QPointer>
+#include <QMetaMethod>
+#include <QReadWriteLock>
+#include <QVarLengthArray>
+
+#ifndef QXT_DOXYGEN_RUN
+/*
+ * One path segment position in the routing tree. Literal children are kept
+ * sorted so that they can be searched with a QStringRef into the request
+ * path, without splitting it.
+ */
+struct QxtWebRouteNode
+{
+    QxtWebRouteNode() : intChild(0), stringChild(0), pathChild(0), route(-1), mount(-1) {}
+    ~QxtWebRouteNode();
+
+    QxtWebRouteNode* literal(const QStringRef& segment) const;
+    QxtWebRouteNode* addLiteral(const QString& segment);
+
+    QVector<QPair<QString, QxtWebRouteNode*> > literals;
+    QxtWebRouteNode* intChild;          // {name:int}
+    QxtWebRouteNode* stringChild;       // {name} and {name:string}
+    QxtWebRouteNode* pathChild;         // {name:path} and *, matching the rest of the path
+    int route;                          // handler ending here
+    int mount;                          // service handling everything below
+};
+
+struct QxtWebRoute
+{
+    QString pattern;
+    QPointer<QObject> receiver;
+    QMetaMethod method;                 // resolved once, when the route is added
+    QVector<int> captureTypes;          // QMetaType::Int or QMetaType::QString
+    QPointer<QxtAbstractWebService> service;
+};
+
+class QxtWebRouterPrivate : public QxtPrivate<QxtWebRouter>
+{
+public:
+    QXT_DECLARE_PUBLIC(QxtWebRouter)
+
+    enum { MaxCaptures = 9 };
+    typedef QVarLengthArray<QStringRef, MaxCaptures> Captures;
+
+    struct Match
+    {
+        Match() : route(-1), remainder(-1) {}
+        int route;
+        int remainder;                  // for mounts, where the unmatched part of the path starts
+        Captures captures;
+    };
+
+    mutable QReadWriteLock lock;
+    QxtWebRouteNode root;
+    QVector<QxtWebRoute> routes;
+
+    bool captures(const QString& pattern, QVector<int>* captureTypes);
+    QxtWebRouteNode* insert(const QString& pattern);
+    bool resolve(const QxtWebRouteNode* node, const QString& path, int pos, Match& match) const;
+};
+#endif // QXT_DOXYGEN_RUN
+
+#endif // QXTWEBROUTER_P_H
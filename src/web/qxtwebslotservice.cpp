@@ -57,17 +57,60 @@ will output<br>
 &lth1&gtFoo&lt/h1&gt<br>
 
 
-\sa QxtAbstractWebService
+\sa QxtAbstractWebService, QxtWebRouter
 */
 
 #include "qxtwebslotservice.h"
 #include "qxtwebevent.h"
+#include <QHash>
+#include <QMetaMethod>
+#include <QReadWriteLock>
+
+#ifndef QXT_DOXYGEN_RUN
+class QxtWebSlotServicePrivate : public QxtPrivate<QxtWebSlotService>
+{
+public:
+    QXT_DECLARE_PUBLIC(QxtWebSlotService)
+
+    // Slots are looked up by name and argument count once; later requests
+    // for the same action reuse the method index. The table only ever holds
+    // slots that exist, so its size is bounded by the service's interface.
+    QReadWriteLock lock;
+    QHash<QByteArray, int> methods;
+
+    int method(const QMetaObject* metaObject, const QByteArray& action, int argc);
+};
+
+int QxtWebSlotServicePrivate::method(const QMetaObject* metaObject, const QByteArray& action, int argc)
+{
+    QByteArray key = action + '/' + QByteArray::number(argc);
+    {
+        QReadLocker locker(&lock);
+        QHash<QByteArray, int>::const_iterator it = methods.constFind(key);
+        if (it != methods.constEnd())
+            return *it;
+    }
+    QByteArray signature = action + "(QxtWebRequestEvent*";
+    for (int i = 0; i < argc; i++)
+        signature += ",QString";
+    signature += ')';
+    int index = metaObject->indexOfMethod(QMetaObject::normalizedSignature(signature.constData()).constData());
+    // Misses are not cached: the action comes from the URL, so remembering
+    // them would let clients grow the table without bound.
+    if (index >= 0) {
+        QWriteLocker locker(&lock);
+        methods.insert(key, index);
+    }
+    return index;
+}
+#endif
 
 /*!
     Constructs a new QxtWebSlotService with \a sm and \a parent.
  */
 QxtWebSlotService::QxtWebSlotService(QxtAbstractWebSessionManager* sm, QObject* parent): QxtAbstractWebService(sm, parent)
 {
+    QXT_INIT_PRIVATE(QxtWebSlotService);
 }
 
 /*!
@@ -117,96 +160,19 @@ void QxtWebSlotService::pageRequestedEvent(QxtWebRequestEvent* event)
 
 
 
+    // At most eight arguments are passed; further path segments are ignored
+    int argc = qMin(args.count(), 8);
     bool ok = false;
-    if (args.count() > 7)
-    {
-        ok = QMetaObject::invokeMethod(this, action,
-                                       Q_ARG(QxtWebRequestEvent*, event),
-                                       Q_ARG(QString, args.at(0)),
-                                       Q_ARG(QString, args.at(1)),
-                                       Q_ARG(QString, args.at(2)),
-                                       Q_ARG(QString, args.at(3)),
-                                       Q_ARG(QString, args.at(4)),
-                                       Q_ARG(QString, args.at(5)),
-                                       Q_ARG(QString, args.at(6)),
-                                       Q_ARG(QString, args.at(7))
-                                      );
-    }
-    else if (args.count() > 6)
-    {
-        ok = QMetaObject::invokeMethod(this, action,
-                                       Q_ARG(QxtWebRequestEvent*, event),
-                                       Q_ARG(QString, args.at(0)),
-                                       Q_ARG(QString, args.at(1)),
-                                       Q_ARG(QString, args.at(2)),
-                                       Q_ARG(QString, args.at(3)),
-                                       Q_ARG(QString, args.at(4)),
-                                       Q_ARG(QString, args.at(5)),
-                                       Q_ARG(QString, args.at(6))
-                                      );
-    }
-    else if (args.count() > 5)
-    {
-        ok = QMetaObject::invokeMethod(this, action,
-                                       Q_ARG(QxtWebRequestEvent*, event),
-                                       Q_ARG(QString, args.at(0)),
-                                       Q_ARG(QString, args.at(1)),
-                                       Q_ARG(QString, args.at(2)),
-                                       Q_ARG(QString, args.at(3)),
-                                       Q_ARG(QString, args.at(4)),
-                                       Q_ARG(QString, args.at(5))
-                                      );
-    }
-    else if (args.count() > 4)
-    {
-        ok = QMetaObject::invokeMethod(this, action,
-                                       Q_ARG(QxtWebRequestEvent*, event),
-                                       Q_ARG(QString, args.at(0)),
-                                       Q_ARG(QString, args.at(1)),
-                                       Q_ARG(QString, args.at(2)),
-                                       Q_ARG(QString, args.at(3)),
-                                       Q_ARG(QString, args.at(4))
-                                      );
-    }
-    else if (args.count() > 3)
-    {
-        ok = QMetaObject::invokeMethod(this, action,
-                                       Q_ARG(QxtWebRequestEvent*, event),
-                                       Q_ARG(QString, args.at(0)),
-                                       Q_ARG(QString, args.at(1)),
-                                       Q_ARG(QString, args.at(2)),
-                                       Q_ARG(QString, args.at(3))
-                                      );
-    }
-    else if (args.count() > 2)
-    {
-        ok = QMetaObject::invokeMethod(this, action,
-                                       Q_ARG(QxtWebRequestEvent*, event),
-                                       Q_ARG(QString, args.at(0)),
-                                       Q_ARG(QString, args.at(1)),
-                                       Q_ARG(QString, args.at(2))
-                                      );
-    }
-    else if (args.count() > 1)
-    {
-        ok = QMetaObject::invokeMethod(this, action,
-                                       Q_ARG(QxtWebRequestEvent*, event),
-                                       Q_ARG(QString, args.at(0)),
-                                       Q_ARG(QString, args.at(1))
-                                      );
-    }
-    else if (args.count() > 0)
-    {
-        ok = QMetaObject::invokeMethod(this, action,
-                                       Q_ARG(QxtWebRequestEvent*, event),
-                                       Q_ARG(QString, args.at(0))
-                                      );
-    }
-    else
+    int index = qxt_d().method(metaObject(), action, argc);
+    if (index != -1)
     {
-        ok = QMetaObject::invokeMethod(this, action,
-                                       Q_ARG(QxtWebRequestEvent*, event)
-                                      );
+        QGenericArgument argv[10];
+        argv[0] = Q_ARG(QxtWebRequestEvent*, event);
+        for (int i = 0; i < argc; i++)
+            argv[i + 1] = Q_ARG(QString, args.at(i));
+        ok = metaObject()->method(index).invoke(this, Qt::DirectConnection,
+                                                argv[0], argv[1], argv[2], argv[3], argv[4],
+                                                argv[5], argv[6], argv[7], argv[8], argv[9]);
     }
 
 
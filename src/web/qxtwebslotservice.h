@@ -35,6 +35,7 @@
 #include "qxtabstractwebservice.h"
 #include <QUrl>
 
+class QxtWebSlotServicePrivate;
 class QXT_WEB_EXPORT QxtWebSlotService : public QxtAbstractWebService
 {
     Q_OBJECT
@@ -47,6 +48,9 @@ protected:
     QUrl self(QxtWebRequestEvent* event);
 
     virtual void functionInvokedEvent(QxtWebRequestEvent* event);
+
+private:
+    QXT_DECLARE_PRIVATE(QxtWebSlotService)
 };
 
 #endif // QXTWEBSLOTSERVICE_H
@@ -0,0 +1,673 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+/*!
+\class QxtWebStaticFileService
+
+\inmodule QxtWeb
+
+\brief The QxtWebStaticFileService class serves files from a directory
+
+QxtWebStaticFileService answers GET and HEAD requests with the contents of the
+files below its root() directory. It can be used as the static content service
+of a QxtHttpSessionManager or mounted in a QxtWebServiceDirectory, in which
+case the part of the URL after the mount point is used as the file path.
+
+Files of up to 64 MiB are mapped into memory instead of being read through
+QIODevice, so the contents travel from the page cache to the connection with
+a single copy. Larger files are streamed from disk in blocks. Small files are
+kept in a cache of limited size, together with a gzip-compressed copy of
+compressible content; repeated requests for a cached file are answered
+without reading the file again. Cached files are checked for modification at
+most once per second. For files that are not compressed in memory, a
+precompressed sibling with a \c .gz suffix is sent to clients that accept
+gzip, provided it is at least as recent as the file itself.
+
+The service sends ETag and Last-Modified headers and answers If-None-Match and
+If-Modified-Since with 304 Not Modified. Byte ranges are supported through
+the Range and If-Range headers; several ranges of a mapped file are sent as
+multipart/byteranges.
+
+\code
+QxtHttpSessionManager manager;
+QxtWebStaticFileService files("/var/www/static", &manager);
+manager.setStaticContentService(&files);
+\endcode
+
+\sa QxtWebServiceDirectory
+*/
+
+#include "qxtwebstaticfileservice.h"
+#include "qxtwebstaticfileservice_p.h"
+#include "qxtwebevent.h"
+#include <qxtgzip_p.h>
+#include <QBuffer>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocale>
+#include <QMimeDatabase>
+#include <QUrl>
+#include <QUuid>
+
+#ifndef QXT_DOXYGEN_RUN
+static const qint64 qxtRevalidateInterval = 1000;
+static const qint64 qxtMaxMappedFileSize = 64 * 1024 * 1024;    // keeps every mapped offset within int
+static const int qxtMaxRanges = 16;
+
+static QString qxtHttpDate(const QDateTime& time)
+{
+    return QLocale::c().toString(time.toUTC(), QLatin1String("ddd, dd MMM yyyy hh:mm:ss 'GMT'"));
+}
+
+static QDateTime qxtParseHttpDate(const QString& text)
+{
+    QDateTime time = QLocale::c().toDateTime(text.trimmed(), QLatin1String("ddd, dd MMM yyyy hh:mm:ss 'GMT'"));
+    time.setTimeSpec(Qt::UTC);
+    return time;
+}
+
+/*
+ * Compresses a cached file for clients that accept gzip. Returns an empty
+ * array if Qxt was built without zlib.
+ */
+static QByteArray qxtGzipContents(const QByteArray& data)
+{
+    QByteArray gzip;
+    QBuffer in;
+    in.setData(data);
+    QBuffer out(&gzip);
+    if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly) || !qxtGzip(&in, &out))
+        return QByteArray();
+    return gzip;
+}
+
+static bool qxtIsCompressible(const QByteArray& type)
+{
+    return type.startsWith("text/") || type.endsWith("+xml") || type.endsWith("+json")
+           || type == "application/javascript" || type == "application/json" || type == "application/xml";
+}
+
+enum QxtRangeResult { NoRange, Satisfiable, Unsatisfiable };
+
+struct QxtByteRange
+{
+    qint64 first, last;
+};
+
+/*
+ * Parses a Range header into the satisfiable ranges of a file of the given
+ * size. A malformed header, or one with too many ranges, is ignored and the
+ * whole file is served.
+ */
+static QxtRangeResult qxtParseRange(const QString& spec, qint64 size, QList<QxtByteRange>& ranges)
+{
+    QString value = spec.trimmed();
+    if (!value.startsWith(QLatin1String("bytes="))) return NoRange;
+    QStringList specs = value.mid(6).split(',');
+    if (specs.count() > qxtMaxRanges) return NoRange;
+    foreach(const QString& item, specs)
+    {
+        QString range = item.trimmed();
+        int dash = range.indexOf('-');
+        if (dash == -1) return NoRange;
+        bool ok;
+        QxtByteRange r;
+        if (dash == 0)
+        {
+            qint64 suffix = range.mid(1).toLongLong(&ok);
+            if (!ok) return NoRange;
+            if (suffix <= 0 || size == 0) continue;
+            r.first = qMax(Q_INT64_C(0), size - suffix);
+            r.last = size - 1;
+        }
+        else
+        {
+            r.first = range.left(dash).toLongLong(&ok);
+            if (!ok || r.first < 0) return NoRange;
+            if (dash == range.size() - 1)
+            {
+                r.last = size - 1;
+            }
+            else
+            {
+                r.last = range.mid(dash + 1).toLongLong(&ok);
+                if (!ok || r.last < r.first) return NoRange;
+                r.last = qMin(r.last, size - 1);
+            }
+            if (r.first >= size) continue;
+        }
+        ranges.append(r);
+    }
+    return ranges.isEmpty() ? Unsatisfiable : Satisfiable;
+}
+
+QxtStaticFile::~QxtStaticFile()
+{
+    if (map)
+        file.unmap(map);
+}
+
+bool QxtStaticFile::open(const QString& filePath, const QDateTime& modified, qint64 fileSize)
+{
+    path = filePath;
+    lastModified = modified;
+    size = fileSize;
+    etag = '"' + QByteArray::number(size, 16) + '-' + QByteArray::number(lastModified.toMSecsSinceEpoch(), 16) + '"';
+    contentType = QMimeDatabase().mimeTypeForFile(path).name().toLatin1();
+    if (contentType.startsWith("text/"))
+        contentType += "; charset=utf-8";
+    checked = QDateTime::currentMSecsSinceEpoch();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    if (size > 0 && size <= qxtMaxMappedFileSize)
+    {
+        map = file.map(0, size);
+        if (!map) return false;
+    }
+    return true;
+}
+
+QByteArray QxtStaticFile::contents() const
+{
+    return contents(0, size);
+}
+
+/*
+ * Returns length bytes from first onwards without copying them. The result
+ * is empty if the file is too large to be mapped.
+ */
+QByteArray QxtStaticFile::contents(qint64 first, qint64 length) const
+{
+    if (!map || first < 0 || length < 0 || first + length > size) return QByteArray();
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(map) + first, int(length));
+}
+
+QxtStaticFileBuffer::QxtStaticFileBuffer(const QxtStaticFilePointer& file, const QByteArray& data) : file(file)
+{
+    setData(data);
+    open(QIODevice::ReadOnly);
+}
+
+QxtStaticFileStream::QxtStaticFileStream(const QString& path, qint64 offset, qint64 length) : file(path), remaining(0)
+{
+    if (file.open(QIODevice::ReadOnly) && file.seek(offset))
+        remaining = qMax(Q_INT64_C(0), qMin(length, file.size() - offset));
+    open(QIODevice::ReadOnly);
+}
+
+bool QxtStaticFileStream::isSequential() const
+{
+    return true;
+}
+
+qint64 QxtStaticFileStream::bytesAvailable() const
+{
+    return remaining + QIODevice::bytesAvailable();
+}
+
+qint64 QxtStaticFileStream::readData(char* data, qint64 maxSize)
+{
+    if (remaining <= 0) return 0;
+    qint64 size = file.read(data, qMin(maxSize, remaining));
+    if (size <= 0)
+    {
+        // The file shrank while it was being sent
+        remaining = 0;
+        return size < 0 ? -1 : 0;
+    }
+    remaining -= size;
+    return size;
+}
+
+qint64 QxtStaticFileStream::writeData(const char*, qint64)
+{
+    return -1;
+}
+
+/*
+ * Returns a device that serves length bytes of file from first onwards.
+ */
+static QIODevice* qxtOpenRange(const QxtStaticFilePointer& file, qint64 first, qint64 length)
+{
+    if (file->map || length == 0)
+        return new QxtStaticFileBuffer(file, file->contents(first, length));
+    return new QxtStaticFileStream(file->path, first, length);
+}
+
+QxtWebStaticFileServicePrivate::QxtWebStaticFileServicePrivate()
+    : indexFile("index.html"), cacheSize(16 * 1024 * 1024), maxCachedFileSize(256 * 1024), compression(true),
+      head(0), tail(0), cachedBytes(0)
+{
+}
+
+static qint64 qxtCacheCost(const QxtStaticFile* entry)
+{
+    return entry->size + entry->gzip.size();
+}
+
+void QxtWebStaticFileServicePrivate::unlink(QxtStaticFile* entry)
+{
+    if (entry->prev) entry->prev->next = entry->next;
+    else if (head == entry) head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    else if (tail == entry) tail = entry->prev;
+    entry->prev = entry->next = 0;
+}
+
+void QxtWebStaticFileServicePrivate::touch(QxtStaticFile* entry)
+{
+    if (head == entry) return;
+    unlink(entry);
+    entry->next = head;
+    if (head) head->prev = entry;
+    head = entry;
+    if (!tail) tail = entry;
+}
+
+void QxtWebStaticFileServicePrivate::evict()
+{
+    while (tail && cachedBytes > cacheSize)
+    {
+        QxtStaticFile* entry = tail;
+        unlink(entry);
+        cachedBytes -= qxtCacheCost(entry);
+        cache.remove(entry->path);     // the file stays mapped while it is being served
+    }
+}
+
+/*
+ * Returns the file at path, from the cache if possible. Returns a null
+ * pointer if path does not name a readable regular file.
+ */
+QxtStaticFilePointer QxtWebStaticFileServicePrivate::file(const QString& path)
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker locker(&cacheLock);
+    QxtStaticFilePointer entry = cache.value(path);
+    if (entry && now - entry->checked < qxtRevalidateInterval)
+    {
+        touch(entry.data());
+        return entry;
+    }
+    locker.unlock();
+
+    QFileInfo info(path);
+    locker.relock();
+    if (entry && cache.value(path) == entry)
+    {
+        if (info.isFile() && info.size() == entry->size && info.lastModified() == entry->lastModified)
+        {
+            entry->checked = now;
+            touch(entry.data());
+            return entry;
+        }
+        unlink(entry.data());
+        cachedBytes -= qxtCacheCost(entry.data());
+        cache.remove(path);
+    }
+    locker.unlock();
+
+    if (!info.isFile() || !info.isReadable()) return QxtStaticFilePointer();
+    entry = QxtStaticFilePointer(new QxtStaticFile);
+    if (!entry->open(path, info.lastModified(), info.size())) return QxtStaticFilePointer();
+    if (entry->size > maxCachedFileSize || entry->size > qxtMaxMappedFileSize || cacheSize <= 0) return entry;
+
+    if (compression && entry->size > 0 && qxtIsCompressible(entry->contentType))
+    {
+        QByteArray gzip = qxtGzipContents(entry->contents());
+        if (!gzip.isEmpty() && gzip.size() < entry->size)
+            entry->gzip = gzip;
+    }
+    locker.relock();
+    QxtStaticFilePointer existing = cache.value(path);
+    if (existing) return existing;      // another thread got here first
+    cache.insert(path, entry);
+    touch(entry.data());
+    cachedBytes += qxtCacheCost(entry.data());
+    evict();
+    return entry;
+}
+#endif
+
+/*!
+ * Constructs a QxtWebStaticFileService object with the specified session
+ * \a manager and \a parent that serves the files below the directory \a root.
+ *
+ * Often, the session manager will also be the parent, but this is not a requirement.
+ */
+QxtWebStaticFileService::QxtWebStaticFileService(const QString& root, QxtAbstractWebSessionManager* manager, QObject* parent) : QxtAbstractWebService(manager, parent)
+{
+    QXT_INIT_PRIVATE(QxtWebStaticFileService);
+    setRoot(root);
+}
+
+/*!
+ * Returns the directory files are served from.
+ *
+ * \sa setRoot()
+ */
+QString QxtWebStaticFileService::root() const
+{
+    return qxt_d().root;
+}
+
+/*!
+ * Sets the directory files are served from to \a root.
+ *
+ * \sa root()
+ */
+void QxtWebStaticFileService::setRoot(const QString& root)
+{
+    qxt_d().root = QDir(root).absolutePath();
+    clearCache();
+}
+
+/*!
+ * Returns the name of the file served when a directory is requested. The
+ * default is "index.html".
+ *
+ * \sa setIndexFile()
+ */
+QString QxtWebStaticFileService::indexFile() const
+{
+    return qxt_d().indexFile;
+}
+
+/*!
+ * Sets the \a name of the file served when a directory is requested. Set an
+ * empty name to answer requests for directories with 404 Not Found.
+ *
+ * \sa indexFile()
+ */
+void QxtWebStaticFileService::setIndexFile(const QString& name)
+{
+    qxt_d().indexFile = name;
+}
+
+/*!
+ * Returns the maximum number of bytes held by the file cache. The default is
+ * 16 MiB.
+ *
+ * \sa setCacheSize()
+ */
+qint64 QxtWebStaticFileService::cacheSize() const
+{
+    return qxt_d().cacheSize;
+}
+
+/*!
+ * Sets the maximum number of \a bytes held by the file cache. The least
+ * recently used files are dropped when the limit is exceeded. Both the file
+ * contents and their compressed copies count towards the limit. Set it to 0
+ * to disable the cache.
+ *
+ * \sa cacheSize(), setMaximumCachedFileSize()
+ */
+void QxtWebStaticFileService::setCacheSize(qint64 bytes)
+{
+    QMutexLocker locker(&qxt_d().cacheLock);
+    qxt_d().cacheSize = bytes;
+    qxt_d().evict();
+}
+
+/*!
+ * Returns the size of the largest file that is cached. The default is 256 KiB.
+ *
+ * \sa setMaximumCachedFileSize()
+ */
+qint64 QxtWebStaticFileService::maximumCachedFileSize() const
+{
+    return qxt_d().maxCachedFileSize;
+}
+
+/*!
+ * Sets the size of the largest file that is cached to \a bytes. Larger files
+ * are mapped for the duration of each request only.
+ *
+ * \sa maximumCachedFileSize(), setCacheSize()
+ */
+void QxtWebStaticFileService::setMaximumCachedFileSize(qint64 bytes)
+{
+    qxt_d().maxCachedFileSize = bytes;
+}
+
+/*!
+ * Returns whether cached files are also offered gzip-compressed.
+ *
+ * \sa setCompressionEnabled()
+ */
+bool QxtWebStaticFileService::compressionEnabled() const
+{
+    return qxt_d().compression;
+}
+
+/*!
+ * Sets whether cached files of a textual content type are also offered
+ * gzip-compressed to clients that accept it, according to \a enable. The
+ * compressed copy is made once, when the file enters the cache. The default
+ * is enabled. Without zlib, files are only compressed when a precompressed
+ * sibling exists.
+ *
+ * \sa compressionEnabled()
+ */
+void QxtWebStaticFileService::setCompressionEnabled(bool enable)
+{
+    qxt_d().compression = enable;
+    clearCache();
+}
+
+/*!
+ * Drops all files from the cache.
+ */
+void QxtWebStaticFileService::clearCache()
+{
+    QMutexLocker locker(&qxt_d().cacheLock);
+    qxt_d().cache.clear();
+    qxt_d().head = qxt_d().tail = 0;
+    qxt_d().cachedBytes = 0;
+}
+
+/*!
+ * \reimp
+ */
+void QxtWebStaticFileService::pageRequestedEvent(QxtWebRequestEvent* event)
+{
+    if (event->method != "GET" && event->method != "HEAD")
+    {
+        QxtWebErrorEvent* error = new QxtWebErrorEvent(event->sessionID, event->requestID, 405, "Method Not Allowed");
+        error->headers.insert("allow", "GET, HEAD");
+        postEvent(error);
+        return;
+    }
+
+    QString path = QDir::cleanPath('/' + event->url.path(QUrl::FullyDecoded));
+    if (path.startsWith(QLatin1String("/..")) || path.contains(QLatin1String("/../")) || path.contains(QChar(0)))
+    {
+        postEvent(new QxtWebErrorEvent(event->sessionID, event->requestID, 403, "Forbidden"));
+        return;
+    }
+    QString filePath = qxt_d().root + path;
+    if (event->url.path().endsWith('/') && !qxt_d().indexFile.isEmpty())
+        filePath += '/' + qxt_d().indexFile;
+
+    QxtStaticFilePointer file = qxt_d().file(filePath);
+    if (!file)
+    {
+        if (!event->url.path().endsWith('/') && QFileInfo(filePath).isDir())
+            postEvent(new QxtWebRedirectEvent(event->sessionID, event->requestID, path.mid(path.lastIndexOf('/') + 1) + '/', 301));
+        else
+            postEvent(new QxtWebErrorEvent(event->sessionID, event->requestID, 404, "Not Found"));
+        return;
+    }
+
+    // A file that has no compressed copy in memory may have a precompressed
+    // sibling. It is only looked for when the client would accept it.
+    bool acceptGzip = event->headers.value("accept-encoding").contains("gzip");
+    bool ranged = event->headers.contains("range");
+    QxtStaticFilePointer gzipFile;
+    if (acceptGzip && !ranged && qxt_d().compression && file->gzip.isEmpty() && !filePath.endsWith(QLatin1String(".gz")))
+    {
+        gzipFile = qxt_d().file(filePath + QLatin1String(".gz"));
+        if (gzipFile && gzipFile->lastModified < file->lastModified)
+            gzipFile.clear();
+    }
+    // The representation that is sent decides the validators
+    const QByteArray& etag = gzipFile ? gzipFile->etag : file->etag;
+
+    QMultiHash<QString, QString> headers;
+    headers.insert("etag", QString::fromLatin1(etag));
+    headers.insert("last-modified", qxtHttpDate(file->lastModified));
+    headers.insert("accept-ranges", "bytes");
+    if (!file->gzip.isEmpty() || gzipFile)
+        headers.insert("vary", "accept-encoding");
+
+    // Conditional requests
+    bool notModified = false;
+    QString ifNoneMatch = event->headers.value("if-none-match");
+    if (!ifNoneMatch.isEmpty())
+    {
+        foreach(const QString& tag, ifNoneMatch.split(','))
+        {
+            QString t = tag.trimmed();
+            if (t.startsWith(QLatin1String("W/"))) t = t.mid(2);
+            if (t == QLatin1String("*") || t == QLatin1String(etag)) notModified = true;
+        }
+    }
+    else if (event->headers.contains("if-modified-since"))
+    {
+        QDateTime since = qxtParseHttpDate(event->headers.value("if-modified-since"));
+        if (since.isValid() && file->lastModified.toMSecsSinceEpoch() / 1000 <= since.toMSecsSinceEpoch() / 1000)
+            notModified = true;
+    }
+    if (notModified)
+    {
+        QxtWebPageEvent* page = new QxtWebPageEvent(event->sessionID, event->requestID, QByteArray());
+        page->status = 304;
+        page->statusMessage = "Not Modified";
+        page->headers = headers;
+        postEvent(page);
+        return;
+    }
+
+    // Byte ranges
+    QList<QxtByteRange> ranges;
+    QxtRangeResult range = NoRange;
+    if (ranged)
+    {
+        QString ifRange = event->headers.value("if-range").trimmed();
+        if (ifRange.isEmpty() || ifRange == QLatin1String(file->etag) || qxtParseHttpDate(ifRange) == file->lastModified.toUTC())
+            range = qxtParseRange(event->headers.value("range"), file->size, ranges);
+    }
+    if (range == Unsatisfiable)
+    {
+        QxtWebErrorEvent* error = new QxtWebErrorEvent(event->sessionID, event->requestID, 416, "Range Not Satisfiable");
+        error->headers.insert("content-range", "bytes */" + QString::number(file->size));
+        postEvent(error);
+        return;
+    }
+    QByteArray contentType = file->contentType;
+    QByteArray multipart;
+    if (range == Satisfiable && ranges.count() > 1)
+    {
+        // The parts are assembled in memory. Overlapping ranges could make
+        // that far larger than the file, in which case the whole file is sent.
+        qint64 total = 0;
+        foreach(const QxtByteRange& r, ranges)
+            total += r.last - r.first + 1;
+        if (!file->map || total > file->size)
+        {
+            range = NoRange;
+        }
+        else
+        {
+            QByteArray boundary = QUuid::createUuid().toRfc4122().toHex();
+            foreach(const QxtByteRange& r, ranges)
+            {
+                multipart += "--" + boundary + "\r\ncontent-type: " + file->contentType
+                             + "\r\ncontent-range: bytes " + QByteArray::number(r.first) + '-' + QByteArray::number(r.last)
+                             + '/' + QByteArray::number(file->size) + "\r\n\r\n";
+                multipart += file->contents(r.first, r.last - r.first + 1);
+                multipart += "\r\n";
+            }
+            multipart += "--" + boundary + "--\r\n";
+            contentType = "multipart/byteranges; boundary=" + boundary;
+        }
+    }
+
+    QxtStaticFilePointer source = file;
+    QByteArray data;
+    qint64 first = 0, length = file->size;
+    if (!multipart.isEmpty())
+    {
+        data = multipart;
+        length = data.size();
+    }
+    else if (range == Satisfiable)
+    {
+        first = ranges.first().first;
+        length = ranges.first().last - first + 1;
+        headers.insert("content-range", QString("bytes %1-%2/%3").arg(first).arg(ranges.first().last).arg(file->size));
+    }
+    else if (acceptGzip && !file->gzip.isEmpty())
+    {
+        data = file->gzip;
+        length = data.size();
+        headers.insert("content-encoding", "gzip");
+    }
+    else if (gzipFile)
+    {
+        source = gzipFile;
+        length = gzipFile->size;
+        headers.insert("content-encoding", "gzip");
+    }
+
+    QxtWebPageEvent* page;
+    if (event->method == "HEAD")
+    {
+        page = new QxtWebPageEvent(event->sessionID, event->requestID, QByteArray());
+        headers.insert("content-length", QString::number(length));
+    }
+    else
+    {
+        QIODevice* body = data.isEmpty() ? qxtOpenRange(source, first, length) : new QxtStaticFileBuffer(source, data);
+        page = new QxtWebPageEvent(event->sessionID, event->requestID, body);
+        page->chunked = false;
+        page->streaming = false;
+    }
+    if (range == Satisfiable)
+    {
+        page->status = 206;
+        page->statusMessage = "Partial Content";
+    }
+    page->contentType = contentType;
+    page->headers = headers;
+    postEvent(page);
+}
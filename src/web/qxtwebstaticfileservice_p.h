@@ -0,0 +1,135 @@
+
+/****************************************************************************
+** Copyright (c) 2006 - 2011, the LibQxt project.
+** See the Qxt AUTHORS file for a list of authors and copyright holders.
+** All rights reserved.
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of the LibQxt project nor the
+**       names of its contributors may be used to endorse or promote products
+**       derived from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+** WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+** DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+** DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+** (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+** LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+** ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+** (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+** SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+**
+** <http://libqxt.org>  <foundation@libqxt.org>
+*****************************************************************************/
+
+#ifndef QXTWEBSTATICFILESERVICE_P_H
+#define QXTWEBSTATICFILESERVICE_P_H
+
+#include "qxtwebstaticfileservice.h"
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QFile>
+#include <QBuffer>
+#include <QMutex>
+#include <QSharedPointer>
+
+#ifndef QXT_DOXYGEN_RUN
+/*
+ * A file opened for serving. Files up to a size cap are mapped into memory
+ * rather than read, so serving them costs one copy into the socket's send
+ * buffer; larger ones are streamed through QFile. Cached entries are linked
+ * into the LRU list of the service.
+ */
+struct QxtStaticFile
+{
+    QxtStaticFile() : size(0), map(0), checked(0), prev(0), next(0) {}
+    ~QxtStaticFile();
+
+    bool open(const QString& path, const QDateTime& modified, qint64 size);
+    QByteArray contents() const;
+    QByteArray contents(qint64 first, qint64 length) const;
+
+    QString path;
+    QDateTime lastModified;
+    qint64 size;
+    QByteArray etag;
+    QByteArray contentType;
+    QFile file;
+    uchar* map;
+    QByteArray gzip;            // pre-compressed body, if compressible
+    qint64 checked;             // last time the file was stat()ed, in ms since the epoch
+
+    QxtStaticFile* prev;        // LRU links; more recently used towards the head
+    QxtStaticFile* next;
+};
+typedef QSharedPointer<QxtStaticFile> QxtStaticFilePointer;
+
+/*
+ * Serves part of a file's contents while keeping the file mapped.
+ */
+class QxtStaticFileBuffer : public QBuffer
+{
+public:
+    QxtStaticFileBuffer(const QxtStaticFilePointer& file, const QByteArray& data);
+
+private:
+    QxtStaticFilePointer file;
+};
+
+/*
+ * Serves part of a file that is too large to be mapped, reading it through
+ * QFile one block at a time.
+ */
+class QxtStaticFileStream : public QIODevice
+{
+public:
+    QxtStaticFileStream(const QString& path, qint64 offset, qint64 length);
+
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize);
+    qint64 writeData(const char* data, qint64 size);
+
+private:
+    QFile file;
+    qint64 remaining;
+};
+
+class QxtWebStaticFileServicePrivate : public QxtPrivate<QxtWebStaticFileService>
+{
+public:
+    QxtWebStaticFileServicePrivate();
+    QXT_DECLARE_PUBLIC(QxtWebStaticFileService)
+
+    QString root;
+    QString indexFile;
+    qint64 cacheSize;
+    qint64 maxCachedFileSize;
+    bool compression;
+
+    // The service may be invoked from several I/O threads at once
+    QMutex cacheLock;
+    QHash<QString, QxtStaticFilePointer> cache;
+    QxtStaticFile* head;
+    QxtStaticFile* tail;
+    qint64 cachedBytes;
+
+    QxtStaticFilePointer file(const QString& path);
+    void touch(QxtStaticFile* entry);
+    void unlink(QxtStaticFile* entry);
+    void evict();
+};
+#endif // QXT_DOXYGEN_RUN
+
+#endif // QXTWEBSTATICFILESERVICE_P_H
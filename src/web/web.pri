@@ -2,27 +2,40 @@ INCLUDEPATH += $$PWD
 DEPENDPATH += $$PWD
 
 SOURCES += qxtabstracthttpconnector.cpp
+SOURCES += qxtabstractsessionstore.cpp
 SOURCES += qxtabstractwebservice.cpp
 SOURCES += qxtabstractwebsessionmanager.cpp
+SOURCES += qxtfcgiserverconnector.cpp
 SOURCES += qxthtmltemplate.cpp
+SOURCES += qxthttpcompressor.cpp
 SOURCES += qxthttpserverconnector.cpp
+SOURCES += qxthttprequestparser.cpp
 SOURCES += qxthttpsessionmanager.cpp
 SOURCES += qxtscgiserverconnector.cpp
 SOURCES += qxtwebcgiservice.cpp
 SOURCES += qxtwebcontent.cpp
 SOURCES += qxtwebevent.cpp
 SOURCES += qxtwebjsonrpcservice.cpp
+SOURCES += qxtwebmultipartparser.cpp
+SOURCES += qxtwebrouter.cpp
 SOURCES += qxtwebservicedirectory.cpp
 SOURCES += qxtwebslotservice.cpp
+SOURCES += qxtwebstaticfileservice.cpp
 SOURCES += qhttpheader.cpp
 #SOURCES += qxtwebtemplate.cpp
 
 HEADERS += qxtabstracthttpconnector.h
+HEADERS += qxtabstractsessionstore.h
 HEADERS += qxtabstractwebservice.h
 HEADERS += qxtabstractwebsessionmanager.h
 HEADERS += qxtabstractwebsessionmanager_p.h
+HEADERS += qxtfcgi_p.h
+HEADERS += qxtfcgiserverconnector_p.h
 HEADERS += qxthtmltemplate.h
+HEADERS += qxthttpcompressor_p.h
+HEADERS += qxthttprequestparser.h
 HEADERS += qxthttpsessionmanager.h
+HEADERS += qxthttpsessionmanager_p.h
 HEADERS += qxtwebcgiservice.h
 HEADERS += qxtwebcgiservice_p.h
 HEADERS += qxtwebcontent.h
@@ -30,9 +43,14 @@ HEADERS += qxtwebevent.h
 HEADERS += qxtweb.h
 HEADERS += qxtwebjsonrpcservice.h
 HEADERS += qxtwebjsonrpcservice_p.h
+HEADERS += qxtwebmultipartparser.h
+HEADERS += qxtwebrouter.h
+HEADERS += qxtwebrouter_p.h
 HEADERS += qxtwebservicedirectory.h
 HEADERS += qxtwebservicedirectory_p.h
 HEADERS += qxtwebslotservice.h
+HEADERS += qxtwebstaticfileservice.h
+HEADERS += qxtwebstaticfileservice_p.h
 HEADERS += qhttpheader.h
 #HEADERS += qxtwebtemplate.h
 #HEADERS += qxtwebtemplate_p.h
@@ -8,6 +8,10 @@ contains(DEFINES,QXT_HAVE_WEBSOCKETS) {
   QT += websockets
 }
 
+contains(DEFINES,QXT_HAVE_ZLIB) {
+  LIBS += -lz
+}
+
 include(web.pri)
 include(../qxtbase.pri)
 
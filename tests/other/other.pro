@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS += app no_keywords QxtFileLock QxtScheduleView slotjob
+SUBDIRS += app no_keywords QxtFileLock QxtScheduleView slotjob xmlloggerbench
@@ -0,0 +1,155 @@
+/*
+ * Compares the XML file logger engine with the implementation it replaced.
+ *
+ * "legacy" is the writer as it was before append-only framing was added: it
+ * seeks back over the closing tag for every entry, issues one write per
+ * fragment and escapes messages with chained replace() calls. "rewrite" and
+ * "append only" are the two framing modes of QxtXmlFileLoggerEngine.
+ *
+ * throughput() reports the time per 1000 entries through QBENCHMARK;
+ * latency() times single entries and prints the median, 99th percentile and
+ * maximum.
+ */
+
+#include <QTest>
+#include <QElapsedTimer>
+#include <QTime>
+#include <QVector>
+#include <QxtXmlFileLoggerEngine>
+#include <QxtAbstractFileLoggerEngine>
+#include <QxtTemporaryDir>
+#include <algorithm>
+
+class LegacyXmlFileLoggerEngine : public QxtAbstractFileLoggerEngine
+{
+public:
+    LegacyXmlFileLoggerEngine(const QString& fileName)
+        : QxtAbstractFileLoggerEngine(fileName, QIODevice::ReadWrite | QIODevice::Unbuffered), tab("    ")
+    {
+        initLoggerEngine();
+    }
+
+    void initLoggerEngine()
+    {
+        QxtAbstractFileLoggerEngine::initLoggerEngine();
+        QIODevice* file = device();
+        if (file && file->size() == 0)
+        {
+            file->write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+            file->write("<log>\n");
+            file->write("</log>");
+        }
+    }
+
+protected:
+    void writeToFile(const QString& level, const QVariantList& messages)
+    {
+        QIODevice* file = device();
+        file->seek(file->size() - 6);
+        file->write(tab.toUtf8());
+        file->write("<entry type=\"");
+        file->write(level.toUtf8());
+        file->write("\" time=\"");
+        file->write(QTime::currentTime().toString("hh:mm:ss.zzzz").toUtf8());
+        file->write("\">");
+        file->write("\n");
+        foreach(const QVariant& m, messages)
+        {
+            file->write(tab.toUtf8());
+            file->write(tab.toUtf8());
+            file->write("<message>");
+            file->write(toXmlSafeString(m.toString()).toUtf8());
+            file->write("</message>\n");
+        }
+        file->write(tab.toUtf8());
+        file->write("</entry>");
+        file->write("\n");
+        file->write("</log>");
+    }
+
+private:
+    static QString toXmlSafeString(const QString& raw)
+    {
+        return QByteArray(raw.toUtf8()).replace('&', "&amp;").replace('<', "&lt;").replace('>', "&gt;").replace('\'', "&apos;").replace('"', "&quot;");
+    }
+
+    QString tab;
+};
+
+enum Writer { Legacy, Rewrite, AppendOnly };
+Q_DECLARE_METATYPE(Writer)
+
+static QxtLoggerEngine* createEngine(Writer writer, const QString& fileName)
+{
+    if (writer == Legacy)
+        return new LegacyXmlFileLoggerEngine(fileName);
+    QxtXmlFileLoggerEngine* xml = new QxtXmlFileLoggerEngine(fileName);
+    xml->setAppendOnly(writer == AppendOnly);
+    return xml;
+}
+
+class Bench : public QObject
+{
+    Q_OBJECT
+private:
+    QList<QVariant> messages;
+
+    void writers()
+    {
+        QTest::addColumn<Writer>("writer");
+        QTest::newRow("legacy") << Legacy;
+        QTest::newRow("rewrite") << Rewrite;
+        QTest::newRow("append only") << AppendOnly;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        messages << "request served" << 200 << "<html> & \"more\"";
+    }
+
+    void throughput_data()
+    {
+        writers();
+    }
+
+    void throughput()
+    {
+        QFETCH(Writer, writer);
+        QxtTemporaryDir dir;
+        QxtLoggerEngine* engine = createEngine(writer, dir.path() + "/bench.xml");
+        QBENCHMARK {
+            for (int i = 0; i < 1000; i++)
+                engine->writeFormatted(QxtLogger::InfoLevel, messages);
+        }
+        delete engine;
+    }
+
+    void latency_data()
+    {
+        writers();
+    }
+
+    void latency()
+    {
+        QFETCH(Writer, writer);
+        QxtTemporaryDir dir;
+        QxtLoggerEngine* engine = createEngine(writer, dir.path() + "/bench.xml");
+        const int count = 20000;
+        QVector<qint64> samples(count);
+        QElapsedTimer timer;
+        for (int i = 0; i < count; i++)
+        {
+            timer.start();
+            engine->writeFormatted(QxtLogger::InfoLevel, messages);
+            samples[i] = timer.nsecsElapsed();
+        }
+        delete engine;
+        std::sort(samples.begin(), samples.end());
+        qDebug("%s: median %lld ns, p99 %lld ns, max %lld ns per entry", QTest::currentDataTag(),
+               samples.at(count / 2), samples.at(count * 99 / 100), samples.last());
+    }
+};
+
+QTEST_MAIN(Bench)
+#include "main.moc"
@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET =
+DEPENDPATH += .
+INCLUDEPATH += .
+CONFIG += console qtestlib
+CONFIG -= app_bundle
+QT = core testlib
+QXT = core
+include($$QXT_SOURCE_TREE/src/qxtlibs.pri)
+
+SOURCES += main.cpp
@@ -1,6 +1,33 @@
 #include <QxtJSON>
+#include <QxtJSONReader>
 #include <QTest>
 #include <QDebug>
+#include <QBuffer>
+#include <QJsonDocument>
+
+// A batch of JSON-RPC calls with the mix of small strings, numbers and
+// nested objects that typical service traffic carries.
+static QVariant rpcPayload(int calls)
+{
+    QVariantList batch;
+    for (int i = 0; i < calls; i++)
+    {
+        QVariantMap params;
+        params["user"] = QString("user%1@example.com").arg(i);
+        params["limit"] = 50;
+        params["offset"] = i * 50;
+        params["ratio"] = 0.25 * i;
+        params["flags"] = QVariantList() << true << false << QVariant();
+        params["title"] = QString::fromUtf8("Caf\xc3\xa9 \"quoted\"\n");
+        QVariantMap call;
+        call["jsonrpc"] = "2.0";
+        call["method"] = "inventory.search";
+        call["params"] = params;
+        call["id"] = i;
+        batch << call;
+    }
+    return batch;
+}
 
 class QxtJSONTest: public QObject{
     Q_OBJECT;
@@ -56,6 +83,83 @@ private slots:
 	}
 
 
+    void parseStrict(){
+        bool ok = true;
+        QVERIFY(QxtJSON::parseUtf8("[1,2,]", &ok).isNull());
+        QVERIFY(!ok);
+        QVERIFY(QxtJSON::parseUtf8("{\"a\":1} x", &ok).isNull());
+        QVERIFY(!ok);
+        QVERIFY(QxtJSON::parseUtf8("\"unterminated", &ok).isNull());
+        QVERIFY(!ok);
+        QCOMPARE(QxtJSON::parseUtf8(" {\"a\":[]} ", &ok), QVariant(QVariantMap{{"a", QVariantList()}}));
+        QVERIFY(ok);
+        QCOMPARE(QxtJSON::parseUtf8("12345678901").toLongLong(), Q_INT64_C(12345678901));
+        QCOMPARE(QxtJSON::parseUtf8("1e3").toDouble(), 1000.0);
+    }
+
+    void escapes(){
+        QString s = QString::fromUtf8("tab\tquote\"back\\slash\x01 \xc3\xa9 \xf0\x9f\x98\x80");
+        QByteArray json = QxtJSON::stringifyUtf8(s);
+        QCOMPARE(json, QByteArray("\"tab\\tquote\\\"back\\\\slash\\u0001 \xc3\xa9 \xf0\x9f\x98\x80\""));
+        QCOMPARE(QxtJSON::parseUtf8(json).toString(), s);
+        QCOMPARE(QxtJSON::parseUtf8("\"\\ud83d\\ude00\\u00e9\"").toString(), QString::fromUtf8("\xf0\x9f\x98\x80\xc3\xa9"));
+    }
+
+    void reader(){
+        QxtJSONReader reader("{\"skip\":{\"a\":[1,{}]},\"id\":7,\"name\":\"x\"}");
+        QCOMPARE(reader.readNext(), QxtJSONReader::StartObject);
+        QCOMPARE(reader.readNext(), QxtJSONReader::Name);
+        QCOMPARE(reader.text(), QString("skip"));
+        reader.skipValue();
+        QCOMPARE(reader.readNext(), QxtJSONReader::Name);
+        QCOMPARE(reader.readValue(), QVariant(7));
+        QCOMPARE(reader.readNext(), QxtJSONReader::Name);
+        QCOMPARE(reader.readNext(), QxtJSONReader::String);
+        QCOMPARE(reader.text(), QString("x"));
+        QCOMPARE(reader.readNext(), QxtJSONReader::EndObject);
+        QCOMPARE(reader.readNext(), QxtJSONReader::EndDocument);
+        QVERIFY(!reader.hasError());
+    }
+
+    void stringifyDevice(){
+        QVariant payload = rpcPayload(2000);
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        QVERIFY(QxtJSON::stringify(payload, &buffer));
+        QCOMPARE(buffer.data(), QxtJSON::stringifyUtf8(payload));
+        QCOMPARE(QxtJSON::parseUtf8(buffer.data()), payload);
+    }
+
+    void benchmarkParse_data(){
+        QTest::addColumn<int>("parser");
+        QTest::newRow("QxtJSON") << 0;
+        QTest::newRow("QJsonDocument") << 1;
+    }
+    void benchmarkParse(){
+        QFETCH(int, parser);
+        QByteArray json = QxtJSON::stringifyUtf8(rpcPayload(2000));
+        QBENCHMARK {
+            if (parser == 0)
+                QxtJSON::parseUtf8(json);
+            else
+                QJsonDocument::fromJson(json).toVariant();
+        }
+    }
+
+    void benchmarkStringify_data(){
+        benchmarkParse_data();
+    }
+    void benchmarkStringify(){
+        QFETCH(int, parser);
+        QVariant payload = rpcPayload(2000);
+        QBENCHMARK {
+            if (parser == 0)
+                QxtJSON::stringifyUtf8(payload);
+            else
+                QJsonDocument::fromVariant(payload).toJson(QJsonDocument::Compact);
+        }
+    }
+
 	void regressXenakios(){
         QVariant e=QxtJSON::parse("{\"apina\":\"ripulia!\",\"doctype\":\"QtCDP WorkSpace\",\"processinghistory\":[{\"infilename\":\"H:/Samples from net/Berklee44v8/Berklee44v8/aluminum2.wav\",\"itemname\":\"aluminum2.wav\",\"itemtag\":\"inputfile\",\"tse\":5.62246,\"tss\":5.08163},{\"infilename\":\"H:/Samples from net/Berklee44v8/Berklee44v8/aluminum3.wav\",\"itemname\":\"aluminum3.wav\",\"itemtag\":\"inputfile\"},{\"infilename\":\"H:/Samples from net/Berklee44v8/Berklee44v8/asprin_crinkle_1.wav\",\"itemname\":\"asprin_crinkle_1.wav\",\"itemtag\":\"inputfile\",\"tse\":0.593006,\"tss\":0.255667},{\"infilename\":\"H:/Samples from net/Berklee44v8/Berklee44v8/asprin_crinkle_2.wav\",\"itemname\":\"asprin_crinkle_2.wav\",\"itemtag\":\"inputfile\",\"tse\":1.66739,\"tss\":1.53128}]}");
         QVERIFY(!e.isNull());
@@ -0,0 +1,237 @@
+#include <QTest>
+#include <QThread>
+#include <QSemaphore>
+#include <QMutex>
+#include <QxtLogger>
+#include <QxtLoggerEngine>
+#include <QxtBasicFileLoggerEngine>
+#include <QxtXmlFileLoggerEngine>
+#include <QxtTemporaryDir>
+#include <QDir>
+#include <QFileInfo>
+#include <QThreadPool>
+#ifdef QXT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+class RecordingEngine : public QxtLoggerEngine
+{
+public:
+    RecordingEngine() : gate(0) {}
+
+    void initLoggerEngine() {}
+    void killLoggerEngine() {}
+    bool isInitialized() const { return true; }
+
+    void writeFormatted(QxtLogger::LogLevel level, const QList<QVariant>& messages)
+    {
+        if (gate) gate->acquire();
+        QMutexLocker lock(&mutex);
+        levels.append(level);
+        this->messages.append(messages);
+    }
+
+    QSemaphore* gate;
+    QMutex mutex;
+    QList<QxtLogger::LogLevel> levels;
+    QList<QList<QVariant> > messages;
+};
+
+class Producer : public QThread
+{
+public:
+    Producer(int id) : id(id) {}
+    void run()
+    {
+        for (int i = 0; i < 1000; i++)
+            qxtLog->info(id, i);
+    }
+    int id;
+};
+
+class Test : public QObject
+{
+    Q_OBJECT
+    RecordingEngine* engine;
+
+private slots:
+    void init()
+    {
+        qxtLog->disableLoggerEngine("DEFAULT");
+        engine = new RecordingEngine;
+        qxtLog->addLoggerEngine("recording", engine);
+        qxtLog->setMinimumLevel("recording", QxtLogger::InfoLevel);
+    }
+
+    void cleanup()
+    {
+        qxtLog->flush();
+        qxtLog->setOverflowPolicy(QxtLogger::BlockOnOverflow);
+        qxtLog->removeLoggerEngine("recording");
+    }
+
+    void levels()
+    {
+        QVERIFY(qxtLog->isLogLevelEnabled(QxtLogger::InfoLevel));
+        QVERIFY(!qxtLog->isLogLevelEnabled(QxtLogger::DebugLevel));
+        qxtLog->debug("hidden");
+        qxtLog->debug() << "hidden";
+        qxtLog->info() << "shown" << 1;
+        qxtLog->flush();
+        QCOMPARE(engine->messages.count(), 1);
+        QCOMPARE(engine->messages.at(0), QList<QVariant>() << "shown" << 1);
+
+        qxtLog->disableLoggerEngine("recording");
+        QVERIFY(!qxtLog->isLogLevelEnabled(QxtLogger::InfoLevel));
+        qxtLog->enableLoggerEngine("recording");
+        QVERIFY(qxtLog->isLogLevelEnabled(QxtLogger::InfoLevel));
+    }
+
+    void ordering()
+    {
+        QList<Producer*> producers;
+        for (int i = 0; i < 4; i++)
+            producers.append(new Producer(i));
+        foreach (Producer* producer, producers)
+            producer->start();
+        foreach (Producer* producer, producers)
+            producer->wait();
+        qxtLog->flush();
+        qDeleteAll(producers);
+
+        QCOMPARE(engine->messages.count(), 4000);
+        QCOMPARE(qxtLog->queuedMessageCount(), 0);
+        int next[4] = { 0, 0, 0, 0 };
+        foreach (const QList<QVariant>& message, engine->messages) {
+            int id = message.at(0).toInt();
+            QCOMPARE(message.at(1).toInt(), next[id]++);
+        }
+    }
+
+    void overflow()
+    {
+        QSemaphore gate;
+        engine->gate = &gate;
+        qxtLog->setOverflowPolicy(QxtLogger::DropOnOverflow);
+        qint64 dropped = qxtLog->droppedMessageCount();
+        int capacity = qxtLog->queueCapacity();
+        for (int i = 0; i < capacity + 100; i++)
+            qxtLog->info(i);
+        QVERIFY(qxtLog->droppedMessageCount() - dropped >= 99);
+
+        gate.release(capacity + 100);
+        qxtLog->flush();
+        engine->gate = 0;
+        QCOMPARE(engine->messages.count() + int(qxtLog->droppedMessageCount() - dropped), capacity + 100);
+    }
+
+    void fileRotation()
+    {
+        QxtTemporaryDir dir;
+        QString name = dir.path() + "/test.log";
+        QxtBasicFileLoggerEngine* file = new QxtBasicFileLoggerEngine(name);
+        file->setDateFormat("hh");
+        file->setBufferSize(1024);
+        file->setMaximumFileSize(200);
+
+        file->writeFormatted(QxtLogger::InfoLevel, QList<QVariant>() << "first" << "second");
+        QCOMPARE(QFileInfo(name).size(), qint64(0));    // still buffered
+        file->flushLoggerEngine();
+        QFile log(name);
+        QVERIFY(log.open(QIODevice::ReadOnly));
+        QList<QByteArray> lines = log.readAll().split('\n');
+        log.close();
+        QVERIFY(lines.at(0).startsWith('[') && lines.at(0).endsWith("] [Info] first"));
+        QCOMPARE(lines.at(1), QByteArray(lines.at(0).size() - 5, ' ') + "second");
+
+        for (int i = 0; i < 20; i++)
+            file->writeFormatted(QxtLogger::InfoLevel, QList<QVariant>() << QString(20, QChar('a' + i)));
+        file->flushLoggerEngine();
+        QStringList files = QDir(dir.path()).entryList(QStringList() << "test.log*", QDir::Files);
+        QVERIFY(files.count() >= 2);
+        QVERIFY(QFileInfo(name).size() <= 200 + 36);
+        delete file;
+    }
+
+#ifdef QXT_HAVE_ZLIB
+    void compressedRotation()
+    {
+        QxtTemporaryDir dir;
+        QString name = dir.path() + "/test.log";
+        QxtBasicFileLoggerEngine* file = new QxtBasicFileLoggerEngine(name);
+        file->setCompressRotatedFiles(true);
+        // Larger than one compression block
+        file->setMaximumFileSize(200000);
+        QString line(100, QChar('x'));
+        for (int i = 0; i < 2100; i++)
+            file->writeFormatted(QxtLogger::InfoLevel, QList<QVariant>() << line);
+        file->flushLoggerEngine();
+        delete file;
+        QThreadPool::globalInstance()->waitForDone();
+
+        QStringList rotated = QDir(dir.path()).entryList(QStringList() << "test.log.*", QDir::Files);
+        QCOMPARE(rotated.count(), 1);
+        QVERIFY(rotated.first().endsWith(".gz"));
+
+        gzFile gz = gzopen(QFile::encodeName(dir.path() + '/' + rotated.first()).constData(), "rb");
+        QVERIFY(gz);
+        QByteArray data;
+        char buffer[16384];
+        int size;
+        while ((size = gzread(gz, buffer, sizeof(buffer))) > 0)
+            data.append(buffer, size);
+        QCOMPARE(gzclose(gz), Z_OK);
+        QVERIFY(data.size() > 200000);
+        QCOMPARE(data.count('\n'), data.count(line.toLatin1() + '\n'));
+    }
+#endif
+
+    void xmlAppendOnly()
+    {
+        QxtTemporaryDir dir;
+        QString name = dir.path() + "/test.xml";
+        QxtXmlFileLoggerEngine* xml = new QxtXmlFileLoggerEngine(name);
+        xml->writeFormatted(QxtLogger::ErrorLevel, QList<QVariant>() << "a < b & \"c\"");
+        xml->setAppendOnly(true);
+        xml->writeFormatted(QxtLogger::InfoLevel, QList<QVariant>() << "second");
+
+        QFile file(name);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QByteArray data = file.readAll();
+        file.close();
+        QVERIFY(!data.endsWith("</log>"));     // nothing is rewritten while logging
+        QCOMPARE(data.count("<entry"), 2);
+        QVERIFY(data.contains("<message>a &lt; b &amp; &quot;c&quot;</message>"));
+
+        delete xml;
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        data = file.readAll();
+        file.close();
+        QVERIFY(data.startsWith("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<log>\n"));
+        QVERIFY(data.endsWith("    </entry>\n</log>"));
+        QCOMPARE(data.count("</log>"), 1);
+    }
+
+    void xmlThroughput_data()
+    {
+        QTest::addColumn<bool>("appendOnly");
+        QTest::newRow("rewrite closing tag") << false;
+        QTest::newRow("append only") << true;
+    }
+
+    void xmlThroughput()
+    {
+        QFETCH(bool, appendOnly);
+        QxtTemporaryDir dir;
+        QxtXmlFileLoggerEngine xml(dir.path() + "/bench.xml");
+        xml.setAppendOnly(appendOnly);
+        QList<QVariant> messages = QList<QVariant>() << "request served" << 200 << "<html> & more";
+        QBENCHMARK {
+            for (int i = 0; i < 1000; i++)
+                xml.writeFormatted(QxtLogger::InfoLevel, messages);
+        }
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
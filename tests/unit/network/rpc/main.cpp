@@ -1,5 +1,9 @@
 /** ***** QxtRPCPeer loopback test ******/
 #include <QxtRPCPeer>
+#include <QxtDataStreamSignalSerializer>
+#include <QxtBinarySignalSerializer>
+#include <QxtAbstractConnectionManager>
+#include <QxtTcpConnectionManager>
 #include <qxtfifo.h>
 #include <QCoreApplication>
 #include <QTest>
@@ -9,6 +13,66 @@
 #include <QDebug>
 #include <QByteArray>
 #include <QTcpSocket>
+#include <QDate>
+#include <QScopedPointer>
+
+// A device whose write buffer can be made to look full, standing in for a client that stops reading.
+class StallDevice : public QIODevice
+{
+public:
+    StallDevice() : pending(0) { open(QIODevice::ReadWrite); }
+    qint64 bytesToWrite() const { return pending; }
+    void drain() { pending = 0; emit bytesWritten(0); }
+
+    QByteArray written;
+    qint64 pending;
+
+protected:
+    qint64 readData(char*, qint64) { return 0; }
+    qint64 writeData(const char* data, qint64 len) { written.append(data, int(len)); return len; }
+};
+
+class TestConnectionManager : public QxtAbstractConnectionManager
+{
+public:
+    TestConnectionManager() : QxtAbstractConnectionManager(0) {}
+    bool isAcceptingConnections() const { return true; }
+    void add(QIODevice* device) { addConnection(device, quint64(device)); }
+
+protected:
+    void removeConnection(QIODevice* device, quint64) { device->deleteLater(); }
+};
+
+// Answers every tick from a client with a tock carrying the same number.
+class Echo : public QObject
+{
+    Q_OBJECT
+public:
+    Echo(QxtRPCService* service) : service(service) {}
+    QxtRPCService* service;
+
+public slots:
+    void tick(quint64 id, int n) { service->call(id, "tock(int)", n); }
+};
+
+// Answers requests for its own thread; see the request tests.
+class Calculator : public QObject
+{
+    Q_OBJECT
+public slots:
+    int add(int a, int b) { return a + b; }
+    QString name() { return QString("calculator"); }
+};
+
+class Collector : public QObject
+{
+    Q_OBJECT
+public:
+    QList<int> received;
+
+public slots:
+    void tock(int n) { received << n; }
+};
 
 class RPCTest: public QObject
 {
@@ -23,6 +87,8 @@ signals:
     void wave(QString);
     void counterwave(QString);
     void networkedwave(quint64,QString);
+    void tick(int);
+    void tock(int);
 
 
 private slots:
@@ -88,6 +154,290 @@ private slots:
         QVERIFY2(arguments.at(0).toString()=="world","argument missmatch");
     }
 
+    void requestResponse()
+    {
+        // The peer answers its own requests through the loopback device.
+        QxtRPCService peer(new QxtFifo, 0);
+        Calculator calculator;
+        QVERIFY(peer.attachSlot("add", &calculator, SLOT(add(int,int))));
+        QVERIFY(peer.attachSlot("name", &calculator, SLOT(name())));
+
+        // Many requests are in flight at once; each reply gets its own answer.
+        QList<QxtRPCReply*> replies;
+        for(int i = 0; i < 100; i++)
+            replies << peer.request("add", i, 1000);
+        QxtRPCReply* name = peer.request("name");
+        QTRY_VERIFY(name->isFinished());
+        for(int i = 0; i < replies.count(); i++) {
+            QTRY_VERIFY(replies.at(i)->isFinished());
+            QCOMPARE(replies.at(i)->error(), QxtRPCReply::NoError);
+            QCOMPARE(replies.at(i)->result().toInt(), 1000 + i);
+            QVERIFY(replies.at(i)->latency() >= 0);
+        }
+        QCOMPARE(name->result().toString(), QString("calculator"));
+
+        quint64 answered = 0;
+        foreach(quint64 count, peer.latencyHistogram("add"))
+            answered += count;
+        QCOMPARE(answered, quint64(100));
+
+        // A function without a slot is reported by the peer.
+        QxtRPCReply* missing = peer.request("subtract", 1, 2);
+        QVERIFY(missing->waitForFinished(5000));
+        QCOMPARE(missing->error(), QxtRPCReply::RemoteError);
+        QVERIFY(!missing->errorString().isEmpty());
+    }
+
+    void requestTimeoutAndCancel()
+    {
+        // The device swallows everything, so no request is ever answered.
+        QxtRPCService peer(new StallDevice, 0);
+        peer.setRequestTimeout(20);
+
+        QxtRPCReply* timedOut = peer.request("add", 1, 2);
+        QxtRPCReply* canceled = peer.request("add", 3, 4);
+        QxtRPCReply* waiting = peer.request("add", 5, 6);
+        QCOMPARE(timedOut->timeout(), 20);
+        QCOMPARE(waiting->timeout(), 20);
+        waiting->setTimeout(0);
+        QCOMPARE(waiting->timeout(), 0);
+        QSignalSpy spy(canceled, SIGNAL(finished()));
+        canceled->cancel();
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(canceled->error(), QxtRPCReply::CanceledError);
+
+        QTRY_VERIFY(timedOut->isFinished());
+        QCOMPARE(timedOut->error(), QxtRPCReply::TimeoutError);
+        QVERIFY(!waiting->isFinished());
+
+        // Losing the connection fails the requests still waiting.
+        peer.disconnectServer();
+        QVERIFY(waiting->isFinished());
+        QCOMPARE(waiting->error(), QxtRPCReply::ConnectionError);
+        QVERIFY(peer.latencyHistogram("add").isEmpty());
+    }
+
+    void burstDeserialize()
+    {
+        // 10k small messages arriving in a single read.
+        QxtDataStreamSignalSerializer serializer;
+        QByteArray burst;
+        for(int i = 0; i < 10000; i++)
+            burst += serializer.serialize("tick(int)", i);
+
+        QBENCHMARK {
+            int offset = 0;
+            int count = 0;
+            while(serializer.canDeserialize(burst, offset)) {
+                QxtAbstractSignalSerializer::DeserializedData data = serializer.deserialize(burst, &offset);
+                QCOMPARE(data.second.value(0).toInt(), count++);
+            }
+            QCOMPARE(count, 10000);
+            QCOMPARE(offset, burst.size());
+        }
+
+        // The copying overload still removes the processed message from the buffer.
+        QByteArray single = serializer.serialize("tick(int)", 1) + burst.left(3);
+        QxtAbstractSignalSerializer::DeserializedData data = serializer.deserialize(single);
+        QCOMPARE(data.first, QString("tick(int)"));
+        QCOMPARE(single, burst.left(3));
+        QVERIFY(!serializer.canDeserialize(single));
+    }
+
+    void burstDispatch()
+    {
+        QxtRPCService peer(new QxtFifo, 0);
+        QVERIFY2(peer.attachSlot(SIGNAL(tick(int)), this, SIGNAL(tock(int))), "cannot attach slot");
+
+        QxtDataStreamSignalSerializer serializer;
+        QByteArray burst;
+        for(int i = 0; i < 10000; i++)
+            burst += serializer.serialize("tick(int)", i);
+
+        // Split the last message so that the read cursor has to carry a partial frame over to the next read.
+        QSignalSpy spy(this, SIGNAL(tock(int)));
+        peer.device()->write(burst.left(burst.size() - 2));
+        QCoreApplication::processEvents ();
+        QCoreApplication::processEvents ();
+        QCOMPARE(spy.count(), 9999);
+
+        peer.device()->write(burst.right(2));
+        QCoreApplication::processEvents ();
+        QCoreApplication::processEvents ();
+        QCOMPARE(spy.count(), 10000);
+        for(int i = 0; i < spy.count(); i++)
+            QCOMPARE(spy.at(i).at(0).toInt(), i);
+    }
+
+    void binaryRoundTrip()
+    {
+        QxtBinarySignalSerializer out, in;
+        QByteArray first = out.serialize("wave(QString)", QString("world"), 42, true, 2.5, QByteArray("raw"),
+                qlonglong(-7), QDate(2011, 1, 1));
+        QByteArray second = out.serialize("wave(QString)", QString("world"), 42, true, 2.5, QByteArray("raw"),
+                qlonglong(-7), QDate(2011, 1, 1));
+        // The name is only sent with the first call.
+        QCOMPARE(first.size() - second.size(), int(sizeof("wave(QString)")));
+
+        QByteArray wire = first + second;
+        int offset = 0;
+        for(int i = 0; i < 2; i++) {
+            QVERIFY(in.canDeserialize(wire, offset));
+            QxtAbstractSignalSerializer::DeserializedData data = in.deserialize(wire, &offset);
+            QCOMPARE(data.first, QString("wave(QString)"));
+            QCOMPARE(data.second.count(), 7);
+            QCOMPARE(data.second.at(0), QVariant(QString("world")));
+            QCOMPARE(data.second.at(1), QVariant(42));
+            QCOMPARE(data.second.at(2), QVariant(true));
+            QCOMPARE(data.second.at(3), QVariant(2.5));
+            QCOMPARE(data.second.at(4), QVariant(QByteArray("raw")));
+            QCOMPARE(data.second.at(5), QVariant(qlonglong(-7)));
+            QCOMPARE(data.second.at(6), QVariant(QDate(2011, 1, 1)));
+        }
+        QCOMPARE(offset, wire.size());
+
+        // A reference to a name that was never defined is a protocol error.
+        QxtBinarySignalSerializer fresh;
+        offset = 0;
+        QVERIFY(QxtAbstractSignalSerializer::isProtocolError(fresh.deserialize(second, &offset)));
+    }
+
+    void binaryService()
+    {
+        QxtRPCService peer(new QxtFifo, 0);
+        peer.setSerializer(new QxtBinarySignalSerializer);
+        QVERIFY2(peer.attachSlot(SIGNAL(tick(int)), this, SIGNAL(tock(int))), "cannot attach slot");
+
+        QSignalSpy spy(this, SIGNAL(tock(int)));
+        for(int i = 0; i < 100; i++)
+            peer.call(SIGNAL(tick(int)), i);
+        QCoreApplication::processEvents ();
+        QCoreApplication::processEvents ();
+
+        QCOMPARE(spy.count(), 100);
+        for(int i = 0; i < spy.count(); i++)
+            QCOMPARE(spy.at(i).at(0).toInt(), i);
+    }
+
+    void serializerThroughput_data()
+    {
+        QTest::addColumn<bool>("binary");
+        QTest::newRow("datastream") << false;
+        QTest::newRow("binary") << true;
+    }
+
+    void serializerThroughput()
+    {
+        QFETCH(bool, binary);
+        QScopedPointer<QxtAbstractSignalSerializer> out, in;
+        if(binary) {
+            out.reset(new QxtBinarySignalSerializer);
+            in.reset(new QxtBinarySignalSerializer);
+        } else {
+            out.reset(new QxtDataStreamSignalSerializer);
+            in.reset(new QxtDataStreamSignalSerializer);
+        }
+
+        // Time per 1000 calls, encoded and decoded.
+        QBENCHMARK {
+            QByteArray wire;
+            for(int i = 0; i < 1000; i++)
+                wire += out->serialize("tick(int,QString)", i, QString("tock"));
+            int offset = 0;
+            int count = 0;
+            while(in->canDeserialize(wire, offset)) {
+                in->deserialize(wire, &offset);
+                count++;
+            }
+            QCOMPARE(count, 1000);
+        }
+    }
+
+    void serializedSize()
+    {
+        // The binary format is meant to be the smaller one on the wire for the same calls.
+        QxtDataStreamSignalSerializer dataStream;
+        QxtBinarySignalSerializer binary;
+        QByteArray dataStreamWire, binaryWire;
+        for(int i = 0; i < 1000; i++) {
+            dataStreamWire += dataStream.serialize("tick(int,QString)", i, QString("tock"));
+            binaryWire += binary.serialize("tick(int,QString)", i, QString("tock"));
+        }
+        QVERIFY(binaryWire.size() < dataStreamWire.size());
+    }
+
+    void broadcastHighWater()
+    {
+        QxtRPCService server;
+        TestConnectionManager* manager = new TestConnectionManager;
+        server.setConnectionManager(manager);
+        server.setHighWaterMark(100000);
+
+        StallDevice* fast = new StallDevice;
+        StallDevice* slow = new StallDevice;
+        manager->add(fast);
+        manager->add(slow);
+        QCOMPARE(server.clients().count(), 2);
+
+        // The slow client's write buffer is already over the direct write limit, so its calls are queued.
+        slow->pending = 70000;
+        QByteArray payload(1000, 'x');
+        for(int i = 0; i < 50; i++)
+            server.call("tick(QByteArray)", payload);
+        QVERIFY(fast->written.size() > 50 * 1000);
+        QCOMPARE(slow->written.size(), 0);
+        QVERIFY(server.droppedCallCount() > 0);
+        QVERIFY(server.droppedCallCount() < 50);
+
+        // Once the client catches up, the queued frames are handed over unchanged.
+        slow->drain();
+        QVERIFY(fast->written.startsWith(slow->written));
+        quint64 delivered = 50 - server.droppedCallCount();
+        QCOMPARE(quint64(slow->written.size()), delivered * (fast->written.size() / 50));
+
+        // With the disconnect policy the slow client is dropped instead.
+        server.setHighWaterPolicy(QxtRPCService::DisconnectOnHighWater);
+        slow->pending = 200000;
+        server.call("tick(QByteArray)", payload);
+        QCOMPARE(server.clients().count(), 1);
+        QCOMPARE(server.clients().first(), quint64(fast));
+    }
+
+    void highWaterStatefulSerializer()
+    {
+        QxtRPCService server;
+        TestConnectionManager* manager = new TestConnectionManager;
+        server.setConnectionManager(manager);
+        server.setSerializer(new QxtBinarySignalSerializer);
+        server.setHighWaterMark(1000);
+
+        StallDevice* client = new StallDevice;
+        manager->add(client);
+        server.call("first(int)", 1);
+
+        // The call is dropped while the client is stalled, so the name it would have defined is never sent.
+        client->pending = 5000;
+        server.call("second(int)", 2);
+        QCOMPARE(server.droppedCallCount(), quint64(1));
+
+        // The next call has to define the name again for the client to decode it.
+        client->drain();
+        server.call("second(int)", 3);
+
+        QxtBinarySignalSerializer in;
+        int offset = 0;
+        QVERIFY(in.canDeserialize(client->written, offset));
+        QxtAbstractSignalSerializer::DeserializedData data = in.deserialize(client->written, &offset);
+        QCOMPARE(data.first, QString("first(int)"));
+        QCOMPARE(data.second.value(0).toInt(), 1);
+        QVERIFY(in.canDeserialize(client->written, offset));
+        data = in.deserialize(client->written, &offset);
+        QVERIFY(!QxtAbstractSignalSerializer::isProtocolError(data));
+        QCOMPARE(data.first, QString("second(int)"));
+        QCOMPARE(data.second.value(0).toInt(), 3);
+        QCOMPARE(offset, client->written.size());
+    }
+
     void TcpServerIo()
     {
         QxtRPCPeer server;
@@ -166,6 +516,51 @@ private slots:
         QVERIFY(!client.isClient());
     }
 
+    void TcpServerWorkerThreads()
+    {
+        QxtRPCPeer server;
+        QxtTcpConnectionManager* manager = qobject_cast<QxtTcpConnectionManager*>(server.connectionManager());
+        QVERIFY(manager);
+        manager->setWorkerThreadCount(2);
+        Echo echo(&server);
+        QVERIFY(server.attachSlot("tick(int)", &echo, SLOT(tick(quint64,int))));
+        QVERIFY(server.listen(QHostAddress::LocalHost, 23445));
+
+        const int clientCount = 4;
+        const int callCount = 100;
+        QList<QxtRPCPeer*> clients;
+        QList<Collector*> collectors;
+        for(int i = 0; i < clientCount; i++) {
+            QxtRPCPeer* client = new QxtRPCPeer(this);
+            Collector* collector = new Collector;
+            QVERIFY(client->attachSlot("tock(int)", collector, SLOT(tock(int))));
+            client->connect(QHostAddress::LocalHost, 23445);
+            QVERIFY(qobject_cast<QTcpSocket*>(client->device())->waitForConnected(30000));
+            clients << client;
+            collectors << collector;
+        }
+        QTRY_COMPARE(server.clients().count(), clientCount);
+
+        // The sockets are served by the worker threads, not by the thread the service lives in.
+        foreach(quint64 id, server.clients())
+            QVERIFY(manager->client(id)->thread() != QThread::currentThread());
+
+        for(int n = 0; n < callCount; n++) {
+            foreach(QxtRPCPeer* client, clients)
+                client->call("tick(int)", n);
+        }
+
+        // Every client gets its answers back in the order it asked.
+        for(int i = 0; i < clientCount; i++) {
+            QTRY_COMPARE(collectors.at(i)->received.count(), callCount);
+            for(int n = 0; n < callCount; n++)
+                QCOMPARE(collectors.at(i)->received.at(n), n);
+        }
+
+        qDeleteAll(clients);
+        qDeleteAll(collectors);
+    }
+
     void cleanupTestCase()
     {}
 };
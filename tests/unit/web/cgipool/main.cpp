@@ -0,0 +1,286 @@
+#include <QTest>
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QBuffer>
+#include <QxtWebCgiService>
+#include <QxtAbstractWebSessionManager>
+#include <QxtWebEvent>
+#include <QxtWebContent>
+#include <cstdlib>
+
+/*
+ * The test binary doubles as the pooled FastCGI worker. Requests for a path
+ * containing "exit" make it die, paths containing "hang" are never
+ * answered, and everything else is answered with the worker's process ID.
+ */
+class Worker : public QObject
+{
+    Q_OBJECT
+public:
+    Worker(const QString& path)
+    {
+        connect(&server, SIGNAL(newConnection()), this, SLOT(accept()));
+        if (!server.listen(path))
+            std::exit(2);
+    }
+
+private slots:
+    void accept()
+    {
+        socket = server.nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(read()));
+        connect(socket, SIGNAL(disconnected()), qApp, SLOT(quit()));
+    }
+
+    void read()
+    {
+        buffer += socket->readAll();
+        while (buffer.size() >= 8)
+        {
+            const uchar* h = reinterpret_cast<const uchar*>(buffer.constData());
+            int type = h[1], id = (h[2] << 8) | h[3], size = (h[4] << 8) | h[5], padding = h[6];
+            if (buffer.size() < 8 + size + padding) break;
+            QByteArray data = buffer.mid(8, size);
+            buffer.remove(0, 8 + size + padding);
+            if (type == 4)          // FCGI_PARAMS
+                params += data;
+            else if (type == 5 && data.isEmpty())   // end of FCGI_STDIN
+                respond(id);
+        }
+    }
+
+private:
+    void record(int type, int id, const QByteArray& data)
+    {
+        char h[8] = { 1, char(type), char(id >> 8), char(id), char(data.size() >> 8), char(data.size()), 0, 0 };
+        socket->write(h, 8);
+        socket->write(data);
+    }
+
+    void respond(int id)
+    {
+        QByteArray path = pathInfo();
+        params.clear();
+        if (path.contains("exit"))
+            std::exit(3);
+        if (path.contains("hang"))
+            return;
+        record(6, id, "Content-Type: text/plain\r\n\r\n" + QByteArray::number(QCoreApplication::applicationPid()));
+        record(6, id, QByteArray());
+        record(3, id, QByteArray(8, 0));    // FCGI_END_REQUEST
+        socket->flush();
+    }
+
+    QByteArray pathInfo() const
+    {
+        int pos = 0;
+        while (pos < params.size())
+        {
+            int lengths[2];
+            for (int i = 0; i < 2; i++)
+            {
+                uchar b = params[pos];
+                if (b & 0x80)
+                {
+                    const uchar* p = reinterpret_cast<const uchar*>(params.constData()) + pos;
+                    lengths[i] = ((p[0] & 0x7f) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+                    pos += 4;
+                }
+                else
+                {
+                    lengths[i] = b;
+                    pos++;
+                }
+            }
+            QByteArray name = params.mid(pos, lengths[0]);
+            QByteArray value = params.mid(pos + lengths[0], lengths[1]);
+            pos += lengths[0] + lengths[1];
+            if (name == "PATH_INFO")
+                return value;
+        }
+        return QByteArray();
+    }
+
+    QLocalServer server;
+    QLocalSocket* socket;
+    QByteArray buffer, params;
+};
+
+// A request body source whose length is not known in advance
+class DisconnectingSource : public QBuffer
+{
+    Q_OBJECT
+signals:
+    void disconnected();
+};
+
+class RecordingSessionManager : public QxtAbstractWebSessionManager
+{
+public:
+    RecordingSessionManager() : status(0), finished(false) {}
+    bool start() { return true; }
+    bool shutdown() { return true; }
+    void processEvents() {}
+
+    void postEvent(QxtWebEvent* event)
+    {
+        if (event->type() == QxtWebEvent::Page)
+        {
+            QxtWebPageEvent* page = static_cast<QxtWebPageEvent*>(event);
+            status = page->status;
+            delete body;
+            body = page->dataSource;
+            page->dataSource = 0;
+        }
+        delete event;
+    }
+
+    // Reads the body of the last response until the service finishes it
+    QByteArray readBody()
+    {
+        QByteArray data;
+        if (!body) return data;
+        finished = false;
+        QObject::connect(body, &QIODevice::aboutToClose, [this]() { finished = true; });
+        QTest::qWaitFor([&]() { data += body->readAll(); return finished; }, 5000);
+        data += body->readAll();
+        delete body;
+        return data;
+    }
+
+    int status;
+    QPointer<QIODevice> body;
+    bool finished;
+};
+
+class Test : public QObject
+{
+    Q_OBJECT
+private:
+    RecordingSessionManager sm;
+
+    void request(QxtWebCgiService& service, const QString& path)
+    {
+        sm.status = 0;
+        QxtWebRequestEvent event(0, 1, QUrl(path));
+        service.pageRequestedEvent(&event);
+    }
+
+private slots:
+    void dispatch()
+    {
+        QxtWebCgiService service(QCoreApplication::applicationFilePath(), &sm);
+        service.setPoolArguments(QStringList() << "--worker" << "%1");
+        service.setPoolSize(1);
+
+        request(service, "/a");
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 200, 10000);
+        QByteArray pid = sm.readBody();
+        QVERIFY(pid.toLongLong() > 0);
+        QTRY_COMPARE(service.busyWorkerCount(), 0);
+
+        // The same process serves the next request
+        request(service, "/b");
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 200, 5000);
+        QCOMPARE(sm.readBody(), pid);
+        QCOMPARE(service.servedRequestCount(), qint64(2));
+    }
+
+    void workerExit()
+    {
+        QxtWebCgiService service(QCoreApplication::applicationFilePath(), &sm);
+        service.setPoolArguments(QStringList() << "--worker" << "%1");
+        service.setPoolSize(1);
+
+        request(service, "/a");
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 200, 10000);
+        QByteArray pid = sm.readBody();
+
+        request(service, "/exit");
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 502, 5000);
+
+        // The worker is replaced and the queued request waits for it
+        request(service, "/a");
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 200, 10000);
+        QByteArray restarted = sm.readBody();
+        QVERIFY(restarted.toLongLong() > 0);
+        QVERIFY(restarted != pid);
+    }
+
+    void requestTimeout()
+    {
+        QxtWebCgiService service(QCoreApplication::applicationFilePath(), &sm);
+        service.setPoolArguments(QStringList() << "--worker" << "%1");
+        service.setPoolSize(1);
+
+        // Wait for the worker so that the timeout applies to the request
+        // itself rather than to the wait in the queue
+        request(service, "/a");
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 200, 10000);
+        sm.readBody();
+
+        service.setTimeout(500);
+        request(service, "/hang");
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 504, 10000);
+    }
+
+    void bodyUntilClose()
+    {
+        QxtWebCgiService service(QCoreApplication::applicationFilePath(), &sm);
+        service.setPoolArguments(QStringList() << "--worker" << "%1");
+        service.setPoolSize(1);
+
+        request(service, "/a");
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 200, 10000);
+        sm.readBody();
+
+        // The worker only answers once FCGI_STDIN has been closed, which
+        // happens when the source of the body disconnects
+        DisconnectingSource source;
+        source.open(QIODevice::ReadOnly);
+        QxtWebContent* content = new QxtWebContent(-1, "abc", 0, &source);
+        QVERIFY(content->wantAll());
+        sm.status = 0;
+        QxtWebRequestEvent event(0, 1, QUrl("/post"));
+        event.content = content;
+        service.pageRequestedEvent(&event);
+        QTest::qWait(200);
+        QCOMPARE(sm.status, 0);
+
+        emit source.disconnected();
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 200, 5000);
+        sm.readBody();
+        delete content;
+    }
+
+    void neverConnects()
+    {
+        QxtWebCgiService service(QCoreApplication::applicationFilePath(), &sm);
+        service.setPoolArguments(QStringList() << "--idle");
+        service.setPoolSize(1);
+        service.setTimeout(500);
+
+        request(service, "/a");
+        QTRY_COMPARE_WITH_TIMEOUT(sm.status, 504, 5000);
+        QCOMPARE(service.queuedRequestCount(), 0);
+    }
+};
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QStringList arguments = app.arguments();
+    if (arguments.value(1) == "--worker")
+    {
+        Worker worker(arguments.value(2));
+        return app.exec();
+    }
+    if (arguments.value(1) == "--idle")
+        return app.exec();
+    Test test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "main.moc"
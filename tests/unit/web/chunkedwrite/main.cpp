@@ -0,0 +1,142 @@
+#include <QTest>
+#include <QTcpSocket>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QxtHttpSessionManager>
+#include <QxtAbstractWebService>
+#include <QxtWebEvent>
+#include <algorithm>
+
+// Answers /<size> with a chunked body of size bytes
+class BodyService : public QxtAbstractWebService
+{
+public:
+    BodyService(QxtAbstractWebSessionManager* manager) : QxtAbstractWebService(manager) {}
+    void pageRequestedEvent(QxtWebRequestEvent* event)
+    {
+        QBuffer* source = new QBuffer;
+        source->setData(body(event->url.path().mid(1).toInt()));
+        source->open(QIODevice::ReadOnly);
+        QxtWebPageEvent* page = new QxtWebPageEvent(event->sessionID, event->requestID, source);
+        page->chunked = true;
+        page->streaming = false;
+        postEvent(page);
+    }
+
+    static QByteArray body(int size)
+    {
+        QByteArray data(size, '\0');
+        for (int i = 0; i < size; i++)
+            data[i] = char('a' + i % 26);
+        return data;
+    }
+};
+
+struct Response
+{
+    QByteArray raw;             // the body as received, with its framing
+    QByteArray body;
+    QList<int> chunkSizes;
+};
+
+class Test : public QObject
+{
+    Q_OBJECT
+private:
+    QxtHttpSessionManager* manager;
+
+    // Reads one chunked response. For the first slowFor milliseconds the
+    // client takes 4 KiB every 20 milliseconds.
+    Response get(int size, int slowFor = 0)
+    {
+        Response response;
+        QTcpSocket client;
+        if (slowFor)
+            client.setReadBufferSize(4096);
+        client.connectToHost(QHostAddress::LocalHost, manager->serverPort());
+        if (!client.waitForConnected(5000)) return response;
+        client.write("GET /" + QByteArray::number(size) + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+        QElapsedTimer slow;
+        slow.start();
+        QByteArray received;
+        QTest::qWaitFor([&]() {
+            if (slow.elapsed() < slowFor)
+            {
+                received += client.read(4096);
+                QTest::qWait(20);
+                return false;
+            }
+            client.setReadBufferSize(0);
+            received += client.readAll();
+            return client.state() == QAbstractSocket::UnconnectedState;
+        }, 60000);
+        received += client.readAll();
+        int end = received.indexOf("\r\n\r\n");
+        if (end < 0) return response;
+        response.raw = received.mid(end + 4);
+        int pos = 0;
+        for (;;)
+        {
+            int eol = response.raw.indexOf("\r\n", pos);
+            if (eol < 0) break;
+            bool ok;
+            int chunk = response.raw.mid(pos, eol - pos).toInt(&ok, 16);
+            if (!ok || chunk == 0) break;
+            response.chunkSizes << chunk;
+            response.body += response.raw.mid(eol + 2, chunk);
+            pos = eol + 2 + chunk + 2;
+        }
+        return response;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        manager = new QxtHttpSessionManager(this);
+        BodyService* service = new BodyService(manager);
+        manager->setAutoCreateSession(false);
+        manager->setStaticContentService(service);
+        manager->setListenInterface(QHostAddress::LocalHost);
+        manager->setPort(0);
+        manager->setConnector(QxtHttpSessionManager::HttpServer);
+        QVERIFY(manager->start());
+    }
+
+    void copyCounters()
+    {
+        manager->setAdaptiveChunkSize(false);
+        manager->setWriteChunkSize(4096);
+        qint64 copied = manager->bytesCopied();
+        qint64 saved = manager->concatenationBytesSaved();
+
+        Response r = get(100000);
+        QCOMPARE(r.body, BodyService::body(100000));
+        QCOMPARE(r.chunkSizes.count(), 25);
+        QCOMPARE(manager->bytesCopied() - copied, qint64(100000));
+        // Every chunk with its size line and line break, without the final "0\r\n\r\n"
+        QCOMPARE(manager->concatenationBytesSaved() - saved, qint64(r.raw.size() - 5));
+    }
+
+    void adaptiveGrowsOnFastConnection()
+    {
+        manager->setAdaptiveChunkSize(true);
+        manager->setWriteChunkSize(4096);
+        Response r = get(32 * 1024 * 1024);
+        QCOMPARE(r.body.size(), 32 * 1024 * 1024);
+        QCOMPARE(r.chunkSizes.first(), 4096);
+        QVERIFY(*std::max_element(r.chunkSizes.constBegin(), r.chunkSizes.constEnd()) > 4096);
+    }
+
+    void adaptiveShrinksOnSlowConnection()
+    {
+        manager->setAdaptiveChunkSize(true);
+        manager->setWriteChunkSize(65536);
+        Response r = get(32 * 1024 * 1024, 2000);
+        QCOMPARE(r.body.size(), 32 * 1024 * 1024);
+        QCOMPARE(r.chunkSizes.first(), 65536);
+        QVERIFY(r.chunkSizes.mid(0, r.chunkSizes.count() - 1).contains(4096));
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
@@ -0,0 +1,225 @@
+#include <QTest>
+#include <QTcpSocket>
+#include <QBuffer>
+#include <QTimer>
+#include <QxtHttpSessionManager>
+#include <QxtAbstractWebService>
+#include <QxtWebEvent>
+#ifdef QXT_HAVE_ZLIB
+#include <zlib.h>
+#include <cstring>
+#endif
+
+// Answers /<kind>/<size> with size bytes of text of the content type named by kind
+class BodyService : public QxtAbstractWebService
+{
+public:
+    BodyService(QxtAbstractWebSessionManager* manager) : QxtAbstractWebService(manager) {}
+    void pageRequestedEvent(QxtWebRequestEvent* event)
+    {
+        QStringList path = event->url.path().split('/');
+        QByteArray body = textBody(path.value(2).toInt());
+        if (path.value(1) == "stream")
+        {
+            // A streaming source that closes with most of its data unread
+            QBuffer* source = new QBuffer;
+            source->setData(body);
+            source->open(QIODevice::ReadOnly);
+            QxtWebPageEvent* page = new QxtWebPageEvent(event->sessionID, event->requestID, source);
+            page->contentType = "text/plain; charset=utf-8";
+            page->streaming = true;
+            postEvent(page);
+            QTimer::singleShot(0, source, [source]() { source->close(); });
+            return;
+        }
+        QxtWebPageEvent* page = new QxtWebPageEvent(event->sessionID, event->requestID, body);
+        if (path.value(1) == "png")
+            page->contentType = "image/png";
+        else if (path.value(1) == "zip")
+            page->contentType = "application/zip";
+        else
+            page->contentType = "text/plain; charset=utf-8";
+        postEvent(page);
+    }
+
+    static QByteArray textBody(int size)
+    {
+        QByteArray line = "The quick brown fox jumps over the lazy dog.\n";
+        QByteArray body;
+        while (body.size() < size)
+            body += line;
+        body.truncate(size);
+        return body;
+    }
+};
+
+struct Response
+{
+    QByteArray encoding;
+    QByteArray body;
+};
+
+class Test : public QObject
+{
+    Q_OBJECT
+private:
+    QxtHttpSessionManager* manager;
+
+    // HTTP/1.0 responses end with the connection, so no chunked decoding is
+    // needed. A null acceptEncoding leaves the header out.
+    Response get(const QByteArray& path, const QByteArray& acceptEncoding = QByteArray())
+    {
+        Response response;
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, manager->serverPort());
+        if (!client.waitForConnected(5000)) return response;
+        QByteArray request = "GET " + path + " HTTP/1.0\r\n";
+        if (!acceptEncoding.isNull())
+            request += "Accept-Encoding: " + acceptEncoding + "\r\n";
+        client.write(request + "\r\n");
+        QByteArray received;
+        QTest::qWaitFor([&]() {
+            received += client.readAll();
+            return client.state() == QAbstractSocket::UnconnectedState;
+        }, 5000);
+        received += client.readAll();
+        int end = received.indexOf("\r\n\r\n");
+        if (end < 0) return response;
+        QByteArray head = received.left(end + 2).toLower();
+        int pos = head.indexOf("\r\ncontent-encoding:");
+        if (pos >= 0)
+        {
+            pos += 19;
+            response.encoding = head.mid(pos, head.indexOf("\r\n", pos) - pos).trimmed();
+        }
+        response.body = received.mid(end + 4);
+        return response;
+    }
+
+#ifdef QXT_HAVE_ZLIB
+    // Inflates a gzip or zlib stream
+    static QByteArray inflate(const QByteArray& data)
+    {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, 15 + 32) != Z_OK) return QByteArray();
+        QByteArray out;
+        char buffer[16384];
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+        stream.avail_in = data.size();
+        int result;
+        do
+        {
+            stream.next_out = reinterpret_cast<Bytef*>(buffer);
+            stream.avail_out = sizeof(buffer);
+            result = ::inflate(&stream, Z_NO_FLUSH);
+            out.append(buffer, sizeof(buffer) - stream.avail_out);
+        } while (result == Z_OK);
+        inflateEnd(&stream);
+        return result == Z_STREAM_END ? out : QByteArray();
+    }
+#endif
+
+private slots:
+    void initTestCase()
+    {
+#ifndef QXT_HAVE_ZLIB
+        QSKIP("QxtWeb was built without zlib");
+#endif
+        manager = new QxtHttpSessionManager(this);
+        BodyService* service = new BodyService(manager);
+        manager->setAutoCreateSession(false);
+        manager->setStaticContentService(service);
+        manager->setListenInterface(QHostAddress::LocalHost);
+        manager->setPort(0);
+        manager->setConnector(QxtHttpSessionManager::HttpServer);
+        manager->setCompressionEnabled(true);
+        manager->setCompressionThreshold(1000);
+        QVERIFY(manager->start());
+    }
+
+    void negotiate_data()
+    {
+        QTest::addColumn<QByteArray>("acceptEncoding");
+        QTest::addColumn<QByteArray>("encoding");
+        QTest::newRow("gzip") << QByteArray("gzip") << QByteArray("gzip");
+        QTest::newRow("deflate") << QByteArray("deflate") << QByteArray("deflate");
+        QTest::newRow("both") << QByteArray("deflate, gzip") << QByteArray("gzip");
+        QTest::newRow("deflate preferred") << QByteArray("gzip;q=0.5, deflate") << QByteArray("deflate");
+        QTest::newRow("gzip preferred") << QByteArray("gzip, deflate;q=0.5") << QByteArray("gzip");
+        QTest::newRow("gzip refused") << QByteArray("gzip;q=0") << QByteArray();
+        QTest::newRow("all refused") << QByteArray("gzip;q=0, deflate;q=0") << QByteArray();
+        QTest::newRow("identity") << QByteArray("identity") << QByteArray();
+        QTest::newRow("wildcard") << QByteArray("*") << QByteArray("gzip");
+        QTest::newRow("wildcard refused") << QByteArray("*;q=0") << QByteArray();
+        QTest::newRow("wildcard without gzip") << QByteArray("*, gzip;q=0") << QByteArray("deflate");
+        QTest::newRow("case and spacing") << QByteArray(" GZIP ; Q=1") << QByteArray("gzip");
+    }
+
+    void negotiate()
+    {
+        QFETCH(QByteArray, acceptEncoding);
+        QFETCH(QByteArray, encoding);
+        QCOMPARE(get("/text/4000", acceptEncoding).encoding, encoding);
+    }
+
+    void missingHeader()
+    {
+        Response r = get("/text/4000");
+        QVERIFY(r.encoding.isEmpty());
+        QCOMPARE(r.body, BodyService::textBody(4000));
+    }
+
+#ifdef QXT_HAVE_ZLIB
+    void roundTrip_data()
+    {
+        QTest::addColumn<QByteArray>("encoding");
+        QTest::newRow("gzip") << QByteArray("gzip");
+        QTest::newRow("deflate") << QByteArray("deflate");
+    }
+
+    void roundTrip()
+    {
+        QFETCH(QByteArray, encoding);
+        // Larger than the compressor's input block
+        Response r = get("/text/200000", encoding);
+        QCOMPARE(r.encoding, encoding);
+        QVERIFY(r.body.size() < 200000);
+        QCOMPARE(inflate(r.body), BodyService::textBody(200000));
+    }
+
+    void streamClosedWithBacklog_data()
+    {
+        roundTrip_data();
+    }
+
+    void streamClosedWithBacklog()
+    {
+        QFETCH(QByteArray, encoding);
+        Response r = get("/stream/1000000", encoding);
+        QCOMPARE(r.encoding, encoding);
+        QCOMPARE(inflate(r.body), BodyService::textBody(1000000));
+    }
+#endif
+
+    void threshold()
+    {
+        Response below = get("/text/999", QByteArray("gzip"));
+        QVERIFY(below.encoding.isEmpty());
+        QCOMPARE(below.body, BodyService::textBody(999));
+
+        QCOMPARE(get("/text/1000", QByteArray("gzip")).encoding, QByteArray("gzip"));
+    }
+
+    void compressedTypes()
+    {
+        Response png = get("/png/4000", QByteArray("gzip"));
+        QVERIFY(png.encoding.isEmpty());
+        QCOMPARE(png.body, BodyService::textBody(4000));
+
+        QVERIFY(get("/zip/4000", QByteArray("gzip")).encoding.isEmpty());
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
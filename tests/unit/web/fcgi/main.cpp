@@ -0,0 +1,266 @@
+#include <QTest>
+#include <QTcpSocket>
+#include <QHash>
+#include <QSet>
+#include <QxtHttpSessionManager>
+#include <QxtScgiServerConnector>
+#include <QxtFcgiServerConnector>
+#include <QxtHttpRequestParser>
+#include <QxtAbstractWebService>
+#include <QxtWebEvent>
+
+class EchoService : public QxtAbstractWebService
+{
+public:
+    EchoService(QxtAbstractWebSessionManager* manager) : QxtAbstractWebService(manager) {}
+    void pageRequestedEvent(QxtWebRequestEvent* event)
+    {
+        postEvent(new QxtWebPageEvent(event->sessionID, event->requestID, event->url.path().toLatin1()));
+    }
+};
+
+class ScgiParser : public QxtScgiServerConnector
+{
+public:
+    using QxtScgiServerConnector::parseRequest;
+};
+
+class FcgiParser : public QxtFcgiServerConnector
+{
+public:
+    using QxtFcgiServerConnector::readRequestHeader;
+};
+
+typedef QList<QPair<QByteArray, QByteArray> > Params;
+
+static Params requestParams(const QByteArray& uri)
+{
+    Params params;
+    params << qMakePair(QByteArray("REQUEST_METHOD"), QByteArray("GET"))
+           << qMakePair(QByteArray("REQUEST_URI"), uri)
+           << qMakePair(QByteArray("QUERY_STRING"), QByteArray())
+           << qMakePair(QByteArray("SERVER_PROTOCOL"), QByteArray("HTTP/1.1"))
+           << qMakePair(QByteArray("REMOTE_ADDR"), QByteArray("127.0.0.1"))
+           << qMakePair(QByteArray("SERVER_NAME"), QByteArray("localhost"))
+           << qMakePair(QByteArray("HTTP_HOST"), QByteArray("localhost"))
+           << qMakePair(QByteArray("HTTP_USER_AGENT"), QByteArray("Mozilla/5.0 (X11; Linux x86_64) Gecko/20100101 Firefox/60.0"))
+           << qMakePair(QByteArray("HTTP_ACCEPT"), QByteArray("text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8"))
+           << qMakePair(QByteArray("HTTP_ACCEPT_LANGUAGE"), QByteArray("en-US,en;q=0.5"))
+           << qMakePair(QByteArray("HTTP_ACCEPT_ENCODING"), QByteArray("gzip, deflate"))
+           << qMakePair(QByteArray("HTTP_COOKIE"), QByteArray("sessionID={6f1e5b4c-1d2a-4c3b-9e8f-7a6b5c4d3e2f}"));
+    return params;
+}
+
+static QByteArray fcgiParams(const Params& params)
+{
+    QByteArray out;
+    foreach (const Params::value_type& pair, params)
+    {
+        out += char(pair.first.size());
+        out += char(pair.second.size());
+        out += pair.first + pair.second;
+    }
+    return out;
+}
+
+static QByteArray scgiParams(const Params& params)
+{
+    QByteArray block;
+    block += QByteArray("CONTENT_LENGTH") + '\0' + '0' + '\0';
+    foreach (const Params::value_type& pair, params)
+        block += pair.first + '\0' + pair.second + '\0';
+    return QByteArray::number(block.size()) + ':' + block + ',';
+}
+
+static QByteArray record(int type, quint16 id, const QByteArray& body)
+{
+    QByteArray out;
+    out += char(1);
+    out += char(type);
+    out += char(id >> 8);
+    out += char(id);
+    out += char(body.size() >> 8);
+    out += char(body.size());
+    out += char(0);
+    out += char(0);
+    return out + body;
+}
+
+static QByteArray beginRequest(quint16 id)
+{
+    // responder role, FCGI_KEEP_CONN
+    return record(1, id, QByteArray("\0\1\1\0\0\0\0\0", 8));
+}
+
+class Test : public QObject
+{
+    Q_OBJECT
+private:
+    QHash<int, QByteArray> output;
+    QSet<int> ended;
+    QByteArray pending;
+
+public slots:
+    // Connected to the client socket; not a test function
+    void readRecords()
+    {
+        QTcpSocket* socket = static_cast<QTcpSocket*>(sender());
+        pending += socket->readAll();
+        while (pending.size() >= 8)
+        {
+            const uchar* h = reinterpret_cast<const uchar*>(pending.constData());
+            int id = (h[2] << 8) | h[3];
+            int size = (h[4] << 8) | h[5];
+            int total = 8 + size + h[6];
+            if (pending.size() < total)
+                break;
+            if (h[1] == 6)
+                output[id] += pending.mid(8, size);
+            else if (h[1] == 3)
+                ended.insert(id);
+            pending.remove(0, total);
+        }
+    }
+
+private slots:
+    void multiplexed()
+    {
+        QxtHttpSessionManager manager;
+        EchoService service(&manager);
+        manager.setAutoCreateSession(false);
+        manager.setStaticContentService(&service);
+        manager.setConnector(QxtHttpSessionManager::Fcgi);
+        manager.setListenInterface(QHostAddress::LocalHost);
+        manager.setPort(0);
+        QVERIFY(manager.start());
+
+        QTcpSocket client;
+        connect(&client, SIGNAL(readyRead()), this, SLOT(readRecords()));
+        client.connectToHost(QHostAddress::LocalHost, manager.serverPort());
+        QVERIFY(client.waitForConnected(5000));
+
+        for (int round = 0; round < 2; round++)
+        {
+            output.clear();
+            ended.clear();
+            // Two requests interleaved on the same connection
+            client.write(beginRequest(1) + beginRequest(2)
+                         + record(4, 2, fcgiParams(requestParams("/two")))
+                         + record(4, 1, fcgiParams(requestParams("/one")))
+                         + record(4, 2, QByteArray()) + record(5, 2, QByteArray())
+                         + record(4, 1, QByteArray()) + record(5, 1, QByteArray()));
+            QTRY_COMPARE(ended.count(), 2);
+            QVERIFY(output[1].startsWith("Status: 200"));
+            QVERIFY(output[1].endsWith("\r\n\r\n/one"));
+            QVERIFY(output[2].endsWith("\r\n\r\n/two"));
+            QVERIFY(!output[1].toLower().contains("transfer-encoding"));
+            QCOMPARE(client.state(), QAbstractSocket::ConnectedState);
+        }
+    }
+
+    // End to end: 100 sequential requests, each SCGI request on a connection
+    // of its own, all FastCGI requests on one connection kept open with
+    // FCGI_KEEP_CONN. Both run over loopback in this thread, so the numbers
+    // show the cost of connection setup and teardown in QxtWeb, not the
+    // latency of a real network or front-end.
+    void connectionReuse_data()
+    {
+        QTest::addColumn<int>("connector");
+        QTest::newRow("scgi, connection per request") << int(QxtHttpSessionManager::Scgi);
+        QTest::newRow("fastcgi, one connection") << int(QxtHttpSessionManager::Fcgi);
+    }
+
+    void connectionReuse()
+    {
+        QFETCH(int, connector);
+        QxtHttpSessionManager manager;
+        EchoService service(&manager);
+        manager.setAutoCreateSession(false);
+        manager.setStaticContentService(&service);
+        manager.setConnector(QxtHttpSessionManager::Connector(connector));
+        manager.setListenInterface(QHostAddress::LocalHost);
+        manager.setPort(0);
+        QVERIFY(manager.start());
+
+        const int requests = 100;
+        const QByteArray scgiRequest = scgiParams(requestParams("/index.html"));
+        const QByteArray fcgiRequest = beginRequest(1)
+                                       + record(4, 1, fcgiParams(requestParams("/index.html")))
+                                       + record(4, 1, QByteArray()) + record(5, 1, QByteArray());
+        QBENCHMARK
+        {
+            if (connector == QxtHttpSessionManager::Scgi)
+            {
+                for (int i = 0; i < requests; i++)
+                {
+                    QTcpSocket client;
+                    client.connectToHost(QHostAddress::LocalHost, manager.serverPort());
+                    QVERIFY(client.waitForConnected(5000));
+                    client.write(scgiRequest);
+                    QByteArray response;
+                    QVERIFY(QTest::qWaitFor([&]() {
+                        response += client.readAll();
+                        return client.state() == QAbstractSocket::UnconnectedState;
+                    }, 5000));
+                    response += client.readAll();
+                    QVERIFY(response.endsWith("/index.html"));
+                }
+            }
+            else
+            {
+                QTcpSocket client;
+                connect(&client, SIGNAL(readyRead()), this, SLOT(readRecords()));
+                client.connectToHost(QHostAddress::LocalHost, manager.serverPort());
+                QVERIFY(client.waitForConnected(5000));
+                pending.clear();
+                for (int i = 0; i < requests; i++)
+                {
+                    output.clear();
+                    ended.clear();
+                    client.write(fcgiRequest);
+                    QVERIFY(QTest::qWaitFor([&]() { return ended.contains(1); }, 5000));
+                    QVERIFY(output[1].endsWith("/index.html"));
+                }
+            }
+        }
+    }
+
+    // The two benchmarks below only time header decoding, without any I/O
+    void benchmarkScgi()
+    {
+        ScgiParser connector;
+        const QByteArray request = scgiParams(requestParams("/index.html"));
+        QBENCHMARK
+        {
+            for (int i = 0; i < 1000; i++)
+            {
+                QByteArray buffer = request;
+                QHttpRequestHeader header = connector.parseRequest(buffer);
+                Q_UNUSED(header);
+            }
+        }
+    }
+
+    void benchmarkFcgi()
+    {
+        FcgiParser connector;
+        QByteArray params = fcgiParams(requestParams("/index.html"));
+        QByteArray request(4, '\0');
+        request[2] = char(params.size() >> 8);
+        request[3] = char(params.size());
+        request += params;
+        QxtHttpRequestParser parser;
+        QBENCHMARK
+        {
+            for (int i = 0; i < 1000; i++)
+            {
+                int offset = 0;
+                QHttpRequestHeader header;
+                connector.readRequestHeader(parser, request, offset, header);
+            }
+        }
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
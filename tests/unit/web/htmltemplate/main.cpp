@@ -1,5 +1,10 @@
 #include <QTest>
 #include <QSignalSpy>
+#include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QTemporaryDir>
 #include <QxtHtmlTemplate>
 class Test: public QObject
 {
@@ -26,6 +31,86 @@ private slots:
         t["foo"]="baz\nbar";
         QVERIFY(t.render()=="\n       baz\n       bar");
     }
+    void conditional()
+    {
+        QxtHtmlTemplate t;
+        t.load("<?? foo ?>a<?! bar ?>b<?/><?/><?! foo ?>c<?/>d");
+        QVERIFY(t.render()=="d");
+        t["foo"]="x";
+        QVERIFY(t.render()=="abd");
+        t["bar"]="y";
+        QVERIFY(t.render()=="ad");
+    }
+    void device()
+    {
+        QxtHtmlTemplate t;
+        t.load("<p><?=foo?></p>");
+        t["foo"]=QString::fromUtf8("\xc3\xa9t\xc3\xa9");
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        QVERIFY(t.render(&buffer));
+        QVERIFY(buffer.data()==t.render().toUtf8());
+    }
+    void cachedFile()
+    {
+        QTemporaryDir dir;
+        QString path = dir.path() + "/page.html";
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write("<?=foo?>");
+        f.close();
+
+        QxtHtmlTemplate t;
+        t["foo"]="bla";
+        QVERIFY(t.open(path));
+        QVERIFY(t.render()=="bla");
+
+        // A different size invalidates the cached template
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write("<b><?=foo?></b>");
+        f.close();
+        QVERIFY(t.open(path));
+        QVERIFY(t.render()=="<b>bla</b>");
+    }
+    void cacheLimit()
+    {
+        int limit = QxtHtmlTemplate::cacheLimit();
+        QxtHtmlTemplate::setCacheLimit(1);
+        QCOMPARE(QxtHtmlTemplate::cacheLimit(), 1);
+        QxtHtmlTemplate::clearCache();
+
+        QTemporaryDir dir;
+        QFile a(dir.path() + "/a");
+        QFile b(dir.path() + "/b");
+        QVERIFY(a.open(QIODevice::WriteOnly));
+        a.write("a<?=foo?>");
+        a.close();
+        QVERIFY(b.open(QIODevice::WriteOnly));
+        b.write("b<?=foo?>");
+        b.close();
+
+        QxtHtmlTemplate t;
+        t["foo"]="!";
+        QVERIFY(t.open(a.fileName()));
+        QCOMPARE(t.render(), QString("a!"));
+
+        // Rewriting "a" with the same size and modification time goes unnoticed while it is cached
+        QDateTime modified = QFileInfo(a).lastModified();
+        QVERIFY(a.open(QIODevice::WriteOnly));
+        a.write("A<?=foo?>");
+        QVERIFY(a.setFileTime(modified, QFileDevice::FileModificationTime));
+        a.close();
+        QVERIFY(t.open(a.fileName()));
+        QCOMPARE(t.render(), QString("a!"));
+
+        // Opening "b" pushes "a" out, so the next open reads the new content
+        QVERIFY(t.open(b.fileName()));
+        QCOMPARE(t.render(), QString("b!"));
+        QVERIFY(t.open(a.fileName()));
+        QCOMPARE(t.render(), QString("A!"));
+
+        QxtHtmlTemplate::setCacheLimit(limit);
+    }
 };
 
 QTEST_MAIN(Test)
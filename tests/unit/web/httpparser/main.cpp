@@ -0,0 +1,181 @@
+#include <QTest>
+#include <QxtHttpRequestParser>
+
+// The request header handling used before QxtHttpRequestParser, kept here as
+// the baseline for the benchmarks.
+static bool legacyCanParse(const QByteArray& buffer)
+{
+    if (buffer.indexOf("\r\n\r\n") >= 0) return true;
+    if (buffer.indexOf("\r\n") >= 0 && buffer.indexOf("HTTP/") == -1) return true;
+    return false;
+}
+
+static QHttpRequestHeader legacyParse(QByteArray& buffer)
+{
+    int pos = buffer.indexOf("\r\n\r\n"), endpos = pos + 3;
+    if (pos == -1)
+    {
+        pos = buffer.indexOf("\r\n");
+        endpos = pos + 1;
+    }
+    QHttpRequestHeader header(QString::fromUtf8(buffer.left(endpos)));
+    buffer.remove(0, endpos + 1);
+    return header;
+}
+
+static QByteArray pipelinedGets(int count)
+{
+    QByteArray data;
+    for (int i = 0; i < count; i++)
+    {
+        data += "GET /static/images/icon" + QByteArray::number(i) + ".png HTTP/1.1\r\n"
+                "Host: www.example.com\r\n"
+                "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:60.0) Gecko/20100101 Firefox/60.0\r\n"
+                "Accept: image/webp,*/*\r\n"
+                "Accept-Language: en-US,en;q=0.5\r\n"
+                "Accept-Encoding: gzip, deflate\r\n"
+                "Cookie: sessionID=0123456789abcdef0123456789abcdef\r\n"
+                "Connection: keep-alive\r\n"
+                "\r\n";
+    }
+    return data;
+}
+
+// Feeds data to the parser in segment-sized pieces, like a socket would
+static int parseChunked(const QByteArray& data, int chunkSize)
+{
+    QxtHttpRequestParser parser;
+    QByteArray buffer;
+    int offset = 0, requests = 0;
+    for (int pos = 0; pos < data.size(); pos += chunkSize)
+    {
+        buffer.append(data.constData() + pos, qMin(chunkSize, data.size() - pos));
+        while (parser.parse(buffer) == QxtHttpRequestParser::Complete)
+        {
+            QHttpRequestHeader header = parser.header(buffer);
+            if (header.isValid()) requests++;
+            offset = parser.endOffset();
+            if (offset > buffer.size() / 2)
+            {
+                buffer.remove(0, offset);
+                offset = 0;
+            }
+            parser.reset(offset);
+        }
+    }
+    return requests;
+}
+
+static int legacyParseChunked(const QByteArray& data, int chunkSize)
+{
+    QByteArray buffer;
+    int requests = 0;
+    for (int pos = 0; pos < data.size(); pos += chunkSize)
+    {
+        buffer.append(data.constData() + pos, qMin(chunkSize, data.size() - pos));
+        while (legacyCanParse(buffer))
+        {
+            QHttpRequestHeader header = legacyParse(buffer);
+            if (header.isValid()) requests++;
+        }
+    }
+    return requests;
+}
+
+class Test: public QObject
+{
+Q_OBJECT
+private slots:
+    void requestLine()
+    {
+        QByteArray buffer("GET /index.html?a=b HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        QxtHttpRequestParser parser;
+        QCOMPARE(parser.parse(buffer), QxtHttpRequestParser::Complete);
+        QCOMPARE(parser.method(buffer), QByteArray("GET"));
+        QCOMPARE(parser.path(buffer), QByteArray("/index.html?a=b"));
+        QCOMPARE(parser.majorVersion(), 1);
+        QCOMPARE(parser.minorVersion(), 1);
+        QCOMPARE(parser.endOffset(), buffer.size());
+        QCOMPARE(parser.value(buffer, "host"), QByteArray("localhost"));
+    }
+    void incremental()
+    {
+        QByteArray data("POST /form HTTP/1.0\r\nContent-Length: 3\r\nX-Folded: one\r\n  two\r\n\r\nabc");
+        QxtHttpRequestParser parser;
+        QByteArray buffer;
+        for (int i = 0; i < data.size(); i++)
+        {
+            buffer.append(data.at(i));
+            if (parser.parse(buffer) == QxtHttpRequestParser::Complete) break;
+        }
+        QCOMPARE(parser.status(), QxtHttpRequestParser::Complete);
+        QCOMPARE(parser.endOffset(), data.size() - 3);
+        QCOMPARE(parser.fieldCount(), 2);
+        QCOMPARE(parser.value(buffer, "X-FOLDED"), QByteArray("one two"));
+        QHttpRequestHeader header = parser.header(buffer);
+        QCOMPARE(header.method(), QString("POST"));
+        QCOMPARE(header.contentLength(), 3u);
+    }
+    void header()
+    {
+        QByteArray buffer("\r\nGET /caf\xc3\xa9 HTTP/1.1\r\nHost: localhost\r\nCookie: a=1\r\nX-Folded: one\r\n  two\r\n"
+                          "cookie: b=2\r\n\r\nGET /next HTTP/1.1\r\n");
+        QxtHttpRequestParser parser;
+        QCOMPARE(parser.parse(buffer), QxtHttpRequestParser::Complete);
+        QHttpRequestHeader header = parser.header(buffer);
+
+        // The header does not depend on the buffer it was parsed from
+        buffer.fill('x');
+        QVERIFY(header.isValid());
+        QCOMPARE(header.method(), QString("GET"));
+        QCOMPARE(header.path(), QString::fromUtf8("/caf\xc3\xa9"));
+        QVERIFY(header.hasKey("HOST"));
+        QVERIFY(!header.hasKey("content-length"));
+        QCOMPARE(header.value("x-folded"), QString("one two"));
+        QCOMPARE(header.allValues("Cookie"), QStringList() << "a=1" << "b=2");
+        QCOMPARE(header.keys(), QStringList() << "Host" << "Cookie" << "X-Folded");
+        QCOMPARE(header.values().count(), 4);
+
+        // Changing a field keeps the others
+        QHttpRequestHeader copy = header;
+        copy.setValue("host", "example.com");
+        QCOMPARE(copy.value("Host"), QString("example.com"));
+        QCOMPARE(copy.allValues("cookie"), QStringList() << "a=1" << "b=2");
+        QCOMPARE(header.value("Host"), QString("localhost"));
+        copy.setRequest("POST", "/form");
+        QCOMPARE(copy.method(), QString("POST"));
+        QCOMPARE(header.method(), QString("GET"));
+    }
+    void simpleRequest()
+    {
+        QByteArray buffer("GET /\r\n");
+        QxtHttpRequestParser parser;
+        QCOMPARE(parser.parse(buffer), QxtHttpRequestParser::Complete);
+        QCOMPARE(parser.majorVersion(), 0);
+        QCOMPARE(parser.minorVersion(), 9);
+    }
+    void pipelined()
+    {
+        QByteArray data = pipelinedGets(100);
+        QCOMPARE(parseChunked(data, 1460), 100);
+        QCOMPARE(parseChunked(data, 7), 100);
+        QCOMPARE(legacyParseChunked(data, 1460), 100);
+    }
+    void benchmarkLegacy()
+    {
+        QByteArray data = pipelinedGets(1000);
+        QBENCHMARK {
+            legacyParseChunked(data, 1460);
+        }
+    }
+    void benchmarkParser()
+    {
+        QByteArray data = pipelinedGets(1000);
+        QBENCHMARK {
+            parseChunked(data, 1460);
+        }
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
@@ -0,0 +1,183 @@
+#include <QTest>
+#include <QThreadPool>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QxtWebJsonRPCService>
+#include <QxtAbstractWebSessionManager>
+#include <QxtWebContent>
+#include <QxtWebEvent>
+#include <QxtJSON>
+
+class RecordingSessionManager : public QxtAbstractWebSessionManager
+{
+public:
+    bool start() { return true; }
+    bool shutdown() { return true; }
+    void processEvents() {}
+
+    void postEvent(QxtWebEvent* event)
+    {
+        QxtWebPageEvent* page = static_cast<QxtWebPageEvent*>(event);
+        QMutexLocker locker(&lock);
+        status = page->status;
+        body = page->dataSource->readAll();
+        delete event;
+        posted.wakeAll();
+    }
+
+    QMutex lock;
+    QWaitCondition posted;
+    int status;
+    QByteArray body;
+};
+
+class Service : public QxtWebJsonRPCService
+{
+    Q_OBJECT
+public:
+    Service(QxtAbstractWebSessionManager* sm) : QxtWebJsonRPCService(sm), notified(0) {}
+    // The slots of running batch entries belong to this class
+    ~Service() { setThreadPool(0); }
+
+    void send(const QByteArray& data)
+    {
+        RecordingSessionManager* sm = static_cast<RecordingSessionManager*>(sessionManager());
+        QxtWebRequestEvent event(0, 1, QUrl("/"));
+        event.method = "POST";
+        event.content = new QxtWebContent(data);
+        QMutexLocker locker(&sm->lock);
+        sm->body = "-";
+        locker.unlock();
+        static_cast<QxtAbstractWebService*>(this)->pageRequestedEvent(&event);
+    }
+
+    QByteArray request(const QByteArray& data)
+    {
+        RecordingSessionManager* sm = static_cast<RecordingSessionManager*>(sessionManager());
+        send(data);
+        QMutexLocker locker(&sm->lock);
+        if (sm->body == "-")
+            sm->posted.wait(&sm->lock, 5000);
+        return sm->body;
+    }
+
+    QAtomicInt notified;
+
+public slots:
+    int sleep(int msecs)
+    {
+        QThread::msleep(msecs);
+        return msecs;
+    }
+
+    int add(int a, int b)
+    {
+        return a + b;
+    }
+    QString join(const QStringList& parts)
+    {
+        return parts.join(",");
+    }
+    void notify()
+    {
+        notified.ref();
+    }
+    int fail()
+    {
+        throwRPCError("failed");
+        return 1;
+    }
+};
+
+class Test : public QObject
+{
+    Q_OBJECT
+private slots:
+    void single()
+    {
+        RecordingSessionManager sm;
+        Service service(&sm);
+        QVariantMap res = QxtJSON::parseUtf8(service.request("{\"method\":\"add\",\"id\":1,\"params\":[9,2]}")).toMap();
+        QCOMPARE(res.value("result").toInt(), 11);
+        QVERIFY(res.contains("error"));
+
+        // arguments are converted to the parameter types
+        res = QxtJSON::parseUtf8(service.request("{\"jsonrpc\":\"2.0\",\"method\":\"add\",\"id\":2,\"params\":{\"a\":\"4\",\"b\":1.0}}")).toMap();
+        QCOMPARE(res.value("result").toInt(), 5);
+        QVERIFY(!res.contains("error"));
+        res = QxtJSON::parseUtf8(service.request("{\"jsonrpc\":\"2.0\",\"method\":\"join\",\"id\":3,\"params\":[[\"a\",\"b\"]]}")).toMap();
+        QCOMPARE(res.value("result").toString(), QString("a,b"));
+        res = QxtJSON::parseUtf8(service.request("{\"jsonrpc\":\"2.0\",\"method\":\"add\",\"id\":4,\"params\":[{},1]}")).toMap();
+        QCOMPARE(res.value("error").toMap().value("code").toInt(), -32602);
+
+        res = QxtJSON::parseUtf8(service.request("{\"jsonrpc\":\"2.0\",\"method\":\"fail\",\"id\":5}")).toMap();
+        QCOMPARE(res.value("error").toMap().value("message").toString(), QString("failed"));
+        QVERIFY(!res.contains("result"));
+    }
+
+    void notification()
+    {
+        RecordingSessionManager sm;
+        Service service(&sm);
+        QCOMPARE(service.request("{\"jsonrpc\":\"2.0\",\"method\":\"notify\"}"), QByteArray());
+        QCOMPARE(sm.status, 204);
+        QCOMPARE(int(service.notified), 1);
+    }
+
+    void batch_data()
+    {
+        QTest::addColumn<bool>("parallel");
+        QTest::newRow("sequential") << false;
+        QTest::newRow("thread pool") << true;
+    }
+
+    void batch()
+    {
+        QFETCH(bool, parallel);
+        RecordingSessionManager sm;
+        Service service(&sm);
+        QThreadPool pool;
+        if (parallel)
+            service.setThreadPool(&pool);
+
+        QByteArray request = "[";
+        for (int i = 0; i < 50; i++)
+            request += "{\"jsonrpc\":\"2.0\",\"method\":\"add\",\"id\":" + QByteArray::number(i) + ",\"params\":[" + QByteArray::number(i) + ",1]},";
+        request += "{\"jsonrpc\":\"2.0\",\"method\":\"notify\"},{\"jsonrpc\":\"2.0\",\"method\":\"missing\",\"id\":\"x\"},5]";
+
+        QVariantList responses = QxtJSON::parseUtf8(service.request(request)).toList();
+        QCOMPARE(responses.count(), 52);
+        for (int i = 0; i < 50; i++) {
+            QVariantMap res = responses.at(i).toMap();
+            QCOMPARE(res.value("id").toInt(), i);
+            QCOMPARE(res.value("result").toInt(), i + 1);
+        }
+        QCOMPARE(responses.at(50).toMap().value("error").toMap().value("code").toInt(), -32601);
+        QCOMPARE(responses.at(51).toMap().value("error").toMap().value("code").toInt(), -32600);
+        QCOMPARE(int(service.notified), 1);
+
+        QCOMPARE(service.request("[{\"jsonrpc\":\"2.0\",\"method\":\"notify\"},{\"jsonrpc\":\"2.0\",\"method\":\"notify\"}]"), QByteArray());
+        QCOMPARE(sm.status, 204);
+        QCOMPARE(int(service.notified), 3);
+    }
+
+    void destroyDuringBatch()
+    {
+        RecordingSessionManager sm;
+        QThreadPool pool;
+        pool.setMaxThreadCount(1);
+        {
+            Service service(&sm);
+            service.setThreadPool(&pool);
+            service.send("[{\"jsonrpc\":\"2.0\",\"method\":\"sleep\",\"id\":1,\"params\":[50]},"
+                         "{\"jsonrpc\":\"2.0\",\"method\":\"sleep\",\"id\":2,\"params\":[50]}]");
+        }
+        // The batch was answered before the service went away
+        QMutexLocker locker(&sm.lock);
+        QCOMPARE(QxtJSON::parseUtf8(sm.body).toList().count(), 2);
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
@@ -0,0 +1,165 @@
+#include <QTest>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QxtHttpSessionManager>
+#include <QxtAbstractWebService>
+#include <QxtWebEvent>
+
+class DelayService : public QxtAbstractWebService
+{
+public:
+    DelayService(QxtAbstractWebSessionManager* manager) : QxtAbstractWebService(manager) {}
+    void pageRequestedEvent(QxtWebRequestEvent* event)
+    {
+        int sessionID = event->sessionID, requestID = event->requestID;
+        QByteArray path = event->url.path().toLatin1();
+        // Answer the slow request last so that the responses have to be reordered
+        int delay = path == "/slow" ? 200 : 0;
+        QTimer::singleShot(delay, this, [this, sessionID, requestID, path]() {
+            postEvent(new QxtWebPageEvent(sessionID, requestID, path));
+        });
+    }
+};
+
+// Splits complete Content-Length delimited responses off the front of buffer
+static QList<QByteArray> takeResponses(QByteArray& buffer)
+{
+    QList<QByteArray> bodies;
+    for (;;)
+    {
+        int end = buffer.indexOf("\r\n\r\n");
+        if (end < 0) break;
+        QByteArray head = buffer.left(end).toLower();
+        int pos = head.indexOf("content-length:");
+        if (pos < 0) break;
+        int length = head.mid(pos + 15, head.indexOf("\r\n", pos) - pos - 15).trimmed().toInt();
+        if (buffer.size() < end + 4 + length) break;
+        bodies << buffer.mid(end + 4, length);
+        buffer.remove(0, end + 4 + length);
+    }
+    return bodies;
+}
+
+class Test : public QObject
+{
+    Q_OBJECT
+private slots:
+    void pipelined()
+    {
+        QxtHttpSessionManager manager;
+        DelayService service(&manager);
+        manager.setAutoCreateSession(false);
+        manager.setStaticContentService(&service);
+        manager.setListenInterface(QHostAddress::LocalHost);
+        manager.setPort(0);
+        manager.setConnector(QxtHttpSessionManager::HttpServer);
+        QVERIFY(manager.start());
+
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, manager.serverPort());
+        QVERIFY(client.waitForConnected(5000));
+
+        QByteArray buffer;
+        QList<QByteArray> bodies;
+        auto receive = [&]() {
+            buffer += client.readAll();
+            bodies += takeResponses(buffer);
+            return bodies.count();
+        };
+        for (int round = 0; round < 2; round++)
+        {
+            client.write("GET /slow HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                         "GET /fast HTTP/1.1\r\nHost: localhost\r\n\r\n");
+            QTRY_COMPARE(receive(), 2 * (round + 1));
+        }
+        QCOMPARE(bodies, QList<QByteArray>() << "/slow" << "/fast" << "/slow" << "/fast");
+        QCOMPARE(client.state(), QAbstractSocket::ConnectedState);
+    }
+
+    void headerTimeout()
+    {
+        QxtHttpSessionManager manager;
+        DelayService service(&manager);
+        manager.setAutoCreateSession(false);
+        manager.setStaticContentService(&service);
+        manager.setListenInterface(QHostAddress::LocalHost);
+        manager.setPort(0);
+        manager.setConnector(QxtHttpSessionManager::HttpServer);
+        manager.connector()->setHeaderTimeout(1000);
+        QVERIFY(manager.start());
+
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, manager.serverPort());
+        QVERIFY(client.waitForConnected(5000));
+        // Never finish the header
+        client.write("GET / HTTP/1.1\r\nHost: loc");
+        QTRY_COMPARE_WITH_TIMEOUT(client.state(), QAbstractSocket::UnconnectedState, 5000);
+    }
+
+    void bodyInPieces()
+    {
+        QxtHttpSessionManager manager;
+        DelayService service(&manager);
+        manager.setAutoCreateSession(false);
+        manager.setStaticContentService(&service);
+        manager.setListenInterface(QHostAddress::LocalHost);
+        manager.setPort(0);
+        manager.setConnector(QxtHttpSessionManager::HttpServer);
+        QVERIFY(manager.start());
+
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, manager.serverPort());
+        QVERIFY(client.waitForConnected(5000));
+
+        QByteArray buffer;
+        QList<QByteArray> bodies;
+        auto receive = [&]() {
+            buffer += client.readAll();
+            bodies += takeResponses(buffer);
+            return bodies.count();
+        };
+        // The body arrives over several reads and is followed by another
+        // request on the same connection
+        const int pieces = 64, pieceSize = 16384;
+        client.write("POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Length: "
+                     + QByteArray::number(pieces * pieceSize) + "\r\n\r\n");
+        for (int i = 0; i < pieces; i++)
+        {
+            client.write(QByteArray(pieceSize, 'x'));
+            QVERIFY(client.waitForBytesWritten(5000));
+            QTest::qWait(1);
+        }
+        client.write("GET /after HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        QTRY_COMPARE_WITH_TIMEOUT(receive(), 2, 5000);
+        QCOMPARE(bodies, QList<QByteArray>() << "/upload" << "/after");
+    }
+
+    void oversizedContentLength()
+    {
+        QxtHttpSessionManager manager;
+        DelayService service(&manager);
+        manager.setAutoCreateSession(false);
+        manager.setStaticContentService(&service);
+        manager.setListenInterface(QHostAddress::LocalHost);
+        manager.setPort(0);
+        manager.setConnector(QxtHttpSessionManager::HttpServer);
+        QVERIFY(manager.start());
+
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, manager.serverPort());
+        QVERIFY(client.waitForConnected(5000));
+        // 2^32 truncates to 0 in 32 bits, which would expose the body as
+        // a second request
+        client.write("POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Length: 4294967296\r\n\r\n"
+                     "GET /smuggled HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        QByteArray received;
+        QTRY_VERIFY_WITH_TIMEOUT((received += client.readAll(),
+                                  client.state() == QAbstractSocket::UnconnectedState), 5000);
+        received += client.readAll();
+        QVERIFY(received.startsWith("HTTP/1.") && received.contains(" 413 "));
+        QVERIFY(!received.contains("/smuggled"));
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
@@ -0,0 +1,105 @@
+#include <QTest>
+#include <QSignalSpy>
+#include <QxtWebContent>
+#include <QxtWebMultipartParser>
+
+static const QByteArray contentType("multipart/form-data; boundary=\"----qxtboundary\"");
+
+static QByteArray formBody(const QByteArray& file)
+{
+    return "preamble\r\n"
+           "------qxtboundary\r\n"
+           "Content-Disposition: form-data; name=\"note\"\r\n"
+           "\r\n"
+           "hello\r\n"
+           "------qxtboundary\r\n"
+           "Content-Disposition: form-data; name=\"upfile\"; filename=\"data.bin\"\r\n"
+           "Content-Type: application/octet-stream\r\n"
+           "\r\n"
+           + file + "\r\n"
+           "------qxtboundary--\r\n";
+}
+
+static QByteArray fileData(int size)
+{
+    QByteArray data;
+    data.reserve(size);
+    for (int i = 0; i < size; i++)
+        data += char(i * 7 % 251);
+    return data;
+}
+
+class Test : public QObject
+{
+    Q_OBJECT
+private slots:
+    void boundary()
+    {
+        QCOMPARE(QxtWebMultipartParser::boundary(contentType), QByteArray("----qxtboundary"));
+        QCOMPARE(QxtWebMultipartParser::boundary("multipart/mixed; boundary=abc"), QByteArray("abc"));
+        QVERIFY(QxtWebMultipartParser::boundary("text/plain; boundary=abc").isEmpty());
+    }
+    void incremental_data()
+    {
+        QTest::addColumn<int>("step");
+        QTest::newRow("whole") << 0;
+        QTest::newRow("bytes") << 1;
+        QTest::newRow("segments") << 1460;
+    }
+    void incremental()
+    {
+        QFETCH(int, step);
+        QByteArray file = fileData(200000);
+        QByteArray body = formBody(file);
+        QxtWebContent content(body.size(), QByteArray(), 0, 0);
+        QxtWebMultipartParser parser(&content, contentType);
+        parser.setSpoolThreshold(1024);
+        QSignalSpy started(&parser, SIGNAL(partStarted(QxtWebMultipartPart)));
+        QSignalSpy finished(&parser, SIGNAL(finished()));
+        if (step == 0) step = body.size();
+        for (int i = 0; i < body.size(); i += step)
+        {
+            content.write(body.constData() + i, qMin(step, body.size() - i));
+            if (i % (step * 64) == 0)
+                QCoreApplication::processEvents();
+        }
+        QTRY_COMPARE(finished.count(), 1);
+        QCOMPARE(started.count(), 2);
+
+        QList<QxtWebMultipartPart> parts = parser.parts();
+        QCOMPARE(parts.count(), 2);
+        QCOMPARE(parts[0].name, QString("note"));
+        QCOMPARE(parts[0].data, QByteArray("hello"));
+        QVERIFY(!parts[0].isSpooled());
+        QCOMPARE(parts[1].name, QString("upfile"));
+        QCOMPARE(parts[1].fileName, QString("data.bin"));
+        QCOMPARE(parts[1].contentType, QByteArray("application/octet-stream"));
+        QCOMPARE(parts[1].size, qint64(file.size()));
+        QVERIFY(parts[1].isSpooled());
+        QIODevice* device = parts[1].open();
+        QVERIFY(device);
+        QCOMPARE(device->readAll(), file);
+        delete device;
+    }
+    void truncated()
+    {
+        QByteArray body = formBody(fileData(100));
+        body.chop(30);
+        QxtWebContent content(body);
+        QxtWebMultipartParser parser(&content, contentType);
+        QSignalSpy error(&parser, SIGNAL(error(QString)));
+        QTRY_COMPARE(error.count(), 1);
+        QVERIFY(!parser.isFinished());
+        QCOMPARE(parser.parts().count(), 1);
+    }
+    void notMultipart()
+    {
+        QxtWebContent content(QByteArray("a=b"));
+        QxtWebMultipartParser parser(&content, "application/x-www-form-urlencoded");
+        QSignalSpy error(&parser, SIGNAL(error(QString)));
+        QTRY_COMPARE(error.count(), 1);
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
@@ -0,0 +1,8 @@
+TEMPLATE = app
+TARGET = 
+DEPENDPATH += .
+INCLUDEPATH += .
+QT = core
+QXT = web
+SOURCES += main.cpp
+include(../../unit.pri)
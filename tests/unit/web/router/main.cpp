@@ -0,0 +1,108 @@
+#include <QTest>
+#include <QxtHttpSessionManager>
+#include <QxtWebRouter>
+#include <QxtWebEvent>
+
+class Handler : public QObject
+{
+    Q_OBJECT
+public:
+    QString called;
+    QVariantList arguments;
+
+public slots:
+    void user(QxtWebRequestEvent*, int id)
+    {
+        called = "user";
+        arguments = QVariantList() << id;
+    }
+    void post(QxtWebRequestEvent*, int id, const QString& slug)
+    {
+        called = "post";
+        arguments = QVariantList() << id << slug;
+    }
+};
+
+class RecordingService : public QxtAbstractWebService
+{
+public:
+    RecordingService(QxtAbstractWebSessionManager* sm) : QxtAbstractWebService(sm) {}
+    void pageRequestedEvent(QxtWebRequestEvent* event)
+    {
+        path = event->url.path();
+    }
+    QString path;
+};
+
+class Test : public QObject
+{
+    Q_OBJECT
+private slots:
+    void precedence()
+    {
+        QxtHttpSessionManager sm;
+        QxtWebRouter router(&sm);
+        Handler handler;
+        int me = router.addRoute("/users/me", &handler, SLOT(user(QxtWebRequestEvent*, int)));
+        QCOMPARE(me, -1);   // the slot expects a capture the pattern does not have
+        int byId = router.addRoute("/users/{id:int}", &handler, SLOT(user(QxtWebRequestEvent*, int)));
+        int byName = router.addRoute("/users/{name}/files/*", &handler, SLOT(post(QxtWebRequestEvent*, int, QString)));
+        QCOMPARE(byName, -1);
+        byName = router.addRoute("/users/{id:int}/posts/{slug}", &handler, SLOT(post(QxtWebRequestEvent*, int, QString)));
+        QVERIFY(byId >= 0 && byName >= 0);
+
+        QVariantList arguments;
+        QCOMPARE(router.match("/users/42", &arguments), byId);
+        QCOMPARE(arguments, QVariantList() << 42);
+        QCOMPARE(router.match("/users/42/"), byId);
+        QCOMPARE(router.match("/users/bob"), -1);
+        QCOMPARE(router.match("/users/7/posts/hello", &arguments), byName);
+        QCOMPARE(arguments, QVariantList() << 7 << QString("hello"));
+        QCOMPARE(router.match("/users/7/posts"), -1);
+    }
+
+    void dispatch()
+    {
+        QxtHttpSessionManager sm;
+        QxtWebRouter router(&sm);
+        Handler handler;
+        RecordingService files(&sm);
+        router.addRoute("/users/{id:int}/posts/{slug}", &handler, SLOT(post(QxtWebRequestEvent*, int, QString)));
+        router.addRoute("/static", &files);
+
+        QxtWebRequestEvent post(0, 1, QUrl("/users/3/posts/news"));
+        router.pageRequestedEvent(&post);
+        QCOMPARE(handler.called, QString("post"));
+        QCOMPARE(handler.arguments, QVariantList() << 3 << QString("news"));
+
+        QxtWebRequestEvent file(0, 2, QUrl("/static/css/site.css"));
+        router.pageRequestedEvent(&file);
+        QCOMPARE(files.path, QString("/css/site.css"));
+    }
+
+    void benchmark()
+    {
+        QxtHttpSessionManager sm;
+        QxtWebRouter router(&sm);
+        Handler handler;
+        for (int i = 0; i < 10000; i++)
+            router.addRoute(QString("/api/v%1/resource%2/{id:int}/posts/{slug}").arg(i % 10).arg(i),
+                            &handler, SLOT(post(QxtWebRequestEvent*, int, QString)));
+        QCOMPARE(router.routeCount(), 10000);
+        QStringList paths;
+        for (int i = 0; i < 1000; i++)
+        {
+            int route = (i * 7919) % 10000;
+            paths << QString("/api/v%1/resource%2/%3/posts/entry").arg(route % 10).arg(route).arg(i);
+        }
+        QBENCHMARK
+        {
+            foreach (const QString& path, paths)
+                router.match(path);
+        }
+        QCOMPARE(router.match(paths.at(1)), 7919);
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
@@ -0,0 +1,137 @@
+#include <QTest>
+#include <QFile>
+#include <QDir>
+#include <QDateTime>
+#include <QUuid>
+#include <QRegularExpression>
+#include <QxtFileSessionStore>
+#include <QxtTemporaryDir>
+
+typedef QHash<QByteArray, QByteArray> Sessions;
+
+class Test : public QObject
+{
+    Q_OBJECT
+private:
+    static QString fileFor(const QxtFileSessionStore& store, const QByteArray& key)
+    {
+        return QDir(store.directory()).filePath(QString::fromLatin1(key.toHex()));
+    }
+
+private slots:
+    void storeAndLoad()
+    {
+        QxtTemporaryDir dir;
+        QxtFileSessionStore store(dir.path());
+        QByteArray key = QUuid::createUuid().toByteArray();
+        Sessions sessions;
+        sessions.insert(key, "state");
+        sessions.insert("empty", QByteArray(""));
+        QVERIFY(store.save(sessions, QList<QByteArray>()));
+
+        QCOMPARE(store.load(key), QByteArray("state"));
+        QByteArray empty = store.load("empty");
+        QVERIFY(!empty.isNull());
+        QVERIFY(empty.isEmpty());
+        QVERIFY(store.load("unknown").isNull());
+
+        QVERIFY(store.save(Sessions(), QList<QByteArray>() << key));
+        QVERIFY(store.load(key).isNull());
+    }
+
+    void restoreAfterRestart()
+    {
+        QxtTemporaryDir dir;
+        QByteArray key = QUuid::createUuid().toByteArray();
+        {
+            QxtFileSessionStore store(dir.path());
+            Sessions sessions;
+            sessions.insert(key, QByteArray("binary\0state", 12));
+            QVERIFY(store.save(sessions, QList<QByteArray>()));
+        }
+        QxtFileSessionStore store(dir.path());
+        QCOMPARE(store.load(key), QByteArray("binary\0state", 12));
+    }
+
+    void missesAreForgottenOnSave()
+    {
+        QxtTemporaryDir dir;
+        QxtFileSessionStore store(dir.path());
+        QVERIFY(store.load("later").isNull());
+        Sessions sessions;
+        sessions.insert("later", "state");
+        QVERIFY(store.save(sessions, QList<QByteArray>()));
+        QCOMPARE(store.load("later"), QByteArray("state"));
+    }
+
+    void expiry()
+    {
+        QxtTemporaryDir dir;
+        QxtFileSessionStore store(dir.path());
+        store.setMaximumAge(60);
+        Sessions sessions;
+        sessions.insert("old", "state");
+        sessions.insert("stale", "state");
+        sessions.insert("fresh", "state");
+        QVERIFY(store.save(sessions, QList<QByteArray>()));
+
+        QDateTime past = QDateTime::currentDateTime().addSecs(-120);
+        foreach(const QByteArray& key, QList<QByteArray>() << "old" << "stale")
+        {
+            QFile file(fileFor(store, key));
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QVERIFY(file.setFileTime(past, QFileDevice::FileModificationTime));
+        }
+
+        QVERIFY(store.load("old").isNull());
+        QVERIFY(!QFile::exists(fileFor(store, "old")));
+        QCOMPARE(store.removeExpired(), 1);
+        QVERIFY(!QFile::exists(fileFor(store, "stale")));
+        QCOMPARE(store.load("fresh"), QByteArray("state"));
+    }
+
+    void corruptFile_data()
+    {
+        QTest::addColumn<QByteArray>("contents");
+        QTest::newRow("empty") << QByteArray();
+        QTest::newRow("no header") << QByteArray("state");
+        QTest::newRow("truncated") << QByteArray("QxtS\0\0\0\x05\0\0sta", 13);
+        QTest::newRow("bad checksum") << QByteArray("QxtS\0\0\0\x05\0\0state", 15);
+    }
+
+    void corruptFile()
+    {
+        QFETCH(QByteArray, contents);
+        QxtTemporaryDir dir;
+        QxtFileSessionStore store(dir.path());
+        QFile file(fileFor(store, "corrupt"));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(contents);
+        file.close();
+
+        QTest::ignoreMessage(QtWarningMsg, QRegularExpression("corrupt session file"));
+        QVERIFY(store.load("corrupt").isNull());
+        QVERIFY(!file.exists());
+    }
+
+    void invalidKeys()
+    {
+        QxtTemporaryDir dir;
+        QxtFileSessionStore store(dir.path());
+        QVERIFY(QxtFileSessionStore::isValidKey(QUuid::createUuid().toByteArray()));
+        QVERIFY(!QxtFileSessionStore::isValidKey(QByteArray()));
+        QVERIFY(!QxtFileSessionStore::isValidKey("../escape"));
+        QVERIFY(!QxtFileSessionStore::isValidKey("with space"));
+        QVERIFY(!QxtFileSessionStore::isValidKey(QByteArray(129, 'a')));
+
+        Sessions sessions;
+        sessions.insert("../escape", "state");
+        QTest::ignoreMessage(QtWarningMsg, QRegularExpression("invalid key"));
+        QVERIFY(!store.save(sessions, QList<QByteArray>()));
+        QVERIFY(QDir(store.directory()).entryList(QDir::Files).isEmpty());
+        QVERIFY(store.load("../escape").isNull());
+    }
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
@@ -0,0 +1,184 @@
+#include <QTest>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QxtHttpSessionManager>
+#include <QxtWebStaticFileService>
+#ifdef QXT_HAVE_ZLIB
+#include <zlib.h>
+#include <cstring>
+#endif
+
+struct Response
+{
+    int status;
+    QByteArray head;        // lower-cased
+    QByteArray body;
+
+    QByteArray header(const QByteArray& name) const
+    {
+        int pos = head.indexOf("\r\n" + name + ':');
+        if (pos < 0) return QByteArray();
+        pos += name.size() + 3;
+        return head.mid(pos, head.indexOf("\r\n", pos) - pos).trimmed();
+    }
+};
+
+class Test : public QObject
+{
+    Q_OBJECT
+private:
+    QTemporaryDir dir;
+    QxtHttpSessionManager* manager;
+    QxtWebStaticFileService* service;
+
+    void writeFile(const QString& name, const QByteArray& data)
+    {
+        QFile file(dir.path() + '/' + name);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(data), qint64(data.size()));
+    }
+
+    Response get(const QByteArray& path, const QByteArray& headers = QByteArray())
+    {
+        Response response;
+        response.status = 0;
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, manager->serverPort());
+        if (!client.waitForConnected(5000)) return response;
+        client.write("GET " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n" + headers + "\r\n");
+        QByteArray received;
+        QTest::qWaitFor([&]() {
+            received += client.readAll();
+            return client.state() == QAbstractSocket::UnconnectedState;
+        }, 5000);
+        received += client.readAll();
+        int end = received.indexOf("\r\n\r\n");
+        if (end < 0) return response;
+        response.head = received.left(end + 2).toLower();
+        response.body = received.mid(end + 4);
+        response.status = response.head.mid(9, 3).toInt();
+        return response;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(dir.isValid());
+        writeFile("digits.bin", "0123456789");
+        writeFile("asset.bin", "identity");
+        writeFile("asset.bin.gz", "compressed");
+        writeFile("page.txt", QByteArray(20000, 'a'));
+        manager = new QxtHttpSessionManager(this);
+        service = new QxtWebStaticFileService(dir.path(), manager, manager);
+        manager->setAutoCreateSession(false);
+        manager->setStaticContentService(service);
+        manager->setListenInterface(QHostAddress::LocalHost);
+        manager->setPort(0);
+        manager->setConnector(QxtHttpSessionManager::HttpServer);
+        QVERIFY(manager->start());
+    }
+
+    void whole()
+    {
+        Response r = get("/digits.bin");
+        QCOMPARE(r.status, 200);
+        QCOMPARE(r.body, QByteArray("0123456789"));
+        QCOMPARE(r.header("accept-ranges"), QByteArray("bytes"));
+    }
+
+    void singleRange()
+    {
+        Response r = get("/digits.bin", "Range: bytes=2-5\r\n");
+        QCOMPARE(r.status, 206);
+        QCOMPARE(r.body, QByteArray("2345"));
+        QCOMPARE(r.header("content-range"), QByteArray("bytes 2-5/10"));
+
+        r = get("/digits.bin", "Range: bytes=-3\r\n");
+        QCOMPARE(r.status, 206);
+        QCOMPARE(r.body, QByteArray("789"));
+    }
+
+    void multiRange()
+    {
+        Response r = get("/digits.bin", "Range: bytes=0-1,5-6\r\n");
+        QCOMPARE(r.status, 206);
+        QByteArray type = r.header("content-type");
+        QVERIFY(type.startsWith("multipart/byteranges; boundary="));
+        QByteArray boundary = type.mid(type.indexOf('=') + 1);
+        QVERIFY(r.body.startsWith("--" + boundary + "\r\n"));
+        QVERIFY(r.body.endsWith("--" + boundary + "--\r\n"));
+        QVERIFY(r.body.contains("content-range: bytes 0-1/10\r\n\r\n01\r\n"));
+        QVERIFY(r.body.contains("content-range: bytes 5-6/10\r\n\r\n56\r\n"));
+
+        // Overlapping ranges would add up to more than the file
+        r = get("/digits.bin", "Range: bytes=0-9,0-9\r\n");
+        QCOMPARE(r.status, 200);
+        QCOMPARE(r.body, QByteArray("0123456789"));
+    }
+
+    void unsatisfiable()
+    {
+        Response r = get("/digits.bin", "Range: bytes=20-30\r\n");
+        QCOMPARE(r.status, 416);
+        QCOMPARE(r.header("content-range"), QByteArray("bytes */10"));
+    }
+
+    void notModified()
+    {
+        QByteArray etag = get("/digits.bin").header("etag");
+        QVERIFY(!etag.isEmpty());
+        Response r = get("/digits.bin", "If-None-Match: " + etag + "\r\n");
+        QCOMPARE(r.status, 304);
+        QVERIFY(r.body.isEmpty());
+
+        r = get("/digits.bin", "If-None-Match: \"other\"\r\n");
+        QCOMPARE(r.status, 200);
+    }
+
+    void precompressed()
+    {
+        Response r = get("/asset.bin", "Accept-Encoding: gzip\r\n");
+        QCOMPARE(r.status, 200);
+        QCOMPARE(r.body, QByteArray("compressed"));
+        QCOMPARE(r.header("content-encoding"), QByteArray("gzip"));
+        QByteArray gzipTag = r.header("etag");
+
+        r = get("/asset.bin");
+        QCOMPARE(r.status, 200);
+        QCOMPARE(r.body, QByteArray("identity"));
+        QVERIFY(r.header("content-encoding").isEmpty());
+        QVERIFY(r.header("etag") != gzipTag);
+
+        // Ranges always refer to the identity encoding
+        r = get("/asset.bin", "Accept-Encoding: gzip\r\nRange: bytes=0-1\r\n");
+        QCOMPARE(r.status, 206);
+        QCOMPARE(r.body, QByteArray("id"));
+    }
+
+#ifdef QXT_HAVE_ZLIB
+    void compressedInCache()
+    {
+        Response r = get("/page.txt", "Accept-Encoding: gzip\r\n");
+        QCOMPARE(r.status, 200);
+        QCOMPARE(r.header("content-encoding"), QByteArray("gzip"));
+        QVERIFY(r.body.size() < 20000);
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        QCOMPARE(inflateInit2(&stream, 31), Z_OK);
+        QByteArray inflated(20001, '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(r.body.data());
+        stream.avail_in = r.body.size();
+        stream.next_out = reinterpret_cast<Bytef*>(inflated.data());
+        stream.avail_out = inflated.size();
+        QCOMPARE(inflate(&stream, Z_FINISH), Z_STREAM_END);
+        inflated.resize(inflated.size() - stream.avail_out);
+        inflateEnd(&stream);
+        QCOMPARE(inflated, QByteArray(20000, 'a'));
+    }
+#endif
+};
+
+QTEST_MAIN(Test)
+#include "main.moc"
@@ -0,0 +1,9 @@
+TEMPLATE = app
+TARGET = 
+DEPENDPATH += .
+INCLUDEPATH += .
+QT = core network
+QXT = web
+SOURCES += main.cpp
+contains(DEFINES,QXT_HAVE_ZLIB):LIBS += -lz
+include(../../unit.pri)
@@ -4,7 +4,7 @@
 
 TEMPLATE = subdirs
 # SUBDIRS += async cgi direct invoketest upload # TODO: fix these unit tests
-SUBDIRS += htmltemplate
+SUBDIRS += cgipool chunkedwrite compression fcgi htmltemplate httpparser jsonrpc keepalive multipart router sessionstore staticfile
 
 test.CONFIG += recursive
 QMAKE_EXTRA_TARGETS += test